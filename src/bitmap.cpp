@@ -0,0 +1,379 @@
+/*--------------------------------------------------------------------------------------------------
+ * Author:      
+ * Date:        2026-10-19
+ * Assignment:  Final Project
+ * Source File: bitmap.cpp
+ * Language:    C/C++
+ * Course:      Operating Systems
+ * Purpose:     Contains the implementation of the bitmap class.
+ -------------------------------------------------------------------------------------------------*/
+
+#include "bitmap.h"
+#include "constants.h"
+
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BITMAP_HAVE_AVX2 1
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+namespace vdi_explorer
+{
+    const u64 bitmap::npos;
+    
+    namespace
+    {
+        const u64 ALL_ONES = ~0ULL;
+        const u32 BITS_PER_WORD = 64;
+        const u32 WORDS_PER_VECTOR = 4; // 256 bits per AVX2 register
+        
+        #ifdef BITMAP_HAVE_AVX2
+        /*------------------------------------------------------------------------------------------
+         * Name:    skip_words_avx2
+         * Type:    Function
+         * Purpose: Skip forward over words equal to the given value, 256 bits per comparison.
+         * Input:   const u64 * words, holds the words to search.
+         * Input:   u64 index, holds the word to start at.
+         * Input:   u64 end, holds the word to stop at.
+         * Input:   u64 value, holds the value to skip over (all ones or all zeroes).
+         * Output:  u64, the index of the first group of four words that is not entirely equal to
+         *          the value, or the start of the tail too short for a full comparison.
+        ------------------------------------------------------------------------------------------*/
+        __attribute__((target("avx2")))
+        u64 skip_words_avx2(const u64 * words, u64 index, u64 end, u64 value)
+        {
+            const __m256i pattern = _mm256_set1_epi64x((long long)value);
+            for (; index + WORDS_PER_VECTOR <= end; index += WORDS_PER_VECTOR)
+            {
+                __m256i chunk = _mm256_loadu_si256((const __m256i *)(words + index));
+                if (_mm256_movemask_epi8(_mm256_cmpeq_epi64(chunk, pattern)) != -1)
+                {
+                    break;
+                }
+            }
+            return index;
+        }
+        #endif
+        
+        /*------------------------------------------------------------------------------------------
+         * Name:    skip_words
+         * Type:    Function
+         * Purpose: Skip forward over words equal to the given value, using AVX2 when the
+         *          processor has it and a word at a time otherwise.
+         * Input:   const u64 * words, holds the words to search.
+         * Input:   u64 index, holds the word to start at.
+         * Input:   u64 end, holds the word to stop at.
+         * Input:   u64 value, holds the value to skip over (all ones or all zeroes).
+         * Output:  u64, the index of the first word not equal to the value, or end.
+        ------------------------------------------------------------------------------------------*/
+        u64 skip_words(const u64 * words, u64 index, u64 end, u64 value)
+        {
+            #ifdef BITMAP_HAVE_AVX2
+            static const bool have_avx2 = __builtin_cpu_supports("avx2");
+            if (have_avx2)
+            {
+                index = skip_words_avx2(words, index, end, value);
+            }
+            #endif
+            
+            while (index < end && words[index] == value)
+            {
+                index++;
+            }
+            return index;
+        }
+    } // namespace
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    bitmap
+     * Type:    Function
+     * Purpose: Default constructor for the bitmap class.  Creates an empty bitmap.
+     * Input:   Nothing.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    bitmap::bitmap()
+    {
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    bitmap
+     * Type:    Function
+     * Purpose: Constructor for the bitmap class.  Creates a bitmap with every bit clear.
+     * Input:   u64 bits, holds the number of bits in the bitmap.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    bitmap::bitmap(u64 bits)
+    {
+        num_bits = bits;
+        words.assign((bits + BITS_PER_WORD - 1) / BITS_PER_WORD, 0);
+        
+        // Set the padding bits in the final word.
+        if (bits % BITS_PER_WORD)
+        {
+            words.back() |= ALL_ONES << (bits % BITS_PER_WORD);
+        }
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    load
+     * Type:    Function
+     * Purpose: Replaces the bitmap with one in on-disk form.
+     * Input:   const u8 * bytes, holds the bitmap as read from disk (LSB-first).
+     * Input:   u64 bits, holds the number of bits in the bitmap.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    void bitmap::load(const u8 * bytes, u64 bits)
+    {
+        *this = bitmap(bits);
+        
+        // Copy the whole bytes, then the bits of the final partial byte, if any.  The padding bits
+        // set by the constructor are left alone.
+        memcpy(words.data(), bytes, bits / BITS_PER_BYTE);
+        for (u64 i = bits - bits % BITS_PER_BYTE; i < bits; i++)
+        {
+            if ((bytes[i / BITS_PER_BYTE] >> (i % BITS_PER_BYTE)) & 1)
+            {
+                set(i);
+            }
+        }
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    store
+     * Type:    Function
+     * Purpose: Writes the bitmap out in on-disk form.  Any bytes past the end of the bitmap are
+     *          filled with ones, as ext2 expects for the unused tail of a bitmap block.
+     * Input:   u8 * bytes, holds the buffer to write to (LSB-first).
+     * Input:   size_t num_bytes, holds the size of the buffer.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    void bitmap::store(u8 * bytes, size_t num_bytes) const
+    {
+        size_t bitmap_bytes = words.size() * sizeof(u64);
+        if (bitmap_bytes > num_bytes)
+        {
+            bitmap_bytes = num_bytes;
+        }
+        
+        memcpy(bytes, words.data(), bitmap_bytes);
+        memset(&(bytes[bitmap_bytes]), 0xFF, num_bytes - bitmap_bytes);
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    size
+     * Type:    Function
+     * Purpose: Returns the number of bits in the bitmap.
+     * Input:   Nothing.
+     * Output:  u64, the number of bits.
+    ----------------------------------------------------------------------------------------------*/
+    u64 bitmap::size() const
+    {
+        return num_bits;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    count
+     * Type:    Function
+     * Purpose: Counts the set bits in the bitmap, a word at a time.
+     * Input:   Nothing.
+     * Output:  u64, the number of set bits, not counting the padding.
+    ----------------------------------------------------------------------------------------------*/
+    u64 bitmap::count() const
+    {
+        u64 total = 0;
+        for (u64 i = 0; i < words.size(); i++)
+        {
+            total += __builtin_popcountll(words[i]);
+        }
+        
+        // Take the padding back out.
+        return total - (words.size() * BITS_PER_WORD - num_bits);
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    test
+     * Type:    Function
+     * Purpose: Checks a single bit.
+     * Input:   u64 bit, holds the bit to check.
+     * Output:  bool, true if the bit is set.
+    ----------------------------------------------------------------------------------------------*/
+    bool bitmap::test(u64 bit) const
+    {
+        return (words[bit / BITS_PER_WORD] >> (bit % BITS_PER_WORD)) & 1;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    set
+     * Type:    Function
+     * Purpose: Sets a single bit.
+     * Input:   u64 bit, holds the bit to set.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    void bitmap::set(u64 bit)
+    {
+        words[bit / BITS_PER_WORD] |= 1ULL << (bit % BITS_PER_WORD);
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    clear
+     * Type:    Function
+     * Purpose: Clears a single bit.
+     * Input:   u64 bit, holds the bit to clear.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    void bitmap::clear(u64 bit)
+    {
+        words[bit / BITS_PER_WORD] &= ~(1ULL << (bit % BITS_PER_WORD));
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    set_range
+     * Type:    Function
+     * Purpose: Sets a range of bits, a whole word at a time where possible.
+     * Input:   u64 first, holds the first bit to set.
+     * Input:   u64 length, holds the number of bits to set.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    void bitmap::set_range(u64 first, u64 length)
+    {
+        u64 end = first + length;
+        for (u64 bit = first; bit < end;)
+        {
+            u64 index = bit / BITS_PER_WORD;
+            u64 offset = bit % BITS_PER_WORD;
+            u64 count = (end - bit < BITS_PER_WORD - offset ? end - bit : BITS_PER_WORD - offset);
+            u64 mask = (count == BITS_PER_WORD ? ALL_ONES : ((1ULL << count) - 1) << offset);
+            words[index] |= mask;
+            bit += count;
+        }
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    clear_range
+     * Type:    Function
+     * Purpose: Clears a range of bits, a whole word at a time where possible.
+     * Input:   u64 first, holds the first bit to clear.
+     * Input:   u64 length, holds the number of bits to clear.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    void bitmap::clear_range(u64 first, u64 length)
+    {
+        u64 end = first + length;
+        for (u64 bit = first; bit < end;)
+        {
+            u64 index = bit / BITS_PER_WORD;
+            u64 offset = bit % BITS_PER_WORD;
+            u64 count = (end - bit < BITS_PER_WORD - offset ? end - bit : BITS_PER_WORD - offset);
+            u64 mask = (count == BITS_PER_WORD ? ALL_ONES : ((1ULL << count) - 1) << offset);
+            words[index] &= ~mask;
+            bit += count;
+        }
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    find_clear
+     * Type:    Function
+     * Purpose: Finds the next clear (free) bit.  Full words are skipped 256 bits at a time where
+     *          AVX2 is available, and the bit within a word is found with a count of trailing
+     *          zeroes.
+     * Input:   u64 from, holds the bit to start searching at.
+     * Output:  u64, the first clear bit at or after from, or npos if there is none.
+    ----------------------------------------------------------------------------------------------*/
+    u64 bitmap::find_clear(u64 from) const
+    {
+        if (from >= num_bits)
+        {
+            return npos;
+        }
+        
+        // Check the rest of the starting word, ignoring the bits before from.
+        u64 index = from / BITS_PER_WORD;
+        u64 candidates = ~words[index] & (ALL_ONES << (from % BITS_PER_WORD));
+        if (candidates != 0)
+        {
+            return index * BITS_PER_WORD + __builtin_ctzll(candidates);
+        }
+        
+        // Skip the full words that follow, then look inside the first one that is not.
+        index = skip_words(words.data(), index + 1, words.size(), ALL_ONES);
+        if (index == words.size())
+        {
+            return npos;
+        }
+        return index * BITS_PER_WORD + __builtin_ctzll(~words[index]);
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    find_set
+     * Type:    Function
+     * Purpose: Finds the next set (used) bit, the same way find_clear finds the next clear one.
+     * Input:   u64 from, holds the bit to start searching at.
+     * Output:  u64, the first set bit at or after from, or size() if there is none.
+    ----------------------------------------------------------------------------------------------*/
+    u64 bitmap::find_set(u64 from) const
+    {
+        if (from >= num_bits)
+        {
+            return num_bits;
+        }
+        
+        // Check the rest of the starting word, ignoring the bits before from.
+        u64 index = from / BITS_PER_WORD;
+        u64 candidates = words[index] & (ALL_ONES << (from % BITS_PER_WORD));
+        if (candidates == 0)
+        {
+            // Skip the empty words that follow.  The padding guarantees that the final word is
+            // never empty unless the bitmap ends on a word boundary.
+            index = skip_words(words.data(), index + 1, words.size(), 0);
+            if (index == words.size())
+            {
+                return num_bits;
+            }
+            candidates = words[index];
+        }
+        
+        u64 bit = index * BITS_PER_WORD + __builtin_ctzll(candidates);
+        return (bit < num_bits ? bit : num_bits);
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    find_clear_run
+     * Type:    Function
+     * Purpose: Finds the next run of consecutive clear (free) bits of at least the given length.
+     *          Each candidate run is measured by jumping straight to the next set bit, so the
+     *          search never walks the bitmap one bit at a time.
+     * Input:   u64 from, holds the bit to start searching at.
+     * Input:   u64 length, holds the number of consecutive clear bits wanted.
+     * Output:  u64, the first bit of the run, or npos if there is no such run.
+    ----------------------------------------------------------------------------------------------*/
+    u64 bitmap::find_clear_run(u64 from, u64 length) const
+    {
+        for (u64 start = find_clear(from); start != npos; start = find_clear(start))
+        {
+            u64 end = find_set(start);
+            if (end - start >= length)
+            {
+                return start;
+            }
+            start = end;
+        }
+        return npos;
+    }
+} // namespace vdi_explorer
@@ -0,0 +1,49 @@
+#ifndef BITMAP_H
+#define BITMAP_H
+
+#include "datatypes.h" //typedefs for s8, u8, s16, u16, s32, u32, s64, and u64
+
+#include <cstddef>
+#include <vector>
+
+namespace vdi_explorer
+{
+    // An ext2 allocation bitmap held as an array of 64-bit words.  Bit i of the bitmap is bit
+    // (i % 64) of word (i / 64), which on a little-endian host is exactly the on-disk LSB-first
+    // byte layout, so loading and storing are plain copies.  Bits past the end of the bitmap are
+    // kept set, so they are never reported as free.
+    class bitmap
+    {
+        public:
+            // Returned by the searches when nothing suitable was found.
+            static const u64 npos = ~0ULL;
+            
+            // Constructors
+            bitmap();
+            bitmap(u64);
+            
+            // Conversion to and from the on-disk form.
+            void load(const u8 *, u64);
+            void store(u8 *, size_t) const;
+            
+            u64 size() const;
+            u64 count() const;
+            
+            bool test(u64) const;
+            void set(u64);
+            void clear(u64);
+            void set_range(u64, u64);
+            void clear_range(u64, u64);
+            
+            // Searches, each starting at the given bit.
+            u64 find_clear(u64) const;
+            u64 find_set(u64) const;
+            u64 find_clear_run(u64, u64) const;
+        
+        private:
+            std::vector<u64> words;
+            u64 num_bits = 0;
+    };
+} // namespace vdi_explorer
+
+#endif // BITMAP_H
@@ -0,0 +1,238 @@
+/*--------------------------------------------------------------------------------------------------
+ * Author:      
+ * Date:        2026-10-19
+ * Assignment:  Final Project
+ * Source File: buffer_pool.cpp
+ * Language:    C/C++
+ * Course:      Operating Systems
+ * Purpose:     Contains the implementation of the buffer_pool class.
+ -------------------------------------------------------------------------------------------------*/
+
+#include "buffer_pool.h"
+
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+using namespace std;
+
+namespace vdi_explorer
+{
+    namespace
+    {
+        // One thread's spare buffers, by size class.  They are freed when the thread ends.
+        struct free_lists
+        {
+            vector<u8 *> lists[buffer_pool::NUM_SIZES];
+            size_t bytes = 0;
+            
+            ~free_lists()
+            {
+                for (u32 i = 0; i < buffer_pool::NUM_SIZES; i++)
+                {
+                    for (u32 j = 0; j < lists[i].size(); j++)
+                    {
+                        free(lists[i][j]);
+                    }
+                }
+            }
+        };
+        
+        free_lists & thread_free_lists()
+        {
+            static thread_local free_lists lists;
+            return lists;
+        }
+    } // namespace
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    acquire
+     * Type:    Function
+     * Purpose: Takes a page-aligned buffer of at least the given size, from this thread's free
+     *          list if it has one of the right size, or else from the heap.
+     * Input:   size_t size, holds the number of bytes needed.
+     * Output:  u8 *, the buffer.  Throws bad_alloc if memory has run out.
+    ----------------------------------------------------------------------------------------------*/
+    u8 * buffer_pool::acquire(size_t size)
+    {
+        u32 size_index = size_class(size);
+        size_t capacity;
+        if (size_index < NUM_SIZES)
+        {
+            free_lists & spares = thread_free_lists();
+            capacity = ALIGNMENT << size_index;
+            if (!spares.lists[size_index].empty())
+            {
+                u8 * memory = spares.lists[size_index].back();
+                spares.lists[size_index].pop_back();
+                spares.bytes -= capacity;
+                return memory;
+            }
+        }
+        else
+        {
+            // Too big to pool: a whole number of pages, straight from the heap.
+            capacity = (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+        }
+        
+        void * memory = nullptr;
+        if (posix_memalign(&memory, ALIGNMENT, capacity) != 0)
+        {
+            throw bad_alloc();
+        }
+        return (u8 *)memory;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    release
+     * Type:    Function
+     * Purpose: Gives a buffer back, keeping it on this thread's free list unless the list is full.
+     * Input:   u8 * memory, holds the buffer.  Nothing is done if it is nullptr.
+     * Input:   size_t size, holds the size the buffer was acquired with.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    void buffer_pool::release(u8 * memory, size_t size)
+    {
+        if (memory == nullptr)
+        {
+            return;
+        }
+        
+        u32 size_index = size_class(size);
+        if (size_index < NUM_SIZES)
+        {
+            free_lists & spares = thread_free_lists();
+            size_t capacity = ALIGNMENT << size_index;
+            if (spares.lists[size_index].size() < MAX_FREE_PER_SIZE &&
+                spares.bytes + capacity <= MAX_FREE_BYTES)
+            {
+                spares.lists[size_index].push_back(memory);
+                spares.bytes += capacity;
+                return;
+            }
+        }
+        free(memory);
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    size_class
+     * Type:    Function
+     * Purpose: Works out which free list a buffer of a given size belongs on.
+     * Input:   size_t size, holds the size in bytes.
+     * Output:  u32, n for a buffer of ALIGNMENT << n bytes, or NUM_SIZES if it is too big to pool.
+    ----------------------------------------------------------------------------------------------*/
+    u32 buffer_pool::size_class(size_t size)
+    {
+        u32 size_index = 0;
+        while (size_index < NUM_SIZES && (ALIGNMENT << size_index) < size)
+        {
+            size_index++;
+        }
+        return size_index;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    buffer
+     * Type:    Function
+     * Purpose: Constructors for the buffer class: an empty handle, or one holding a new buffer of
+     *          at least the given size.
+     * Input:   size_t size, holds the number of bytes needed.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    buffer_pool::buffer::buffer()
+    {
+    }
+    
+    buffer_pool::buffer::buffer(size_t size)
+    {
+        reset(size);
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    buffer
+     * Type:    Function
+     * Purpose: Move constructor and assignment for the buffer class.  The other handle is left
+     *          empty.
+     * Input:   buffer && other, holds the handle to take the buffer from.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    buffer_pool::buffer::buffer(buffer && other)
+    {
+        memory = other.memory;
+        length = other.length;
+        other.memory = nullptr;
+        other.length = 0;
+    }
+    
+    buffer_pool::buffer & buffer_pool::buffer::operator=(buffer && other)
+    {
+        if (this != &other)
+        {
+            release(memory, length);
+            memory = other.memory;
+            length = other.length;
+            other.memory = nullptr;
+            other.length = 0;
+        }
+        return *this;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    ~buffer
+     * Type:    Function
+     * Purpose: Destructor for the buffer class.  Gives the buffer back to the pool.
+     * Input:   Nothing.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    buffer_pool::buffer::~buffer()
+    {
+        release(memory, length);
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    reset
+     * Type:    Function
+     * Purpose: Makes the handle hold a buffer of at least the given size, keeping the one it has
+     *          if that falls in the same size class.
+     * Input:   size_t size, holds the number of bytes needed.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    void buffer_pool::buffer::reset(size_t size)
+    {
+        if (memory != nullptr && size_class(size) == size_class(length) && size_class(size) < NUM_SIZES)
+        {
+            length = size;
+            return;
+        }
+        release(memory, length);
+        memory = nullptr;
+        length = 0;
+        memory = acquire(size);
+        length = size;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    data, size
+     * Type:    Function
+     * Purpose: Return the buffer and the size it was asked for.
+     * Input:   Nothing.
+     * Output:  u8 *, the buffer (nullptr if the handle is empty), or size_t, its size.
+    ----------------------------------------------------------------------------------------------*/
+    u8 * buffer_pool::buffer::data() const
+    {
+        return memory;
+    }
+    
+    size_t buffer_pool::buffer::size() const
+    {
+        return length;
+    }
+} // namespace vdi_explorer
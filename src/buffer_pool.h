@@ -0,0 +1,66 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include "datatypes.h" //typedefs for s8, u8, s16, u16, s32, u32, s64, and u64
+
+#include <cstddef>
+
+namespace vdi_explorer
+{
+    // Hands out page-aligned I/O buffers and takes them back for reuse, so routines that need a
+    // block or a few megabytes of scratch space on every call do not go to the heap (and take
+    // fresh page faults) each time.  Sizes are rounded up to a power-of-two number of pages, and
+    // each thread keeps its own free list per size, so no locking is needed.  Being page aligned,
+    // the buffers are also fit for unbuffered (O_DIRECT) I/O.
+    //
+    // Buffers are normally held through a buffer_pool::buffer, which gives its memory back to the
+    // pool when it goes out of scope.  Their contents are not cleared between uses.
+    class buffer_pool
+    {
+        public:
+            static const size_t ALIGNMENT = 4096;           // a page, and a multiple of any sector
+            static const u32 NUM_SIZES = 12;                // 4 KiB up to 8 MiB
+            static const u32 MAX_FREE_PER_SIZE = 4;         // buffers of each size kept per thread
+            static const size_t MAX_FREE_BYTES = 33554432;  // memory kept per thread (32 MiB)
+            
+            // RAII handle to a pooled buffer.  It can be moved but not copied.
+            class buffer
+            {
+                public:
+                    buffer();
+                    explicit buffer(size_t);
+                    buffer(buffer &&);
+                    buffer & operator=(buffer &&);
+                    ~buffer();
+                    
+                    // Swap the buffer for one of at least this many bytes.  The contents are lost.
+                    void reset(size_t);
+                    
+                    u8 * data() const;
+                    size_t size() const;
+                    
+                    template <typename T>
+                    T * as() const
+                    {
+                        return reinterpret_cast<T *>(memory);
+                    }
+                
+                private:
+                    u8 * memory = nullptr;
+                    size_t length = 0;
+                    
+                    buffer(const buffer &) = delete;
+                    buffer & operator=(const buffer &) = delete;
+            };
+            
+            // Take and give back raw buffers, for holders that cannot use a handle.  A buffer must
+            // be given back with the size it was taken with.
+            static u8 * acquire(size_t);
+            static void release(u8 *, size_t);
+        
+        private:
+            static u32 size_class(size_t);
+    };
+} // namespace vdi_explorer
+
+#endif // BUFFER_POOL_H
@@ -0,0 +1,180 @@
+/*--------------------------------------------------------------------------------------------------
+ * Author:      
+ * Date:        2026-10-19
+ * Assignment:  Final Project
+ * Source File: buffer_ring.cpp
+ * Language:    C/C++
+ * Course:      Operating Systems
+ * Purpose:     Contains the implementation of the buffer_ring class.
+ -------------------------------------------------------------------------------------------------*/
+
+#include "buffer_ring.h"
+#include "buffer_pool.h"
+
+using namespace std;
+
+namespace vdi_explorer
+{
+    /*----------------------------------------------------------------------------------------------
+     * Name:    buffer_ring
+     * Type:    Function
+     * Purpose: Constructor for the buffer_ring class.  Takes all the buffers from the buffer pool
+     *          up front; none are taken or given back while data is flowing.  The buffers are page
+     *          aligned.
+     * Input:   size_t buffer_size, holds the size in bytes of each buffer.
+     * Input:   u32 buffer_count, holds the number of buffers to rotate through.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    buffer_ring::buffer_ring(size_t buffer_size, u32 buffer_count)
+    {
+        size_of_buffer = buffer_size;
+        for (u32 i = 0; i < buffer_count; i++)
+        {
+            buffers.push_back((char *)buffer_pool::acquire(buffer_size));
+            empty_buffers.push_back(buffers.back());
+        }
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    ~buffer_ring
+     * Type:    Function
+     * Purpose: Destructor for the buffer_ring class.
+     * Input:   Nothing.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    buffer_ring::~buffer_ring()
+    {
+        for (u32 i = 0; i < buffers.size(); i++)
+        {
+            buffer_pool::release((u8 *)buffers[i], size_of_buffer);
+        }
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    acquire
+     * Type:    Function
+     * Purpose: Waits until an empty buffer is available and takes it.
+     * Input:   Nothing.
+     * Output:  char *, holding the buffer, or nullptr if the ring has been aborted.
+    ----------------------------------------------------------------------------------------------*/
+    char * buffer_ring::acquire()
+    {
+        unique_lock<mutex> lock(ring_mutex);
+        ring_changed.wait(lock, [this] { return aborted || !empty_buffers.empty(); });
+        
+        if (aborted)
+        {
+            return nullptr;
+        }
+        
+        char * to_return = empty_buffers.front();
+        empty_buffers.pop_front();
+        return to_return;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    submit
+     * Type:    Function
+     * Purpose: Hands a filled buffer over to the consumer.
+     * Input:   char * buffer, holds a buffer previously returned by acquire.
+     * Input:   size_t length, holds the number of valid bytes in the buffer.
+     * Input:   u64 offset, holds where the data belongs in the stream being copied.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    void buffer_ring::submit(char * buffer, size_t length, u64 offset)
+    {
+        lock_guard<mutex> lock(ring_mutex);
+        filled_buffers.push_back({buffer, length, offset});
+        ring_changed.notify_all();
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    close
+     * Type:    Function
+     * Purpose: Signals the consumer that no more buffers will be submitted.  Buffers already
+     *          submitted are still delivered.
+     * Input:   Nothing.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    void buffer_ring::close()
+    {
+        lock_guard<mutex> lock(ring_mutex);
+        closed = true;
+        ring_changed.notify_all();
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    receive
+     * Type:    Function
+     * Purpose: Waits until a filled buffer is available and takes it.
+     * Output:  <reference> char * & buffer, will hold the buffer.
+     * Output:  <reference> size_t & length, will hold the number of valid bytes in the buffer.
+     * Output:  <reference> u64 & offset, will hold where the data belongs in the stream.
+     * Output:  bool, false once the ring is closed and drained, or has been aborted.
+    ----------------------------------------------------------------------------------------------*/
+    bool buffer_ring::receive(char * & buffer, size_t & length, u64 & offset)
+    {
+        unique_lock<mutex> lock(ring_mutex);
+        ring_changed.wait(lock, [this] { return aborted || closed || !filled_buffers.empty(); });
+        
+        if (aborted || filled_buffers.empty())
+        {
+            return false;
+        }
+        
+        buffer = filled_buffers.front().data;
+        length = filled_buffers.front().length;
+        offset = filled_buffers.front().offset;
+        filled_buffers.pop_front();
+        return true;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    release
+     * Type:    Function
+     * Purpose: Returns a drained buffer to the producer.
+     * Input:   char * buffer, holds a buffer previously returned by receive.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    void buffer_ring::release(char * buffer)
+    {
+        lock_guard<mutex> lock(ring_mutex);
+        empty_buffers.push_back(buffer);
+        ring_changed.notify_all();
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    abort
+     * Type:    Function
+     * Purpose: Stops the transfer.  Both sides return immediately from any wait, and all further
+     *          waits fail.
+     * Input:   Nothing.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    void buffer_ring::abort()
+    {
+        lock_guard<mutex> lock(ring_mutex);
+        aborted = true;
+        ring_changed.notify_all();
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    buffer_size
+     * Type:    Function
+     * Purpose: Returns the size of each buffer in the ring.
+     * Input:   Nothing.
+     * Output:  size_t, holding the size in bytes.
+    ----------------------------------------------------------------------------------------------*/
+    size_t buffer_ring::buffer_size() const
+    {
+        return size_of_buffer;
+    }
+} // namespace vdi_explorer
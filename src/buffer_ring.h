@@ -0,0 +1,61 @@
+#ifndef BUFFER_RING_H
+#define BUFFER_RING_H
+
+#include "datatypes.h" //typedefs for s8, u8, s16, u16, s32, u32, s64, and u64
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+namespace vdi_explorer
+{
+    // A fixed set of rotating buffers handed back and forth between a producer and a consumer
+    // running on different threads, so that one side can fill a buffer while the other is still
+    // draining the previous one.
+    class buffer_ring
+    {
+        public:
+            // Constructor
+            buffer_ring(size_t, u32);
+            
+            // Destructor
+            ~buffer_ring();
+            
+            // Producer side: wait for an empty buffer, then hand it over once it has been filled.
+            char * acquire();
+            void submit(char *, size_t, u64);
+            
+            // Producer side: signal that no more buffers will be submitted.
+            void close();
+            
+            // Consumer side: wait for a filled buffer, then give it back once it has been drained.
+            bool receive(char * &, size_t &, u64 &);
+            void release(char *);
+            
+            // Either side: give up, waking anyone who is waiting.
+            void abort();
+            
+            size_t buffer_size() const;
+            
+        private:
+            struct filled_buffer
+            {
+                char * data;
+                size_t length;
+                u64 offset;
+            };
+            
+            size_t size_of_buffer = 0;
+            std::vector<char *> buffers;
+            std::deque<char *> empty_buffers;
+            std::deque<filled_buffer> filled_buffers;
+            bool closed = false;
+            bool aborted = false;
+            
+            std::mutex ring_mutex;
+            std::condition_variable ring_changed;
+    };
+} // namespace vdi_explorer
+
+#endif // BUFFER_RING_H
@@ -22,13 +22,42 @@ const int VDI_SECTOR_SIZE = 512; // The size in bytes of a sector in a VDI. (con
 
 const int EXT2_SUPERBLOCK_OFFSET = 1024; // The superblock is located 1024 bytes from the beginning of the volume.
 const int EXT2_SUPERBLOCK_SIZE = 1024; // The superblock is 1024 bytes long.
+const int EXT2_SUPER_MAGIC = 0xEF53; // The signature in every ext2 superblock's s_magic.
+const unsigned int EXT2_MAX_LOG_BLOCK_SIZE = 6; // The largest s_log_block_size, for 64 KiB blocks.
 const unsigned int EXT2_BLOCK_BASE_SIZE = 1024; // The base block size is 1024 bytes.
 const unsigned int EXT2_FRAG_BASE_SIZE = 1024; // The base fragment size is 1024 bytes.
 
 const int EXT2_BLOCK_POINTER_SIZE = 4; // The size of a block pointer in bytes.
 const unsigned long long int EXT2_MAX_ABS_FILE_SIZE = 2199023255040; // (2^32-1)*512 => The absolute maximum file size allowed by the ext2 file system. (2 TiB)
+const unsigned int EXT2_MAX_SMALL_FILE_SIZE = 0x7FFFFFFF; // The largest file size that does not need the large file feature (2 GiB - 1).
 const int EXT2_FILENAME_MAX_LENGTH = 255; // The max number of characters allowed in a filename in the ext2 file system.
 
+const int EXT2_GOOD_OLD_REV = 0; // The original revision of ext2, with no feature flags and 32-bit file sizes.
+const unsigned int EXT3_FEATURE_COMPAT_HAS_JOURNAL = 0x0004; // The file system has a journal, which writing around would leave out of step with the metadata.
+const unsigned int EXT2_FEATURE_RO_COMPAT_SPARSE_SUPER = 0x0001; // Only groups 0, 1 and powers of 3, 5 and 7 hold backups of the superblock and descriptor table.
+const unsigned int EXT2_FEATURE_RO_COMPAT_LARGE_FILE = 0x0002; // Regular files may be larger than 2 GiB, with the high 32 bits of their size in i_dir_acl.
+const unsigned int EXT4_FEATURE_RO_COMPAT_HUGE_FILE = 0x0008; // i_blocks may be 48 bits, or count file system blocks for inodes flagged EXT4_HUGE_FILE_FL.
+const unsigned int EXT4_FEATURE_RO_COMPAT_GDT_CSUM = 0x0010; // Group descriptors carry a checksum, and groups may be left uninitialized (uninit_bg).
+const unsigned int EXT4_FEATURE_RO_COMPAT_DIR_NLINK = 0x0020; // A directory's link count may stop at 1 once it has too many subdirectories to count.
+const unsigned int EXT4_FEATURE_RO_COMPAT_EXTRA_ISIZE = 0x0040; // Inodes larger than 128 bytes reserve at least s_min_extra_isize bytes past the first 128.
+const unsigned int EXT4_FEATURE_RO_COMPAT_METADATA_CSUM = 0x0400; // The superblock, descriptors, bitmaps, inodes, directories and extent blocks all carry checksums.
+const unsigned int EXT2_FEATURE_INCOMPAT_FILETYPE = 0x0002; // Directory entries record the type of the file they name.
+const unsigned int EXT4_FEATURE_INCOMPAT_EXTENTS = 0x0040; // Files may be mapped by extent trees (see EXT4_INODE_FLAGS_EXTENTS).
+const unsigned int EXT4_FEATURE_INCOMPAT_64BIT = 0x0080; // Block numbers may be 64 bits, and group descriptors are s_desc_size bytes.
+const unsigned int EXT4_FEATURE_INCOMPAT_FLEX_BG = 0x0200; // The bitmaps and inode tables of each flex group are packed together (see s_log_groups_per_flex).
+
+const unsigned int EXT2_WRITE_RO_COMPAT = EXT2_FEATURE_RO_COMPAT_SPARSE_SUPER | EXT2_FEATURE_RO_COMPAT_LARGE_FILE |
+                                         EXT4_FEATURE_RO_COMPAT_HUGE_FILE | EXT4_FEATURE_RO_COMPAT_DIR_NLINK |
+                                         EXT4_FEATURE_RO_COMPAT_EXTRA_ISIZE; // The read-only compatible features this program can write under.  Any other ro_compat bit opens the file system read-only.
+const unsigned int EXT2_WRITE_INCOMPAT = EXT2_FEATURE_INCOMPAT_FILETYPE | EXT4_FEATURE_INCOMPAT_EXTENTS |
+                                         EXT4_FEATURE_INCOMPAT_64BIT | EXT4_FEATURE_INCOMPAT_FLEX_BG; // The incompatible features this program can write under.  Any other incompat bit opens the file system read-only.
+
+const int EXT4_EXTENT_MAGIC = 0xF30A; // The signature at the start of every extent tree node.
+const int EXT4_EXTENT_MAX_INIT_LEN = 32768; // The longest initialized extent.  Longer ee_len values mark uninitialized (preallocated) extents of ee_len - 32768 blocks, which read as zeroes.
+const int EXT4_EXTENT_MAX_DEPTH = 5; // The deepest an extent tree can be.
+
+const int EXT2_ROOT_INODE = 2; // The inode number of the root directory.
+
 const int EXT2_INODE_NBLOCKS_DIR = 12; // The number of direct block pointers in an inode.
 const int EXT2_INODE_BLOCK_S_IND = EXT2_INODE_NBLOCKS_DIR; // Array location of the singly indirect block pointer in an inode.
 const int EXT2_INODE_BLOCK_D_IND = EXT2_INODE_BLOCK_S_IND + 1; // Array location of the doubly indirect block pointer in an inode.
@@ -66,11 +95,22 @@ const int EXT2_INODE_FLAGS_IMMUTABLE = 0x00000010;
 const int EXT2_INODE_FLAGS_APPEND = 0x00000020;
 const int EXT2_INODE_FLAGS_DO_NOT_DUMP = 0x00000040;
 const int EXT2_INODE_FLAGS_LAST_ACCESS_NO_UPDATE = 0x00000080;
-const int EXT2_INODE_FLAGS_HASH_INDEX_DIR = 0x00010000;
-const int EXT2_INODE_FLAGS_AFS_DIR = 0x00020000;
+const int EXT2_INODE_FLAGS_HASH_INDEX_DIR = 0x00001000; // The directory has a hash tree index (htree) over its blocks, whose entries must then be placed by hash.
+const int EXT2_INODE_FLAGS_AFS_DIR = 0x00002000;
 const int EXT2_INODE_FLAGS_JOURNAL_FILE_DATA = 0x0004000;
+const int EXT4_INODE_FLAGS_EXTENTS = 0x00080000; // i_block holds the root of an ext4 extent tree instead of block pointers.
+
+const unsigned int EXT2_COPY_BUFFER_SIZE = 4194304; // Size in bytes of each buffer used when copying files to or from the host. (4 MiB)
+const unsigned int EXT2_COPY_BUFFER_COUNT = 3; // Number of rotating copy buffers, so disk reads and host writes can overlap.
+const unsigned int EXT2_IMPORT_THREADS = 4; // Number of threads reading host files ahead of the writer during a directory tree import.
+const unsigned int EXT2_IMPORT_WINDOW = 64; // Number of host files a directory tree import may read ahead of the writer.
+const unsigned int EXT2_IMPORT_PREFETCH_SIZE = 1048576; // Largest host file read into memory ahead of the writer; larger ones are read as they are written. (1 MiB)
+const unsigned int EXT2_EXPORT_THREADS = 4; // Number of threads copying files out to the host during a directory tree export.
+const unsigned int EXT2_STAT_BATCH_SIZE = 65536; // Number of inodes read at a time when stating the entries of a directory.
+const unsigned int EXT2_METADATA_READ_MAX = 4194304; // Largest single read when prefetching neighbouring metadata blocks, such as a flex group's bitmaps. (4 MiB)
 
 const int EXT2_DIR_BASE_SIZE = 8; // The base size of an ext2_dir_entry structure.
+const int EXT2_DIR_MIN_SIZE = 12; // The size of the smallest ext2_dir_entry structure (a one-character name, padded to 4 bytes).
 
 const int EXT2_DIR_TYPE_UNKNOWN = 0;
 const int EXT2_DIR_TYPE_FILE = 1;
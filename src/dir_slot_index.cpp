@@ -0,0 +1,135 @@
+/*--------------------------------------------------------------------------------------------------
+ * Author:      
+ * Date:        2026-10-19
+ * Assignment:  Final Project
+ * Source File: dir_slot_index.cpp
+ * Language:    C/C++
+ * Course:      Operating Systems
+ * Purpose:     Contains the implementation of the dir_slot_index class.
+ -------------------------------------------------------------------------------------------------*/
+
+#include "dir_slot_index.h"
+#include "constants.h"
+
+using namespace std;
+
+namespace vdi_explorer
+{
+    /*----------------------------------------------------------------------------------------------
+     * Name:    is_built
+     * Type:    Function
+     * Purpose: Checks whether the index has been built from the directory's blocks yet.
+     * Input:   Nothing.
+     * Output:  bool, true if it has.
+    ----------------------------------------------------------------------------------------------*/
+    bool dir_slot_index::is_built() const
+    {
+        return built;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    mark_built
+     * Type:    Function
+     * Purpose: Records that every block of the directory has been added to the index.
+     * Input:   Nothing.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    void dir_slot_index::mark_built()
+    {
+        built = true;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    set_slack
+     * Type:    Function
+     * Purpose: Records how much room a record has for a new entry, replacing whatever was known
+     *          about it before.  Room too small to hold any entry is not kept.
+     * Input:   u32 block_num, holds the block the record is in.
+     * Input:   u32 offset, holds the byte offset of the record within the block.
+     * Input:   u16 slack, holds the number of spare bytes in the record.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    void dir_slot_index::set_slack(u32 block_num, u32 offset, u16 slack)
+    {
+        pair<u32, u32> position = make_pair(block_num, offset);
+        
+        map<pair<u32, u32>, u16>::iterator entry = slack_by_position.find(position);
+        if (entry != slack_by_position.end())
+        {
+            slack_by_size.erase(make_tuple(entry->second, block_num, offset));
+            slack_by_position.erase(entry);
+        }
+        
+        if (slack >= EXT2_DIR_MIN_SIZE)
+        {
+            slack_by_position[position] = slack;
+            slack_by_size.insert(make_tuple(slack, block_num, offset));
+        }
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    find
+     * Type:    Function
+     * Purpose: Finds the record with the least room that still fits a new entry.
+     * Input:   u16 needed, holds the size of the new entry.
+     * Input:   u32 & block_num, receives the block the record is in.
+     * Input:   u32 & offset, receives the byte offset of the record within the block.
+     * Input:   u16 & slack, receives the room the record has.
+     * Output:  bool, true if there is a record with enough room.
+    ----------------------------------------------------------------------------------------------*/
+    bool dir_slot_index::find(u16 needed, u32 & block_num, u32 & offset, u16 & slack) const
+    {
+        set<tuple<u16, u32, u32>>::const_iterator fit = slack_by_size.lower_bound(make_tuple(needed, (u32)0, (u32)0));
+        if (fit == slack_by_size.end())
+        {
+            return false;
+        }
+        
+        slack = get<0>(*fit);
+        block_num = get<1>(*fit);
+        offset = get<2>(*fit);
+        return true;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    has_name
+     * Type:    Function
+     * Purpose: Checks whether the directory has an entry with a given name.
+     * Input:   const string & name, holds the name.
+     * Output:  bool, true if it does.
+    ----------------------------------------------------------------------------------------------*/
+    bool dir_slot_index::has_name(const string & name) const
+    {
+        return names.count(name) != 0;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    add_name
+     * Type:    Function
+     * Purpose: Records a name added to the directory.
+     * Input:   const string & name, holds the name.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    void dir_slot_index::add_name(const string & name)
+    {
+        names.insert(name);
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    remove_name
+     * Type:    Function
+     * Purpose: Records a name removed from the directory.
+     * Input:   const string & name, holds the name.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    void dir_slot_index::remove_name(const string & name)
+    {
+        names.erase(name);
+    }
+} // namespace vdi_explorer
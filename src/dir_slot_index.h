@@ -0,0 +1,47 @@
+#ifndef DIR_SLOT_INDEX_H
+#define DIR_SLOT_INDEX_H
+
+#include "datatypes.h" //typedefs for s8, u8, s16, u16, s32, u32, s64, and u64
+
+#include <map>
+#include <set>
+#include <string>
+#include <tuple>
+#include <unordered_set>
+#include <utility>
+
+namespace vdi_explorer
+{
+    // An in-memory summary of where a directory has room for new entries.  Every record in the
+    // directory's blocks that has spare bytes (the slack between the end of its entry and the end
+    // of its record, or the whole record if it is unused) is listed by where it is and by how much
+    // room it has, so finding a place for a new entry is a lookup rather than a scan of the
+    // directory.  The names in the directory are kept as well, so that checking for a clash needs
+    // no scan either.
+    //
+    // Positions are (physical block, byte offset of the record within the block).  The index is
+    // built from the directory's blocks once, and must be told about every change made to them.
+    class dir_slot_index
+    {
+        public:
+            bool is_built() const;
+            void mark_built();
+            
+            // Room for new entries.
+            void set_slack(u32, u32, u16);
+            bool find(u16, u32 &, u32 &, u16 &) const;
+            
+            // Names in the directory.
+            bool has_name(const std::string &) const;
+            void add_name(const std::string &);
+            void remove_name(const std::string &);
+        
+        private:
+            std::map<std::pair<u32, u32>, u16> slack_by_position;  // (block, offset) -> slack
+            std::set<std::tuple<u16, u32, u32>> slack_by_size;      // (slack, block, offset)
+            std::unordered_set<std::string> names;
+            bool built = false;
+    };
+} // namespace vdi_explorer
+
+#endif // DIR_SLOT_INDEX_H
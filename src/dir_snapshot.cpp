@@ -0,0 +1,312 @@
+/*--------------------------------------------------------------------------------------------------
+ * Author:      
+ * Date:        2026-10-19
+ * Assignment:  Final Project
+ * Source File: dir_snapshot.cpp
+ * Language:    C/C++
+ * Course:      Operating Systems
+ * Purpose:     Contains the implementation of the dir_snapshot class.
+ -------------------------------------------------------------------------------------------------*/
+
+#include "dir_snapshot.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fnmatch.h>
+
+using namespace std;
+
+namespace vdi_explorer
+{
+    /*----------------------------------------------------------------------------------------------
+     * Name:    clear
+     * Type:    Function
+     * Purpose: Empties the snapshot, keeping the memory it has for reuse.
+     * Input:   Nothing.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    void dir_snapshot::clear()
+    {
+        names.clear();
+        name_offsets.clear();
+        name_lengths.clear();
+        inodes.clear();
+        types.clear();
+        modes.clear();
+        user_ids.clear();
+        group_ids.clear();
+        sizes.clear();
+        created.clear();
+        modified.clear();
+        for (u32 i = 0; i < NUM_SORT_KEYS; i++)
+        {
+            orders[i].clear();
+        }
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    reserve
+     * Type:    Function
+     * Purpose: Makes room for a number of entries up front, so adding them allocates nothing.
+     * Input:   u32 num_entries, holds the number of entries expected.
+     * Input:   size_t name_bytes, holds the total length of their names expected.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    void dir_snapshot::reserve(u32 num_entries, size_t name_bytes)
+    {
+        names.reserve(name_bytes + num_entries);
+        name_offsets.reserve(num_entries);
+        name_lengths.reserve(num_entries);
+        inodes.reserve(num_entries);
+        types.reserve(num_entries);
+        modes.reserve(num_entries);
+        user_ids.reserve(num_entries);
+        group_ids.reserve(num_entries);
+        sizes.reserve(num_entries);
+        created.reserve(num_entries);
+        modified.reserve(num_entries);
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    add
+     * Type:    Function
+     * Purpose: Adds an entry, with its inode's details zeroed until set_inode_info fills them in.
+     * Input:   u32 inode_num, holds the entry's inode number.
+     * Input:   u8 type, holds the file type from the directory entry.
+     * Input:   const char * name, holds the name.  It need not be null terminated.
+     * Input:   u32 length, holds the length of the name (at most 255).
+     * Output:  u32, the new entry's index.
+    ----------------------------------------------------------------------------------------------*/
+    u32 dir_snapshot::add(u32 inode_num, u8 type, const char * name, u32 length)
+    {
+        name_offsets.push_back(names.size());
+        name_lengths.push_back(length);
+        names.insert(names.end(), name, name + length);
+        names.push_back('\0');
+        
+        inodes.push_back(inode_num);
+        types.push_back(type);
+        modes.push_back(0);
+        user_ids.push_back(0);
+        group_ids.push_back(0);
+        sizes.push_back(0);
+        created.push_back(0);
+        modified.push_back(0);
+        
+        for (u32 i = 0; i < NUM_SORT_KEYS; i++)
+        {
+            orders[i].clear();
+        }
+        return inodes.size() - 1;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    set_inode_info
+     * Type:    Function
+     * Purpose: Records what an entry's inode says about it.
+     * Input:   u32 index, holds the entry's index.
+     * Input:   u16 permissions, holds the permission bits.
+     * Input:   u16 user_id, holds the owner.
+     * Input:   u16 group_id, holds the group.
+     * Input:   u64 size, holds the size in bytes.
+     * Input:   s64 timestamp_created, holds the creation (inode change) time.
+     * Input:   s64 timestamp_modified, holds the modification time.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    void dir_snapshot::set_inode_info(u32 index,
+                                      u16 permissions,
+                                      u16 user_id,
+                                      u16 group_id,
+                                      u64 size,
+                                      s64 timestamp_created,
+                                      s64 timestamp_modified)
+    {
+        modes[index] = permissions;
+        user_ids[index] = user_id;
+        group_ids[index] = group_id;
+        sizes[index] = size;
+        created[index] = timestamp_created;
+        modified[index] = timestamp_modified;
+        
+        // The size and time orderings may no longer hold.
+        orders[sort_size].clear();
+        orders[sort_mtime].clear();
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    size
+     * Type:    Function
+     * Purpose: Returns the number of entries.
+     * Input:   Nothing.
+     * Output:  u32, the number of entries.
+    ----------------------------------------------------------------------------------------------*/
+    u32 dir_snapshot::size() const
+    {
+        return inodes.size();
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    inode, type, name, name_length, permissions, user_id, group_id, file_size,
+     *          timestamp_created, timestamp_modified
+     * Type:    Function
+     * Purpose: Return one field of an entry.
+     * Input:   u32 index, holds the entry's index.
+     * Output:  The field.  The name is null terminated, and stays valid until the snapshot is
+     *          changed.
+    ----------------------------------------------------------------------------------------------*/
+    u32 dir_snapshot::inode(u32 index) const
+    {
+        return inodes[index];
+    }
+    
+    u8 dir_snapshot::type(u32 index) const
+    {
+        return types[index];
+    }
+    
+    const char * dir_snapshot::name(u32 index) const
+    {
+        return &(names[name_offsets[index]]);
+    }
+    
+    u32 dir_snapshot::name_length(u32 index) const
+    {
+        return name_lengths[index];
+    }
+    
+    u16 dir_snapshot::permissions(u32 index) const
+    {
+        return modes[index];
+    }
+    
+    u16 dir_snapshot::user_id(u32 index) const
+    {
+        return user_ids[index];
+    }
+    
+    u16 dir_snapshot::group_id(u32 index) const
+    {
+        return group_ids[index];
+    }
+    
+    u64 dir_snapshot::file_size(u32 index) const
+    {
+        return sizes[index];
+    }
+    
+    s64 dir_snapshot::timestamp_created(u32 index) const
+    {
+        return created[index];
+    }
+    
+    s64 dir_snapshot::timestamp_modified(u32 index) const
+    {
+        return modified[index];
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    inode_numbers
+     * Type:    Function
+     * Purpose: Returns every entry's inode number as one array, for stating them in bulk.
+     * Input:   Nothing.
+     * Output:  const u32 *, size() inode numbers, in entry order.  Valid until the snapshot is
+     *          changed.
+    ----------------------------------------------------------------------------------------------*/
+    const u32 * dir_snapshot::inode_numbers() const
+    {
+        return inodes.data();
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    order
+     * Type:    Function
+     * Purpose: Returns the entry indices sorted by a key, sorting them the first time the key is
+     *          asked for.  Only the indices move; the entries stay where they are.
+     * Input:   sort_key key, holds what to sort by.
+     * Output:  const vector<u32> &, the sorted indices.  Valid until the snapshot is changed.
+    ----------------------------------------------------------------------------------------------*/
+    const vector<u32> & dir_snapshot::order(sort_key key)
+    {
+        vector<u32> & sorted = orders[key];
+        if (sorted.size() == inodes.size())
+        {
+            return sorted;
+        }
+        
+        sorted.resize(inodes.size());
+        for (u32 i = 0; i < sorted.size(); i++)
+        {
+            sorted[i] = i;
+        }
+        
+        switch (key)
+        {
+            case sort_size:
+                sort(sorted.begin(), sorted.end(), [this](u32 a, u32 b)
+                {
+                    return sizes[a] != sizes[b] ? sizes[a] > sizes[b] : compare_names(a, b) < 0;
+                });
+                break;
+            
+            case sort_mtime:
+                sort(sorted.begin(), sorted.end(), [this](u32 a, u32 b)
+                {
+                    return modified[a] != modified[b] ? modified[a] > modified[b] : compare_names(a, b) < 0;
+                });
+                break;
+            
+            default:
+                sort(sorted.begin(), sorted.end(), [this](u32 a, u32 b)
+                {
+                    return compare_names(a, b) < 0;
+                });
+                break;
+        }
+        
+        return sorted;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    match
+     * Type:    Function
+     * Purpose: Finds the entries whose names match a shell wildcard pattern.  A leading period
+     *          must be matched explicitly, as in the shell.
+     * Input:   const string & pattern, holds the pattern.
+     * Output:  <reference> vector<u32> & matches, receives the matching indices, in entry order.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    void dir_snapshot::match(const string & pattern, vector<u32> & matches) const
+    {
+        matches.clear();
+        for (u32 i = 0; i < inodes.size(); i++)
+        {
+            if (fnmatch(pattern.c_str(), name(i), FNM_PERIOD) == 0)
+            {
+                matches.push_back(i);
+            }
+        }
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    compare_names
+     * Type:    Function
+     * Purpose: Compares two entries' names byte by byte.
+     * Input:   u32 a, holds the first entry's index.
+     * Input:   u32 b, holds the second entry's index.
+     * Output:  int, less than, equal to or greater than 0 as a's name sorts before, with or after
+     *          b's.
+    ----------------------------------------------------------------------------------------------*/
+    int dir_snapshot::compare_names(u32 a, u32 b) const
+    {
+        return strcmp(name(a), name(b));
+    }
+} // namespace vdi_explorer
@@ -0,0 +1,72 @@
+#ifndef DIR_SNAPSHOT_H
+#define DIR_SNAPSHOT_H
+
+#include "datatypes.h" //typedefs for s8, u8, s16, u16, s32, u32, s64, and u64
+
+#include <string>
+#include <vector>
+
+namespace vdi_explorer
+{
+    // A picture of a directory's entries, laid out for very large directories.  The names are
+    // packed end to end in a single arena (each followed by a null, so they can be used as C
+    // strings), and every other field is kept in its own array indexed by entry.  A directory of a
+    // million entries therefore costs a handful of allocations rather than millions.
+    //
+    // Orderings by name, size and modification time are worked out the first time they are asked
+    // for, as permutations of the entry indices, and kept until entries are added or cleared.
+    class dir_snapshot
+    {
+        public:
+            enum sort_key
+            {
+                sort_name,      // by name, byte by byte
+                sort_size,      // largest first, then by name
+                sort_mtime,     // newest first, then by name
+                NUM_SORT_KEYS
+            };
+            
+            void clear();
+            void reserve(u32, size_t);
+            
+            // Building the snapshot: the entries first, then what their inodes say.
+            u32 add(u32, u8, const char *, u32);
+            void set_inode_info(u32, u16, u16, u16, u64, s64, s64);
+            
+            u32 size() const;
+            u32 inode(u32) const;
+            const u32 * inode_numbers() const;
+            u8 type(u32) const;
+            const char * name(u32) const;
+            u32 name_length(u32) const;
+            u16 permissions(u32) const;
+            u16 user_id(u32) const;
+            u16 group_id(u32) const;
+            u64 file_size(u32) const;
+            s64 timestamp_created(u32) const;
+            s64 timestamp_modified(u32) const;
+            
+            const std::vector<u32> & order(sort_key);
+            void match(const std::string &, std::vector<u32> &) const;
+        
+        private:
+            std::vector<char> names;            // the name arena
+            std::vector<u32> name_offsets;      // where each name starts in the arena
+            std::vector<u8> name_lengths;
+            
+            std::vector<u32> inodes;
+            std::vector<u8> types;
+            std::vector<u16> modes;
+            std::vector<u16> user_ids;
+            std::vector<u16> group_ids;
+            std::vector<u64> sizes;
+            std::vector<s64> created;
+            std::vector<s64> modified;
+            
+            std::vector<u32> orders[NUM_SORT_KEYS];
+            
+            int compare_names(u32, u32) const;
+    };
+} // namespace vdi_explorer
+
+#endif // DIR_SNAPSHOT_H
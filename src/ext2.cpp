@@ -8,6 +8,10 @@
  * Purpose:     Contains the implementation of the ext2 class.
  -------------------------------------------------------------------------------------------------*/
 
+#include "buffer_pool.h"
+#include "buffer_ring.h"
+#include "indirect_tree.h"
+#include "task_pool.h"
 #include "constants.h"
 #include "datatypes.h"
 #include "ext2.h"
@@ -20,8 +24,20 @@
 #include <fcntl.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <cerrno>
 #include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <ctime>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <set>
+#include <dirent.h>
+#include <fnmatch.h>
+#include <sys/stat.h>
+#include <thread>
 
 /*
  * EXT2 should read the MBR, boot sector, super block, and navigate through an EXT2 filesystem.
@@ -37,9 +53,13 @@ namespace vdi_explorer
      * Type:    Function
      * Purpose: Constructor for the ext2 class. Reads in MBR and Superblock.
      * Input:   vdi_reader *_vdi, containing pointer to vdi object.
+     * Input:   bool lazy, holds whether to stop once the superblock checks out.  The block group
+     *          descriptor table is then read the first time it is needed, and nothing is
+     *          printed.  Otherwise it is read straight away, and the boot sector, superblock,
+     *          descriptor table and root directory are printed.
      * Output:  Nothing.
     ----------------------------------------------------------------------------------------------*/
-    ext2::ext2(vdi_reader *_vdi)
+    ext2::ext2(vdi_reader *_vdi, bool lazy)
     {
         // Store the pointer to the VDI reader and validate it.
         vdi = _vdi;
@@ -54,22 +74,37 @@ namespace vdi_explorer
         vdi->vdiRead(&bootSector, 512);
         
         // Debug info.
-        print_bootsector();
+        if (!lazy)
+            print_bootsector();
         // End debug info.
         
         // Determine the start of the superblock.
-        superblock_start = bootSector.partitionTable[0].firstSector * VDI_SECTOR_SIZE +
+        superblock_start = (off_t)bootSector.partitionTable[0].firstSector * VDI_SECTOR_SIZE +
                            EXT2_SUPERBLOCK_OFFSET;
         
         // Read the superblock.
         vdi->vdiSeek(superblock_start, SEEK_SET);
         vdi->vdiRead(&superblock, sizeof(ext2_superblock));
         
+        // Make sure there is an ext2 file system there before trusting anything else in the
+        // superblock.
+        if (superblock.s_magic != EXT2_SUPER_MAGIC ||
+            superblock.s_log_block_size > EXT2_MAX_LOG_BLOCK_SIZE ||
+            superblock.s_blocks_per_group == 0 ||
+            superblock.s_inodes_per_group == 0)
+        {
+            cout << "Error: The partition does not hold a valid ext2 file system." << endl;
+            throw;
+        }
+        
         // Record the actual block size.
         block_size_actual = EXT2_BLOCK_BASE_SIZE << superblock.s_log_block_size;
         
+        // Set up the metadata cache over the partition's blocks.
+        metadata.attach(vdi, (off_t)bootSector.partitionTable[0].firstSector * VDI_SECTOR_SIZE, block_size_actual);
+        
         // Calculate the max allowable file size.
-        u16 dwords_per_block = block_size_actual / 4;
+        u64 dwords_per_block = block_size_actual / 4;
         u64 max_file_size_by_block = (dwords_per_block * dwords_per_block * dwords_per_block +
                                       dwords_per_block * dwords_per_block +
                                       dwords_per_block +
@@ -78,14 +113,21 @@ namespace vdi_explorer
         if (max_file_size_by_block < EXT2_MAX_ABS_FILE_SIZE)
             max_file_size = max_file_size_by_block;
         
+        // The original revision has no large file feature, so its sizes must fit in i_size.
+        if (superblock.s_rev_level == EXT2_GOOD_OLD_REV && max_file_size > EXT2_MAX_SMALL_FILE_SIZE)
+            max_file_size = EXT2_MAX_SMALL_FILE_SIZE;
+        
         // Debug info.
-        print_superblock();
+        if (!lazy)
+            print_superblock();
         // End debug info.
         
-        // Calculate and verify the number of block groups in the partition.
+        // Calculate and verify the number of block groups in the partition.  The last group may be
+        // short of blocks, but every group has the same number of inodes.
         u32 nBlockGroupCalc1, nBlockGroupCalc2;
-        nBlockGroupCalc1 = (float)superblock.s_blocks_count / superblock.s_blocks_per_group + 0.5;
-        nBlockGroupCalc2 = (float)superblock.s_inodes_count / superblock.s_inodes_per_group + 0.5;
+        nBlockGroupCalc1 = (superblock.s_blocks_count - superblock.s_first_data_block + superblock.s_blocks_per_group - 1) /
+                           superblock.s_blocks_per_group;
+        nBlockGroupCalc2 = superblock.s_inodes_count / superblock.s_inodes_per_group;
         if (nBlockGroupCalc1 != nBlockGroupCalc2)
         {
             cout << "Block group calculation mismatch.";
@@ -94,9 +136,12 @@ namespace vdi_explorer
         numBlockGroups = nBlockGroupCalc1;
         
         // Debug info.
-        cout << "\n# of Block Groups:\n";
-        cout << "Calculation 1: " << nBlockGroupCalc1 << endl;
-        cout << "Calculation 2: " << nBlockGroupCalc2 << endl;
+        if (!lazy)
+        {
+            cout << "\n# of Block Groups:\n";
+            cout << "Calculation 1: " << nBlockGroupCalc1 << endl;
+            cout << "Calculation 2: " << nBlockGroupCalc2 << endl;
+        }
         // End debug info.
         
         // Allocate and verify an array of pointers to the (as yes unloaded) block group
@@ -108,42 +153,58 @@ namespace vdi_explorer
             throw;
         }
         
-        // Determine where the start of the block group descriptor table is.
-        bgd_table_start = superblock.s_log_block_size == 0 ?
-                          blockToOffset(2) :
-                          blockToOffset(1);
+        // Determine where the start of the block group descriptor table is: the block after the
+        // superblock's.
+        bgd_table_start = blockToOffset(superblock.s_first_data_block + 1);
         
-        // Debug info.
-        cout << "BGD Table Start: " << bgd_table_start << endl;
-        // End debug info.
+        // Under the 64bit feature each descriptor is s_desc_size bytes, of which only the first
+        // sizeof(ext2_block_group_desc) are used here.  Under flex_bg, the bitmaps and inode
+        // tables of each run of groups_per_flex groups are packed together.
+        if ((superblock.s_feature_incompat & EXT4_FEATURE_INCOMPAT_64BIT) &&
+            superblock.s_desc_size > sizeof(ext2_block_group_desc))
+        {
+            desc_size = superblock.s_desc_size;
+        }
+        if (superblock.s_feature_incompat & EXT4_FEATURE_INCOMPAT_FLEX_BG)
+        {
+            groups_per_flex = 1 << superblock.s_log_groups_per_flex;
+        }
+        
+        // Writes keep no journal, compute no checksums and assume every group is initialized, so
+        // a file system that relies on any of that, or on a feature not known here, or that has
+        // more blocks than 32-bit block numbers can reach, is only read.
+        if ((superblock.s_feature_compat & EXT3_FEATURE_COMPAT_HAS_JOURNAL) ||
+            (superblock.s_feature_ro_compat & ~EXT2_WRITE_RO_COMPAT) ||
+            (superblock.s_feature_incompat & ~EXT2_WRITE_INCOMPAT) ||
+            ((superblock.s_feature_incompat & EXT4_FEATURE_INCOMPAT_64BIT) && superblock.s_blocks_count_hi != 0))
+        {
+            read_only = true;
+            if (!lazy)
+            {
+                cout << "\nThe file system has features that cannot be written here (a journal, "
+                        "checksums or uninitialized block groups, say), so it is open read-only.\n";
+            }
+        }
         
-        // Read the block group descriptor table into memory.
-        vdi->vdiSeek(bgd_table_start, SEEK_SET);
-        vdi->vdiRead(bgdTable, sizeof(ext2_block_group_desc) * numBlockGroups);
+        // The root directory is the initial pwd.
+        pwd.push_back(make_dir_entry(EXT2_ROOT_INODE, "/", EXT2_DIR_TYPE_DIR));
         
-        // Debug info.
-        print_bgd_table();
-        // End debug info.
+        if (lazy)
+        {
+            return;
+        }
         
-        ext2_inode temp = readInode(2);//18);// 30481);
+        load_bgd_table();
         
         // Debug info.
+        cout << "BGD Table Start: " << bgd_table_start << endl;
+        print_bgd_table();
+        ext2_inode temp = readInode(EXT2_ROOT_INODE);
         print_inode(&temp);
-        // End debug info.
-        
-        // u8 dummy = 0;
-        // vdi->vdiSeek(blockToOffset(temp.i_block[0]), SEEK_SET);
-        // vdi->vdiRead(&dummy, 1);
-        
-        auto temp2 = parse_directory_inode(temp);
+        vector<ext2_dir_entry> temp2 = parse_directory_inode(temp);
         for (u32 i = 0; i < temp2.size(); i++)
             print_dir_entry(temp2[i], true);
-        
-        // set the root folder as the initial pwd.
-        // pwd_inode.emplace_back(readInode(2));
-        // pwd.emplace_back(parse_directory_inode(pwd_inode.back())[0]);
-        pwd.emplace_back(parse_directory_inode(readInode(2))[0]);
-        pwd.back().name.assign("/");
+        // End debug info.
     }
     
     /*----------------------------------------------------------------------------------------------
@@ -155,11 +216,48 @@ namespace vdi_explorer
     ----------------------------------------------------------------------------------------------*/
     ext2::~ext2()
     {
+        // Write out anything not yet committed.
+        commit();
+        
         // Delete the block descriptor table.
         if (bgdTable != nullptr)
             delete[] bgdTable;
     }
     
+    /*----------------------------------------------------------------------------------------------
+     * Name:    load_bgd_table
+     * Type:    Function
+     * Purpose: Reads the block group descriptor table, if that has not already been done.  The
+     *          table's blocks are read into the metadata cache in one go, and the descriptors are
+     *          copied out of them.  Everything that uses bgdTable calls this first (most of it by
+     *          way of inodeToOffset or load_free_space_index), so a lazy mount only reads the
+     *          table once something needs it.
+     * Input:   Nothing.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    void ext2::load_bgd_table()
+    {
+        if (bgd_table_loaded)
+        {
+            return;
+        }
+        
+        off_t table_offset = bgd_table_start - blockToOffset(0);
+        u32 table_first_block = table_offset / block_size_actual;
+        u32 table_blocks = ((u64)desc_size * numBlockGroups + block_size_actual - 1) / block_size_actual;
+        vector<u32> table_block_nums(table_blocks);
+        iota(table_block_nums.begin(), table_block_nums.end(), table_first_block);
+        metadata.prefetch(table_block_nums);
+        for (u32 i = 0; i < numBlockGroups; i++)
+        {
+            u64 desc_offset = (u64)i * desc_size;
+            memcpy(&(bgdTable[i]),
+                   &(metadata.get(table_first_block + desc_offset / block_size_actual)[desc_offset % block_size_actual]),
+                   sizeof(ext2_block_group_desc));
+        }
+        bgd_table_loaded = true;
+    }
+    
     /*----------------------------------------------------------------------------------------------
      * Name:    list_directory_contents
      * Type:    Function
@@ -167,40 +265,125 @@ namespace vdi_explorer
      * Input:   Nothing.
      * Output:  vector<fs_entry_posix>, containing a listing of all the files in the present working
      *          directory.
-     *
-     * @TODO    Optimize.
     ----------------------------------------------------------------------------------------------*/
     vector<fs_entry_posix> ext2::get_directory_contents(void)
     {
         vector<fs_entry_posix> to_return;
-        ext2_inode temp_inode;
+        dir_snapshot listing;
         
-        // Parse the contents of the current directory.
-        vector<ext2_dir_entry> directory_contents = parse_directory_inode(pwd.back().inode);
+        read_directory(readInode(pwd.back().inode), listing);
         
         // Instead of returning the raw contents, add a layer of abstraction to help facilitate
         // future design plans (eventual support for different filesystems).
-        for (u32 i = 0; i < directory_contents.size(); i++)
+        stat_many(listing.inode_numbers(), listing.size(), to_return);
+        for (u32 i = 0; i < listing.size(); i++)
         {
-            // Read the entry's inode to gather data.
-            temp_inode = readInode(directory_contents[i].inode);
-            
-            // Add an fs_entry_posix object to the back of the to_return vector and fill it with the
-            // appropriate data.
-            to_return.emplace_back();
-            to_return.back().name = directory_contents[i].name;
-            to_return.back().type = directory_contents[i].file_type;
-            to_return.back().permissions = temp_inode.i_mode & 0x0fff; // mask for the bottom 12 bits
-            to_return.back().user_id = temp_inode.i_uid;
-            to_return.back().group_id = temp_inode.i_gid;
-            to_return.back().size = temp_inode.i_size;
-            to_return.back().timestamp_created = temp_inode.i_ctime;
-            to_return.back().timestamp_modified = temp_inode.i_mtime;
+            to_return[i].name.assign(listing.name(i), listing.name_length(i));
         }
         
         return to_return;
     }
     
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    get_directory_contents
+     * Type:    Function
+     * Purpose: Takes a snapshot of the current directory, reading its blocks in as few reads as
+     *          they allow and the inodes of its entries in inode table order.  Nothing is
+     *          allocated per entry, so this is the one to use for very large directories.
+     * Input:   Nothing.
+     * Output:  <reference> dir_snapshot & listing, receives the directory's entries, in directory
+     *          order.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    void ext2::get_directory_contents(dir_snapshot & listing)
+    {
+        vector<ext2_inode> inodes;
+        
+        read_directory(readInode(pwd.back().inode), listing);
+        
+        // Stat the entries a batch at a time, so a huge directory's inodes are never all in memory
+        // at once.  The inode numbers are taken straight from the snapshot.
+        for (u32 first = 0; first < listing.size(); first += EXT2_STAT_BATCH_SIZE)
+        {
+            u32 end = (listing.size() - first > EXT2_STAT_BATCH_SIZE ? first + EXT2_STAT_BATCH_SIZE : listing.size());
+            inodes.resize(end - first);
+            read_inodes(listing.inode_numbers() + first, end - first, inodes.data());
+            
+            for (u32 i = first; i < end; i++)
+            {
+                const ext2_inode & entry_inode = inodes[i - first];
+                listing.set_inode_info(i,
+                                       entry_inode.i_mode & 0x0fff, // mask for the bottom 12 bits
+                                       entry_inode.i_uid,
+                                       entry_inode.i_gid,
+                                       inode_size(entry_inode),
+                                       entry_inode.i_ctime,
+                                       entry_inode.i_mtime);
+            }
+        }
+    }
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    stat_many
+     * Type:    Function
+     * Purpose: Looks up many files' details at once from their inode numbers.  Each inode table
+     *          block involved is read only once, in ascending order, however the numbers are
+     *          ordered, so this is far cheaper than stating the files one by one.
+     * Input:   const u32 * inode_nums, holds the inode numbers, in any order.
+     * Input:   u32 count, holds the number of inode numbers.
+     * Output:  <reference> vector<fs_entry_posix> & stats, receives the details, in the same order
+     *          as the numbers.  The names are left empty, as an inode does not know its name.
+     * Output:  bool, false if any inode number was out of bounds (its details are left zeroed).
+    ----------------------------------------------------------------------------------------------*/
+    bool ext2::stat_many(const u32 * inode_nums, u32 count, vector<fs_entry_posix> & stats)
+    {
+        vector<ext2_inode> inodes(count);
+        bool all_read = read_inodes(inode_nums, count, inodes.data());
+        
+        stats.resize(count);
+        for (u32 i = 0; i < count; i++)
+        {
+            stats[i].name.clear();
+            switch (inodes[i].i_mode & 0xF000)
+            {
+                case EXT2_INODE_TYPE_FILE:
+                    stats[i].type = EXT2_DIR_TYPE_FILE;
+                    break;
+                case EXT2_INODE_TYPE_DIR:
+                    stats[i].type = EXT2_DIR_TYPE_DIR;
+                    break;
+                case EXT2_INODE_TYPE_CHARDEV:
+                    stats[i].type = EXT2_DIR_TYPE_CHARDEV;
+                    break;
+                case EXT2_INODE_TYPE_BLOCKDEV:
+                    stats[i].type = EXT2_DIR_TYPE_BLOCKDEV;
+                    break;
+                case EXT2_INODE_TYPE_FIFO:
+                    stats[i].type = EXT2_DIR_TYPE_FIFO;
+                    break;
+                case EXT2_INODE_TYPE_SOCKET:
+                    stats[i].type = EXT2_DIR_TYPE_SOCKET;
+                    break;
+                case EXT2_INODE_TYPE_SYMLINK:
+                    stats[i].type = EXT2_DIR_TYPE_SYMLINK;
+                    break;
+                default:
+                    stats[i].type = EXT2_DIR_TYPE_UNKNOWN;
+                    break;
+            }
+            stats[i].permissions = inodes[i].i_mode & 0x0fff; // mask for the bottom 12 bits
+            stats[i].user_id = inodes[i].i_uid;
+            stats[i].group_id = inodes[i].i_gid;
+            stats[i].size = inode_size(inodes[i]);
+            stats[i].timestamp_created = inodes[i].i_ctime;
+            stats[i].timestamp_modified = inodes[i].i_mtime;
+        }
+        
+        return all_read;
+    }
+    
+    
     /*----------------------------------------------------------------------------------------------
      * Name:    get_pwd
      * Type:    Function
@@ -279,1926 +462,5210 @@ namespace vdi_explorer
      * Name:    file_read
      * Type:    Function
      * Purpose: Reads a file from the virtual filesystem and outputs it on to the host filesystem.
-     * Input:   fstream & output_file, contains the output file stream.
+     *          The file is read in large buffers, each covering many blocks, with physically
+     *          consecutive blocks read together.  Filled buffers are handed to a writer thread, so
+     *          the next buffer is read from the virtual disk while the previous one is still being
+     *          written to the host.  Holes in the file (block pointers of 0) are never read; they
+     *          are skipped over in the host file, leaving holes there too.
+     *
+     *          Where the host file is a regular file the kernel can copy into (copy_file_range, or
+     *          splice), the data is not read into user space at all; see export_range.
+     * Input:   int output_fd, contains the host file descriptor to write to.
      * Input:   const string & file_to_read, holds the name of the file to read from the virtual
      *          filesystem.
      * Output:  bool, representing whether the file was found and read (true) or not (false).
     ----------------------------------------------------------------------------------------------*/
-    bool ext2::file_read(fstream & output_file, const string & file_to_read)
-    {
-        // Check if the file specified in file_to_read exists or not, and if it does, its inode
-        // number will be stored in file_inode.
-        u32 file_inode = 0;
-        if (file_entry_exists(file_to_read, file_inode) == true)
-        {
-            cout << "debug >> ext2::file_read >> file exists\n";
-            
-            // Get the file size.
-            size_t file_size = readInode(file_inode).i_size;
-            
-            // Unroll the block chain where the file resides.
-            list<u32> file_block_list = make_block_list(file_inode);
-            cout << "debug (ext2::file_read) number of blocks: " << file_block_list.size() << endl;
-            cin.ignore(1);
-            
-            // Set up an iterator to go through the block list.
-            list<u32>::iterator iter = file_block_list.begin();
-            
-            // Set up some housekeeping variables.
-            size_t bytes_read = 0;
-            size_t bytes_to_read = 0;
-            
-            // Buffer to receive the file contents. Must be char (versus u8) or compiler pukes.
-            char * read_buffer = new char[block_size_actual];
-
-            // Loop until the whole file has been read.
-            // @TODO determine if a (iter != file_block_list.end()) condition should be added.
-            while (bytes_read < file_size)
-            {
-                // Determine how many bytes to read.  Read a full block if possible, otherwise read
-                // just until the end of the file.
-                bytes_to_read = (block_size_actual < file_size - bytes_read ? block_size_actual : file_size - bytes_read);
-                
-                // Set the VDI seek pointer to the apropriate position and then read the designated
-                // number of bytes.
-                vdi->vdiSeek(blockToOffset(*iter), SEEK_SET);
-                vdi->vdiRead(read_buffer, bytes_to_read);
-                
-                // Immediately write the buffer to file.
-                output_file.write(read_buffer, bytes_to_read);
-                //output_file.
-                
-                // Get set up to do the next read by setting the iterated to the next block in the
-                // chain and incrementing the number of bytes that have been read.
-                iter++;
-                bytes_read += bytes_to_read;
-            }
-            
-            // Release the read buffer's memory and return.
-            delete[] read_buffer;
-            return true;
-        }
-        else
-        {
-            cout << "debug >> ext2::file_read >> file does not exist\n";
-            // The file does not exist, so return false.
-            return false;
-        }
-    }
-
-
-    /*----------------------------------------------------------------------------------------------
-     * Name:    file_write
-     * Type:    Function
-     * Purpose: Writes a file from the host filesystem and into the filesystem being accessed by
-     *          this program.
-     * Input:   fstream & input_file, contains the input file stream.
-     * Input:   string filename_to_write, holds the name of the file to write to in the filesystem.
-     * Output:  bool, representing whether the file was written (true) or not (false).
-     *
-     * NOTE:    This function is a train wreck and needs to be broken up more than Evil Corp.
-    ----------------------------------------------------------------------------------------------*/
-    bool ext2::file_write(fstream & input_file, string filename_to_write)
+    bool ext2::file_read(int output_fd, const string & file_to_read)
     {
-        // Tasks to complete:
-        //   [x] check if file already exists
-        //   [x] determine input file size
-        //   [x] make sure the file is under the max size
-        //   [x] truncate filename_to_write if needed (max size is EXT2_FILENAME_MAX_LENGTH)
-        //   [x] determine how many blocks the file is going to take including supporting
-        //       structures, such as inode and indirect blocks, and check directory inode to make
-        //       sure it can handle another ext2_dir_entry (or if it needs another block to handle
-        //       it)
-        //   [x] verify that there are enough free blocks
-        //   [x] make a list of free blocks that we plan on using (try to use the ones that are in
-        //       the same block group as the parent directly)
-        //   [x] write incoming file to disk
-        //   [x] record blocks in indirect block structures if necessary
-        //   [x] find free inode
-        //   [x] build inode entry (don't forget about permissions!)
-        //   [x] write inode entry to disk
-        //   [x] add ext2_dir_entry to directory block
-        //   [x] modify block group descriptor block bitmaps on disk
-        //   [x] modify block group descriptor inode bitmap on disk
-        //   [x] modify block group descriptor table in memory
-        //   [x] modify block group descriptor table on disk
-        //   [x] modify superblock in memory
-        //   [x] modify superblock on disk
-        //
-        //   Double-check the filesystem documentation to make damn sure we don't overwrite or miss
-        //   something critical.
-        
-        u32 dir_inode_num = pwd.back().inode;
-        
-        
-        /***   Check to see if the file already exists.   ***/
-        u32 garbage;
-        if (file_entry_exists(filename_to_write, garbage))
-        {
-            cout << "Error: File already exists.  (ext2::file_write)\n";
-            return false;
-        }
-        /***   End check to see if the file already exists.   ***/
-        
-        
-        /***   Determine file size.   ***/
-        // Assume that the file stream is at the beginning and record the position of the current
-        // character in the input stream.
-        std::streampos stream_size = input_file.tellg();
-        
-        // Seek to the end of the file.
-        input_file.seekg(0, std::ios::end);
-        
-        // Record the actual size as the end position minus the beginning position.
-        stream_size = input_file.tellg() - stream_size;
-        
-        // Seek back to the beginning of the file.
-        input_file.seekg(0, std::ios::beg);
-        
-        // Convert the stream size into file size.
-        size_t file_size = (u64)stream_size;
-        /***   End determine file size.   ***/
-        
-        
-        /***   Ensure the file is under the max size.   ***/
-        if (file_size > max_file_size)
+        // Open the file.  Its blocks are mapped as the copy goes, rather than all up front.
+        file_handle file = open(file_to_read);
+        if (!file.is_open())
         {
-            cout << "Error: File is too large to be handled by the file system. (ext2::file_write)\n";
+            cout << "Error: File does not exist.  (ext2::file_read)\n";
             return false;
         }
-        /***   End ensure the file is under the max size.   ***/
-        
         
-        /***   Truncate filename_to_write to EXT2_FILENAME_MAX_LENGTH bytes if needed.   ***/
-        if (filename_to_write.length() > EXT2_FILENAME_MAX_LENGTH)
+        // If the host file can be sized up front, and the kernel will copy the first stretch of
+        // data into it, copy the file with positioned copies instead, so that whole runs of blocks
+        // go straight from the VDI file to the host file.
+        if (ftruncate(output_fd, file.size()) == 0)
         {
-            cout << "Warning: File name is too long.  Truncating to " << EXT2_FILENAME_MAX_LENGTH <<
-                    " characters.\n";
-            filename_to_write.erase(EXT2_FILENAME_MAX_LENGTH);
+            u64 first_data = file.next_data(0);
+            u64 first_end = file.next_hole(first_data, file.size());
+            u64 copied_to = file.copy_to(output_fd, first_data, first_end);
+            if (first_data == file.size() || copied_to > first_data)
+            {
+                bool copied = export_range(file, output_fd, copied_to, file.size());
+                file.close();
+                return copied;
+            }
         }
-        /***   End truncate filename_to_write to EXT2_FILENAME_MAX_LENGTH bytes if needed.   ***/
-        
-        
-        /***   Determine how many blocks the file will take up.   ***/
-        // NOTE: This section may be more useful as a function.
-        // @TODO verify mathy things
-        // @TODO optimize, maybe even rework the whole algorithm
-        
-        // The file will use at least file_size / block_size_actual number of blocks.  Because this
-        // uses integer division, the decimal is cut off, hence we use modulus to determine if the
-        // block count needs to be expanded by one to compensate. A.k.a poor man's ceiling function.
-        u32 raw_num_blocks_needed = (file_size % block_size_actual ?
-                                     file_size / block_size_actual + 1 :
-                                     file_size / block_size_actual);
-        
-        // Housekeeping variables to help keep calculations from being as stupidly long.
-        u32 s_num_block_pointers = block_size_actual / EXT2_BLOCK_POINTER_SIZE;
-        u32 d_num_block_pointers = s_num_block_pointers * s_num_block_pointers;
         
-        // Establish a counter for the total number of blocks that will be needed when all support
-        // structures, such as indirect blocks, are taken into account.
-        u32 total_num_blocks_needed = raw_num_blocks_needed;
+        // Set up the rotating buffers shared by the reading and writing sides.
+        buffer_ring ring(EXT2_COPY_BUFFER_SIZE, EXT2_COPY_BUFFER_COUNT);
+        bool write_failed = false;
+        bool read_failed = false;
         
-        // Establish a counter for the number supporting blocks needed (indirect blocks, etc.)
-        u32 supporting_blocks_needed = 0;
+        // Keep track of how far into the host file the writer has gotten.
+        u64 host_position = 0;
         
-        // Check to see if the singly indirect block will be needed.
-        if (raw_num_blocks_needed > EXT2_INODE_NBLOCKS_DIR)
+        // Start the writer thread, which drains filled buffers to the host file in order, skipping
+        // over any hole between the end of one buffer and the start of the next.
+        thread writer([&]()
         {
-            // Add 1 for the singly indirect block.
-            total_num_blocks_needed += 1;
-            supporting_blocks_needed += 1;
-            
-            // Keep track of how many more blocks are needed at each stage.  At this stage,
-            // compensate for the number of direct block pointers.
-            u32 num_blocks_left = raw_num_blocks_needed - EXT2_INODE_NBLOCKS_DIR;
+            char * buffer = nullptr;
+            size_t length = 0;
+            u64 offset = 0;
             
-            // Check to see if the doubly indirect block will be needed.
-            if (raw_num_blocks_needed > EXT2_INODE_NBLOCKS_DIR + s_num_block_pointers)
+            while (ring.receive(buffer, length, offset))
             {
-                // Add 1 for the doubly indirect block.
-                total_num_blocks_needed += 1;
-                supporting_blocks_needed += 1;
-                
-                // Keep track of how many more blocks are needed at each stage.  At this stage,
-                // compensate for the number of block pointers contained in the singly indirect
-                // block.
-                num_blocks_left -= s_num_block_pointers;
-                
-                // Calculate the number of singly indirect blocks still needed, compensating for
-                // integer division.
-                u32 num_s_blocks_left = (num_blocks_left % s_num_block_pointers ?
-                                         num_blocks_left / s_num_block_pointers + 1 :
-                                         num_blocks_left / s_num_block_pointers);
-                
-                // Whether or not a triply indirect block is needed, this number of singly indirect
-                // blocks will be, so add the number of singly indirect blocks left to the total.
-                total_num_blocks_needed += num_s_blocks_left;
-                supporting_blocks_needed += num_s_blocks_left;
-                
-                // Check to see if the triply indirect block will be needed.
-                if (raw_num_blocks_needed > EXT2_INODE_NBLOCKS_DIR + s_num_block_pointers + 
-                                            d_num_block_pointers)
+                if (!utility::skip_zeroes(output_fd, offset - host_position) ||
+                    !utility::write_fully(output_fd, buffer, length))
                 {
-                    // Add 1 for the triply indirect block.
-                    total_num_blocks_needed += 1;
-                    supporting_blocks_needed += 1;
-                    
-                    // Keep track of how many more blocks are needed at each stage.  At this stage,
-                    // compensate for the number of block pointers contained in the doubly indirect
-                    // block.
-                    num_blocks_left -= d_num_block_pointers;
-                    
-                    // Calculate the number of doubly indirect blocks still needed, compensating for
-                    // integer division.
-                    u32 num_d_blocks_left = (num_blocks_left % d_num_block_pointers ?
-                                             num_blocks_left / d_num_block_pointers + 1 :
-                                             num_blocks_left / d_num_block_pointers);
-                    
-                    // Add the number of doubly indirect blocks needed to the total.
-                    total_num_blocks_needed += num_d_blocks_left;
-                    supporting_blocks_needed += num_d_blocks_left;
+                    // Stop the reading side as well; there is no point in reading any further.
+                    write_failed = true;
+                    ring.abort();
+                    break;
                 }
+                host_position = offset + length;
+                ring.release(buffer);
             }
-        }
+        });
         
-        // Check to see if the directory inode will need another block to handle the added
-        // ext2_dir_entry structure.
-        // Establish a variable for downstream subfunctions to easily determine whether a block
-        // needs to be added.
-        bool additional_dir_block_needed = false;
-        
-        // Parse the directory inode where the file will live.
-        vector<ext2::ext2_dir_entry> directory_entries = parse_directory_inode(dir_inode_num);
+        // Fill buffers from the virtual disk, one stretch of data at a time, until the end of the
+        // file is reached.
+        u64 offset = file.next_data(0);
+        while (offset < file.size())
+        {
+            char * buffer = ring.acquire();
+            if (buffer == nullptr)
+            {
+                // The writer gave up.
+                break;
+            }
+            
+            // Read up to the next hole, or as much as fits in the buffer.
+            u64 data_end = file.next_hole(offset, offset + ring.buffer_size());
+            size_t bytes_read = file.pread(buffer, data_end - offset, offset);
+            ring.submit(buffer, bytes_read, offset);
+            if (bytes_read < data_end - offset)
+            {
+                // The image could not be read, so the rest of the file cannot be either.
+                read_failed = true;
+                break;
+            }
+            
+            // Move on to the next data after this stretch.
+            offset = file.next_data(offset + bytes_read);
+        }
         
-        // Calculate the number of bytes left in the directory block.
-        size_t dir_block_space_left = directory_entries.back().rec_len - 
-                                      utility::nearest_mult_four(EXT2_DIR_BASE_SIZE + directory_entries.back().name_len);
+        // Let the writer drain what is left, then wait for it.
+        ring.close();
+        writer.join();
         
-        // Calculate the number of bytes needed to store an ext2_dir_entry structure for the file.
-        size_t dir_block_space_needed = utility::nearest_mult_four(EXT2_DIR_BASE_SIZE + filename_to_write.length());
-
-        // If the number of bytes needed exceeds those available, add 1 to the total number of
-        // needed blocks to account for the extra block needed for the directory entry.
-        if (dir_block_space_needed > dir_block_space_left)
+        // A hole at the end of the file still counts towards its size, so extend the host file to
+        // the full size.  Anything that cannot be truncated gets the zeroes written out.
+        if (!write_failed && !read_failed && host_position < file.size() &&
+            ftruncate(output_fd, file.size()) != 0 &&
+            !utility::skip_zeroes(output_fd, file.size() - host_position))
         {
-            additional_dir_block_needed = true;
-            total_num_blocks_needed += 1;
-            supporting_blocks_needed += 1;
+            write_failed = true;
         }
-        /***   End determine how many blocks the file will take up.   ***/
-        
+        file.close();
         
-        /***   Verify that enough free space exists.   ***/
-        // Check the number of free blocks.
-        if (superblock.s_free_blocks_count < total_num_blocks_needed)
+        if (read_failed)
         {
-            cout << "Error: Not enough free blocks available on the file system.\n";
+            cout << "Error: Could not read the file from the image.  (ext2::file_read)\n";
             return false;
         }
-        
-        // Check the number of free inodes.
-        if (superblock.s_free_inodes_count < 1)
+        if (write_failed)
         {
-            cout << "Error: Not enough free inodes available on the file system.\n";
+            cout << "Error: Could not write to the host file.  (ext2::file_read)\n";
             return false;
         }
-        /***   End verify that enough free space exists.   ***/
-        
         
-        /***   Make a list of free blocks we plan on using.   ***/
-        // Implement functions specifically for reading / writing bitmaps?
-        // What about using vector<bool>? Sure!
-        //
-        // algorithm
-        //
-        // check whether file will fit into one block group
-        // yes:
-        //   read just that bdg bitmap
-        //   run through bitmap starting at index [2 + (superblock.s_inodes_per_group * superblock.s_inode_size) / block_size_actual]
-        //   add every free block up to the number of blocks we need.
-        // no:
-        //   read all bgd bitmaps
-        //   run through each bitmap starting at index starting at index [2 + (superblock.s_inodes_per_group * superblock.s_inode_size) / block_size_actual]
-        //   add every block from one block group before moving to the next one, up to the number of blocks we need (probably not good practice... fix at a later date)
-        
-        // Create a vector to hold the block numbers that will be written.
-        vector<u32> blocks_to_write;
+        return true;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    extract_files
+     * Type:    Function
+     * Purpose: Copies many files out to a host directory at once, keeping their names.  Each
+     *          pattern may name a file or hold wildcards (*, ? and [...]) in its last component.
+     *
+     *          Rather than copying the files one after another, which jumps back and forth across
+     *          the image, every stretch of data of every file is gathered first and located in the
+     *          VDI file through the page map.  The stretches are then read in the order they sit
+     *          in the VDI file, with neighbouring ones read together, and each is written to its
+     *          place in its host file.  Holes are never read, and stay holes on the host.
+     * Input:   const vector<string> & patterns, holds the files to copy.
+     * Input:   const string & host_dir, holds the host directory to copy them into.
+     * Output:  bool, true if every file was copied.
+    ----------------------------------------------------------------------------------------------*/
+    bool ext2::extract_files(const vector<string> & patterns, const string & host_dir)
+    {
+        // A stretch of file data that is contiguous on the virtual disk.
+        struct extent
+        {
+            u32 file;
+            u64 file_offset;
+            off_t disk_offset;
+            off_t vdi_offset;       // where the start of the stretch sits in the VDI file
+            size_t length;
+        };
         
-        // Determine what block group the directory inode is in.
-        u32 dir_inode_block_group_num = inodeToBlockGroup(dir_inode_num);
+        bool all_copied = true;
         
-        // @TODO Decide if this should simply be read in during object construction.
-        vector<vector<bool>> block_group_block_bitmaps; // vector-inception...
         
-        // Establish a vector to keep track of "dirty" block group block bitmaps that will need to
-        // be written to disk.
-        vector<bool> dirty_block_group_block_bitmaps;
+        /***   Find the files and create their host copies.   ***/
+        vector<ext2_dir_entry> entries;
+        for (u32 i = 0; i < patterns.size(); i++)
+        {
+            if (!match_files(patterns[i], entries))
+            {
+                cout << "Error: No files match " << patterns[i] << "  (ext2::extract_files)\n";
+                all_copied = false;
+            }
+        }
         
-        // Establish a vector to keep track of how many blocks are being used from each block group.
-        vector<u32> num_blocks_used_per_block_group;
+        vector<u32> inode_nums;
+        for (u32 i = 0; i < entries.size(); i++)
+        {
+            inode_nums.push_back(entries[i].inode);
+        }
+        vector<ext2_inode> inodes;
+        read_inodes(inode_nums, inodes);
         
-        // Add enough elements to the vectors to cover the number of block groups.
-        for (u32 i = 0; i < numBlockGroups; i++)
+        vector<file_handle> files;
+        vector<string> host_paths;
+        vector<int> host_fds;
+        for (u32 i = 0; i < entries.size(); i++)
         {
-            block_group_block_bitmaps.push_back(vector<bool> (0));
-            dirty_block_group_block_bitmaps.push_back(0);
-            num_blocks_used_per_block_group.push_back(0);
+            string host_path = host_dir + "/" + entries[i].name;
+            int fd = ::open(host_path.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+            if (fd == -1)
+            {
+                cout << "Error: Could not create the host file: " << host_path << "  (ext2::extract_files)\n";
+                all_copied = false;
+                continue;
+            }
+            
+            // Size the host file up front; everything not written stays a hole.
+            files.push_back(open_inode(entries[i].inode, inodes[i]));
+            host_paths.push_back(host_path);
+            host_fds.push_back(fd);
+            if (ftruncate(fd, files.back().size()) != 0)
+            {
+                cout << "Error: Could not write to the host file: " << host_path << "  (ext2::extract_files)\n";
+                all_copied = false;
+            }
         }
+        /***   End find the files and create their host copies.   ***/
         
-        // Housekeeping variable to establish the bitmap index where the real data blocks begin.
-        u64 starting_data_block_offset = 1 + // 1 for the block usage bitmap
-                                         1 + // 1 for the inode usage bitmap
-                                         (superblock.s_inodes_per_group * superblock.s_inode_size) / block_size_actual;
         
-        // Check if the block group has enough free blocks to hold the file or if it will have to
-        // be written across multiple block groups.
-        if (total_num_blocks_needed < bgdTable[dir_inode_block_group_num].bg_free_blocks_count)
+        /***   Gather the extents.   ***/
+        // Stretches are cut at the copy buffer size, so that any one of them fits in a buffer.
+        vector<extent> extents;
+        for (u32 f = 0; f < files.size(); f++)
         {
-            // Only have to read the one bitmap.
-            block_group_block_bitmaps[dir_inode_block_group_num] = read_bitmap(bgdTable[dir_inode_block_group_num].bg_block_bitmap, superblock.s_blocks_per_group);
-            
-            // Iterate through the block group's block bitmap.
-            for (u64 i = starting_data_block_offset; i < block_group_block_bitmaps[dir_inode_block_group_num].size() && blocks_to_write.size() < total_num_blocks_needed; i++)
+            file_handle & file = files[f];
+            for (u64 offset = file.next_data(0); offset < file.size(); offset = file.next_data(offset))
             {
-                // Check that the block is not in use.
-                if (block_group_block_bitmaps[dir_inode_block_group_num][i] == false)
+                u64 data_end = file.next_hole(offset, file.size());
+                while (offset < data_end)
                 {
-                    // Mark the block as in use.
-                    block_group_block_bitmaps[dir_inode_block_group_num][i] = true;
-                    
-                    // Mark the bitmap dirty.
-                    dirty_block_group_block_bitmaps[dir_inode_block_group_num] = true;
+                    // Follow the blocks for as long as they are consecutive on the disk.
+                    u32 logical_block = offset / block_size_actual;
+                    u32 first_block = map_logical_block(file.inode, logical_block, file.cache);
+                    u64 run_end = (u64)(logical_block + 1) * block_size_actual;
+                    for (u32 i = 1; run_end < data_end && run_end - offset < EXT2_COPY_BUFFER_SIZE; i++)
+                    {
+                        if (map_logical_block(file.inode, logical_block + i, file.cache) != first_block + i)
+                        {
+                            break;
+                        }
+                        run_end += block_size_actual;
+                    }
+                    if (run_end > data_end)
+                    {
+                        run_end = data_end;
+                    }
+                    if (run_end - offset > EXT2_COPY_BUFFER_SIZE)
+                    {
+                        run_end = offset + EXT2_COPY_BUFFER_SIZE;
+                    }
                     
-                    // Increment the number of used blocks in this block group.
-                    num_blocks_used_per_block_group[dir_inode_block_group_num] += 1;
+                    extent to_add;
+                    to_add.file = f;
+                    to_add.file_offset = offset;
+                    to_add.disk_offset = blockToOffset(first_block) + offset % block_size_actual;
+                    to_add.vdi_offset = vdi->vdiPhysicalOffset(to_add.disk_offset);
+                    to_add.length = run_end - offset;
+                    extents.push_back(to_add);
                     
-                    // Add the block to the list of blocks to write.
-                    blocks_to_write.push_back(bgdTable[dir_inode_block_group_num].bg_block_bitmap + i);
+                    offset = run_end;
                 }
             }
         }
-        else
+        
+        // Elevator order: by place in the VDI file.
+        sort(extents.begin(), extents.end(), [](const extent & a, const extent & b)
         {
-            // Need to read all bitmaps.
-            for (u32 i = 0; i < numBlockGroups; i++)
+            return a.vdi_offset < b.vdi_offset;
+        });
+        /***   End gather the extents.   ***/
+        
+        
+        /***   Read the extents in order, and scatter them to the host files.   ***/
+        buffer_pool::buffer buffer(EXT2_COPY_BUFFER_SIZE);
+        for (u32 first = 0; first < extents.size();)
+        {
+            // Take in the following extents for as long as they carry straight on from the
+            // previous one, both on the virtual disk and in the VDI file, and still fit.
+            size_t read_length = extents[first].length;
+            u32 end = first + 1;
+            while (end < extents.size() &&
+                   extents[end].disk_offset == extents[first].disk_offset + (off_t)read_length &&
+                   extents[end].vdi_offset == extents[first].vdi_offset + (off_t)read_length &&
+                   read_length + extents[end].length <= buffer.size())
             {
-                block_group_block_bitmaps[i] = read_bitmap(bgdTable[i].bg_block_bitmap, superblock.s_blocks_per_group);
+                read_length += extents[end].length;
+                end++;
             }
             
-            // Iterate through all the block groups.
-            for (u32 i = 0; i < numBlockGroups && blocks_to_write.size() < total_num_blocks_needed; i++)
+            vdi->vdiPreadBulk(buffer.data(), read_length, extents[first].disk_offset);
+            
+            size_t buffer_offset = 0;
+            for (u32 i = first; i < end; i++)
             {
-                // Iterate through the block group's block bitmap, stopping when the end of the
-                // block is reached or when the required number of blocks to write has been reached.
-                for (u64 j = starting_data_block_offset; j < block_group_block_bitmaps[i].size() && blocks_to_write.size() < total_num_blocks_needed; j++)
+                if (!utility::pwrite_fully(host_fds[extents[i].file],
+                                           buffer.as<char>() + buffer_offset,
+                                           extents[i].length,
+                                           extents[i].file_offset))
                 {
-                    // Check that the block is not in use.
-                    if (block_group_block_bitmaps[i][j] == false)
-                    {
-                        // Mark the block as in use.
-                        block_group_block_bitmaps[i][j] = true;
-                        
-                        // Mark the bitmap dirty.
-                        dirty_block_group_block_bitmaps[i] = true;
-                        
-                        // Increment the number of used blocks in this block group. -> directly increment bdgTable[i].bg_free_blocks_count?
-                        num_blocks_used_per_block_group[i] += 1;
-                        
-                        // Add the block to the list of blocks to write.
-                        // (bgdTable[i].bg_block_bitmap serves as the base block for that block
-                        // group, so you just need to add 'j' to it to get the actual block number.)
-                        blocks_to_write.push_back(bgdTable[i].bg_block_bitmap + j);
-                    }
+                    cout << "Error: Could not write to the host file: " << host_paths[extents[i].file] << "  (ext2::extract_files)\n";
+                    all_copied = false;
                 }
+                buffer_offset += extents[i].length;
             }
+            
+            first = end;
         }
-        /***   End make a list of free blocks we plan on using.   ***/
+        /***   End read the extents in order, and scatter them to the host files.   ***/
         
+        for (u32 f = 0; f < host_fds.size(); f++)
+        {
+            ::close(host_fds[f]);
+        }
         
-        /***   Write file to disk.   ***/
-        // DUN DUN DUN - the crux of the function
-        //
-        // algorithm
-        //
-        // in each block, write block_size_actual bytes worth of data
+        return all_copied;
+    }
+
+
+    /*----------------------------------------------------------------------------------------------
+     * Name:    file_write
+     * Type:    Function
+     * Purpose: Writes a file from the host filesystem and into the filesystem being accessed by
+     *          this program.  This is a batch of one for ingest.
+     * Input:   int input_fd, contains the host file descriptor to read from.
+     * Input:   string filename_to_write, holds the name of the file to write to in the filesystem.
+     * Output:  bool, representing whether the file was written (true) or not (false).
+    ----------------------------------------------------------------------------------------------*/
+    bool ext2::file_write(int input_fd, string filename_to_write)
+    {
+        vector<ingest_item> batch(1);
+        batch[0].input_fd = input_fd;
+        batch[0].name = filename_to_write;
         
-        // Establish a variable to keep track of how many bytes have been written.
-        size_t bytes_written = 0;
+        return ingest_into(pwd.back().inode, batch);
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    file_write_at
+     * Type:    Function
+     * Purpose: Writes the contents of a host file into an existing file, starting at a given
+     *          offset, growing the file if the data runs past its end.  Only the blocks the data
+     *          lands in are touched: whole blocks are written straight out, and the partial blocks
+     *          at either end have the rest of their old contents read in first.  Blocks are only
+     *          allocated where the file has none yet (past its end, or in holes), and all-zero
+     *          blocks that would fill a hole are left as holes.  The input may be a pipe, which
+     *          is read until it ends.
+     * Input:   int input_fd, holds the host file descriptor to read from.
+     * Input:   const string & path, holds the file to write to, relative to the pwd or absolute.
+     * Input:   u64 offset, holds the offset in the file to start writing at.
+     * Output:  bool, true if all of the input was written.
+    ----------------------------------------------------------------------------------------------*/
+    bool ext2::file_write_at(int input_fd, const string & path, u64 offset)
+    {
+        inode_edit edit;
+        if (!begin_edit(path, edit))
+        {
+            return false;
+        }
         
-        // Create a buffer for reading the input file.
-        s8 * input_file_buffer = nullptr;
-        input_file_buffer = new s8[block_size_actual];
-        if (input_file_buffer == nullptr)
+        // Anything past the old end of the file in its last block must read back as zeroes once
+        // the file grows over it.
+        u64 old_size = inode_size(edit.inode);
+        if (offset > old_size && old_size % block_size_actual != 0)
         {
-            cout << "Error: Could not allocate the file buffer. (ext2::file_write)\n";
-            throw;
+            zero_block_tail(edit, old_size);
         }
         
-        // Dashing through the loop
-        // In an integer vector
-        // O'er this we traverse
-        // Laughing all the way
-        // HA HA HA HA
-        for (u32 i = 0; i < blocks_to_write.size() - supporting_blocks_needed; i++)
+        // Write the input a buffer at a time.
+        bool written = true;
+        buffer_pool::buffer buffer(EXT2_COPY_BUFFER_SIZE);
+        u64 position = offset;
+        while (true)
         {
-            // Attempt to read a block's worth of bytes from the input file into the input file
-            // buffer.  If there aren't a block's worth of bytes left to read, no error occurs and
-            // the file buffer will only be partially full.
-            input_file.read(input_file_buffer, block_size_actual);
-            
-            // If the number of bytes to be written is not a full block's worth, ensure the
-            // remainder of the buffer is zeroed out.
-            if (file_size - bytes_written < block_size_actual)
+            size_t bytes_read = utility::read_fully(input_fd, buffer.as<char>(), buffer.size());
+            if (bytes_read == 0)
+            {
+                break;
+            }
+            if (position + bytes_read > max_file_size)
             {
-                // @TODO Verify that numbers do not suffer from an off-by-1 error.
-                memset(&(input_file_buffer[file_size - bytes_written]),
-                       0,
-                       block_size_actual - (file_size - bytes_written));
+                cout << "Error: File is too large to be handled by the file system. (ext2::file_write_at)\n";
+                written = false;
+                break;
             }
             
-            // Write the contents of the buffer to the file system.
-            vdi->vdiSeek(blockToOffset(blocks_to_write[i]), SEEK_SET);
-            vdi->vdiWrite(input_file_buffer, block_size_actual);
-            
-            // Update the number of bytes written.
-            bytes_written += block_size_actual;
-        }
-        
-        // Deallocate the input file buffer.
-        delete[] input_file_buffer;
-        /***   End write file to disk.   ***/
-        
-        
-        /***   Record indirect blocks.   ***/
-        // @TODO This NEEDS to be its own function, it's too complicated.
-        
-        // Declare and allocate a write buffer.
-        s8 * write_buffer = nullptr;
-        write_buffer = new s8[block_size_actual];
-        if (write_buffer == nullptr)
-        {
-            cout << "Error: Could not allocate write buffer. (ext2::file_write)\n";
-            throw;
-        }
-        
-        // Establish variable to keep track of the block pointers of the various indirect blocks
-        // written.
-        vector<u32> si_blocks_written;
-        vector<u32> di_blocks_written;
-        vector<u32> ti_blocks_written;
-        
-        // Establish a variable to keep track of the indirect block index.
-        u32 indirect_block_index = blocks_to_write.size() - supporting_blocks_needed; 
-        
-        // Check if there is a need to write the singly indirect block.
-        if (blocks_to_write.size() > EXT2_INODE_NBLOCKS_DIR)
-        {
-            // Establish a variable to keep track of the current index of the block pointers in the
-            // blocks_to_write vector to be written into singly indirect blocks.
-            u32 blocks_index = EXT2_INODE_NBLOCKS_DIR;
-            
-            // Determine the total number of singly indirect blocks that will need to be written.
-            u32 num_s_blocks_to_write = ((blocks_to_write.size() - EXT2_INODE_NBLOCKS_DIR) % s_num_block_pointers ?
-                                         (blocks_to_write.size() - EXT2_INODE_NBLOCKS_DIR) / s_num_block_pointers + 1 :
-                                         (blocks_to_write.size() - EXT2_INODE_NBLOCKS_DIR) / s_num_block_pointers);
-            
-            // Write all the singly indirect blocks at once.
-            for (u32 i = 0; i < num_s_blocks_to_write; i++)
-            {
-                // Determine the number of bytes to copy from the blocks_to_write vector.
-                //
-                // This calculation is to determine the number of blocks that will be written, that
-                // is, a full block's worth of block pointers, or just until the end of the
-                // blocks_to_write vector.
-                size_t bytes_to_copy = (blocks_index + s_num_block_pointers < blocks_to_write.size() - supporting_blocks_needed ?
-                                        s_num_block_pointers :
-                                        blocks_to_write.size() - supporting_blocks_needed - blocks_index);
-                // Convert the number of blocks to the number of bytes.
-                bytes_to_copy *= EXT2_BLOCK_POINTER_SIZE;
-                
-                // Copy bytes_to_copy bytes to the write buffer.
-                memcpy(write_buffer,
-                       &(blocks_to_write.data()[blocks_index]),
-                       bytes_to_copy);
-                
-                // Fill the rest of the write buffer with zeroes.
-                if (bytes_to_copy < block_size_actual)
-                {
-                    memset(&(write_buffer[bytes_to_copy]), 0, block_size_actual - bytes_to_copy);
-                }
-                
-                // Seek to and write the block.
-                vdi->vdiSeek(blockToOffset(blocks_to_write[indirect_block_index]), SEEK_SET);
-                vdi->vdiRead(write_buffer, block_size_actual);
-                
-                // Record the singly indirect block written.
-                si_blocks_written.push_back(blocks_to_write[indirect_block_index]);
-                
-                // Increment the indirect block index.
-                indirect_block_index++;
-                
-                // Increment the block index.
-                blocks_index += bytes_to_copy / EXT2_BLOCK_POINTER_SIZE;
+            u64 written_end = position;
+            written = write_range(edit, position, buffer.as<char>(), bytes_read, written_end);
+            if (written_end > inode_size(edit.inode))
+            {
+                set_inode_size(edit.inode, written_end);
             }
-            
-            // Check if we need to write doubly indirect blocks.
-            if (si_blocks_written.size() > 1)
+            if (!written || bytes_read < buffer.size())
             {
-                // Determine the total number of doubly indirect blocks that will need to be
-                // written.
-                u32 num_d_blocks_to_write = ((si_blocks_written.size() - 1) % s_num_block_pointers ?
-                                             (si_blocks_written.size() - 1) / s_num_block_pointers + 1 :
-                                             (si_blocks_written.size() - 1) / s_num_block_pointers);
-                
-                // Write all the doubly indirect blocks at once.
-                for (u32 i = 0; i < num_d_blocks_to_write; i++)
-                {
-                    // Determine the number of bytes to copy from the si_blocks_written vector.
-                    //
-                    // This calculation is to determine the number of blocks that will be written,
-                    // that is, a full block's worth of block pointers, or just until the end of the
-                    // blocks_to_write vector.
-                    size_t bytes_to_copy = (EXT2_INODE_NBLOCKS_DIR + i + s_num_block_pointers < si_blocks_written.size() ?
-                                            s_num_block_pointers :
-                                            si_blocks_written.size() - EXT2_INODE_NBLOCKS_DIR - i);
-                    // Convert the number of blocks to the number of bytes.
-                    bytes_to_copy *= EXT2_BLOCK_POINTER_SIZE;
-                    
-                    // Copy bytes_to_copy bytes to the write buffer.
-                    memcpy(write_buffer,
-                           &(blocks_to_write.data()[EXT2_INODE_NBLOCKS_DIR + i]),
-                           bytes_to_copy);
-                    
-                    // Fill the rest of the write buffer with zeroes.
-                    if (bytes_to_copy < block_size_actual)
-                    {
-                        memset(&(write_buffer[bytes_to_copy]),
-                               0,
-                               block_size_actual - bytes_to_copy);
-                    }
-                    
-                    // Seek to and write the block.
-                    vdi->vdiSeek(blockToOffset(blocks_to_write[indirect_block_index]), SEEK_SET);
-                    vdi->vdiRead(write_buffer, block_size_actual);
-                    
-                    // Record the singly indirect block written.
-                    di_blocks_written.push_back(blocks_to_write[indirect_block_index]);
-                    
-                    // Increment the indirect block index.
-                    indirect_block_index++;
-                }
-                
-                // Check if we need to write triply indirect block. (There will only ever be one
-                // triply indirect block, but the same form is kept as with singly- and doubly-
-                // indirect blocks because reasons.)
-                if (di_blocks_written.size() > 1)
-                {
-                    // Determine the total number of doubly indirect blocks that will need to be
-                    // written.
-                    u32 num_t_blocks_to_write = ((di_blocks_written.size() - 1) % s_num_block_pointers ?
-                                                 (di_blocks_written.size() - 1) / s_num_block_pointers + 1 :
-                                                 (di_blocks_written.size() - 1) / s_num_block_pointers);
-                    
-                    // Write all the triply indirect blocks at once.
-                    for (u32 i = 0; i < num_t_blocks_to_write; i++)
-                    {
-                        // Determine the number of bytes to copy from the sd_blocks_written vector.
-                        //
-                        // This calculation is to determine the number of blocks that will be written,
-                        // that is, a full block's worth of block pointers, or just until the end of the
-                        // blocks_to_write vector.
-                        size_t bytes_to_copy = (EXT2_INODE_NBLOCKS_DIR + i + s_num_block_pointers < di_blocks_written.size() ?
-                                                s_num_block_pointers :
-                                                di_blocks_written.size() - EXT2_INODE_NBLOCKS_DIR - i);
-                        // Convert the number of blocks to the number of bytes.
-                        bytes_to_copy *= EXT2_BLOCK_POINTER_SIZE;
-                        
-                        // Copy bytes_to_copy bytes to the write buffer.
-                        memcpy(write_buffer,
-                               &(blocks_to_write.data()[EXT2_INODE_NBLOCKS_DIR + i]),
-                               bytes_to_copy);
-                        
-                        // Fill the rest of the write buffer with zeroes.
-                        if (bytes_to_copy < block_size_actual)
-                        {
-                            memset(&(write_buffer[bytes_to_copy]),
-                                   0,
-                                   block_size_actual - bytes_to_copy);
-                        }
-                        
-                        // Seek to and write the block.
-                        vdi->vdiSeek(blockToOffset(blocks_to_write[indirect_block_index]), SEEK_SET);
-                        vdi->vdiRead(write_buffer, block_size_actual);
-                        
-                        // Record the singly indirect block written.
-                        ti_blocks_written.push_back(blocks_to_write[indirect_block_index]);
-                        
-                        // Increment the indirect block index.
-                        indirect_block_index++;
-                    }
-                }
+                break;
             }
+            position += bytes_read;
         }
-        /***   End record indirect blocks.   ***/
-        
-        
-        /***   Find free inode.   ***/
-        // Establish a variable to record which inode will be used for the file.
-        u32 inode_to_use = 0;
         
-        // Establish a variable to hold the inode bitmaps for each of the block group descriptors.
-        vector<vector<bool>> block_group_inode_bitmaps;
-        
-        // Establish a vector to keep track of "dirty" block group inode bitmaps that will need to
-        // be written to disk.
-        vector<bool> dirty_block_group_inode_bitmaps;
+        finish_edit(edit);
+        return written;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    file_append
+     * Type:    Function
+     * Purpose: Adds the contents of a host file onto the end of an existing file.  The new blocks
+     *          follow on from the file's last block where there is room.
+     * Input:   int input_fd, holds the host file descriptor to read from.
+     * Input:   const string & path, holds the file to add to, relative to the pwd or absolute.
+     * Output:  bool, true if all of the input was written.
+    ----------------------------------------------------------------------------------------------*/
+    bool ext2::file_append(int input_fd, const string & path)
+    {
+        u32 file_inode = 0;
+        if (!file_path_exists(path, file_inode))
+        {
+            cout << "Error: File does not exist.  (ext2::file_append)\n";
+            return false;
+        }
         
-        // Establish a vector to keep track of how many indoes are being used from each block group.
-        vector<u32> num_inodes_used_per_block_group;
+        return file_write_at(input_fd, path, inode_size(readInode(file_inode)));
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    file_truncate
+     * Type:    Function
+     * Purpose: Changes the size of an existing file.  Growing it just moves its end, leaving a
+     *          hole.  Shrinking it frees every block past the new end, along with any indirect
+     *          block left mapping nothing but freed blocks, and zeroes the rest of the new last
+     *          block.  The freed blocks go back to the free-space index in runs.
+     * Input:   const string & path, holds the file to change, relative to the pwd or absolute.
+     * Input:   u64 new_size, holds the size to give the file.
+     * Output:  bool, true if the file was changed.
+    ----------------------------------------------------------------------------------------------*/
+    bool ext2::file_truncate(const string & path, u64 new_size)
+    {
+        if (new_size > max_file_size)
+        {
+            cout << "Error: File is too large to be handled by the file system. (ext2::file_truncate)\n";
+            return false;
+        }
         
-        // Add enough elements to the vectors to cover the number of block groups.
-        for (u32 i = 0; i < numBlockGroups; i++)
+        inode_edit edit;
+        if (!begin_edit(path, edit))
         {
-            block_group_inode_bitmaps.push_back(vector<bool> (0));
-            dirty_block_group_inode_bitmaps.push_back(0);
-            num_inodes_used_per_block_group.push_back(0);
+            return false;
         }
         
-        // Check if there are any free inodes in the block group where the file's containing
-        // directory has its inode.
-        if (bgdTable[dir_inode_block_group_num].bg_free_inodes_count > 0)
+        if (new_size < inode_size(edit.inode))
         {
-            // Only need to read one inode bitmap into memory.
-            block_group_inode_bitmaps[dir_inode_block_group_num] = read_bitmap(bgdTable[dir_inode_block_group_num].bg_inode_bitmap, superblock.s_inodes_per_group);
+            u64 pointers_per_block = block_size_actual / EXT2_BLOCK_POINTER_SIZE;
+            u64 blocks_kept = (new_size + block_size_actual - 1) / block_size_actual;
+            vector<u32> freed_blocks;
             
-            // Run through the inode bitmap until a free inode is found.  (With a safety guard
-            // against overrunning the bounds of the vector, just in case.)
-            for (u32 i = 0; inode_to_use == 0 && i < superblock.s_inodes_per_group; i++)
+            // Free the direct blocks past the end, then prune each indirect tree.
+            for (u64 i = blocks_kept; i < EXT2_INODE_NBLOCKS_DIR; i++)
             {
-                if (block_group_inode_bitmaps[dir_inode_block_group_num][i] == false)
+                if (edit.inode.i_block[i] != 0)
                 {
-                    // Mark that inode as used.
-                    block_group_inode_bitmaps[dir_inode_block_group_num][i] = true;
-                    
-                    // Mark the bitmap dirty.
-                    dirty_block_group_inode_bitmaps[dir_inode_block_group_num] = true;
-                    
-                    // Increment the number of used blocks in this block group.
-                    num_inodes_used_per_block_group[dir_inode_block_group_num] += 1;
-                    
-                    // Calculate the actual inode number.
-                    inode_to_use = i + 1 + dir_inode_block_group_num * superblock.s_inodes_per_group;
+                    freed_blocks.push_back(edit.inode.i_block[i]);
+                    edit.inode.i_block[i] = 0;
                 }
             }
-        }
-        else
-        {
-            // Read all the inode bitmaps into memory.
-            for (u32 i = 0; i < numBlockGroups; i++)
+            u64 level_start = EXT2_INODE_NBLOCKS_DIR;
+            for (u32 depth = 1; depth <= 3; depth++)
             {
-                block_group_inode_bitmaps[i] = read_bitmap(bgdTable[i].bg_inode_bitmap, superblock.s_inodes_per_group);
+                truncate_indirect(edit, edit.inode.i_block[EXT2_INODE_BLOCK_S_IND + depth - 1], depth, level_start, blocks_kept, freed_blocks);
+                u64 level_span = 1;
+                for (u32 i = 0; i < depth; i++)
+                {
+                    level_span *= pointers_per_block;
+                }
+                level_start += level_span;
             }
+            edit.inode.i_blocks -= freed_blocks.size() * (block_size_actual / EXT2_INODE_IBLOCKS_SIZE);
             
-            // Run through the block groups until a free inode is found.  (With a safety guard
-            // against overrunning the bounds of the vector, just in case.)
-            for (u32 i = 0; inode_to_use == 0 && i < numBlockGroups; i++)
+            // The part of the new last block past the end must read back as zeroes if the file
+            // grows again.
+            if (new_size % block_size_actual != 0)
             {
-                // Run through the block groups until a free inode is found.  (With a safety guard
-                // against overrunning the bounds of the vector, just in case.)
-                for (u32 j = 0; inode_to_use == 0 && j < superblock.s_inodes_per_group; j++)
-                {
-                    if (block_group_inode_bitmaps[i][j] == false)
-                    {
-                        // Mark that inode as used.
-                        block_group_inode_bitmaps[i][j] = true;
-                        
-                        // Mark the bitmap dirty.
-                        dirty_block_group_inode_bitmaps[i] = true;
-                        
-                        // Increment the number of used blocks in this block group.
-                        num_inodes_used_per_block_group[i] += 1;
-                        
-                        // Calculate the actual inode number.
-                        inode_to_use = j + 1 + i * superblock.s_inodes_per_group;
-                    }
-                }
+                zero_block_tail(edit, new_size);
             }
             
+            sort(freed_blocks.begin(), freed_blocks.end());
+            load_free_space_index();
+            release_blocks(freed_blocks);
+            discharge_blocks(freed_blocks.data(), freed_blocks.size());
         }
-        /***   End find free inode.   ***/
-        
-        
-        /***   Build inode entry.   ***/
-        // Create the ext2_inode structure.
-        ext2_inode file_inode;
-        
-        // Zero the entire inode structure since everything is in an indeterminate state initially.
-        memset(&file_inode, 0, sizeof(ext2_inode));
-        
-        // Set the inode type to be "regular file", and then set permissions to 600.
-        file_inode.i_mode = EXT2_INODE_TYPE_FILE & EXT2_INODE_PERM_USER_READ & EXT2_INODE_PERM_USER_WRITE;
-        
-        // Set the user and group to root (user/group 1000)
-        file_inode.i_uid = EXT2_INODE_DEFAULT_UID;
-        file_inode.i_gid = EXT2_INODE_DEFAULT_GID;
-        
-        // Set the size.
-        file_inode.i_size = file_size;
-        
-        // Get the current Unix epoch time.
-        // NOTE: This is not portable.
-        // @TODO Create a utility function to take localtime(time(nullptr)) and make it into Unix
-        //       epoch time to enable portability.
-        time_t current_time = time(nullptr);
-        
-        // Set the hard link count.  It will be one since this is just a file.
-        file_inode.i_links_count = 1;
-        
-        // Set the number of 512-byte blocks used to store this file and its data.
-        file_inode.i_blocks = total_num_blocks_needed * (block_size_actual / EXT2_INODE_IBLOCKS_SIZE);
-        
-        // The total number of blocks needed may be off if the directory block pointing to the file
-        // has insufficient space left to store the ext2_dir_entry structure referencing this file.
-        // This calculation compensates for that.
-        file_inode.i_blocks -= (additional_dir_block_needed == true ? block_size_actual / EXT2_INODE_IBLOCKS_SIZE : 0);
-        
-        // Set the access/creation/modification times.
-        file_inode.i_atime = current_time;
-        file_inode.i_ctime = current_time;
-        file_inode.i_mtime = current_time;
         
-        // Set the direct block pointers.
-        for (u8 i = 0; i < EXT2_INODE_NBLOCKS_DIR && i < blocks_to_write.size(); i++)
+        set_inode_size(edit.inode, new_size);
+        finish_edit(edit);
+        return true;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    begin_edit
+     * Type:    Function
+     * Purpose: Starts an in-place change to an existing regular file.
+     * Input:   const string & path, holds the file, relative to the pwd or absolute.
+     * Output:  <reference> inode_edit & edit, will hold the file's inode, ready to be changed.
+     * Output:  bool, true if the file system can be written, and the file exists and is a regular
+     *          file.
+    ----------------------------------------------------------------------------------------------*/
+    bool ext2::begin_edit(const string & path, inode_edit & edit)
+    {
+        if (read_only)
         {
-            file_inode.i_block[i] = blocks_to_write[i];
+            cout << "Error: The file system is open read-only.  (ext2::begin_edit)\n";
+            return false;
         }
         
-        // Set the singly indirect block pointer if necessary.
-        if (si_blocks_written.size() > 0)
+        if (!file_path_exists(path, edit.inode_num))
         {
-            file_inode.i_block[EXT2_INODE_BLOCK_S_IND] = si_blocks_written.front();
+            cout << "Error: File does not exist.  (ext2::begin_edit)\n";
+            return false;
         }
         
-        // Set the doubly indirect block pointer if necessary.
-        if (di_blocks_written.size() > 0)
+        edit.inode = readInode(edit.inode_num);
+        if ((edit.inode.i_mode & 0xF000) != EXT2_INODE_TYPE_FILE)
         {
-            file_inode.i_block[EXT2_INODE_BLOCK_D_IND] = di_blocks_written.front();
+            cout << "Error: Only regular files can be changed.  (ext2::begin_edit)\n";
+            return false;
         }
-        
-        //Set the triply indirect block pointer if necessary.
-        if (ti_blocks_written.size() > 0)
+        if (uses_extents(edit.inode))
         {
-            file_inode.i_block[EXT2_INODE_BLOCK_T_IND] = ti_blocks_written.front();
+            cout << "Error: Files mapped by extents can only be read.  (ext2::begin_edit)\n";
+            return false;
         }
-        /***   End build inode entry.   ***/
-        
-        
-        /***   Write inode entry to disk.   ***/
-        // Seek to the appropriate offset and write the inode to disk.
-        vdi->vdiSeek(inodeToOffset(inode_to_use), SEEK_SET);
-        vdi->vdiWrite(&file_inode, superblock.s_inode_size);
-        /***   End write inode entry to disk.   ***/
-        
         
-        /***   Build and add directory entry to directory block.   ***/
-        // This is going to be a bitch as there are two very different scenarios that could be
-        // played out:
-        //   1) There's enough space left in the block and the ext2_dir_entry just needs to be
-        //      added.  This means that we would have to alter the currently last ext2_dir_entry's
-        //      rec_len field accordingly, then add the ext2_dir_entry structure for this file.
-        //   2) There's not enough space left in the block and the ext2_dir_entry needs to go into a
-        //      new block.  This means the directory inode would need to have its size increased and
-        //      the new block would have to be added to the i_block array.  The ext2_dir_entry for
-        //      this file will still need to be added to its block, of course.
-        
-        // Create a directory entry.
-        ext2_dir_entry file_dir_entry = make_dir_entry(inode_to_use,
-                                                       filename_to_write,
-                                                       EXT2_DIR_TYPE_FILE);
-        
-        // Read the directory inode for the directory that the file will reside in.
-        ext2_inode dir_inode = readInode(dir_inode_num);
-        
-        // Determine the last directory block.
-        u32 dir_block_num = 0;
-        for (u32 i = EXT2_INODE_NBLOCKS_DIR - 1; i >= 0 && dir_block_num == 0; i--)
+        edit.goal = group_data_start(inodeToBlockGroup(edit.inode_num));
+        return true;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    finish_edit
+     * Type:    Function
+     * Purpose: Completes an in-place change: writes the indirect blocks that changed, accounts
+     *          for the blocks used, gives back the ones allocated but not used, and updates the
+     *          inode in the metadata cache.
+     * Input:   inode_edit & edit, holds the change.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    void ext2::finish_edit(inode_edit & edit)
+    {
+        for (map<u32, edited_block>::iterator i = edit.indirect.begin(); i != edit.indirect.end(); ++i)
         {
-            if (dir_inode.i_block[i] != 0)
+            if (i->second.dirty)
             {
-                dir_block_num = dir_inode.i_block[i];
+                vdi->vdiSeek(blockToOffset(i->first), SEEK_SET);
+                vdi->vdiWrite(i->second.pointers.data(), block_size_actual);
             }
         }
         
-        // Check if an additional directory block is needed.
-        if(additional_dir_block_needed == false)
-        {
-            // No additional directory blocks are needed.
-            
-            // Adjust the record length of the file's directory entry so it goes to the end of the
-            // directory block.
-            file_dir_entry.rec_len = dir_block_space_left;
-            
-            // Seek to the modified rec_len of the current last directory entry on disk.
-            vdi->vdiSeek(blockToOffset(dir_block_num) + 
-                             block_size_actual - 
-                             directory_entries.back().rec_len + 
-                             sizeof(directory_entries.back().inode),
-                         SEEK_SET);
-            
-            // Reduce the record length of the current last entry in the direcory block to contain
-            // just itself, and align it to a 4-byte boundary.
-            directory_entries.back().rec_len = utility::nearest_mult_four(EXT2_DIR_BASE_SIZE + directory_entries.back().name_len);
-            
-            // Write the modified rec_len field.
-            vdi->vdiWrite(&(directory_entries.back().rec_len), sizeof(directory_entries.back().rec_len));
-            
-            // Seek to and write the main part of the new directory entry to disk.
-            vdi->vdiSeek(directory_entries.back().rec_len -
-                             sizeof(directory_entries.back().inode) -
-                             sizeof(directory_entries.back().rec_len),
-                         SEEK_CUR);
-            vdi->vdiWrite(&file_dir_entry, EXT2_DIR_BASE_SIZE);
-            
-            // Write the C-string representation of the file name to disk.
-            vdi->vdiWrite(file_dir_entry.name.c_str(), file_dir_entry.name_len);
-        }
-        else
-        {
-            // Additional directory block is needed.
-            
-            // Adjust the record length of the file's directory entry so it goes to the end of the
-            // directory block.
-            file_dir_entry.rec_len = block_size_actual;
-            
-            // Zero out the write buffer to ensure any garbage left behind is gone.
-            memset(write_buffer, 0, block_size_actual);
-            
-            // Copy over the main part of the directory entry into the buffer.
-            memcpy(write_buffer, &file_dir_entry, EXT2_DIR_BASE_SIZE);
-            
-            // Copy over the C-string representation of the name into the buffer.
-            memcpy(&(write_buffer[EXT2_DIR_BASE_SIZE]), file_dir_entry.name.c_str(), file_dir_entry.name_len);
-            
-            // Seek to and write the directory block.  This should be the last entry in the
-            // blocks_to_write vector.
-            vdi->vdiSeek(blockToOffset(blocks_to_write.back()), SEEK_SET);
-            vdi->vdiWrite(write_buffer, block_size_actual);
-            
-            // Update the inode size field to account for the additional directory block.
-            dir_inode.i_size += block_size_actual;
-            
-            // Update the inode blocks count.
-            dir_inode.i_blocks += block_size_actual / EXT2_INODE_IBLOCKS_SIZE;
-            
-            // Add the new directory block to the i_block array.  This should be the final entry in
-            // the blocks_to_write vector.
-            dir_inode.i_block[dir_block_num + 1] = blocks_to_write.back();
-            
-        }
-        
-        // TODO Update inode access and modification times.
-        dir_inode.i_atime = current_time;
-        dir_inode.i_mtime = current_time;
-        
-        // TODO Write the updated inode back to the inode table.
-        vdi->vdiSeek(inodeToOffset(dir_inode_num), SEEK_SET);
-        vdi->vdiWrite(&dir_inode, superblock.s_inode_size);
-        /***   End build and add directory entry to directory block.   ***/
+        charge_blocks(edit.pool.data(), edit.pool_used);
+        release_blocks(vector<u32>(edit.pool.begin() + edit.pool_used, edit.pool.end()));
         
+        time_t current_time = time(nullptr);
+        edit.inode.i_mtime = current_time;
+        edit.inode.i_ctime = current_time;
+        write_inode(edit.inode, edit.inode_num);
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    write_range
+     * Type:    Function
+     * Purpose: Writes data into a file being changed in place, mapping blocks for it as needed,
+     *          one run of consecutive blocks at a time.
+     * Input:   inode_edit & edit, holds the change.
+     * Input:   u64 offset, holds the offset in the file to write at.
+     * Input:   const char * data, holds the data.
+     * Input:   size_t length, holds the number of bytes to write.
+     * Output:  <reference> u64 & written_end, will hold the offset just past the data written.
+     * Output:  bool, true if it was all written.
+    ----------------------------------------------------------------------------------------------*/
+    bool ext2::write_range(inode_edit & edit, u64 offset, const char * data, size_t length, u64 & written_end)
+    {
+        u32 first_block = offset / block_size_actual;
+        u32 num_blocks = (offset + length + block_size_actual - 1) / block_size_actual - first_block;
+        size_t head = offset % block_size_actual;
+        vector<u8> blocks((size_t)num_blocks * block_size_actual, 0);
         
-        /***   Modify block group descriptor block bitmaps on disk.   ***/
-        // Use this loop to check for dirty flags on the block group block bitmaps.
-        for (u32 i = 0; i < numBlockGroups; i++)
+        // Partial blocks at either end keep the rest of what they hold.
+        if (head != 0)
         {
-            // Check for dirty flags indicating that a block bitmap needs to be written to disk.
-            if (dirty_block_group_block_bitmaps[i] == true)
+            u32 physical_block = edit_map_block(edit, first_block, false);
+            if (physical_block != 0)
             {
-                // Write the bitmap to disk.
-                write_bitmap(block_group_block_bitmaps[i], bgdTable[i].bg_block_bitmap);
+                vdi->vdiPread(blocks.data(), block_size_actual, blockToOffset(physical_block));
             }
         }
-        /***   End modify block group descriptor block bitmaps on disk.   ***/
-        
-        
-        /***   Modify block group descriptor inode bitmap on disk.   ***/
-        // Use this loop to check for dirty flags on the block group inode bitmaps.
-        for (u32 i = 0; i < numBlockGroups; i++)
+        if ((offset + length) % block_size_actual != 0 && (num_blocks > 1 || head == 0))
         {
-            // Check for dirty flags indicating that an inode bitmap needs to be written to disk.
-            if (dirty_block_group_inode_bitmaps[i] == true)
+            u32 physical_block = edit_map_block(edit, first_block + num_blocks - 1, false);
+            if (physical_block != 0)
             {
-                // Write the bitmap to disk.
-                write_bitmap(block_group_inode_bitmaps[i], bgdTable[i].bg_inode_bitmap);
+                vdi->vdiPread(&(blocks[(size_t)(num_blocks - 1) * block_size_actual]), block_size_actual, blockToOffset(physical_block));
             }
         }
-        /***   End modify block group descriptor inode bitmap on disk.   ***/
-        
+        memcpy(&(blocks[head]), data, length);
         
-        /***   Modify block group descriptor table in memory.   ***/
-        // All this requires is an update to the number of free blocks and inodes.
-        for (u32 i = 0; i < numBlockGroups; i++)
+        // Map the blocks, allocating where there are none and the data is not all zeroes.
+        vector<u32> physical_blocks(num_blocks, 0);
+        edit.blocks_wanted = num_blocks;
+        for (u32 i = 0; i < num_blocks; i++)
         {
-            bgdTable[i].bg_free_blocks_count -= num_blocks_used_per_block_group[i];
-            bgdTable[i].bg_free_inodes_count -= num_inodes_used_per_block_group[i];
+            physical_blocks[i] = edit_map_block(edit, first_block + i, false);
+            if (physical_blocks[i] == 0 &&
+                !utility::is_zero_filled(&(blocks[(size_t)i * block_size_actual]), block_size_actual))
+            {
+                physical_blocks[i] = edit_map_block(edit, first_block + i, true);
+                if (physical_blocks[i] == 0)
+                {
+                    cout << "Error: Not enough free blocks available on the file system.\n";
+                    num_blocks = i;
+                    break;
+                }
+            }
         }
-        /***   End modify block group descriptor table in memory.   ***/
-        
         
-        /***   Modify block group descriptor table on disk.   ***/
-        // Run through the block group descriptor table.
-        for (u32 i = 0; i < numBlockGroups; i++)
+        // Write the blocks, one run of consecutive blocks at a time.
+        for (u32 i = 0; i < num_blocks;)
         {
-            // Check each block group descriptor to see if they had any dirty bitmaps.
-            if (dirty_block_group_block_bitmaps[i] == true || dirty_block_group_inode_bitmaps[i] == true)
+            if (physical_blocks[i] == 0)
+            {
+                i++;
+                continue;
+            }
+            
+            u32 run_length = 1;
+            while (i + run_length < num_blocks && physical_blocks[i + run_length] == physical_blocks[i] + run_length)
             {
-                // If they did, the number of blocks and/or the number of inodes that are free have
-                // has changed, so write the changed ext2_block_group_desc structure to disk.
-                vdi->vdiSeek(bgd_table_start + i * sizeof(ext2_block_group_desc), SEEK_SET);
-                vdi->vdiWrite(&(bgdTable[i]), sizeof(ext2_block_group_desc));
+                run_length++;
             }
+            
+            vdi->vdiSeek(blockToOffset(physical_blocks[i]), SEEK_SET);
+            vdi->vdiWrite(&(blocks[(size_t)i * block_size_actual]), (size_t)run_length * block_size_actual);
+            i += run_length;
         }
-        /***   End modify block group descriptor table on disk.   ***/
-        
-        
-        /***   Modify superblock in memory.   ***/
-        // Reset the superblock free blocks and inodes count.
-        superblock.s_free_blocks_count = 0;
-        superblock.s_free_inodes_count = 0;
         
-        // Run through the block group descriptor table and total up the number of free blocks and
-        // inodes.
-        for (u32 i = 0; i < numBlockGroups; i++)
+        if (num_blocks < physical_blocks.size())
         {
-            superblock.s_free_blocks_count += bgdTable[i].bg_free_blocks_count;
-            superblock.s_free_inodes_count += bgdTable[i].bg_free_inodes_count;
+            written_end = (num_blocks == 0 ? offset : (u64)(first_block + num_blocks) * block_size_actual);
+            return false;
         }
-        
-        // Modify the last write time (in Unix epoch time).
-        superblock.s_wtime = current_time;
-        /***   End modify superblock in memory.   ***/
-        
-        
-        /***   Modify superblock on disk.   ***/
-        // Write the superblock to disk.
-        vdi->vdiSeek(superblock_start, SEEK_SET);
-        vdi->vdiWrite(&superblock, sizeof(ext2_superblock));
-        /***   End modify superblock on disk.   ***/
-        
-        
-        // Deallocate the write buffer.
-        delete[] write_buffer;
-        
-        /* It's dangerous to go alone! Take this.
-        //
-        //                   /\
-        //                  |  |
-        //                  |  |
-        //                  |  |
-        //                  |  |
-        //                  |  |
-        //                  |  |
-        //                 _|__|_
-        //                |######|
-        //                ``|##|``
-        //                  |##|
-        //                  ````
-        */
-        
-        // Return.
+        written_end = offset + length;
         return true;
     }
-
-
+    
+    
     /*----------------------------------------------------------------------------------------------
-     * Name:    offsetToBlock
+     * Name:    zero_block_tail
      * Type:    Function
-     * Purpose: ...
-     * Input:   off_t offset, containing ...
-     * Output:  u32....
+     * Purpose: Zeroes a file's block from a given offset to the end of the block, if the block
+     *          exists.
+     * Input:   inode_edit & edit, holds the change.
+     * Input:   u64 offset, holds the offset in the file to zero from.
+     * Output:  Nothing.
     ----------------------------------------------------------------------------------------------*/
-    // Needed?
-    u32 ext2::offsetToBlock(off_t offset)
+    void ext2::zero_block_tail(inode_edit & edit, u64 offset)
     {
-        return (offset - bootSector.partitionTable[0].firstSector * VDI_SECTOR_SIZE) / 
-               (EXT2_BLOCK_BASE_SIZE << superblock.s_log_block_size);
+        u32 physical_block = edit_map_block(edit, offset / block_size_actual, false);
+        if (physical_block == 0)
+        {
+            return;
+        }
+        
+        vector<u8> block(block_size_actual);
+        vdi->vdiPread(block.data(), block_size_actual, blockToOffset(physical_block));
+        memset(&(block[offset % block_size_actual]), 0, block_size_actual - offset % block_size_actual);
+        vdi->vdiSeek(blockToOffset(physical_block), SEEK_SET);
+        vdi->vdiWrite(block.data(), block_size_actual);
     }
     
     
     /*----------------------------------------------------------------------------------------------
-     * Name:    inodeToBlockGroup
+     * Name:    edit_map_block
      * Type:    Function
-     * Purpose: Determine which block group an inode is a part of.
-     * Input:   u32 inode_number, containing the inode number to check.
-     * Output:  u32, containing the block group number the inode is a part of.
+     * Purpose: Maps a logical block of a file being changed in place to its physical block,
+     *          seeing the changes made so far.  If asked to, a block the file does not have yet is
+     *          allocated, along with any indirect blocks missing on the way down to it.
+     * Input:   inode_edit & edit, holds the change.
+     * Input:   u32 logical_block, holds the logical block.
+     * Input:   bool allocate, holds whether to allocate the block if it does not exist.
+     * Output:  u32, the physical block, or 0 if there is none (or none could be allocated).
     ----------------------------------------------------------------------------------------------*/
-    u32 ext2::inodeToBlockGroup(u32 inode_number)
+    u32 ext2::edit_map_block(inode_edit & edit, u32 logical_block, bool allocate)
     {
-        return (inode_number - 1) / superblock.s_inodes_per_group;
+        u64 pointers_per_block = block_size_actual / EXT2_BLOCK_POINTER_SIZE;
+        u64 pointers_squared = pointers_per_block * pointers_per_block;
+        u64 index = logical_block;
+        u32 root = logical_block;
+        u32 depth = 0;
+        u32 slots[3] = {0};
+        
+        // Work out which root pointer leads to the block, and which slot to follow at each level
+        // of indirection below it.
+        if (index >= EXT2_INODE_NBLOCKS_DIR)
+        {
+            index -= EXT2_INODE_NBLOCKS_DIR;
+            if (index < pointers_per_block)
+            {
+                root = EXT2_INODE_BLOCK_S_IND;
+                depth = 1;
+                slots[0] = index;
+            }
+            else if ((index -= pointers_per_block) < pointers_squared)
+            {
+                root = EXT2_INODE_BLOCK_D_IND;
+                depth = 2;
+                slots[0] = index / pointers_per_block;
+                slots[1] = index % pointers_per_block;
+            }
+            else if ((index -= pointers_squared) < pointers_squared * pointers_per_block)
+            {
+                root = EXT2_INODE_BLOCK_T_IND;
+                depth = 3;
+                slots[0] = index / pointers_squared;
+                slots[1] = (index / pointers_per_block) % pointers_per_block;
+                slots[2] = index % pointers_per_block;
+            }
+            else
+            {
+                return 0;
+            }
+        }
+        
+        // Walk down the tree, creating the indirect blocks that are missing if allowed to.
+        u32 * pointer = &(edit.inode.i_block[root]);
+        edited_block * parent = nullptr;
+        for (u32 i = 0; i < depth; i++)
+        {
+            if (*pointer == 0)
+            {
+                u32 new_block = (allocate ? edit_take_block(edit) : 0);
+                if (new_block == 0)
+                {
+                    return 0;
+                }
+                edited_block & node = edit.indirect[new_block];
+                node.pointers.assign(pointers_per_block, 0);
+                node.dirty = true;
+                *pointer = new_block;
+                if (parent != nullptr)
+                {
+                    parent->dirty = true;
+                }
+            }
+            parent = &(edit_indirect_block(edit, *pointer));
+            pointer = &(parent->pointers[slots[i]]);
+        }
+        
+        // Map the block itself if it needs to be.
+        if (*pointer == 0 && allocate)
+        {
+            *pointer = edit_take_block(edit);
+            if (parent != nullptr)
+            {
+                parent->dirty = true;
+            }
+        }
+        return *pointer;
     }
     
+    
     /*----------------------------------------------------------------------------------------------
-     * Name:    inodeBlockGroupIndex
+     * Name:    edit_indirect_block
      * Type:    Function
-     * Purpose: Determines the index of an inode within a block group.
-     * Input:   u32 inode_number, containing the inode number to check.
-     * Output:  u32, containing the index number of an inode within a block group.
+     * Purpose: Returns the pointers in an indirect block of a file being changed in place,
+     *          reading the block in the first time it is needed.
+     * Input:   inode_edit & edit, holds the change.
+     * Input:   u32 block_num, holds the indirect block.
+     * Output:  edited_block &, the block's pointers.  It stays valid until the edit is finished.
     ----------------------------------------------------------------------------------------------*/
-    u32 ext2::inodeBlockGroupIndex(u32 inode_number)
+    ext2::edited_block & ext2::edit_indirect_block(inode_edit & edit, u32 block_num)
     {
-        return (inode_number - 1) % superblock.s_inodes_per_group;
-    }
-    
-    /*----------------------------------------------------------------------------------------------
-     * Name:    blockToOffset
-     * Type:    Function
-     * Purpose: ...
-     * Input:   u32 block_number, containing ...
-     * Output:  off_t....
-    ----------------------------------------------------------------------------------------------*/
-    off_t ext2::blockToOffset(u32 block_number)
-    {
-        return block_number < superblock.s_blocks_count ?
-               bootSector.partitionTable[0].firstSector * VDI_SECTOR_SIZE + 
-                  block_number * (EXT2_BLOCK_BASE_SIZE << superblock.s_log_block_size) :
-               -1;
+        edited_block & node = edit.indirect[block_num];
+        if (node.pointers.empty())
+        {
+            node.pointers.resize(block_size_actual / EXT2_BLOCK_POINTER_SIZE);
+            vdi->vdiPread(node.pointers.data(), block_size_actual, blockToOffset(block_num));
+        }
+        return node;
     }
     
     
     /*----------------------------------------------------------------------------------------------
-     * Name:    inodeToOffset
+     * Name:    edit_take_block
      * Type:    Function
-     * Purpose: Calculates the offset of an inode on the disk.
-     * Input:   u32 inode_num, containing the inode number to calculate the offset for.
-     * Output:  off_t, holding the offset of the inode on the disk.
+     * Purpose: Takes a new block for a file being changed in place.  Blocks are allocated as many
+     *          at a time as the current write still needs, as close as possible to the last one
+     *          taken, with the file's preallocation behind them so it can keep growing in place.
+     * Input:   inode_edit & edit, holds the change.
+     * Output:  u32, the block, or 0 if the file system is full.
     ----------------------------------------------------------------------------------------------*/
-    off_t ext2::inodeToOffset(u32 inode_num)
+    u32 ext2::edit_take_block(inode_edit & edit)
     {
-        u32 inode_block_group = inodeToBlockGroup(inode_num);
-        u32 inode_index = inodeBlockGroupIndex(inode_num);
+        if (edit.pool_used == edit.pool.size() &&
+            !allocate_blocks(edit.goal,
+                             (edit.blocks_wanted > 0 ? edit.blocks_wanted : 1),
+                             superblock.s_prealloc_blocks,
+                             edit.pool,
+                             &(reservations[edit.inode_num])))
+        {
+            return 0;
+        }
         
-        // Calculate and return.
-        return blockToOffset(bgdTable[inode_block_group].bg_inode_table) +
-               inode_index * superblock.s_inode_size;
-    }
-    
-    
-    /*----------------------------------------------------------------------------------------------
-     * Name:    print_inode
-     * Type:    Function
-     * Purpose: Prints inode information.
-     * Input:   ext2_inode* inode, containing pointer to an inode object.
-     * Output:  Nothing.
-    ----------------------------------------------------------------------------------------------*/
-    void ext2::print_inode(ext2_inode* inode)
-    {
-        cout << "\nInode contents:\n";
-        cout << "Type: " <<
-            (((inode->i_mode >> 12) << 12) == EXT2_INODE_TYPE_FIFO ? "FIFO\n" : "") <<
-            (((inode->i_mode >> 12) << 12) == EXT2_INODE_TYPE_CHARDEV ? "Character device\n" : "") <<
-            (((inode->i_mode >> 12) << 12) == EXT2_INODE_TYPE_DIR ? "Directory\n" : "") <<
-            (((inode->i_mode >> 12) << 12) == EXT2_INODE_TYPE_BLOCKDEV ? "Block device \n" : "") <<
-            (((inode->i_mode >> 12) << 12) == EXT2_INODE_TYPE_FILE ? "Regular file\n" : "") <<
-            (((inode->i_mode >> 12) << 12) == EXT2_INODE_TYPE_SYMLINK ? "Symbolic link\n" : "") <<
-            (((inode->i_mode >> 12) << 12) == EXT2_INODE_TYPE_SOCKET ? "Unix socket\n" : "");
-        cout << "Permissions:\n" << 
-            (inode->i_mode & EXT2_INODE_PERM_OTHER_EXECUTE ? "  other execute\n" : "") <<
-            (inode->i_mode & EXT2_INODE_PERM_OTHER_WRITE ? "  other write\n" : "") <<
-            (inode->i_mode & EXT2_INODE_PERM_OTHER_READ ? "  other read\n" : "") <<
-            (inode->i_mode & EXT2_INODE_PERM_GROUP_EXECUTE ? "  group execute\n" : "") <<
-            (inode->i_mode & EXT2_INODE_PERM_GROUP_WRITE ? "  group write\n" : "") <<
-            (inode->i_mode & EXT2_INODE_PERM_GROUP_READ ? "  group read\n" : "") <<
-            (inode->i_mode & EXT2_INODE_PERM_USER_EXECUTE ? "  user execute\n" : "") <<
-            (inode->i_mode & EXT2_INODE_PERM_USER_WRITE ? "  user write\n" : "") <<
-            (inode->i_mode & EXT2_INODE_PERM_USER_READ ? "  user read\n" : "") <<
-            (inode->i_mode & EXT2_INODE_PERM_STICKYBIT ? "  sticky bit\n" : "") <<
-            (inode->i_mode & EXT2_INODE_PERM_SETGID ? "  set group id\n" : "") <<
-            (inode->i_mode & EXT2_INODE_PERM_SETUID ? "  set user id\n" : "");
-        cout << "User ID: " << inode->i_uid << endl;
-        cout << "Lower 32 bits of size in bytes: " << inode->i_size << endl;
-        cout << "Last access time: " << inode->i_atime << endl;
-        cout << "Creation time: " << inode->i_ctime << endl;
-        cout << "Last modification time: " << inode->i_mtime << endl;
-        cout << "Deletion time: " << inode->i_dtime << endl;
-        cout << "Group ID: " << inode->i_gid << endl;
-        cout << "Hard link count: " << inode->i_links_count << endl;
-        cout << "Disk sectors used count: " << inode->i_blocks << endl;
-        cout << "Flags:\n" <<
-            (inode->i_flags & EXT2_INODE_FLAGS_SECURE_DELETE ? "  secure delete\n" : "") <<
-            (inode->i_flags & EXT2_INODE_FLAGS_KEEP_COPY_ON_DELETE ? "  keep copy on delete\n" : "") <<
-            (inode->i_flags & EXT2_INODE_FLAGS_FILE_COMPRESSION ? "  file compression\n" : "") <<
-            (inode->i_flags & EXT2_INODE_FLAGS_SYNC_UPDATES ? "  synchronous updates\n" : "") <<
-            (inode->i_flags & EXT2_INODE_FLAGS_IMMUTABLE ? "  immutable file\n" : "") <<
-            (inode->i_flags & EXT2_INODE_FLAGS_APPEND ? "  append only\n" : "") <<
-            (inode->i_flags & EXT2_INODE_FLAGS_DO_NOT_DUMP ? "  file not included in 'dump' commend\n" : "") <<
-            (inode->i_flags & EXT2_INODE_FLAGS_LAST_ACCESS_NO_UPDATE ? "  last access time not updated\n" : "") <<
-            (inode->i_flags & EXT2_INODE_FLAGS_HASH_INDEX_DIR ? "  hash indexed directory\n" : "") <<
-            (inode->i_flags & EXT2_INODE_FLAGS_AFS_DIR ? "  AFS directory\n" : "") <<
-            (inode->i_flags & EXT2_INODE_FLAGS_JOURNAL_FILE_DATA ? "  journal file data\n" : "");
-        for (u32 i = 0; i < EXT2_INODE_NBLOCKS_TOT; i++)
-            cout << "Block pointer " << i << ": " << inode->i_block[i] << endl;
-        cout << "File version: " << inode->i_generation << endl;
-        cout << "File ACL: " << inode->i_file_acl << endl;
-        cout << "Directory ACL: " << inode->i_dir_acl << endl;
-        cout << "Fragment address: " << inode->i_faddr << endl;
+        u32 block_num = edit.pool[edit.pool_used++];
+        edit.goal = block_num + 1;
+        edit.inode.i_blocks += block_size_actual / EXT2_INODE_IBLOCKS_SIZE;
+        if (edit.blocks_wanted > 0)
+        {
+            edit.blocks_wanted--;
+        }
+        return block_num;
     }
     
     
     /*----------------------------------------------------------------------------------------------
-     * Name:    print_dir_entry
+     * Name:    truncate_indirect
      * Type:    Function
-     * Purpose: Prints directory information.
-     * Input:   ext2_dir_entry & dir_entry, containing pointer to a directory object.
+     * Purpose: Frees the part of an indirect tree that maps blocks past a file's new end.  A tree
+     *          lying wholly past the end is freed whole, indirect block included.
+     * Input:   inode_edit & edit, holds the change.
+     * Input:   u32 & pointer, holds the pointer to the indirect block, cleared if it is freed.
+     * Input:   u32 depth, holds the levels of indirection (1 for a singly indirect block).
+     * Input:   u64 first_block, holds the first logical block the tree maps.
+     * Input:   u64 blocks_kept, holds the number of logical blocks the file keeps.
+     * Output:  <reference> vector<u32> & freed_blocks, has the freed blocks added to it.
      * Output:  Nothing.
     ----------------------------------------------------------------------------------------------*/
-    void ext2::print_dir_entry(ext2_dir_entry & dir_entry, bool verbose)
+    void ext2::truncate_indirect(inode_edit & edit, u32 & pointer, u32 depth, u64 first_block, u64 blocks_kept, vector<u32> & freed_blocks)
     {
-        if (verbose)
+        if (pointer == 0)
         {
-            cout << "\nDirectory Entry:\n";
-            cout << "Inode number: " << dir_entry.inode << endl;
-            cout << "Directory record length: " << dir_entry.rec_len << endl;
-            cout << "Name length: " << (int)(dir_entry.name_len) << endl;
-            cout << "Directory entry type: " <<
-                (dir_entry.file_type == EXT2_DIR_TYPE_UNKNOWN ? "unknown\n" : "") <<
-                (dir_entry.file_type == EXT2_DIR_TYPE_FILE ? "regular file\n" : "") <<
-                (dir_entry.file_type == EXT2_DIR_TYPE_DIR ? "directory\n" : "") <<
-                (dir_entry.file_type == EXT2_DIR_TYPE_CHARDEV ? "character device\n" : "") <<
-                (dir_entry.file_type == EXT2_DIR_TYPE_BLOCKDEV ? "block device\n" : "") <<
-                (dir_entry.file_type == EXT2_DIR_TYPE_FIFO ? "FIFO\n" : "") <<
-                (dir_entry.file_type == EXT2_DIR_TYPE_SOCKET ? "socket\n" : "") <<
-                (dir_entry.file_type == EXT2_DIR_TYPE_SYMLINK ? "symbolic link\n" : "");
-            cout << "Name: ";
+            return;
         }
         
-        cout << dir_entry.name << endl;
-    }
-    
-    
-    /*----------------------------------------------------------------------------------------------
-     * Name:    print_superblock
-     * Type:    Function
-     * Purpose: Prints superblock information.
-     * Input:   Nothing.
-     * Output:  Nothing.
-    ----------------------------------------------------------------------------------------------*/
-    void ext2::print_superblock()
-    {
-        cout << "\nSuperblock Dump:\n";
-        cout << "Inodes count: " << superblock.s_inodes_count << endl;
-        cout << "Blocks count: " << superblock.s_blocks_count << endl;
-        cout << "Reserved blocks count: " << superblock.s_r_blocks_count << endl;
-        cout << "Free blocks count: " << superblock.s_free_blocks_count << endl;
-        cout << "Free inodes count: " << superblock.s_free_inodes_count << endl;
-        cout << "First data block: " << superblock.s_first_data_block << endl;
-        cout << "Block size: " << (EXT2_BLOCK_BASE_SIZE << superblock.s_log_block_size) << endl;
-        cout << "Fragment size: " << (EXT2_FRAG_BASE_SIZE << superblock.s_log_frag_size) << endl;
-        cout << "# blocks per group: " << superblock.s_blocks_per_group << endl;
-        cout << "# fragments per group: " << superblock.s_frags_per_group << endl;
-        cout << "# inodes per group: " << superblock.s_inodes_per_group << endl;
-        cout << "Mount time: " << superblock.s_mtime << endl;
-        cout << "Write time: " << superblock.s_wtime << endl;
-        cout << "Mount count: " << superblock.s_mnt_count << endl;
-        cout << "Maximal mount count: " << superblock.s_max_mnt_count << endl;
-        cout << "Magic signature: " << hex << superblock.s_magic << dec << endl;
-        cout << "File system state: " << superblock.s_state << endl;
-        cout << "Error behaviour: " << superblock.s_errors << endl;
-        cout << "Minor revision level: " << superblock.s_minor_rev_level << endl;
-        cout << "Time of last check: " << superblock.s_lastcheck << endl;
-        cout << "Check interval: " << superblock.s_checkinterval << endl;
-        cout << "Creator OS: " << superblock.s_creator_os << endl;
-        cout << "Revision level: " << superblock.s_rev_level << endl;
-        cout << "Default reserved UID: " << superblock.s_def_resuid << endl;
-        cout << "Default reserved GID: " << superblock.s_def_resgid << endl;
+        if (first_block >= blocks_kept)
+        {
+            indirect_blocks(pointer, depth, freed_blocks);
+            pointer = 0;
+            return;
+        }
         
-        cout << "\nFirst non-reserved inode: " << superblock.s_first_ino << endl;
-        cout << "inode structure size: " << superblock.s_inode_size << endl;
-        cout << "Block group number of superblock: " << superblock.s_block_group_nr << endl;
-        cout << "Compatible feature set: " << superblock.s_feature_compat << endl;
-        cout << "Incompatible feature set: " << superblock.s_feature_incompat << endl;
-        cout << "Read-only compatible feature set: " << superblock.s_feature_ro_compat << endl;
-        cout << "Volume UUID: " << superblock.s_uuid << endl;
-        cout << "Volume Name: " << superblock.s_volume_name << endl;
-        cout << "Directory where last mounted: " << superblock.s_last_mounted << endl;
-        cout << "Compression algorithm usage bitmap: " << superblock.s_algorithm_usage_bitmap << endl;
-    }
-    
-    
-    /*----------------------------------------------------------------------------------------------
-     * Name:    print_bootsector
-     * Type:    Function
-     * Purpose: Prints bootsector information.
-     * Input:   Nothing.
-     * Output:  Nothing.
-    ----------------------------------------------------------------------------------------------*/
-    void ext2::print_bootsector()
-    {
-        cout << "\nBootSector struct: ";
-        for (int i = 0; i < 4 /*number of partition tables*/; i++) {
-            cout << "\nPartition Entry " << i+1 << ": ";
-            cout << "\n  First Sector: " << bootSector.partitionTable[i].firstSector;
-            cout << "\n  nSectors: " << bootSector.partitionTable[i].nSectors;
+        u64 child_span = 1;
+        for (u32 i = 1; i < depth; i++)
+        {
+            child_span *= block_size_actual / EXT2_BLOCK_POINTER_SIZE;
+        }
+        
+        edited_block & node = edit_indirect_block(edit, pointer);
+        for (u32 i = 0; i < node.pointers.size(); i++)
+        {
+            u64 child_first = first_block + i * child_span;
+            if (node.pointers[i] == 0 || child_first + child_span <= blocks_kept)
+            {
+                continue;
+            }
+            
+            if (depth == 1)
+            {
+                freed_blocks.push_back(node.pointers[i]);
+                node.pointers[i] = 0;
+            }
+            else
+            {
+                truncate_indirect(edit, node.pointers[i], depth - 1, child_first, blocks_kept, freed_blocks);
+            }
+            node.dirty = true;
         }
-        cout << "\nBoot Sector Signature: " << hex << bootSector.magic << dec << endl;
     }
     
     
     /*----------------------------------------------------------------------------------------------
-     * Name:    print_bgd_table
+     * Name:    ingest
      * Type:    Function
-     * Purpose: Prints the BGD table information.
-     * Input:   Nothing.
-     * Output:  Nothing.
+     * Purpose: Writes a batch of files from the host filesystem into the present working
+     *          directory.  The whole batch is planned before anything is written: the inodes for
+     *          every file are taken together, and the data blocks for every file are allocated as
+     *          one run (or as few runs as possible), which the files then fill in the order given,
+     *          each one starting where the last one ended.  The directory entries are all added
+     *          in one pass at the end.  Nothing reaches the bitmaps, the block group descriptor
+     *          table or the superblock until the next commit.
+     * Input:   const vector<ingest_item> & items, holds the host file descriptors to read from and
+     *          the names to give the files.
+     * Output:  bool, true if every file was written.  A file that cannot be written (because it
+     *          exists already, say) is reported and skipped, and the rest are still written.
     ----------------------------------------------------------------------------------------------*/
-    void ext2::print_bgd_table()
+    bool ext2::ingest(const vector<ingest_item> & items)
     {
-        cout << "\nBGD Table:\n";
-        for (u32 i = 0; i < numBlockGroups; i++)
-        {
-            cout << "Block Group " << i << endl;
-            cout << "  Block address of block usage bitmap: " << bgdTable[i].bg_block_bitmap << endl;
-            cout << "  Block address of inode usage bitmap: " << bgdTable[i].bg_inode_bitmap << endl;
-            cout << "  Starting block address of inode table: " << bgdTable[i].bg_inode_table << endl;
-            cout << "  Number of unallocated blocks in group: " << bgdTable[i].bg_free_blocks_count << endl;
-            cout << "  Number of unallocated inodes in group: " << bgdTable[i].bg_free_inodes_count << endl;
-            cout << "  Number of directories in group: " << bgdTable[i].bg_used_dirs_count << endl;
-        }
+        return ingest_into(pwd.back().inode, items);
     }
     
     
     /*----------------------------------------------------------------------------------------------
-     * Name:    parse_directory_inode
+     * Name:    ingest_into
      * Type:    Function
-     * Purpose: Read and parse a directory inode, returning the resulting list of directories and
-     *          files in a vector container.
-     * Input:   ext2_inode inode, containing an inode object.
-     * Output:  vector<ext2_dir_entry>, contains a vector holding the contents of the inode.
+     * Purpose: Does the work of ingest, for any directory.
+     * Input:   u32 dir_inode_num, holds the inode number of the directory to write the files to.
+     * Input:   const vector<ingest_item> & items, holds the host file descriptors to read from and
+     *          the names to give the files.
+     * Output:  bool, true if every file was written.
     ----------------------------------------------------------------------------------------------*/
-    vector<ext2::ext2_dir_entry> ext2::parse_directory_inode(ext2_inode inode)
+    bool ext2::ingest_into(u32 dir_inode_num, const vector<ingest_item> & items)
     {
-        vector<ext2_dir_entry> to_return;
-        u32 cursor = 0;
-        s8 name_buffer[256];
-        u8* inode_buffer = nullptr;
-        
-        // Attempt to allocate and then verify memory for the inode buffer.
-        inode_buffer = new u8[EXT2_BLOCK_BASE_SIZE << superblock.s_log_block_size];
-        if (inode_buffer == nullptr)
+        if (read_only)
         {
-            cout << "Error allocating directory inode buffer.";
-            throw;
+            cout << "Error: The file system is open read-only.  (ext2::ingest)\n";
+            return false;
         }
         
-        // Iterate through the direct block pointer portion of the directory inode's i_block array.
-        for (s32 i = 0; i < EXT2_INODE_NBLOCKS_DIR; i++)
+        // Tasks to complete:
+        //   [x] check if the files already exist
+        //   [x] determine input file sizes and where their data is
+        //   [x] make sure the files are under the max size
+        //   [x] truncate names if needed (max size is EXT2_FILENAME_MAX_LENGTH)
+        //   [x] determine how many blocks the files are going to take including supporting
+        //       structures, such as indirect blocks
+        //   [x] verify that there are enough free blocks and inodes
+        //   [x] find free inodes
+        //   [x] make a list of free blocks that we plan on using (try to use the ones that are in
+        //       the same block group as the parent directly)
+        //   [x] write incoming files to disk
+        //   [x] record blocks in indirect block structures if necessary
+        //   [x] build inode entries (don't forget about permissions!)
+        //   [x] write inode entries
+        //   [x] add ext2_dir_entry structures to directory blocks
+        //   [x] modify block group descriptor table in memory
+        //   [x] modify superblock in memory
+        //
+        //   The bitmaps, the block group descriptor table and the superblock are written at the
+        //   next commit.
+        
+        bool all_written = true;
+        
+        
+        /***   Check the files and find the data in them.   ***/
+        // Check names against the directory's slot index, rather than parsing the directory, and
+        // against the rest of the batch.
+        dir_slot_index & slots = directory_slots(dir_inode_num);
+        set<string> names_taken;
+        
+        vector<ingest_item> batch;
+        vector<input_plan> plans;
+        u64 total_num_blocks_needed = 0;
+        for (u32 i = 0; i < items.size(); i++)
         {
-            // Checks to make sure the i_block entry actually points somewhere.
-            if (inode.i_block[i] == 0)
+            ingest_item item = items[i];
+            
+            // Truncate the name to EXT2_FILENAME_MAX_LENGTH bytes if needed.
+            if (item.name.length() > EXT2_FILENAME_MAX_LENGTH)
             {
-                // If it does not, continue to the next block pointer.
-                continue;
+                cout << "Warning: File name is too long.  Truncating to " << EXT2_FILENAME_MAX_LENGTH <<
+                        " characters.\n";
+                item.name.erase(EXT2_FILENAME_MAX_LENGTH);
             }
             
-            // Set the offset to the beginning of the block referenced by the inode.
-            vdi->vdiSeek(blockToOffset(inode.i_block[i]), SEEK_SET);
+            // The name has to be a single path component.
+            if (!valid_entry_name(item.name))
+            {
+                cout << "Error: Invalid file name: " << item.name << "  (ext2::ingest)\n";
+                all_written = false;
+                continue;
+            }
             
-            // Read the contents of the block into memory, based on the given size.
-            vdi->vdiRead(inode_buffer, EXT2_BLOCK_BASE_SIZE << superblock.s_log_block_size);
+            // Check to see if the file already exists, or appears earlier in the batch.
+            if (slots.has_name(item.name) || names_taken.count(item.name) != 0)
+            {
+                cout << "Error: File already exists: " << item.name << "  (ext2::ingest)\n";
+                all_written = false;
+                continue;
+            }
             
-            // Iterate through the inode buffer, reading the directory entry records.
-            while (cursor < (EXT2_BLOCK_BASE_SIZE << superblock.s_log_block_size))
+            // Determine the file size and where its data is.
+            input_plan plan;
+            if (!plan_input(item.input_fd, plan))
             {
-                // Declare a new ext2_dir_entry every loop.
-                ext2_dir_entry to_add;
-                
-                // Read inode, record length, name length, and file type.
-                memcpy(&to_add, &(inode_buffer[cursor]), EXT2_DIR_BASE_SIZE);
-                
-                // Check if the name length is 0.  If so, skip record.
-                if (to_add.name_len == 0)
-                {
-                    cursor += to_add.rec_len;
-                    continue;
-                }
-                else
-                {
-                    cursor += EXT2_DIR_BASE_SIZE;
-                }
-
-                // Read the name into the buffer.
-                memcpy(name_buffer, &(inode_buffer[cursor]), to_add.name_len);
-                cursor += to_add.name_len;
+                all_written = false;
+                continue;
+            }
+            plan.contents = item.contents;
+            
+            names_taken.insert(item.name);
+            batch.push_back(item);
+            plans.push_back(plan);
+            total_num_blocks_needed += plan.num_blocks_needed;
+        }
+        
+        if (batch.empty())
+        {
+            return all_written;
+        }
+        /***   End check the files and find the data in them.   ***/
+        
+        
+        /***   Verify that enough free space exists.   ***/
+        // Check the number of free blocks.  (New directory blocks are checked for as they are
+        // allocated.)
+        if (superblock.s_free_blocks_count < total_num_blocks_needed)
+        {
+            cout << "Error: Not enough free blocks available on the file system.\n";
+            return false;
+        }
+        
+        // Check the number of free inodes.
+        if (superblock.s_free_inodes_count < batch.size())
+        {
+            cout << "Error: Not enough free inodes available on the file system.\n";
+            return false;
+        }
+        /***   End verify that enough free space exists.   ***/
+        
+        
+        /***   Make a list of free blocks we plan on using.   ***/
+        // Every file's blocks are allocated together, as one contiguous run where possible,
+        // starting from a goal near the directory (or straight after the previous file written to
+        // it).
+        vector<u32> blocks_to_write;
+        ext2_inode goal_dir_inode = readInode(dir_inode_num);
+        if (!allocate_blocks(allocation_goal(dir_inode_num, goal_dir_inode), total_num_blocks_needed, 0, blocks_to_write))
+        {
+            cout << "Error: Not enough free blocks available on the file system.\n";
+            return false;
+        }
+        /***   End make a list of free blocks we plan on using.   ***/
+        
+        
+        /***   Find free inodes.   ***/
+        // Take an inode for every file, preferably from the block group the directory's inode is
+        // in, so that they sit together in the inode table.
+        u32 dir_inode_block_group_num = inodeToBlockGroup(dir_inode_num);
+        vector<u32> inodes_to_use(batch.size(), 0);
+        for (u32 i = 0; i < batch.size(); i++)
+        {
+            inodes_to_use[i] = allocate_inode(dir_inode_block_group_num);
+            if (inodes_to_use[i] == 0)
+            {
+                cout << "Error: Not enough free inodes available on the file system.\n";
+                release_blocks(blocks_to_write);
+                return false;
+            }
+        }
+        /***   End find free inodes.   ***/
+        
+        
+        /***   Write files to disk and build their inodes.   ***/
+        // Each file takes what it actually uses from the front of what is left of the blocks, so
+        // the files follow on from one another without gaps, even when some of them are sparse.
+        // Streamed inputs, whose size is not known up front, come last: once the blocks left
+        // over from the rest have been given back, each one grows its own blocks from where the
+        // previous file ended.
+        vector<ext2_dir_entry> new_entries;
+        vector<pair<u32, u32>> entry_blocks;    // each new entry's file -> (first, count) in blocks_kept
+        vector<u32> blocks_kept;
+        u32 blocks_used = 0;
+        time_t current_time = time(nullptr);
+        for (u32 pass = 0; pass < 2; pass++)
+        {
+            if (pass == 1)
+            {
+                // Give back the allocated blocks that went unused, because their contents were
+                // zero or because the indirect blocks that would have mapped them were not needed.
+                vector<u32> blocks_unused(blocks_to_write.begin() + blocks_used, blocks_to_write.end());
+                release_blocks(blocks_unused);
+            }
+            
+            for (u32 i = 0; i < batch.size(); i++)
+            {
+                if (plans[i].streaming != (pass == 1))
+                {
+                    continue;
+                }
                 
-                // Add a null to the end of the characters read in so it becomes a C-style string.
-                name_buffer[to_add.name_len] = '\0';
+                // Create the ext2_inode structure, zeroed since everything is in an indeterminate
+                // state initially.
+                ext2_inode file_inode;
+                memset(&file_inode, 0, sizeof(ext2_inode));
                 
-                // Store the name in the record.
-                to_add.name.assign(name_buffer);
+                // Set the inode type to be "regular file" (the type decides how the size is
+                // stored), and then set permissions to 600.
+                file_inode.i_mode = EXT2_INODE_TYPE_FILE | EXT2_INODE_PERM_USER_READ | EXT2_INODE_PERM_USER_WRITE;
                 
-                // Set the offset to the next record.
-                if (EXT2_DIR_BASE_SIZE + to_add.name_len < to_add.rec_len)
-                    cursor += to_add.rec_len - EXT2_DIR_BASE_SIZE - to_add.name_len;
+                // Write the file's data and indirect blocks, which sets the size, the block
+                // pointers and the block count.
+                vector<u32> stream_blocks;
+                vector<u32> & pool = (plans[i].streaming ? stream_blocks : blocks_to_write);
+                u32 pool_start = (plans[i].streaming ? 0 : blocks_used);
+                u32 goal = (blocks_kept.empty() ? allocation_goal(dir_inode_num, goal_dir_inode) : blocks_kept.back() + 1);
+                u32 file_blocks_used = 0;
+                bool written = write_input(batch[i].input_fd, plans[i], pool, pool_start, goal, file_inode, file_blocks_used);
                 
-                // Add the ext2_dir_entry to the vector.
-                to_return.push_back(to_add);
+                vector<u32> file_blocks(pool.begin() + pool_start, pool.begin() + pool_start + file_blocks_used);
+                if (plans[i].streaming)
+                {
+                    vector<u32> blocks_unused(stream_blocks.begin() + file_blocks_used, stream_blocks.end());
+                    release_blocks(blocks_unused);
+                }
+                else
+                {
+                    blocks_used += file_blocks_used;
+                }
+                
+                // If the file could not be written after all, give back its blocks and inode.
+                if (!written)
+                {
+                    release_blocks(file_blocks);
+                    release_inode(inodes_to_use[i]);
+                    all_written = false;
+                    continue;
+                }
+                entry_blocks.push_back(make_pair((u32)blocks_kept.size(), (u32)file_blocks.size()));
+                blocks_kept.insert(blocks_kept.end(), file_blocks.begin(), file_blocks.end());
+                
+                // Set the user and group to root (user/group 1000)
+                file_inode.i_uid = EXT2_INODE_DEFAULT_UID;
+                file_inode.i_gid = EXT2_INODE_DEFAULT_GID;
+                
+                // Set the hard link count.  It will be one since this is just a file.
+                file_inode.i_links_count = 1;
+                
+                // Set the access/creation/modification times.
+                file_inode.i_atime = current_time;
+                file_inode.i_ctime = current_time;
+                file_inode.i_mtime = current_time;
                 
-                cout << "\ndebug::ext2::ext2_dir_entry\n";
-                print_dir_entry(to_return.back());
+                // Put the inode in its inode table block; it reaches the disk at the next commit.
+                write_inode(file_inode, inodes_to_use[i]);
+                
+                new_entries.push_back(make_dir_entry(inodes_to_use[i], batch[i].name, EXT2_DIR_TYPE_FILE));
             }
         }
         
-        // Free the inode buffer.
-        delete[] inode_buffer;
+        // Account for the blocks the files kept.
+        charge_blocks(blocks_kept.data(), blocks_kept.size());
         
-        // Return the vector.
-        return to_return;
-    }
-    
-    
-    /*----------------------------------------------------------------------------------------------
-     * Name:    parse_directory_inode
-     * Type:    Function
-     * Purpose: Read and parse a directory inode, returning the resulting list of directories and
-     *          files in a vector container.
-     * Input:   u32 inode_num, containing the inode number of a directory inode.
-     * Output:  vector<ext2_dir_entry>, contains a vector holding the contents of the directory
-     *          inode.
-    ----------------------------------------------------------------------------------------------*/
-    vector<ext2::ext2_dir_entry> ext2::parse_directory_inode(u32 inode_num)
-    {
-        return parse_directory_inode(readInode(inode_num));
-    }
-    
-    
-    /*----------------------------------------------------------------------------------------------
-     * Name:    readInode
-     * Type:    Function
-     * Purpose: Small function that verifies an inode index is in bounds, then reads it.
-     * Input:   u32 inode, containing an inode number.
-     * Output:  ext2_inode, containing the read inode.
-     *
-     * @TODO    Set up an actual error to throw instead of the generic one.
-    ----------------------------------------------------------------------------------------------*/
-    ext2::ext2_inode ext2::readInode(u32 inode)
-    {
-        if (inode >= superblock.s_inodes_count)
+        // Remember where the batch ended, so the next file in this directory can follow it.
+        if (!blocks_kept.empty())
         {
-            cout << "inode out of bounds\n";
-            throw;
+            last_allocated_dir = dir_inode_num;
+            last_allocated_block = blocks_kept.back();
         }
+        /***   End write files to disk and build their inodes.   ***/
         
-        ext2_inode to_return;
         
-        vdi->vdiSeek(inodeToOffset(inode), SEEK_SET);
-        vdi->vdiRead(&to_return, sizeof(ext2_inode));
+        /***   Add directory entries to directory blocks.   ***/
+        // A file that could not be given an entry (because the directory cannot grow, say) would
+        // be left allocated but unreachable, so its blocks and inode are given back.
+        if (!add_dir_entries(dir_inode_num, new_entries))
+        {
+            ext2_inode cleared_inode;
+            memset(&cleared_inode, 0, sizeof(ext2_inode));
+            for (u32 i = 0; i < new_entries.size(); i++)
+            {
+                if (slots.has_name(new_entries[i].name))
+                {
+                    continue;
+                }
+                
+                vector<u32> file_blocks(blocks_kept.begin() + entry_blocks[i].first,
+                                        blocks_kept.begin() + entry_blocks[i].first + entry_blocks[i].second);
+                release_blocks(file_blocks);
+                discharge_blocks(file_blocks.data(), file_blocks.size());
+                write_inode(cleared_inode, new_entries[i].inode);
+                release_inode(new_entries[i].inode);
+            }
+            all_written = false;
+        }
+        /***   End add directory entries to directory blocks.   ***/
         
-        return to_return;
+        /* It's dangerous to go alone! Take this.
+        //
+        //                   /\
+        //                  |  |
+        //                  |  |
+        //                  |  |
+        //                  |  |
+        //                  |  |
+        //                  |  |
+        //                 _|__|_
+        //                |######|
+        //                ``|##|``
+        //                  |##|
+        //                  ````
+        */
+        
+        // Return.
+        return all_written;
     }
     
-
+    
     /*----------------------------------------------------------------------------------------------
-     * Name:    dir_entry_exists
+     * Name:    plan_input
      * Type:    Function
-     * Purpose: Verifies whether a path exists or not.
-     * Input:   const string & path_to_check, containing the path to verify.
-     * Output:  vector<ext2_dir_entry>, containing ext2_dir_entry objects representing the path to
-     *          the desired folder if it is found, or containing nothing if not found.
+     * Purpose: Works out how big a host file is, where its data lives, and the most blocks it
+     *          could need, data and indirect blocks together.  An input whose size cannot be
+     *          known up front is marked as streamed instead.
+     * Input:   int input_fd, contains the host file descriptor to read from.
+     * Input:   input_plan & plan, receives the plan.
+     * Output:  bool, true if the file can be written.
     ----------------------------------------------------------------------------------------------*/
-    vector<ext2::ext2_dir_entry> ext2::dir_entry_exists(const string & path_to_check)
+    bool ext2::plan_input(int input_fd, input_plan & plan)
     {
-        // Tokenize the path that will be checked.
-        vector<string> path_tokens = utility::tokenize(path_to_check, DELIMITER_FSLASH);
-        
-        vector<ext2_dir_entry> to_return;
+        /***   Determine file size.   ***/
+        struct stat input_stat;
+        if (fstat(input_fd, &input_stat) != 0)
+        {
+            cout << "Error: Could not determine the size of the input file. (ext2::plan_input)\n";
+            return false;
+        }
+        u64 file_size = input_stat.st_size;
         
-        // Check if the given path is relative or absolute.
-        if(path_to_check[0] == '/')
+        // Anything but a regular file (a pipe, a terminal, a character device) is streamed: read
+        // until it ends, with blocks allocated as the data arrives.
+        if (!S_ISREG(input_stat.st_mode))
         {
-            // Absolute path given.
-            to_return.push_back(pwd.front());
+            plan.streaming = true;
+            return true;
         }
-        else
+        /***   End determine file size.   ***/
+        
+        
+        /***   Ensure the file is under the max size.   ***/
+        if (file_size > max_file_size)
         {
-            // Relative path given.
-            to_return = pwd;
+            cout << "Error: File is too large to be handled by the file system. (ext2::plan_input)\n";
+            return false;
         }
+        /***   End ensure the file is under the max size.   ***/
         
-        vector<ext2_dir_entry> current_dir_parse;
-        bool found_dir = true;
         
-        // Loop through the path_tokens vector, following the user's desired path sequentially.
-        for (u32 i = 0; found_dir == true && i < path_tokens.size(); i++)
+        /***   Find the data in the input file.   ***/
+        // Ask the host where the input file's data lives, so that holes in it are never read, let
+        // alone written.  Each stretch of data is widened out to whole blocks.  If the host cannot
+        // say, the whole file is treated as data.
+        vector<pair<u32, u32>> & input_data_blocks = plan.data_blocks;
+        bool input_holes_known = false;
+        
+        #ifdef SEEK_DATA
+        input_holes_known = true;
+        for (u64 position = 0; position < file_size;)
         {
-            // Parse the current inode for its directory structure.
-            current_dir_parse = parse_directory_inode(to_return.back().inode);
+            // Find the start of the next stretch of data.  ENXIO means there is none.
+            off_t data_start = lseek(input_fd, position, SEEK_DATA);
+            if (data_start < 0)
+            {
+                input_holes_known = (errno == ENXIO);
+                break;
+            }
             
-            // Reset the found directory flag on each iteration.
-            found_dir = false;
+            // Find where it ends.
+            off_t hole_start = lseek(input_fd, data_start, SEEK_HOLE);
+            if (hole_start < 0 || (u64)hole_start > file_size)
+            {
+                hole_start = file_size;
+            }
             
-            // Loop through the parsed directory listing to attempt to find a match.
-            for (u32 j = 0; j < current_dir_parse.size(); j++)
+            // Record it in blocks, merging it with the previous range if they touch.
+            u32 first_block = data_start / block_size_actual;
+            u32 end_block = (hole_start + block_size_actual - 1) / block_size_actual;
+            if (!input_data_blocks.empty() && first_block <= input_data_blocks.back().second)
             {
-                // First, check if the directory entry is a folder.
-                if (current_dir_parse[j].file_type == 2)
-                {
-                    // Then check if the names match.
-                    if (path_tokens[i] == current_dir_parse[j].name)
-                    {
-                        // If the directory entry is a folder and the names match, handle the
-                        // different scenarios.
-                        if (path_tokens[i] == ".")
-                        {
-                            // Intentionally do nothing.
-                        }
-                        else if (path_tokens[i] == "..")
-                        {
-                            // Go up one level unless already at the filesystem root.
-                            if (to_return.size() > 1)
-                            {
-                                to_return.pop_back();
-                            }
-                        }
-                        else
-                        {
-                            // Add the directory entry to the to_return vector.
-                            to_return.push_back(current_dir_parse[j]);
-                        }
-                        
-                        // Set the found directory flag.
-                        found_dir = true;
-                        break;
-                    }
-                }
+                input_data_blocks.back().second = end_block;
+            }
+            else
+            {
+                input_data_blocks.push_back(make_pair(first_block, end_block));
             }
+            
+            position = hole_start;
         }
+        #endif
         
-        // If the directory was not found, clear the to_return vector.
-        if (found_dir == false)
+        if (!input_holes_known)
         {
-            to_return.clear();
+            input_data_blocks.clear();
+            if (file_size > 0)
+            {
+                input_data_blocks.push_back(make_pair(0, (file_size + block_size_actual - 1) / block_size_actual));
+            }
         }
         
-        // Return the path to the folder.
-        return to_return;
-    } 
+        // Count the blocks that may hold data; holes get no blocks at all.
+        u32 num_data_blocks_needed = 0;
+        for (u32 i = 0; i < input_data_blocks.size(); i++)
+        {
+            num_data_blocks_needed += input_data_blocks[i].second - input_data_blocks[i].first;
+        }
+        /***   End find the data in the input file.   ***/
+        
+        
+        /***   Determine how many blocks the file will take up.   ***/
+        // The file spans file_size / block_size_actual blocks, rounded up.  A.k.a poor man's
+        // ceiling function.
+        plan.size = file_size;
+        plan.num_logical_blocks = (file_size % block_size_actual ?
+                                   file_size / block_size_actual + 1 :
+                                   file_size / block_size_actual);
+        
+        // The indirect blocks are counted as if the file had no holes, so a sparse file may leave
+        // some of them unused.  Only the blocks that can hold data count otherwise.
+        plan.num_blocks_needed = num_data_blocks_needed +
+                                 indirect_tree_builder::blocks_needed(plan.num_logical_blocks,
+                                                                      block_size_actual / EXT2_BLOCK_POINTER_SIZE);
+        /***   End determine how many blocks the file will take up.   ***/
+        
+        return true;
+    }
     
     
     /*----------------------------------------------------------------------------------------------
-     * Name:    file_entry_exists
+     * Name:    write_input
      * Type:    Function
-     * Purpose: Verifies whether a file exists or not. Only checks in the pwd.
-     * Input:   const string & file_to_check, containing the path to verify.
-     * Output:  <reference> u32 & file_inode, will hold the file's inode number, should the file
-     *          exist.
-     * Output:  bool, detailing whether the file exists (true) or does not (false).
+     * Purpose: Writes a host file's data, and the indirect blocks mapping it, into blocks taken
+     *          in order from a pool allocated for it.
+     *
+     *          The input file's data is read into large rotating buffers by a reader thread, while
+     *          this thread writes the previous buffer to the virtual disk.  Blocks that turn out to
+     *          hold nothing but zeroes are left as holes; the rest are mapped in order onto the
+     *          pool, by way of the indirect tree builder, which places each indirect block just
+     *          ahead of the data it maps.  Runs of consecutive blocks are written with a single
+     *          write.
+     *
+     *          A streamed input (a pipe, say) is read until it ends, and the pool is grown as the
+     *          data arrives, a run at a time, straight after the blocks already in it.  Blocks
+     *          preallocated beyond each run (see s_prealloc_blocks) keep the next run contiguous;
+     *          whatever is left of them is given back at the end.
+     * Input:   int input_fd, contains the host file descriptor to read from.
+     * Input:   const input_plan & plan, holds where the file's data lives.
+     * Input:   vector<u32> & pool, holds the blocks to use, in order.  Streaming adds to it.
+     * Input:   u32 pool_start, holds where in the pool this file's blocks start.
+     * Input:   u32 goal, holds where a streamed input's first run should ideally start.
+     * Input:   ext2_inode & file_inode, receives the size, block pointers and block count.
+     * Input:   u32 & blocks_used, receives the number of blocks taken from the pool, starting at
+     *          pool_start.  These must be given back if the write fails.
+     * Output:  bool, true if the whole file was written.
     ----------------------------------------------------------------------------------------------*/
-    bool ext2::file_entry_exists(const string & file_to_check, u32 & file_inode)
+    bool ext2::write_input(int input_fd, const input_plan & plan, vector<u32> & pool, u32 pool_start, u32 goal, ext2_inode & file_inode, u32 & blocks_used)
     {
-        // Assume the file does not exist.
-        bool to_return = false;
+        // Housekeeping variable to help keep calculations from being as stupidly long.
+        u32 s_num_block_pointers = block_size_actual / EXT2_BLOCK_POINTER_SIZE;
+        u64 file_size = plan.size;
+        bool written = true;
         
-        // Parse the present working directory.
-        vector<ext2_dir_entry> file_path = parse_directory_inode(pwd.back().inode);
         
-        // Loop through the contents of the pwd looking for a name match.
-        for (u32 i = 0; i < file_path.size(); i++)
-        {
-            // Check the name, and if the name matches, make sure it's not a directory.
-            if (file_path[i].name == file_to_check && file_path[i].file_type != EXT2_DIR_TYPE_DIR)
-            {
-                // Assuming the entry is indeed a file, store the file's inode and update the return
-                // value.
-                file_inode = file_path[i].inode;
-                to_return = true;
-            }
-        }
+        /***   Write file to disk.   ***/
+        // Establish the file's block map, built as the data is written.
+        indirect_tree_builder block_tree(s_num_block_pointers, pool.data() + pool_start, pool.size() - pool_start);
         
-        // Return whether the file exists or not.
-        return to_return;
+        // Establish the file's logical-to-physical block map.  Holes stay 0.
+        vector<u32> logical_blocks(plan.num_logical_blocks, 0);
         
-        // Below is code to enable pathing support in the function.  It is currently not working and
-        // commented out due to needing to work on other more important things.
+        // Establish the preallocation that a streamed input grows into, and where its data ends.
+        block_reservation stream_reservation;
+        u64 stream_size = 0;
         
-        /***   START ACTUAL CODE   ***/
-        // @TODO convert code from dir_entry_exists
-        // @TODO do a deep examination of the algorithm to ensure it's appropriate for files
+        // Set up the rotating buffers shared by the reading and writing sides.
+        buffer_ring ring(EXT2_COPY_BUFFER_SIZE, EXT2_COPY_BUFFER_COUNT);
         
-        // tokenize
-        // determine if relative path or local path
-        // loop through the path vector
+        // Start the reader thread, which reads only the stretches of the input file holding data,
+        // or, if the input is streamed, everything up to its end.
+        thread reader([&]()
+        {
+            for (u64 offset = 0; plan.streaming;)
+            {
+                char * buffer = ring.acquire();
+                if (buffer == nullptr)
+                {
+                    break;
+                }
+                
+                size_t bytes_read = utility::read_fully(input_fd, buffer, ring.buffer_size());
+                memset(&(buffer[bytes_read]), 0, ring.buffer_size() - bytes_read);
+                ring.submit(buffer, bytes_read, offset);
+                offset += bytes_read;
+                
+                if (bytes_read < ring.buffer_size())
+                {
+                    break;
+                }
+            }
+            
+            for (u32 i = 0; i < plan.data_blocks.size(); i++)
+            {
+                u64 offset = (u64)plan.data_blocks[i].first * block_size_actual;
+                u64 end = (u64)plan.data_blocks[i].second * block_size_actual;
+                if (end > file_size)
+                {
+                    end = file_size;
+                }
+                lseek(input_fd, offset, SEEK_SET);
+                
+                while (offset < end)
+                {
+                    char * buffer = ring.acquire();
+                    if (buffer == nullptr)
+                    {
+                        break;
+                    }
+                    
+                    // Read a buffer's worth of the range, or whatever is left of it.
+                    size_t bytes_to_read = (end - offset < ring.buffer_size() ?
+                                            end - offset :
+                                            ring.buffer_size());
+                    size_t bytes_read = 0;
+                    if (plan.contents != nullptr)
+                    {
+                        bytes_read = (offset < plan.contents->size() ? plan.contents->size() - offset : 0);
+                        bytes_read = (bytes_read < bytes_to_read ? bytes_read : bytes_to_read);
+                        memcpy(buffer, plan.contents->data() + offset, bytes_read);
+                    }
+                    else
+                    {
+                        bytes_read = utility::read_fully(input_fd, buffer, bytes_to_read);
+                    }
+                    
+                    // Zero out the rest of the buffer so the final block is padded with zeroes,
+                    // along with anything the input file failed to deliver.
+                    memset(&(buffer[bytes_read]), 0, ring.buffer_size() - bytes_read);
+                    
+                    ring.submit(buffer, bytes_to_read, offset);
+                    offset += bytes_to_read;
+                }
+            }
+            ring.close();
+        });
+        
+        // Write each buffer as it arrives.
+        char * buffer = nullptr;
+        size_t length = 0;
+        u64 offset = 0;
+        while (ring.receive(buffer, length, offset))
+        {
+            // Establish which blocks the buffer covers (the last one may be partial).
+            u32 first_logical_block = offset / block_size_actual;
+            u32 blocks_in_buffer = (length + block_size_actual - 1) / block_size_actual;
+            
+            // A streamed input's size is only known as its data arrives.
+            if (plan.streaming)
+            {
+                stream_size = offset + length;
+                if (stream_size > max_file_size)
+                {
+                    cout << "Error: File is too large to be handled by the file system. (ext2::write_input)\n";
+                    written = false;
+                    ring.abort();
+                    break;
+                }
+                logical_blocks.resize(first_logical_block + blocks_in_buffer, 0);
+            }
+            
+            // Map every block in the buffer that is not all zeroes.  A streamed input's pool is
+            // grown whenever it runs out.
+            for (u32 i = 0; i < blocks_in_buffer && written; i++)
+            {
+                if (utility::is_zero_filled(&(buffer[i * block_size_actual]), block_size_actual))
+                {
+                    continue;
+                }
+                
+                logical_blocks[first_logical_block + i] = block_tree.map_block(first_logical_block + i);
+                while (logical_blocks[first_logical_block + i] == 0 && written)
+                {
+                    if (!pool.empty())
+                    {
+                        goal = pool.back() + 1;
+                    }
+                    if (!plan.streaming ||
+                        !allocate_blocks(goal, EXT2_COPY_BUFFER_SIZE / block_size_actual, superblock.s_prealloc_blocks, pool, &stream_reservation))
+                    {
+                        cout << "Error: Not enough free blocks available on the file system.\n";
+                        written = false;
+                        break;
+                    }
+                    block_tree.extend_pool(pool.data() + pool_start, pool.size() - pool_start);
+                    logical_blocks[first_logical_block + i] = block_tree.map_block(first_logical_block + i);
+                }
+            }
+            if (!written)
+            {
+                ring.abort();
+                break;
+            }
+            
+            // Write the buffer, one run of consecutive blocks at a time.
+            for (u32 i = 0; i < blocks_in_buffer;)
+            {
+                u32 physical_block = logical_blocks[first_logical_block + i];
+                if (physical_block == 0)
+                {
+                    i++;
+                    continue;
+                }
+                
+                u32 run_length = 1;
+                while (i + run_length < blocks_in_buffer &&
+                       logical_blocks[first_logical_block + i + run_length] == physical_block + run_length)
+                {
+                    run_length++;
+                }
+                
+                vdi->vdiSeek(blockToOffset(physical_block), SEEK_SET);
+                vdi->vdiWrite(&(buffer[i * block_size_actual]), run_length * block_size_actual);
+                
+                i += run_length;
+            }
+            
+            ring.release(buffer);
+        }
+        reader.join();
+        /***   End write file to disk.   ***/
         
         
-        // Tokenize the path that will be checked.
-        // vector<string> path_tokens = utility::tokenize(file_to_check, DELIMITER_FSLASH);
+        /***   Write indirect blocks.   ***/
+        // The whole tree is in memory now; write it out in block order, in one pass, with
+        // neighbouring indirect blocks going out in a single write.
+        const map<u32, vector<u32>> & indirect_blocks = block_tree.indirect_blocks();
+        vector<u32> indirect_run;
+        u32 indirect_run_start = 0;
+        for (map<u32, vector<u32>>::const_iterator i = indirect_blocks.begin(); i != indirect_blocks.end(); ++i)
+        {
+            // Write out the current run if this block does not follow on from it.
+            if (!indirect_run.empty() &&
+                (i->first != indirect_run_start + indirect_run.size() / s_num_block_pointers ||
+                 indirect_run.size() * EXT2_BLOCK_POINTER_SIZE >= EXT2_COPY_BUFFER_SIZE))
+            {
+                vdi->vdiSeek(blockToOffset(indirect_run_start), SEEK_SET);
+                vdi->vdiWrite(indirect_run.data(), indirect_run.size() * EXT2_BLOCK_POINTER_SIZE);
+                indirect_run.clear();
+            }
+            
+            // Add the block to the run.
+            if (indirect_run.empty())
+            {
+                indirect_run_start = i->first;
+            }
+            indirect_run.insert(indirect_run.end(), i->second.begin(), i->second.end());
+        }
+        if (!indirect_run.empty())
+        {
+            vdi->vdiSeek(blockToOffset(indirect_run_start), SEEK_SET);
+            vdi->vdiWrite(indirect_run.data(), indirect_run.size() * EXT2_BLOCK_POINTER_SIZE);
+        }
+        /***   End write indirect blocks.   ***/
         
-        // vector<ext2_dir_entry> file_path;
         
-        // // Check if the given path is relative or absolute.
-        // if (file_to_check[0] == '/')
-        // {
-        //     // Absolute path given.
-        //     file_path.push_back(pwd.front());
-        // }
-        // else
-        // {
-        //     // Relative path given.
-        //     file_path = pwd;
-        // }
+        // Give back what is left of the streaming preallocation.
+        if (stream_reservation.length > 0)
+        {
+            free_space.release(blockToBlockGroup(stream_reservation.start), blockBlockGroupIndex(stream_reservation.start), stream_reservation.length);
+        }
         
-        // vector<ext2_dir_entry> current_dir_parse;
-        // bool found_dir_entry = true;
+        // Set the size, the direct and indirect block pointers, and the number of 512-byte blocks
+        // used to store this file and its data, indirect blocks included.
+        set_inode_size(file_inode, (plan.streaming ? stream_size : file_size));
+        block_tree.root_pointers(file_inode.i_block);
+        file_inode.i_blocks = block_tree.blocks_used() * (block_size_actual / EXT2_INODE_IBLOCKS_SIZE);
         
-        // // Loop through the path_tokens vector, following the user's desired path sequentially.
-        // for (u32 i = 0; found_dir_entry == true && i < path_tokens.size(); i++)
-        // {
-        //     // Parse the current inode for its directory structure.
-        //     current_dir_parse = parse_directory_inode(file_path.back().inode);
+        blocks_used = block_tree.blocks_used();
+        return written;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    add_dir_entries
+     * Type:    Function
+     * Purpose: Adds directory entries to a directory, in one pass.  Each entry goes into the
+     *          tightest-fitting room in any of the directory's blocks, according to its slot
+     *          index, including gaps left by removed entries; only when nothing fits is a new
+     *          block added, mapped through indirect blocks once the direct ones are used up.
+     *          Every block touched is written once, in block order, and the directory's inode is
+     *          updated once.
+     * Input:   u32 dir_inode_num, holds the inode number of the directory.
+     * Input:   vector<ext2_dir_entry> & entries, holds the entries to add.  Their rec_len fields
+     *          are set as they are placed.
+     * Output:  bool, true if every entry was added.
+    ----------------------------------------------------------------------------------------------*/
+    bool ext2::add_dir_entries(u32 dir_inode_num, vector<ext2_dir_entry> & entries)
+    {
+        if (entries.empty())
+        {
+            return true;
+        }
+        
+        // Read the directory inode, and find where the index says there is room.  The inode is
+        // changed the way a file being written in place is, so that the directory can grow past
+        // its direct blocks into indirect ones.
+        inode_edit edit;
+        edit.inode_num = dir_inode_num;
+        edit.inode = readInode(dir_inode_num);
+        dir_slot_index & slots = directory_slots(dir_inode_num);
+        bool inode_changed = false;
+        
+        // Entries are placed wherever there is room, not by hash, so a hash tree index would no
+        // longer find them.  An indexed directory is turned back into a plain one instead: its
+        // index blocks read as empty records, so a linear search still sees every entry.
+        if (edit.inode.i_flags & EXT2_INODE_FLAGS_HASH_INDEX_DIR)
+        {
+            edit.inode.i_flags &= ~EXT2_INODE_FLAGS_HASH_INDEX_DIR;
+            inode_changed = true;
+        }
+        
+        // The directory blocks changed so far, by block number.
+        map<u32, vector<u8>> dir_blocks;
+        
+        bool all_added = true;
+        for (u32 i = 0; i < entries.size(); i++)
+        {
+            ext2_dir_entry & entry = entries[i];
+            u16 entry_length = utility::nearest_mult_four(EXT2_DIR_BASE_SIZE + entry.name_len);
             
-        //     // Reset the found directory flag on each iteration.
-        //     found_dir_entry = false;
+            u32 block_num = 0;
+            u32 offset = 0;
+            u16 slack = 0;
+            if (!slots.find(entry_length, block_num, offset, slack))
+            {
+                // There's not enough room anywhere, so add a new block straight after the
+                // directory's last one (and any indirect blocks needed to map it), preallocating
+                // room for the directory to keep growing.
+                if (uses_extents(edit.inode))
+                {
+                    cout << "Error: Directories mapped by extents cannot grow.  (ext2::add_dir_entries)\n";
+                    all_added = false;
+                    break;
+                }
+                
+                u32 dir_block_index = edit.inode.i_size / block_size_actual;
+                if (edit.goal == 0)
+                {
+                    u32 last_block = (dir_block_index > 0 ? edit_map_block(edit, dir_block_index - 1, false) : 0);
+                    edit.goal = (last_block != 0 ? last_block + 1 : allocation_goal(dir_inode_num, edit.inode));
+                }
+                u32 new_block = edit_map_block(edit, dir_block_index, true);
+                if (new_block == 0)
+                {
+                    cout << "Error: Not enough free blocks available on the file system.\n";
+                    all_added = false;
+                    break;
+                }
+                
+                // Account for the new directory block in the inode's size.  (Its block count,
+                // and the block pointers, are updated as the block is mapped.)
+                edit.inode.i_size += block_size_actual;
+                inode_changed = true;
+                
+                // The block starts out as a single unused record spanning all of it.
+                vector<u8> & empty_block = dir_blocks[new_block];
+                empty_block.assign(block_size_actual, 0);
+                u16 whole_block = block_size_actual;
+                memcpy(&(empty_block[sizeof(u32)]), &whole_block, sizeof(u16));
+                
+                block_num = new_block;
+                offset = 0;
+                slack = whole_block;
+            }
             
-        //     // Loop through the parsed directory listing to attempt to find a match.
-        //     for (u32 j = 0; j < current_dir_parse.size(); j++)
-        //     {
-        //         // Check if the names match.
-        //         if (path_tokens[i] == current_dir_parse[j].name)
-        //         {
-        //             // Check if the directory entry is a folder.
-        //             if (current_dir_parse[j].file_type == 2)
-        //             {
-        //                 // If the directory entry is a folder handle the different scenarios.
-        //                 if (path_tokens[i] == ".")
-        //                 {
-        //                     // Intentionally do nothing.
-        //                 }
-        //                 else if (path_tokens[i] == "..")
-        //                 {
-        //                     // Go up one level unless already at the filesystem root.
-        //                     if (file_path.size() > 1)
-        //                     {
-        //                         file_path.pop_back();
-        //                     }
-        //                 }
-        //                 else
-        //                 {
-        //                     // Add the directory entry to the file_path vector.
-        //                     file_path.push_back(current_dir_parse[j]);
-        //                 }
-                        
-        //                 // Set the found directory flag.
-        //                 found_dir_entry = true;
-        //                 break;
-        //             }
-        //             else if (current_dir_parse[j].file_type == 2)
-        //             {
-                        
-        //             }
-        //         }
-        //     }
-        // }
+            // Read in the block holding the room, unless it has been already.
+            vector<u8> & dir_block = dir_blocks[block_num];
+            if (dir_block.empty())
+            {
+                dir_block.resize(block_size_actual);
+                vdi->vdiSeek(blockToOffset(block_num), SEEK_SET);
+                vdi->vdiRead(dir_block.data(), block_size_actual);
+            }
+            
+            // Split the record: an unused record is taken over whole, otherwise the existing entry
+            // is cut down to just itself and the new entry takes the rest.
+            u32 record_inode = 0;
+            u16 record_length = 0;
+            memcpy(&record_inode, &(dir_block[offset]), sizeof(u32));
+            memcpy(&record_length, &(dir_block[offset + sizeof(u32)]), sizeof(u16));
+            
+            u32 entry_offset = offset;
+            if (record_inode != 0)
+            {
+                u16 used_length = record_length - slack;
+                memcpy(&(dir_block[offset + sizeof(u32)]), &used_length, sizeof(u16));
+                slots.set_slack(block_num, offset, 0);
+                entry_offset = offset + used_length;
+                record_length -= used_length;
+            }
+            
+            // Place the entry, with its record running to the end of the old one.
+            entry.rec_len = record_length;
+            memcpy(&(dir_block[entry_offset]), &entry, EXT2_DIR_BASE_SIZE);
+            memcpy(&(dir_block[entry_offset + EXT2_DIR_BASE_SIZE]), entry.name.c_str(), entry.name_len);
+            slots.set_slack(block_num, entry_offset, record_length - entry_length);
+            slots.add_name(entry.name);
+        }
         
-        // // If the directory was not found, clear the file_path vector.
-        // if (found_dir_entry == false)
-        // {
-        //     file_inode = file_path.back().inode;
-        // }
+        // Write the blocks touched.
+        for (map<u32, vector<u8>>::iterator i = dir_blocks.begin(); i != dir_blocks.end(); ++i)
+        {
+            vdi->vdiSeek(blockToOffset(i->first), SEEK_SET);
+            vdi->vdiWrite(i->second.data(), block_size_actual);
+        }
         
-        // // Return true if the file was found, false if not.
-        // return found_dir_entry;
-        /***   END ACTUAL CODE   ***/
+        // Write any indirect blocks changed, account for the new blocks, update the inode's
+        // times, and write the updated inode back to the inode table.
+        if (!dir_blocks.empty() || inode_changed)
+        {
+            edit.inode.i_atime = time(nullptr);
+            finish_edit(edit);
+        }
+        
+        return all_added;
     }
     
     
-    void ext2::debug_dump_pwd_inode()
+    /*----------------------------------------------------------------------------------------------
+     * Name:    directory_slots
+     * Type:    Function
+     * Purpose: Returns a directory's slot index, building it from the directory's blocks the
+     *          first time it is asked for.
+     * Input:   u32 dir_inode_num, holds the inode number of the directory.
+     * Output:  dir_slot_index &, the directory's slot index.
+    ----------------------------------------------------------------------------------------------*/
+    dir_slot_index & ext2::directory_slots(u32 dir_inode_num)
     {
-        ext2_inode temp = readInode(pwd.back().inode);
-        print_inode(&temp);
+        dir_slot_index & slots = dir_slots[dir_inode_num];
+        if (slots.is_built())
+        {
+            return slots;
+        }
+        
+        // Walk every record in every block of the directory, noting its name and its room.
+        ext2_inode dir_inode = readInode(dir_inode_num);
+        indirect_cache dir_indirect_cache;
+        vector<u8> dir_block(block_size_actual);
+        for (u32 i = 0; i < dir_inode.i_size / block_size_actual; i++)
+        {
+            u32 block_num = map_logical_block(dir_inode, i, dir_indirect_cache);
+            if (block_num == 0)
+            {
+                continue;
+            }
+            vdi->vdiSeek(blockToOffset(block_num), SEEK_SET);
+            vdi->vdiRead(dir_block.data(), block_size_actual);
+            
+            for (u32 offset = 0; offset + EXT2_DIR_BASE_SIZE <= block_size_actual;)
+            {
+                u32 record_inode = 0;
+                u16 record_length = 0;
+                u8 name_length = dir_block[offset + sizeof(u32) + sizeof(u16)];
+                memcpy(&record_inode, &(dir_block[offset]), sizeof(u32));
+                memcpy(&record_length, &(dir_block[offset + sizeof(u32)]), sizeof(u16));
+                if (record_length < EXT2_DIR_BASE_SIZE || offset + record_length > block_size_actual)
+                {
+                    break;
+                }
+                
+                if (record_inode == 0)
+                {
+                    slots.set_slack(block_num, offset, record_length);
+                }
+                else
+                {
+                    slots.add_name(string((const char *)&(dir_block[offset + EXT2_DIR_BASE_SIZE]), name_length));
+                    slots.set_slack(block_num, offset, record_length - utility::nearest_mult_four(EXT2_DIR_BASE_SIZE + name_length));
+                }
+                
+                offset += record_length;
+            }
+        }
+        
+        slots.mark_built();
+        return slots;
     }
-    
-    
-    void ext2::print_block(u32 block_to_dump, bool text)
+
+
+    /*----------------------------------------------------------------------------------------------
+     * Name:    ingest_tree
+     * Type:    Function
+     * Purpose: Copies a host directory, and everything below it, into the present working
+     *          directory.
+     *
+     *          The host tree is walked first, and every directory is created up front, so that the
+     *          directories can be spread across the block groups before any data lands.  The files
+     *          are then read by a small pool of threads, which open them and read the small ones
+     *          into memory a limited number of files ahead, while this thread alone allocates and
+     *          writes them, a directory's worth at a time, through ingest.  Regular files and
+     *          directories are copied; anything else is skipped with a warning.
+     * Input:   const string & host_path, holds the host directory to copy.
+     * Input:   string name, holds the name to give the copy.
+     * Output:  bool, true if everything was copied.
+    ----------------------------------------------------------------------------------------------*/
+    bool ext2::ingest_tree(const string & host_path, string name)
     {
-        u8 * raw_block = new u8[EXT2_BLOCK_BASE_SIZE << superblock.s_log_block_size];
+        struct tree_dir
+        {
+            string host_path;
+            string name;
+            u32 parent;
+            u32 inode;
+        };
+        struct tree_file
+        {
+            string host_path;
+            string name;
+            u32 dir;
+        };
         
-        vdi->vdiSeek(blockToOffset(block_to_dump), SEEK_SET);
-        vdi->vdiRead(raw_block, (EXT2_BLOCK_BASE_SIZE << superblock.s_log_block_size));
+        if (read_only)
+        {
+            cout << "Error: The file system is open read-only.  (ext2::ingest_tree)\n";
+            return false;
+        }
         
-        cout << "ext2::print_block\n";
+        bool all_copied = true;
         
-        if (!text)
+        
+        /***   Walk the host tree.   ***/
+        // Breadth first, so that the files of each directory are listed together.
+        vector<tree_dir> dirs;
+        vector<tree_file> files;
+        dirs.push_back({host_path, name, 0, 0});
+        for (u32 d = 0; d < dirs.size(); d++)
         {
-            for (u32 i = 0; i < (EXT2_BLOCK_BASE_SIZE << superblock.s_log_block_size); i++)
+            DIR * host_dir = opendir(dirs[d].host_path.c_str());
+            if (host_dir == nullptr)
             {
-                cout << hex << setw(2) << setfill('0') << (int)raw_block[i] << ' ';
+                cout << "Error: Could not open the host directory: " << dirs[d].host_path << "  (ext2::ingest_tree)\n";
+                if (d == 0)
+                {
+                    return false;
+                }
+                all_copied = false;
+                continue;
+            }
+            
+            vector<string> names;
+            for (struct dirent * host_entry = readdir(host_dir); host_entry != nullptr; host_entry = readdir(host_dir))
+            {
+                string entry_name = host_entry->d_name;
+                if (entry_name != "." && entry_name != "..")
+                {
+                    names.push_back(entry_name);
+                }
             }
+            closedir(host_dir);
+            sort(names.begin(), names.end());
+            
+            for (u32 i = 0; i < names.size(); i++)
+            {
+                string entry_path = dirs[d].host_path + "/" + names[i];
+                struct stat entry_stat;
+                if (lstat(entry_path.c_str(), &entry_stat) != 0)
+                {
+                    all_copied = false;
+                }
+                else if (S_ISDIR(entry_stat.st_mode))
+                {
+                    dirs.push_back({entry_path, names[i], d, 0});
+                }
+                else if (S_ISREG(entry_stat.st_mode))
+                {
+                    files.push_back({entry_path, names[i], d});
+                }
+                else
+                {
+                    cout << "Warning: Skipping " << entry_path << ", which is not a regular file or a directory.\n";
+                }
+            }
+        }
+        /***   End walk the host tree.   ***/
+        
+        
+        /***   Create the directories.   ***/
+        for (u32 d = 0; d < dirs.size(); d++)
+        {
+            u32 parent_inode = (d == 0 ? pwd.back().inode : dirs[dirs[d].parent].inode);
+            if (parent_inode == 0)
+            {
+                continue;
+            }
+            dirs[d].inode = make_directory(parent_inode, dirs[d].name);
+            if (dirs[d].inode == 0)
+            {
+                if (d == 0)
+                {
+                    return false;
+                }
+                all_copied = false;
+            }
+        }
+        /***   End create the directories.   ***/
+        
+        
+        /***   Read the files on the thread pool, and write them here.   ***/
+        struct read_ahead
+        {
+            int fd = -1;
+            vector<char> contents;
+            bool has_contents = false;
+            bool ready = false;
+        };
+        vector<read_ahead> reads(files.size());
+        mutex reads_mutex;
+        condition_variable reads_changed;
+        u32 next_to_read = 0;
+        u32 next_to_write = 0;
+        
+        // Each reader takes the next file, as long as it is not too far ahead of the writer.
+        vector<thread> readers;
+        for (u32 t = 0; t < EXT2_IMPORT_THREADS && t < files.size(); t++)
+        {
+            readers.push_back(thread([&]()
+            {
+                while (true)
+                {
+                    u32 i = 0;
+                    {
+                        unique_lock<mutex> lock(reads_mutex);
+                        reads_changed.wait(lock, [&]()
+                        {
+                            return next_to_read >= files.size() || next_to_read < next_to_write + EXT2_IMPORT_WINDOW;
+                        });
+                        if (next_to_read >= files.size())
+                        {
+                            return;
+                        }
+                        i = next_to_read++;
+                    }
+                    
+                    // Open the file, and read it if it is small enough to hold on to.
+                    read_ahead & read = reads[i];
+                    read.fd = ::open(files[i].host_path.c_str(), O_RDONLY);
+                    struct stat file_stat;
+                    if (read.fd != -1 &&
+                        fstat(read.fd, &file_stat) == 0 &&
+                        (u64)file_stat.st_size <= EXT2_IMPORT_PREFETCH_SIZE)
+                    {
+                        read.contents.resize(file_stat.st_size);
+                        read.contents.resize(utility::read_fully(read.fd, read.contents.data(), file_stat.st_size));
+                        read.has_contents = true;
+                    }
+                    
+                    lock_guard<mutex> lock(reads_mutex);
+                    read.ready = true;
+                    reads_changed.notify_all();
+                }
+            }));
+        }
+        
+        // Write the files a directory at a time, in batches no bigger than the read-ahead window.
+        for (u32 first = 0; first < files.size();)
+        {
+            u32 end = first;
+            while (end < files.size() && files[end].dir == files[first].dir && end - first < EXT2_IMPORT_WINDOW)
+            {
+                end++;
+            }
+            
+            // Wait for the batch to be read.
+            {
+                unique_lock<mutex> lock(reads_mutex);
+                for (u32 i = first; i < end; i++)
+                {
+                    reads_changed.wait(lock, [&]()
+                    {
+                        return reads[i].ready;
+                    });
+                }
+            }
+            
+            vector<ingest_item> batch;
+            for (u32 i = first; i < end; i++)
+            {
+                if (reads[i].fd == -1)
+                {
+                    cout << "Error: Could not open the host file: " << files[i].host_path << "  (ext2::ingest_tree)\n";
+                    all_copied = false;
+                    continue;
+                }
+                ingest_item item;
+                item.input_fd = reads[i].fd;
+                item.name = files[i].name;
+                item.contents = (reads[i].has_contents ? &(reads[i].contents) : nullptr);
+                batch.push_back(item);
+            }
+            
+            u32 dir_inode = dirs[files[first].dir].inode;
+            if (dir_inode == 0 || !ingest_into(dir_inode, batch))
+            {
+                all_copied = false;
+            }
+            
+            // Let go of the batch, and let the readers move on.
+            for (u32 i = first; i < end; i++)
+            {
+                if (reads[i].fd != -1)
+                {
+                    ::close(reads[i].fd);
+                }
+                vector<char>().swap(reads[i].contents);
+            }
+            {
+                lock_guard<mutex> lock(reads_mutex);
+                next_to_write = end;
+                reads_changed.notify_all();
+            }
+            
+            first = end;
+        }
+        
+        for (u32 t = 0; t < readers.size(); t++)
+        {
+            readers[t].join();
+        }
+        /***   End read the files on the thread pool, and write them here.   ***/
+        
+        return all_copied;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    export_tree
+     * Type:    Function
+     * Purpose: Copies a directory, and everything below it, out to the host.
+     *
+     *          The copy runs on a work-stealing pool of threads, all reading the virtual disk at
+     *          once through positioned reads.  Each directory is a task: it reads its entries,
+     *          reads the inodes of everything in it in one pass over the inode table, creates its
+     *          subdirectories on the host and submits each as a task of its own, and copies its
+     *          small files itself.  Files bigger than a copy buffer are split into buffer-sized
+     *          pieces, each its own task, all writing to the same host file with positioned
+     *          writes, so one large file does not hold up everything else.  Holes stay holes on
+     *          the host.  Regular files and directories are copied; anything else is skipped with
+     *          a warning.
+     * Input:   const string & path, holds the directory to copy, relative to the pwd or absolute.
+     * Input:   const string & host_path, holds the host directory to create for the copy.
+     * Output:  bool, true if everything was copied.
+    ----------------------------------------------------------------------------------------------*/
+    bool ext2::export_tree(const string & path, const string & host_path)
+    {
+        // A host file shared by the pieces of a large file, closed once the last one is done.
+        struct host_file
+        {
+            int fd;
+            ~host_file()
+            {
+                ::close(fd);
+            }
+        };
+        
+        vector<ext2_dir_entry> dir_path = dir_entry_exists(path);
+        if (dir_path.empty())
+        {
+            cout << "Error: Directory does not exist.  (ext2::export_tree)\n";
+            return false;
+        }
+        if (mkdir(host_path.c_str(), 0755) != 0)
+        {
+            cout << "Error: Could not create the host directory: " << host_path << "  (ext2::export_tree)\n";
+            return false;
+        }
+        
+        atomic<bool> all_copied(true);
+        work_stealing_pool pool(EXT2_EXPORT_THREADS);
+        
+        function<void(u32, string)> export_directory = [&](u32 dir_inode_num, string dir_host_path)
+        {
+            // Batch the inode reads for everything in the directory.
+            vector<ext2_dir_entry> entries;
+            vector<u32> inode_nums;
+            vector<ext2_dir_entry> all_entries = parse_directory_inode(dir_inode_num);
+            for (u32 i = 0; i < all_entries.size(); i++)
+            {
+                if (all_entries[i].inode != 0 && all_entries[i].name != "." && all_entries[i].name != "..")
+                {
+                    entries.push_back(all_entries[i]);
+                    inode_nums.push_back(all_entries[i].inode);
+                }
+            }
+            vector<ext2_inode> inodes;
+            if (!read_inodes(inode_nums, inodes))
+            {
+                all_copied = false;
+            }
+            
+            for (u32 i = 0; i < entries.size(); i++)
+            {
+                string entry_host_path = dir_host_path + "/" + entries[i].name;
+                u32 entry_type = inodes[i].i_mode & 0xF000;
+                
+                if (entry_type == EXT2_INODE_TYPE_DIR)
+                {
+                    if (mkdir(entry_host_path.c_str(), inodes[i].i_mode & 0777) != 0)
+                    {
+                        cout << "Error: Could not create the host directory: " << entry_host_path << "  (ext2::export_tree)\n";
+                        all_copied = false;
+                        continue;
+                    }
+                    u32 entry_inode_num = entries[i].inode;
+                    pool.submit([&export_directory, entry_inode_num, entry_host_path]()
+                    {
+                        export_directory(entry_inode_num, entry_host_path);
+                    });
+                }
+                else if (entry_type == EXT2_INODE_TYPE_FILE)
+                {
+                    // Size the host file up front; everything not written stays a hole.
+                    int fd = ::open(entry_host_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, inodes[i].i_mode & 0777);
+                    if (fd == -1)
+                    {
+                        cout << "Error: Could not create the host file: " << entry_host_path << "  (ext2::export_tree)\n";
+                        all_copied = false;
+                        continue;
+                    }
+                    shared_ptr<host_file> output(new host_file{fd});
+                    file_handle file = open_inode(entries[i].inode, inodes[i]);
+                    if (ftruncate(fd, file.size()) != 0)
+                    {
+                        cout << "Error: Could not write to the host file: " << entry_host_path << "  (ext2::export_tree)\n";
+                        all_copied = false;
+                        continue;
+                    }
+                    
+                    // Small files are copied here; large ones are split up across the pool.
+                    if (file.size() <= EXT2_COPY_BUFFER_SIZE)
+                    {
+                        if (!export_range(file, fd, 0, file.size()))
+                        {
+                            all_copied = false;
+                        }
+                        continue;
+                    }
+                    for (u64 start = 0; start < file.size(); start += EXT2_COPY_BUFFER_SIZE)
+                    {
+                        u64 end = (file.size() - start > EXT2_COPY_BUFFER_SIZE ? start + EXT2_COPY_BUFFER_SIZE : file.size());
+                        pool.submit([this, &all_copied, file, output, start, end]() mutable
+                        {
+                            if (!export_range(file, output->fd, start, end))
+                            {
+                                all_copied = false;
+                            }
+                        });
+                    }
+                }
+                else
+                {
+                    cout << "Warning: Skipping " << entry_host_path << ", which is not a regular file or a directory.\n";
+                }
+            }
+        };
+        
+        pool.submit([&export_directory, &dir_path, &host_path]()
+        {
+            export_directory(dir_path.back().inode, host_path);
+        });
+        pool.wait();
+        
+        return all_copied;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    export_range
+     * Type:    Function
+     * Purpose: Copies part of an open file to the same place in a host file, one stretch of data
+     *          at a time, skipping holes.  The host file must already be at its full size.
+     *          Each stretch is copied inside the kernel where the host allows it (see
+     *          file_handle::copy_to), and read and written here otherwise.  Positioned writes are
+     *          used, so several ranges of the same file can be copied at once.
+     * Input:   file_handle & file, holds the file to copy from.
+     * Input:   int output_fd, holds the host file descriptor to write to.
+     * Input:   u64 start, holds the offset of the start of the range.
+     * Input:   u64 end, holds the offset just past the end of the range.
+     * Output:  bool, true if the range was copied.
+    ----------------------------------------------------------------------------------------------*/
+    bool ext2::export_range(file_handle & file, int output_fd, u64 start, u64 end)
+    {
+        buffer_pool::buffer buffer;
+        
+        for (u64 offset = file.next_data(start); offset < end; offset = file.next_data(offset))
+        {
+            u64 data_end = file.next_hole(offset, end);
+            
+            // Have the kernel copy what it can, and read and write the rest here, a buffer at a
+            // time.
+            offset = file.copy_to(output_fd, offset, data_end);
+            while (offset < data_end)
+            {
+                size_t length = (data_end - offset < EXT2_COPY_BUFFER_SIZE ?
+                                 data_end - offset :
+                                 EXT2_COPY_BUFFER_SIZE);
+                if (buffer.size() < length)
+                {
+                    buffer.reset(length);
+                }
+                
+                // The host file already has its full length, so a short read would leave zeroes
+                // where the data should be.
+                size_t bytes_read = file.pread(buffer.data(), length, offset);
+                if (bytes_read == 0)
+                {
+                    cout << "Error: Could not read the file from the image.  (ext2::export_range)\n";
+                    return false;
+                }
+                if (!utility::pwrite_fully(output_fd, buffer.data(), bytes_read, offset))
+                {
+                    cout << "Error: Could not write to the host file.  (ext2::export_range)\n";
+                    return false;
+                }
+                offset += bytes_read;
+            }
+        }
+        
+        return true;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    find_directory_group
+     * Type:    Function
+     * Purpose: Chooses the block group for a new directory, along the lines of the Orlov
+     *          allocator in the Linux kernel.  Directories made in the root are spread out: they
+     *          go to the group with the fewest directories among those with at least the average
+     *          number of free inodes and blocks.  Other directories stay in their parent's group,
+     *          or the next one along, unless it is crowded with directories or short of space.
+     * Input:   u32 parent_inode_num, holds the inode number of the parent directory.
+     * Output:  u32, the block group.
+    ----------------------------------------------------------------------------------------------*/
+    u32 ext2::find_directory_group(u32 parent_inode_num)
+    {
+        load_bgd_table();
+        
+        u32 parent_group = inodeToBlockGroup(parent_inode_num);
+        
+        // Work out the averages across the groups.
+        u64 total_dirs = 0;
+        for (u32 i = 0; i < numBlockGroups; i++)
+        {
+            total_dirs += bgdTable[i].bg_used_dirs_count;
+        }
+        u32 average_free_inodes = superblock.s_free_inodes_count / numBlockGroups;
+        u32 average_free_blocks = superblock.s_free_blocks_count / numBlockGroups;
+        u32 average_dirs = total_dirs / numBlockGroups;
+        
+        if (parent_inode_num == EXT2_ROOT_INODE)
+        {
+            // Spread out, starting the search after the group last chosen this way.
+            u32 best_group = numBlockGroups;
+            for (u32 i = 0; i < numBlockGroups; i++)
+            {
+                u32 group = (last_directory_group + 1 + i) % numBlockGroups;
+                if (bgdTable[group].bg_free_inodes_count < average_free_inodes ||
+                    bgdTable[group].bg_free_inodes_count == 0 ||
+                    bgdTable[group].bg_free_blocks_count < average_free_blocks)
+                {
+                    continue;
+                }
+                if (best_group == numBlockGroups ||
+                    bgdTable[group].bg_used_dirs_count < bgdTable[best_group].bg_used_dirs_count)
+                {
+                    best_group = group;
+                }
+            }
+            if (best_group != numBlockGroups)
+            {
+                last_directory_group = best_group;
+                return best_group;
+            }
+        }
+        else
+        {
+            // Stay close to the parent, unless the group is getting crowded.
+            u32 max_dirs = average_dirs + superblock.s_inodes_per_group / 16;
+            u32 min_free_inodes = average_free_inodes / 4;
+            u32 min_free_blocks = average_free_blocks / 4;
+            for (u32 i = 0; i < numBlockGroups; i++)
+            {
+                u32 group = (parent_group + i) % numBlockGroups;
+                if (bgdTable[group].bg_used_dirs_count < max_dirs &&
+                    bgdTable[group].bg_free_inodes_count > 0 &&
+                    bgdTable[group].bg_free_inodes_count >= min_free_inodes &&
+                    bgdTable[group].bg_free_blocks_count >= min_free_blocks)
+                {
+                    return group;
+                }
+            }
+        }
+        
+        // Failing that, take the first group with at least the average number of free inodes.
+        for (u32 i = 0; i < numBlockGroups; i++)
+        {
+            u32 group = (parent_group + i) % numBlockGroups;
+            if (bgdTable[group].bg_free_inodes_count > 0 &&
+                bgdTable[group].bg_free_inodes_count >= average_free_inodes)
+            {
+                return group;
+            }
+        }
+        
+        return parent_group;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    make_directory
+     * Type:    Function
+     * Purpose: Creates an empty directory: its inode, its first block holding the "." and ".."
+     *          entries, and its entry in the parent.  The parent gains a link (from ".."), and the
+     *          block group a directory.
+     * Input:   u32 parent_inode_num, holds the inode number of the parent directory.
+     * Input:   string name, holds the name of the new directory.
+     * Output:  u32, the inode number of the new directory, or 0 if it could not be created.
+    ----------------------------------------------------------------------------------------------*/
+    u32 ext2::make_directory(u32 parent_inode_num, string name)
+    {
+        // Truncate the name to EXT2_FILENAME_MAX_LENGTH bytes if needed.
+        if (name.length() > EXT2_FILENAME_MAX_LENGTH)
+        {
+            cout << "Warning: Directory name is too long.  Truncating to " << EXT2_FILENAME_MAX_LENGTH <<
+                    " characters.\n";
+            name.erase(EXT2_FILENAME_MAX_LENGTH);
+        }
+        
+        // The name has to be a single path component.
+        if (!valid_entry_name(name))
+        {
+            cout << "Error: Invalid directory name: " << name << "  (ext2::make_directory)\n";
+            return 0;
+        }
+        
+        // Check to see if the name is taken.
+        if (directory_slots(parent_inode_num).has_name(name))
+        {
+            cout << "Error: File already exists: " << name << "  (ext2::make_directory)\n";
+            return 0;
+        }
+        
+        
+        /***   Allocate the inode and the first block.   ***/
+        u32 inode_num = allocate_inode(find_directory_group(parent_inode_num));
+        if (inode_num == 0)
+        {
+            cout << "Error: Not enough free inodes available on the file system.\n";
+            return 0;
+        }
+        
+        // The block goes in the same group as the inode, with room preallocated after it for the
+        // directory to grow into.
+        u32 group = inodeToBlockGroup(inode_num);
+        vector<u32> dir_block_num;
+        if (!allocate_blocks(group_data_start(group),
+                             1,
+                             superblock.s_prealloc_dir_blocks,
+                             dir_block_num,
+                             &(reservations[inode_num])))
+        {
+            cout << "Error: Not enough free blocks available on the file system.\n";
+            release_inode(inode_num);
+            return 0;
+        }
+        /***   End allocate the inode and the first block.   ***/
+        
+        
+        /***   Add the directory to its parent.   ***/
+        // The parent gains a link from the new directory's "..".
+        ext2_inode parent_inode = readInode(parent_inode_num);
+        parent_inode.i_links_count += 1;
+        write_inode(parent_inode, parent_inode_num);
+        
+        vector<ext2_dir_entry> parent_entry(1, make_dir_entry(inode_num, name, EXT2_DIR_TYPE_DIR));
+        if (!add_dir_entries(parent_inode_num, parent_entry))
+        {
+            parent_inode = readInode(parent_inode_num);
+            parent_inode.i_links_count -= 1;
+            write_inode(parent_inode, parent_inode_num);
+            release_blocks(dir_block_num);
+            release_inode(inode_num);
+            return 0;
+        }
+        charge_blocks(dir_block_num.data(), 1);
+        /***   End add the directory to its parent.   ***/
+        
+        
+        /***   Write the first directory block.   ***/
+        // "." takes just the room it needs, and ".." the rest of the block.
+        vector<u8> dir_block(block_size_actual, 0);
+        ext2_dir_entry dot = make_dir_entry(inode_num, ".", EXT2_DIR_TYPE_DIR);
+        ext2_dir_entry dot_dot = make_dir_entry(parent_inode_num, "..", EXT2_DIR_TYPE_DIR);
+        dot_dot.rec_len = block_size_actual - dot.rec_len;
+        memcpy(&(dir_block[0]), &dot, EXT2_DIR_BASE_SIZE);
+        memcpy(&(dir_block[EXT2_DIR_BASE_SIZE]), dot.name.c_str(), dot.name_len);
+        memcpy(&(dir_block[dot.rec_len]), &dot_dot, EXT2_DIR_BASE_SIZE);
+        memcpy(&(dir_block[dot.rec_len + EXT2_DIR_BASE_SIZE]), dot_dot.name.c_str(), dot_dot.name_len);
+        
+        vdi->vdiSeek(blockToOffset(dir_block_num[0]), SEEK_SET);
+        vdi->vdiWrite(dir_block.data(), block_size_actual);
+        /***   End write the first directory block.   ***/
+        
+        
+        /***   Build and write the inode.   ***/
+        ext2_inode dir_inode;
+        memset(&dir_inode, 0, sizeof(ext2_inode));
+        
+        // Set the inode type to be "directory", and then set permissions to 755.
+        dir_inode.i_mode = EXT2_INODE_TYPE_DIR |
+                           EXT2_INODE_PERM_USER_READ | EXT2_INODE_PERM_USER_WRITE | EXT2_INODE_PERM_USER_EXECUTE |
+                           EXT2_INODE_PERM_GROUP_READ | EXT2_INODE_PERM_GROUP_EXECUTE |
+                           EXT2_INODE_PERM_OTHER_READ | EXT2_INODE_PERM_OTHER_EXECUTE;
+        dir_inode.i_uid = EXT2_INODE_DEFAULT_UID;
+        dir_inode.i_gid = EXT2_INODE_DEFAULT_GID;
+        
+        // One block, linked from the parent's entry and from its own ".".
+        dir_inode.i_size = block_size_actual;
+        dir_inode.i_blocks = block_size_actual / EXT2_INODE_IBLOCKS_SIZE;
+        dir_inode.i_block[0] = dir_block_num[0];
+        dir_inode.i_links_count = 2;
+        
+        time_t current_time = time(nullptr);
+        dir_inode.i_atime = current_time;
+        dir_inode.i_ctime = current_time;
+        dir_inode.i_mtime = current_time;
+        
+        write_inode(dir_inode, inode_num);
+        /***   End build and write the inode.   ***/
+        
+        
+        // Count the directory in its block group.
+        bgdTable[group].bg_used_dirs_count += 1;
+        bgd_table_dirty = true;
+        
+        return inode_num;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    remove
+     * Type:    Function
+     * Purpose: Removes files, and with recursive set, directories and everything below them.
+     *          Each pattern may name an entry or hold wildcards in its last component.
+     *
+     *          Nothing is freed one file at a time.  Everything to be removed is found first,
+     *          reading the inodes of each directory's entries in one pass over the inode table.
+     *          The names are then taken out of their directories, each directory block being
+     *          rewritten once however many names go from it.  Finally every block of every file
+     *          being removed, indirect blocks included, is gathered, sorted and given back to the
+     *          free-space index in runs, and the inodes are freed.  The bitmaps, inode tables,
+     *          descriptor table and superblock only change in the metadata cache, to be written
+     *          together at the next commit.  A file with other hard links keeps its data, and
+     *          just loses the link.
+     * Input:   const vector<string> & patterns, holds the entries to remove.
+     * Input:   bool recursive, holds whether directories may be removed.
+     * Output:  bool, true if everything was removed.
+    ----------------------------------------------------------------------------------------------*/
+    bool ext2::remove(const vector<string> & patterns, bool recursive)
+    {
+        if (read_only)
+        {
+            cout << "Error: The file system is open read-only.  (ext2::remove)\n";
+            return false;
+        }
+        
+        bool all_removed = true;
+        
+        
+        /***   Find the entries to unlink.   ***/
+        map<u32, set<string>> unlinked_names;   // directory inode -> names to take out of it
+        vector<u32> unlinked_inodes;
+        map<u32, u32> links_dropped;            // directory inode -> subdirectories removed
+        for (u32 i = 0; i < patterns.size(); i++)
+        {
+            u32 dir_inode_num = 0;
+            vector<ext2_dir_entry> matches;
+            if (!match_entries(patterns[i], dir_inode_num, matches))
+            {
+                cout << "Error: No such file or directory: " << patterns[i] << "  (ext2::remove)\n";
+                all_removed = false;
+                continue;
+            }
+            
+            for (u32 j = 0; j < matches.size(); j++)
+            {
+                if (matches[j].file_type == EXT2_DIR_TYPE_DIR)
+                {
+                    if (!recursive)
+                    {
+                        cout << "Error: " << matches[j].name << " is a directory.  (ext2::remove)\n";
+                        all_removed = false;
+                        continue;
+                    }
+                    
+                    // The present working directory, or anything above it, has to stay.
+                    bool in_pwd = false;
+                    for (u32 k = 0; k < pwd.size(); k++)
+                    {
+                        in_pwd = in_pwd || pwd[k].inode == matches[j].inode;
+                    }
+                    if (in_pwd)
+                    {
+                        cout << "Error: Cannot remove " << matches[j].name << ", which holds the present working directory.  (ext2::remove)\n";
+                        all_removed = false;
+                        continue;
+                    }
+                }
+                
+                if (unlinked_names[dir_inode_num].insert(matches[j].name).second)
+                {
+                    unlinked_inodes.push_back(matches[j].inode);
+                    if (matches[j].file_type == EXT2_DIR_TYPE_DIR)
+                    {
+                        links_dropped[dir_inode_num]++;
+                    }
+                }
+            }
+        }
+        /***   End find the entries to unlink.   ***/
+        
+        
+        /***   Walk the directories being removed.   ***/
+        // Directories are freed outright.  Anything else is freed once its last link is gone.
+        map<u32, ext2_inode> dirs_to_free;
+        map<u32, ext2_inode> other_inodes;
+        map<u32, u32> links_left;
+        vector<u32> level = unlinked_inodes;
+        while (!level.empty())
+        {
+            vector<ext2_inode> inodes;
+            read_inodes(level, inodes);
+            
+            vector<u32> next_level;
+            for (u32 i = 0; i < level.size(); i++)
+            {
+                if ((inodes[i].i_mode & 0xF000) != EXT2_INODE_TYPE_DIR)
+                {
+                    if (links_left.find(level[i]) == links_left.end())
+                    {
+                        other_inodes[level[i]] = inodes[i];
+                        links_left[level[i]] = inodes[i].i_links_count;
+                    }
+                    if (links_left[level[i]] > 0)
+                    {
+                        links_left[level[i]]--;
+                    }
+                    continue;
+                }
+                
+                if (!dirs_to_free.insert(make_pair(level[i], inodes[i])).second)
+                {
+                    continue;
+                }
+                vector<ext2_dir_entry> dir_contents = parse_directory_inode(inodes[i]);
+                for (u32 j = 0; j < dir_contents.size(); j++)
+                {
+                    if (dir_contents[j].inode != 0 && dir_contents[j].name != "." && dir_contents[j].name != "..")
+                    {
+                        next_level.push_back(dir_contents[j].inode);
+                    }
+                }
+            }
+            level.swap(next_level);
+        }
+        /***   End walk the directories being removed.   ***/
+        
+        
+        /***   Unlink the entries.   ***/
+        // Directories that are going away altogether are left as they are.
+        time_t current_time = time(nullptr);
+        for (map<u32, set<string>>::iterator i = unlinked_names.begin(); i != unlinked_names.end(); ++i)
+        {
+            if (dirs_to_free.count(i->first) > 0 || i->second.empty())
+            {
+                continue;
+            }
+            if (!remove_dir_entries(i->first, i->second))
+            {
+                all_removed = false;
+            }
+            if (links_dropped[i->first] > 0)
+            {
+                ext2_inode dir_inode = readInode(i->first);
+                dir_inode.i_links_count -= links_dropped[i->first];
+                write_inode(dir_inode, i->first);
+            }
+        }
+        /***   End unlink the entries.   ***/
+        
+        
+        /***   Free the inodes and their blocks.   ***/
+        load_free_space_index();
+        vector<u32> freed_blocks;
+        for (map<u32, ext2_inode>::iterator i = dirs_to_free.begin(); i != dirs_to_free.end(); ++i)
+        {
+            inode_blocks(i->second, freed_blocks);
+            i->second.i_links_count = 0;
+            i->second.i_dtime = current_time;
+            write_inode(i->second, i->first);
+            release_inode(i->first);
+            bgdTable[inodeToBlockGroup(i->first)].bg_used_dirs_count -= 1;
+            dir_slots.erase(i->first);
+        }
+        for (map<u32, ext2_inode>::iterator i = other_inodes.begin(); i != other_inodes.end(); ++i)
+        {
+            i->second.i_links_count = links_left[i->first];
+            i->second.i_ctime = current_time;
+            if (i->second.i_links_count == 0)
+            {
+                inode_blocks(i->second, freed_blocks);
+                i->second.i_dtime = current_time;
+                release_inode(i->first);
+            }
+            write_inode(i->second, i->first);
+        }
+        
+        // Give the blocks back in runs.
+        sort(freed_blocks.begin(), freed_blocks.end());
+        freed_blocks.erase(unique(freed_blocks.begin(), freed_blocks.end()), freed_blocks.end());
+        release_blocks(freed_blocks);
+        discharge_blocks(freed_blocks.data(), freed_blocks.size());
+        /***   End free the inodes and their blocks.   ***/
+        
+        return all_removed;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    remove_dir_entries
+     * Type:    Function
+     * Purpose: Takes names out of a directory.  A removed entry's record is merged into the one
+     *          before it in the block, or if it is the first in its block, is left in place as an
+     *          unused record.  Each block is written back once, after all its changes are made.
+     * Input:   u32 dir_inode_num, holds the inode number of the directory.
+     * Input:   const set<string> & names, holds the names to remove.
+     * Output:  bool, true if every name was found and removed.
+    ----------------------------------------------------------------------------------------------*/
+    bool ext2::remove_dir_entries(u32 dir_inode_num, const set<string> & names)
+    {
+        ext2_inode dir_inode = readInode(dir_inode_num);
+        dir_slot_index * slots = (dir_slots.count(dir_inode_num) > 0 ? &(dir_slots[dir_inode_num]) : nullptr);
+        indirect_cache dir_indirect_cache;
+        vector<u8> dir_block(block_size_actual);
+        u32 num_removed = 0;
+        
+        for (u32 i = 0; i < dir_inode.i_size / block_size_actual && num_removed < names.size(); i++)
+        {
+            u32 block_num = map_logical_block(dir_inode, i, dir_indirect_cache);
+            if (block_num == 0)
+            {
+                continue;
+            }
+            vdi->vdiPread(dir_block.data(), block_size_actual, blockToOffset(block_num));
+            
+            bool block_changed = false;
+            u32 previous = 0;
+            bool has_previous = false;
+            for (u32 offset = 0; offset + EXT2_DIR_BASE_SIZE <= block_size_actual;)
+            {
+                u32 record_inode = 0;
+                u16 record_length = 0;
+                u8 name_length = dir_block[offset + sizeof(u32) + sizeof(u16)];
+                memcpy(&record_inode, &(dir_block[offset]), sizeof(u32));
+                memcpy(&record_length, &(dir_block[offset + sizeof(u32)]), sizeof(u16));
+                if (record_length < EXT2_DIR_BASE_SIZE || offset + record_length > block_size_actual)
+                {
+                    break;
+                }
+                
+                string name((const char *)&(dir_block[offset + EXT2_DIR_BASE_SIZE]), name_length);
+                if (record_inode == 0 || names.count(name) == 0)
+                {
+                    previous = offset;
+                    has_previous = true;
+                    offset += record_length;
+                    continue;
+                }
+                
+                if (has_previous)
+                {
+                    // Fold the record into the one before it.
+                    u32 previous_inode = 0;
+                    u16 previous_length = 0;
+                    u8 previous_name_length = dir_block[previous + sizeof(u32) + sizeof(u16)];
+                    memcpy(&previous_inode, &(dir_block[previous]), sizeof(u32));
+                    memcpy(&previous_length, &(dir_block[previous + sizeof(u32)]), sizeof(u16));
+                    previous_length += record_length;
+                    memcpy(&(dir_block[previous + sizeof(u32)]), &previous_length, sizeof(u16));
+                    
+                    if (slots != nullptr)
+                    {
+                        slots->set_slack(block_num, offset, 0);
+                        slots->set_slack(block_num, previous, (previous_inode == 0 ?
+                                                               previous_length :
+                                                               previous_length - utility::nearest_mult_four(EXT2_DIR_BASE_SIZE + previous_name_length)));
+                    }
+                }
+                else
+                {
+                    // The first record in the block stays, unused.
+                    record_inode = 0;
+                    memcpy(&(dir_block[offset]), &record_inode, sizeof(u32));
+                    if (slots != nullptr)
+                    {
+                        slots->set_slack(block_num, offset, record_length);
+                    }
+                    previous = offset;
+                    has_previous = true;
+                }
+                
+                if (slots != nullptr)
+                {
+                    slots->remove_name(name);
+                }
+                block_changed = true;
+                num_removed++;
+                offset += record_length;
+            }
+            
+            if (block_changed)
+            {
+                vdi->vdiSeek(blockToOffset(block_num), SEEK_SET);
+                vdi->vdiWrite(dir_block.data(), block_size_actual);
+            }
+        }
+        
+        // Update the directory's modification time.
+        time_t current_time = time(nullptr);
+        dir_inode.i_mtime = current_time;
+        dir_inode.i_ctime = current_time;
+        write_inode(dir_inode, dir_inode_num);
+        
+        if (num_removed < names.size())
+        {
+            cout << "Error: Not every entry could be found in its directory.  (ext2::remove_dir_entries)\n";
+            return false;
+        }
+        return true;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    open
+     * Type:    Function
+     * Purpose: Opens a file in the virtual filesystem for random access reads.  Only the file's
+     *          inode is read here; block pointers are resolved on demand by the handle.
+     * Input:   const string & path, holds the path to the file, relative to the pwd or absolute.
+     * Output:  file_handle, holding the opened file.  is_open() will be false if the file could
+     *          not be found.
+    ----------------------------------------------------------------------------------------------*/
+    ext2::file_handle ext2::open(const string & path)
+    {
+        file_handle to_return;
+        u32 file_inode = 0;
+        
+        // Resolve the path, and if it leads to a file, load the file's inode into the handle.
+        if (file_path_exists(path, file_inode) == true)
+        {
+            to_return = open_inode(file_inode, readInode(file_inode));
+        }
+        
+        return to_return;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    open_inode
+     * Type:    Function
+     * Purpose: Opens a file whose inode has already been read.  Handles opened this way can be
+     *          read from several threads at once, one handle per thread.
+     * Input:   u32 inode_num, holds the file's inode number.
+     * Input:   const ext2_inode & inode, holds the file's inode.
+     * Output:  file_handle, holding the opened file.
+    ----------------------------------------------------------------------------------------------*/
+    ext2::file_handle ext2::open_inode(u32 inode_num, const ext2_inode & inode)
+    {
+        file_handle to_return;
+        to_return.file_system = this;
+        to_return.inode_num = inode_num;
+        to_return.inode = inode;
+        return to_return;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    file_handle::pread
+     * Type:    Function
+     * Purpose: Reads a range of bytes from an open file.  Each logical block in the range is mapped
+     *          straight to its physical block, and physically consecutive blocks are read together.
+     *          Holes in the file read back as zeroes.
+     * Input:   void * buf, the buffer into which the data should be read.
+     * Input:   size_t count, the number of bytes which should be read.
+     * Input:   u64 offset, the offset within the file to start reading from.
+     * Output:  size_t, holding the number of bytes actually read, which is short only when the end
+     *          of the file is reached or the image cannot be read.
+    ----------------------------------------------------------------------------------------------*/
+    size_t ext2::file_handle::pread(void * buf, size_t count, u64 offset)
+    {
+        // Nothing can be read past the end of the file.
+        if (!is_open() || offset >= size())
+        {
+            return 0;
+        }
+        
+        // Clamp the read to the end of the file.
+        if (count > size() - offset)
+        {
+            count = size() - offset;
+        }
+        
+        u8 * out = (u8 *)buf;
+        size_t block_size = file_system->block_size_actual;
+        size_t bytes_read = 0;
+        
+        while (bytes_read < count)
+        {
+            // Locate the first block of this run, and where in that block the run starts.
+            u64 position = offset + bytes_read;
+            u32 logical_block = position / block_size;
+            size_t block_offset = position % block_size;
+            u32 physical_block = file_system->map_logical_block(inode, logical_block, cache);
+            
+            // The run covers at least the rest of the first block.
+            size_t run_bytes = block_size - block_offset;
+            if (run_bytes > count - bytes_read)
+            {
+                run_bytes = count - bytes_read;
+            }
+            
+            // Extend the run for as long as the following blocks are physically consecutive (or,
+            // for holes, as long as they are holes too).
+            for (u32 i = 1; bytes_read + run_bytes < count; i++)
+            {
+                u32 next_block = file_system->map_logical_block(inode, logical_block + i, cache);
+                if (physical_block == 0 ? next_block != 0 : next_block != physical_block + i)
+                {
+                    break;
+                }
+                
+                run_bytes += (count - bytes_read - run_bytes < block_size ?
+                              count - bytes_read - run_bytes :
+                              block_size);
+            }
+            
+            // Holes read back as zeroes, everything else comes from the disk.
+            if (physical_block == 0)
+            {
+                memset(&(out[bytes_read]), 0, run_bytes);
+            }
+            else
+            {
+                size_t run_read = file_system->vdi->vdiPreadBulk(&(out[bytes_read]),
+                                                                 run_bytes,
+                                                                 file_system->blockToOffset(physical_block) + block_offset);
+                if (run_read < run_bytes)
+                {
+                    // The image could not be read, so stop at what was.
+                    return bytes_read + run_read;
+                }
+            }
+            
+            bytes_read += run_bytes;
+        }
+        
+        return bytes_read;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    file_handle::copy_to
+     * Type:    Function
+     * Purpose: Copies a range of an open file to the same place in a host file without the data
+     *          passing through user space.  Runs of physically consecutive blocks are handed to
+     *          vdiCopyOut whole.  Holes are skipped, so the host file must already be at its full
+     *          size.  The copy stops at the first run the kernel will not copy in full.
+     * Input:   int output_fd, holds the host file descriptor to copy into.
+     * Input:   u64 offset, holds the offset of the start of the range.
+     * Input:   u64 end, holds the offset just past the end of the range.
+     * Output:  u64, holding the offset the copy got up to: the end of the range (clamped to
+     *          size()) if all of it was copied, or where the rest must be copied the ordinary way.
+    ----------------------------------------------------------------------------------------------*/
+    u64 ext2::file_handle::copy_to(int output_fd, u64 offset, u64 end)
+    {
+        if (end > size())
+        {
+            end = size();
+        }
+        
+        size_t block_size = file_system->block_size_actual;
+        while (offset < end)
+        {
+            // Find the run of blocks starting here, as pread does.
+            u32 logical_block = offset / block_size;
+            size_t block_offset = offset % block_size;
+            u32 physical_block = file_system->map_logical_block(inode, logical_block, cache);
+            
+            u64 run_bytes = block_size - block_offset;
+            for (u32 i = 1; offset + run_bytes < end; i++)
+            {
+                u32 next_block = file_system->map_logical_block(inode, logical_block + i, cache);
+                if (physical_block == 0 ? next_block != 0 : next_block != physical_block + i)
+                {
+                    break;
+                }
+                run_bytes += block_size;
+            }
+            if (run_bytes > end - offset)
+            {
+                run_bytes = end - offset;
+            }
+            
+            if (physical_block != 0)
+            {
+                off_t location = file_system->blockToOffset(physical_block) + block_offset;
+                ssize_t bytes_copied = file_system->vdi->vdiCopyOut(output_fd, offset, run_bytes, location);
+                if (bytes_copied != (ssize_t)run_bytes)
+                {
+                    return offset + (bytes_copied > 0 ? bytes_copied : 0);
+                }
+            }
+            
+            offset += run_bytes;
+        }
+        
+        return offset;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    file_handle::next_data
+     * Type:    Function
+     * Purpose: Finds the next byte at or after the given offset that is not in a hole, much like
+     *          lseek with SEEK_DATA.  Holes under a missing indirect block are skipped whole.
+     * Input:   u64 offset, holds the offset to start looking from.
+     * Output:  u64, holding the offset of the next data, or size() if there is none.
+    ----------------------------------------------------------------------------------------------*/
+    u64 ext2::file_handle::next_data(u64 offset)
+    {
+        size_t block_size = file_system->block_size_actual;
+        u64 end_block = (size() + block_size - 1) / block_size;
+        
+        for (u64 logical_block = offset / block_size; logical_block < end_block;)
+        {
+            u64 hole_end = logical_block + 1;
+            if (file_system->map_logical_block(inode, logical_block, cache, &hole_end) != 0)
+            {
+                return (logical_block * block_size > offset ? logical_block * block_size : offset);
+            }
+            logical_block = hole_end;
+        }
+        
+        return size();
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    file_handle::next_hole
+     * Type:    Function
+     * Purpose: Finds the next byte at or after the given offset that is in a hole, much like lseek
+     *          with SEEK_HOLE, but never looks past the given limit.
+     * Input:   u64 offset, holds the offset to start looking from.
+     * Input:   u64 limit, holds the offset at which to stop looking.
+     * Output:  u64, holding the offset of the next hole, or the limit (clamped to size()) if there
+     *          is no hole before it.
+    ----------------------------------------------------------------------------------------------*/
+    u64 ext2::file_handle::next_hole(u64 offset, u64 limit)
+    {
+        size_t block_size = file_system->block_size_actual;
+        if (limit > size())
+        {
+            limit = size();
+        }
+        
+        u64 logical_block = offset / block_size;
+        while (logical_block * block_size < limit &&
+               file_system->map_logical_block(inode, logical_block, cache) != 0)
+        {
+            logical_block++;
+        }
+        
+        u64 to_return = (logical_block * block_size > offset ? logical_block * block_size : offset);
+        return (to_return < limit ? to_return : limit);
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    file_handle::size
+     * Type:    Function
+     * Purpose: Returns the size of an open file.
+     * Input:   Nothing.
+     * Output:  u64, holding the size of the file in bytes, or 0 if the handle is not open.
+    ----------------------------------------------------------------------------------------------*/
+    u64 ext2::file_handle::size() const
+    {
+        return is_open() ? file_system->inode_size(inode) : 0;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    file_handle::is_open
+     * Type:    Function
+     * Purpose: Returns whether the handle refers to an open file.
+     * Input:   Nothing.
+     * Output:  bool, true if the handle is open.
+    ----------------------------------------------------------------------------------------------*/
+    bool ext2::file_handle::is_open() const
+    {
+        return file_system != nullptr;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    file_handle::close
+     * Type:    Function
+     * Purpose: Closes the handle, releasing its cached indirect blocks.
+     * Input:   Nothing.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    void ext2::file_handle::close()
+    {
+        file_system = nullptr;
+        inode_num = 0;
+        cache = indirect_cache();
+    }
+
+
+    /*----------------------------------------------------------------------------------------------
+     * Name:    offsetToBlock
+     * Type:    Function
+     * Purpose: ...
+     * Input:   off_t offset, containing ...
+     * Output:  u32....
+    ----------------------------------------------------------------------------------------------*/
+    // Needed?
+    u32 ext2::offsetToBlock(off_t offset)
+    {
+        return (offset - (off_t)bootSector.partitionTable[0].firstSector * VDI_SECTOR_SIZE) / 
+               (EXT2_BLOCK_BASE_SIZE << superblock.s_log_block_size);
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    inodeToBlockGroup
+     * Type:    Function
+     * Purpose: Determine which block group an inode is a part of.
+     * Input:   u32 inode_number, containing the inode number to check.
+     * Output:  u32, containing the block group number the inode is a part of.
+    ----------------------------------------------------------------------------------------------*/
+    u32 ext2::inodeToBlockGroup(u32 inode_number)
+    {
+        return (inode_number - 1) / superblock.s_inodes_per_group;
+    }
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    inodeBlockGroupIndex
+     * Type:    Function
+     * Purpose: Determines the index of an inode within a block group.
+     * Input:   u32 inode_number, containing the inode number to check.
+     * Output:  u32, containing the index number of an inode within a block group.
+    ----------------------------------------------------------------------------------------------*/
+    u32 ext2::inodeBlockGroupIndex(u32 inode_number)
+    {
+        return (inode_number - 1) % superblock.s_inodes_per_group;
+    }
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    blockToBlockGroup
+     * Type:    Function
+     * Purpose: Determine which block group a block is a part of.
+     * Input:   u32 block_number, containing the block number to check.
+     * Output:  u32, containing the block group number the block is a part of.
+    ----------------------------------------------------------------------------------------------*/
+    u32 ext2::blockToBlockGroup(u32 block_number)
+    {
+        return (block_number - superblock.s_first_data_block) / superblock.s_blocks_per_group;
+    }
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    blockBlockGroupIndex
+     * Type:    Function
+     * Purpose: Determines the index of a block within a block group, which is also its bit in the
+     *          group's block bitmap.
+     * Input:   u32 block_number, containing the block number to check.
+     * Output:  u32, containing the index number of a block within a block group.
+    ----------------------------------------------------------------------------------------------*/
+    u32 ext2::blockBlockGroupIndex(u32 block_number)
+    {
+        return (block_number - superblock.s_first_data_block) % superblock.s_blocks_per_group;
+    }
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    blockToOffset
+     * Type:    Function
+     * Purpose: ...
+     * Input:   u32 block_number, containing ...
+     * Output:  off_t....
+    ----------------------------------------------------------------------------------------------*/
+    off_t ext2::blockToOffset(u32 block_number)
+    {
+        return block_number < superblock.s_blocks_count ?
+               (off_t)bootSector.partitionTable[0].firstSector * VDI_SECTOR_SIZE + 
+                  (off_t)block_number * (EXT2_BLOCK_BASE_SIZE << superblock.s_log_block_size) :
+               -1;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    inodeToOffset
+     * Type:    Function
+     * Purpose: Calculates the offset of an inode on the disk.
+     * Input:   u32 inode_num, containing the inode number to calculate the offset for.
+     * Output:  off_t, holding the offset of the inode on the disk.
+    ----------------------------------------------------------------------------------------------*/
+    off_t ext2::inodeToOffset(u32 inode_num)
+    {
+        load_bgd_table();
+        
+        u32 inode_block_group = inodeToBlockGroup(inode_num);
+        u32 inode_index = inodeBlockGroupIndex(inode_num);
+        
+        // Calculate and return.
+        return blockToOffset(bgdTable[inode_block_group].bg_inode_table) +
+               (off_t)inode_index * superblock.s_inode_size;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    print_inode
+     * Type:    Function
+     * Purpose: Prints inode information.
+     * Input:   ext2_inode* inode, containing pointer to an inode object.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    void ext2::print_inode(ext2_inode* inode)
+    {
+        cout << "\nInode contents:\n";
+        cout << "Type: " <<
+            (((inode->i_mode >> 12) << 12) == EXT2_INODE_TYPE_FIFO ? "FIFO\n" : "") <<
+            (((inode->i_mode >> 12) << 12) == EXT2_INODE_TYPE_CHARDEV ? "Character device\n" : "") <<
+            (((inode->i_mode >> 12) << 12) == EXT2_INODE_TYPE_DIR ? "Directory\n" : "") <<
+            (((inode->i_mode >> 12) << 12) == EXT2_INODE_TYPE_BLOCKDEV ? "Block device \n" : "") <<
+            (((inode->i_mode >> 12) << 12) == EXT2_INODE_TYPE_FILE ? "Regular file\n" : "") <<
+            (((inode->i_mode >> 12) << 12) == EXT2_INODE_TYPE_SYMLINK ? "Symbolic link\n" : "") <<
+            (((inode->i_mode >> 12) << 12) == EXT2_INODE_TYPE_SOCKET ? "Unix socket\n" : "");
+        cout << "Permissions:\n" << 
+            (inode->i_mode & EXT2_INODE_PERM_OTHER_EXECUTE ? "  other execute\n" : "") <<
+            (inode->i_mode & EXT2_INODE_PERM_OTHER_WRITE ? "  other write\n" : "") <<
+            (inode->i_mode & EXT2_INODE_PERM_OTHER_READ ? "  other read\n" : "") <<
+            (inode->i_mode & EXT2_INODE_PERM_GROUP_EXECUTE ? "  group execute\n" : "") <<
+            (inode->i_mode & EXT2_INODE_PERM_GROUP_WRITE ? "  group write\n" : "") <<
+            (inode->i_mode & EXT2_INODE_PERM_GROUP_READ ? "  group read\n" : "") <<
+            (inode->i_mode & EXT2_INODE_PERM_USER_EXECUTE ? "  user execute\n" : "") <<
+            (inode->i_mode & EXT2_INODE_PERM_USER_WRITE ? "  user write\n" : "") <<
+            (inode->i_mode & EXT2_INODE_PERM_USER_READ ? "  user read\n" : "") <<
+            (inode->i_mode & EXT2_INODE_PERM_STICKYBIT ? "  sticky bit\n" : "") <<
+            (inode->i_mode & EXT2_INODE_PERM_SETGID ? "  set group id\n" : "") <<
+            (inode->i_mode & EXT2_INODE_PERM_SETUID ? "  set user id\n" : "");
+        cout << "User ID: " << inode->i_uid << endl;
+        cout << "Lower 32 bits of size in bytes: " << inode->i_size << endl;
+        cout << "Last access time: " << inode->i_atime << endl;
+        cout << "Creation time: " << inode->i_ctime << endl;
+        cout << "Last modification time: " << inode->i_mtime << endl;
+        cout << "Deletion time: " << inode->i_dtime << endl;
+        cout << "Group ID: " << inode->i_gid << endl;
+        cout << "Hard link count: " << inode->i_links_count << endl;
+        cout << "Disk sectors used count: " << inode->i_blocks << endl;
+        cout << "Flags:\n" <<
+            (inode->i_flags & EXT2_INODE_FLAGS_SECURE_DELETE ? "  secure delete\n" : "") <<
+            (inode->i_flags & EXT2_INODE_FLAGS_KEEP_COPY_ON_DELETE ? "  keep copy on delete\n" : "") <<
+            (inode->i_flags & EXT2_INODE_FLAGS_FILE_COMPRESSION ? "  file compression\n" : "") <<
+            (inode->i_flags & EXT2_INODE_FLAGS_SYNC_UPDATES ? "  synchronous updates\n" : "") <<
+            (inode->i_flags & EXT2_INODE_FLAGS_IMMUTABLE ? "  immutable file\n" : "") <<
+            (inode->i_flags & EXT2_INODE_FLAGS_APPEND ? "  append only\n" : "") <<
+            (inode->i_flags & EXT2_INODE_FLAGS_DO_NOT_DUMP ? "  file not included in 'dump' commend\n" : "") <<
+            (inode->i_flags & EXT2_INODE_FLAGS_LAST_ACCESS_NO_UPDATE ? "  last access time not updated\n" : "") <<
+            (inode->i_flags & EXT2_INODE_FLAGS_HASH_INDEX_DIR ? "  hash indexed directory\n" : "") <<
+            (inode->i_flags & EXT2_INODE_FLAGS_AFS_DIR ? "  AFS directory\n" : "") <<
+            (inode->i_flags & EXT2_INODE_FLAGS_JOURNAL_FILE_DATA ? "  journal file data\n" : "");
+        for (u32 i = 0; i < EXT2_INODE_NBLOCKS_TOT; i++)
+            cout << "Block pointer " << i << ": " << inode->i_block[i] << endl;
+        cout << "File version: " << inode->i_generation << endl;
+        cout << "File ACL: " << inode->i_file_acl << endl;
+        cout << "Directory ACL: " << inode->i_dir_acl << endl;
+        cout << "Fragment address: " << inode->i_faddr << endl;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    print_dir_entry
+     * Type:    Function
+     * Purpose: Prints directory information.
+     * Input:   ext2_dir_entry & dir_entry, containing pointer to a directory object.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    void ext2::print_dir_entry(ext2_dir_entry & dir_entry, bool verbose)
+    {
+        if (verbose)
+        {
+            cout << "\nDirectory Entry:\n";
+            cout << "Inode number: " << dir_entry.inode << endl;
+            cout << "Directory record length: " << dir_entry.rec_len << endl;
+            cout << "Name length: " << (int)(dir_entry.name_len) << endl;
+            cout << "Directory entry type: " <<
+                (dir_entry.file_type == EXT2_DIR_TYPE_UNKNOWN ? "unknown\n" : "") <<
+                (dir_entry.file_type == EXT2_DIR_TYPE_FILE ? "regular file\n" : "") <<
+                (dir_entry.file_type == EXT2_DIR_TYPE_DIR ? "directory\n" : "") <<
+                (dir_entry.file_type == EXT2_DIR_TYPE_CHARDEV ? "character device\n" : "") <<
+                (dir_entry.file_type == EXT2_DIR_TYPE_BLOCKDEV ? "block device\n" : "") <<
+                (dir_entry.file_type == EXT2_DIR_TYPE_FIFO ? "FIFO\n" : "") <<
+                (dir_entry.file_type == EXT2_DIR_TYPE_SOCKET ? "socket\n" : "") <<
+                (dir_entry.file_type == EXT2_DIR_TYPE_SYMLINK ? "symbolic link\n" : "");
+            cout << "Name: ";
+        }
+        
+        cout << dir_entry.name << endl;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    print_superblock
+     * Type:    Function
+     * Purpose: Prints superblock information.
+     * Input:   Nothing.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    void ext2::print_superblock()
+    {
+        cout << "\nSuperblock Dump:\n";
+        cout << "Inodes count: " << superblock.s_inodes_count << endl;
+        cout << "Blocks count: " << superblock.s_blocks_count << endl;
+        cout << "Reserved blocks count: " << superblock.s_r_blocks_count << endl;
+        cout << "Free blocks count: " << superblock.s_free_blocks_count << endl;
+        cout << "Free inodes count: " << superblock.s_free_inodes_count << endl;
+        cout << "First data block: " << superblock.s_first_data_block << endl;
+        cout << "Block size: " << (EXT2_BLOCK_BASE_SIZE << superblock.s_log_block_size) << endl;
+        cout << "Fragment size: " << (EXT2_FRAG_BASE_SIZE << superblock.s_log_frag_size) << endl;
+        cout << "# blocks per group: " << superblock.s_blocks_per_group << endl;
+        cout << "# fragments per group: " << superblock.s_frags_per_group << endl;
+        cout << "# inodes per group: " << superblock.s_inodes_per_group << endl;
+        cout << "Mount time: " << superblock.s_mtime << endl;
+        cout << "Write time: " << superblock.s_wtime << endl;
+        cout << "Mount count: " << superblock.s_mnt_count << endl;
+        cout << "Maximal mount count: " << superblock.s_max_mnt_count << endl;
+        cout << "Magic signature: " << hex << superblock.s_magic << dec << endl;
+        cout << "File system state: " << superblock.s_state << endl;
+        cout << "Error behaviour: " << superblock.s_errors << endl;
+        cout << "Minor revision level: " << superblock.s_minor_rev_level << endl;
+        cout << "Time of last check: " << superblock.s_lastcheck << endl;
+        cout << "Check interval: " << superblock.s_checkinterval << endl;
+        cout << "Creator OS: " << superblock.s_creator_os << endl;
+        cout << "Revision level: " << superblock.s_rev_level << endl;
+        cout << "Default reserved UID: " << superblock.s_def_resuid << endl;
+        cout << "Default reserved GID: " << superblock.s_def_resgid << endl;
+        
+        cout << "\nFirst non-reserved inode: " << superblock.s_first_ino << endl;
+        cout << "inode structure size: " << superblock.s_inode_size << endl;
+        cout << "Block group number of superblock: " << superblock.s_block_group_nr << endl;
+        cout << "Compatible feature set: " << superblock.s_feature_compat << endl;
+        cout << "Incompatible feature set: " << superblock.s_feature_incompat << endl;
+        cout << "Read-only compatible feature set: " << superblock.s_feature_ro_compat << endl;
+        cout << "Volume UUID: " << superblock.s_uuid << endl;
+        cout << "Volume Name: " << superblock.s_volume_name << endl;
+        cout << "Directory where last mounted: " << superblock.s_last_mounted << endl;
+        cout << "Compression algorithm usage bitmap: " << superblock.s_algorithm_usage_bitmap << endl;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    print_bootsector
+     * Type:    Function
+     * Purpose: Prints bootsector information.
+     * Input:   Nothing.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    void ext2::print_bootsector()
+    {
+        cout << "\nBootSector struct: ";
+        for (int i = 0; i < 4 /*number of partition tables*/; i++) {
+            cout << "\nPartition Entry " << i+1 << ": ";
+            cout << "\n  First Sector: " << bootSector.partitionTable[i].firstSector;
+            cout << "\n  nSectors: " << bootSector.partitionTable[i].nSectors;
+        }
+        cout << "\nBoot Sector Signature: " << hex << bootSector.magic << dec << endl;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    print_bgd_table
+     * Type:    Function
+     * Purpose: Prints the BGD table information.
+     * Input:   Nothing.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    void ext2::print_bgd_table()
+    {
+        load_bgd_table();
+        
+        cout << "\nBGD Table:\n";
+        for (u32 i = 0; i < numBlockGroups; i++)
+        {
+            cout << "Block Group " << i << endl;
+            cout << "  Block address of block usage bitmap: " << bgdTable[i].bg_block_bitmap << endl;
+            cout << "  Block address of inode usage bitmap: " << bgdTable[i].bg_inode_bitmap << endl;
+            cout << "  Starting block address of inode table: " << bgdTable[i].bg_inode_table << endl;
+            cout << "  Number of unallocated blocks in group: " << bgdTable[i].bg_free_blocks_count << endl;
+            cout << "  Number of unallocated inodes in group: " << bgdTable[i].bg_free_inodes_count << endl;
+            cout << "  Number of directories in group: " << bgdTable[i].bg_used_dirs_count << endl;
+        }
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    parse_directory_inode
+     * Type:    Function
+     * Purpose: Read and parse a directory inode, returning the resulting list of directories and
+     *          files in a vector container.
+     * Input:   ext2_inode inode, containing an inode object.
+     * Output:  vector<ext2_dir_entry>, contains a vector holding the contents of the inode.
+    ----------------------------------------------------------------------------------------------*/
+    vector<ext2::ext2_dir_entry> ext2::parse_directory_inode(ext2_inode inode)
+    {
+        vector<ext2_dir_entry> to_return;
+        u32 cursor = 0;
+        s8 name_buffer[256];
+        
+        // Take a block buffer from the pool.
+        buffer_pool::buffer block_buffer(block_size_actual);
+        u8 * inode_buffer = block_buffer.data();
+        
+        // Iterate through the directory's blocks, whether they are mapped by block pointers or by
+        // an extent tree.
+        indirect_cache dir_indirect_cache;
+        for (u32 i = 0; i < inode.i_size / block_size_actual; i++)
+        {
+            // Checks to make sure the block actually exists.
+            u32 block_num = map_logical_block(inode, i, dir_indirect_cache);
+            if (block_num == 0)
+            {
+                // If it does not, continue to the next block.
+                continue;
+            }
+            
+            // Read the contents of the block referenced by the inode into memory, based on the
+            // given size.
+            vdi->vdiPread(inode_buffer, EXT2_BLOCK_BASE_SIZE << superblock.s_log_block_size,
+                          blockToOffset(block_num));
+            
+            // Iterate through the inode buffer, reading the directory entry records.
+            cursor = 0;
+            while (cursor < (EXT2_BLOCK_BASE_SIZE << superblock.s_log_block_size))
+            {
+                // Declare a new ext2_dir_entry every loop.
+                ext2_dir_entry to_add;
+                
+                // Read inode, record length, name length, and file type.
+                memcpy(&to_add, &(inode_buffer[cursor]), EXT2_DIR_BASE_SIZE);
+                
+                // Check if the name length is 0.  If so, skip record.
+                if (to_add.name_len == 0)
+                {
+                    cursor += to_add.rec_len;
+                    continue;
+                }
+                else
+                {
+                    cursor += EXT2_DIR_BASE_SIZE;
+                }
+
+                // Read the name into the buffer.
+                memcpy(name_buffer, &(inode_buffer[cursor]), to_add.name_len);
+                cursor += to_add.name_len;
+                
+                // Add a null to the end of the characters read in so it becomes a C-style string.
+                name_buffer[to_add.name_len] = '\0';
+                
+                // Store the name in the record.
+                to_add.name.assign(name_buffer);
+                
+                // Set the offset to the next record.
+                if (EXT2_DIR_BASE_SIZE + to_add.name_len < to_add.rec_len)
+                    cursor += to_add.rec_len - EXT2_DIR_BASE_SIZE - to_add.name_len;
+                
+                // Add the ext2_dir_entry to the vector.
+                to_return.push_back(to_add);
+            }
+        }
+        
+        // Return the vector.
+        return to_return;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    read_directory
+     * Type:    Function
+     * Purpose: Reads a directory's entries straight into a snapshot.  Physically contiguous
+     *          directory blocks are read together, up to EXT2_COPY_BUFFER_SIZE at a time, and
+     *          entries are copied out of the buffer without building a string for each name.
+     *          Records with a bad length end the block they are in.
+     * Input:   const ext2_inode & inode, holds the directory's inode.
+     * Output:  <reference> dir_snapshot & listing, receives the entries, in directory order.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    void ext2::read_directory(const ext2_inode & inode, dir_snapshot & listing)
+    {
+        u32 num_blocks = inode.i_size / block_size_actual;
+        u32 max_run = EXT2_COPY_BUFFER_SIZE / block_size_actual;
+        indirect_cache dir_indirect_cache;
+        buffer_pool::buffer buffer;
+        
+        listing.clear();
+        
+        // A rough guess: each entry takes about 24 bytes of its block, and its name about 12.
+        listing.reserve(inode.i_size / 24, inode.i_size / 2);
+        
+        for (u32 logical_block = 0; logical_block < num_blocks;)
+        {
+            // Skip holes.
+            u32 first_block = map_logical_block(inode, logical_block, dir_indirect_cache);
+            if (first_block == 0)
+            {
+                logical_block++;
+                continue;
+            }
+            
+            // Extend the run for as long as the blocks sit one after another on disk.
+            u32 run_length = 1;
+            while (logical_block + run_length < num_blocks &&
+                   run_length < max_run &&
+                   map_logical_block(inode, logical_block + run_length, dir_indirect_cache) == first_block + run_length)
+            {
+                run_length++;
+            }
+            
+            buffer.reset((size_t)run_length * block_size_actual);
+            vdi->vdiPread(buffer.data(), buffer.size(), blockToOffset(first_block));
+            
+            for (u32 block = 0; block < run_length; block++)
+            {
+                const u8 * block_data = buffer.data() + (size_t)block * block_size_actual;
+                u32 cursor = 0;
+                while (cursor + EXT2_DIR_BASE_SIZE <= block_size_actual)
+                {
+                    u32 entry_inode;
+                    u16 rec_len;
+                    u8 name_len = block_data[cursor + 6];
+                    u8 file_type = block_data[cursor + 7];
+                    memcpy(&entry_inode, &(block_data[cursor]), sizeof(entry_inode));
+                    memcpy(&rec_len, &(block_data[cursor + 4]), sizeof(rec_len));
+                    if (rec_len < EXT2_DIR_BASE_SIZE || rec_len % 4 != 0 ||
+                        cursor + rec_len > block_size_actual ||
+                        EXT2_DIR_BASE_SIZE + name_len > rec_len)
+                    {
+                        break;
+                    }
+                    
+                    // Unused records have no inode, or (as this tool has always treated them) no
+                    // name.
+                    if (entry_inode != 0 && name_len != 0)
+                    {
+                        listing.add(entry_inode,
+                                    file_type,
+                                    (const char *)&(block_data[cursor + EXT2_DIR_BASE_SIZE]),
+                                    name_len);
+                    }
+                    cursor += rec_len;
+                }
+            }
+            
+            logical_block += run_length;
+        }
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    parse_directory_inode
+     * Type:    Function
+     * Purpose: Read and parse a directory inode, returning the resulting list of directories and
+     *          files in a vector container.
+     * Input:   u32 inode_num, containing the inode number of a directory inode.
+     * Output:  vector<ext2_dir_entry>, contains a vector holding the contents of the directory
+     *          inode.
+    ----------------------------------------------------------------------------------------------*/
+    vector<ext2::ext2_dir_entry> ext2::parse_directory_inode(u32 inode_num)
+    {
+        return parse_directory_inode(readInode(inode_num));
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    readInode
+     * Type:    Function
+     * Purpose: Small function that verifies an inode index is in bounds, then reads it.
+     * Input:   u32 inode, containing an inode number.
+     * Output:  ext2_inode, containing the read inode.
+     *
+     * @TODO    Set up an actual error to throw instead of the generic one.
+    ----------------------------------------------------------------------------------------------*/
+    ext2::ext2_inode ext2::readInode(u32 inode)
+    {
+        if (inode >= superblock.s_inodes_count)
+        {
+            cout << "inode out of bounds\n";
+            throw;
+        }
+        
+        ext2_inode to_return;
+        
+        // Use the cached inode table block if there is one, since it may hold changes that have
+        // not been committed yet.
+        off_t offset = inodeToOffset(inode);
+        const u8 * cached_block = metadata.peek((offset - blockToOffset(0)) / block_size_actual);
+        if (cached_block != nullptr)
+        {
+            memcpy(&to_return, &(cached_block[(offset - blockToOffset(0)) % block_size_actual]), sizeof(ext2_inode));
+            return to_return;
+        }
+        
+        vdi->vdiPread(&to_return, sizeof(ext2_inode), offset);
+        
+        return to_return;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    inode_size
+     * Type:    Function
+     * Purpose: Returns the full size of a file.  A regular file keeps the high 32 bits of its size
+     *          in i_dir_acl; for anything else the field is the directory ACL and is ignored.
+     * Input:   const ext2_inode & inode, holds the file's inode.
+     * Output:  u64, the size in bytes.
+    ----------------------------------------------------------------------------------------------*/
+    u64 ext2::inode_size(const ext2_inode & inode) const
+    {
+        u64 size = inode.i_size;
+        if ((inode.i_mode & 0xF000) == EXT2_INODE_TYPE_FILE && superblock.s_rev_level > EXT2_GOOD_OLD_REV)
+        {
+            size |= (u64)inode.i_dir_acl << 32;
+        }
+        return size;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    set_inode_size
+     * Type:    Function
+     * Purpose: Sets the full size of a regular file, splitting it between i_size and i_dir_acl.
+     *          The first file to grow past 2 GiB turns on the large file feature in the superblock,
+     *          which goes out with the inode on the next commit.
+     * Input:   ext2_inode & inode, holds the file's inode.
+     * Input:   u64 size, holds the size in bytes.  It must not be over max_file_size.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    void ext2::set_inode_size(ext2_inode & inode, u64 size)
+    {
+        inode.i_size = (u32)size;
+        if ((inode.i_mode & 0xF000) != EXT2_INODE_TYPE_FILE)
+        {
+            return;
+        }
+        
+        inode.i_dir_acl = (u32)(size >> 32);
+        if (size > EXT2_MAX_SMALL_FILE_SIZE)
+        {
+            superblock.s_feature_ro_compat |= EXT2_FEATURE_RO_COMPAT_LARGE_FILE;
+        }
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    read_inodes
+     * Type:    Function
+     * Purpose: Reads many inodes at once, such as those of everything in a directory.
+     * Input:   const vector<u32> & inode_nums, holds the inode numbers, in any order.
+     * Output:  vector<ext2_inode> & inodes, receives the inodes, in the same order as the numbers.
+     * Output:  bool, false if any inode number was out of bounds (its inode is left zeroed).
+    ----------------------------------------------------------------------------------------------*/
+    bool ext2::read_inodes(const vector<u32> & inode_nums, vector<ext2_inode> & inodes)
+    {
+        inodes.resize(inode_nums.size());
+        return read_inodes(inode_nums.data(), inode_nums.size(), inodes.data());
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    read_inodes
+     * Type:    Function
+     * Purpose: Reads many inodes at once.  The inodes are sorted by where they sit in the inode
+     *          tables (block group, then inode table block), so each inode table block is read
+     *          only once, in ascending order, and runs of neighbouring blocks are read together,
+     *          up to EXT2_METADATA_READ_MAX at a time.  Inode table blocks in the metadata cache
+     *          are used in place of the disk, as in readInode, and a run that is wholly cached is
+     *          not read at all.
+     * Input:   const u32 * inode_nums, holds the inode numbers, in any order.
+     * Input:   u32 count, holds the number of inode numbers.
+     * Output:  ext2_inode * inodes, receives count inodes, in the same order as the numbers.
+     * Output:  bool, false if any inode number was out of bounds (its inode is left zeroed).
+    ----------------------------------------------------------------------------------------------*/
+    bool ext2::read_inodes(const u32 * inode_nums, u32 count, ext2_inode * inodes)
+    {
+        bool all_read = true;
+        u32 max_run = EXT2_METADATA_READ_MAX / block_size_actual;
+        
+        // Key each inode by its byte offset from the start of the disk's blocks, which puts them
+        // in block group, inode table block and slot order at once.
+        vector<pair<u64, u32>> order;
+        order.reserve(count);
+        for (u32 i = 0; i < count; i++)
+        {
+            inodes[i] = ext2_inode();
+            if (inode_nums[i] == 0 || inode_nums[i] > superblock.s_inodes_count)
+            {
+                cout << "inode out of bounds\n";
+                all_read = false;
+                continue;
+            }
+            order.push_back(make_pair((u64)(inodeToOffset(inode_nums[i]) - blockToOffset(0)), i));
+        }
+        sort(order.begin(), order.end());
+        
+        // Read a run of neighbouring inode table blocks at a time.
+        buffer_pool::buffer run;
+        for (u32 first = 0; first < order.size();)
+        {
+            u32 first_block = order[first].first / block_size_actual;
+            u32 last_block = first_block;
+            bool all_cached = (metadata.peek(first_block) != nullptr);
+            u32 end = first + 1;
+            while (end < order.size())
+            {
+                u32 block = order[end].first / block_size_actual;
+                if (block > last_block + 1 || block - first_block >= max_run)
+                {
+                    break;
+                }
+                if (block != last_block)
+                {
+                    all_cached = all_cached && (metadata.peek(block) != nullptr);
+                    last_block = block;
+                }
+                end++;
+            }
+            
+            if (!all_cached)
+            {
+                run.reset((size_t)(last_block - first_block + 1) * block_size_actual);
+                vdi->vdiPread(run.data(), run.size(), blockToOffset(first_block));
+            }
+            
+            for (u32 i = first; i < end; i++)
+            {
+                u32 block = order[i].first / block_size_actual;
+                const u8 * cached_block = metadata.peek(block);
+                const u8 * source = (cached_block != nullptr ?
+                                     cached_block :
+                                     run.data() + (size_t)(block - first_block) * block_size_actual);
+                memcpy(&(inodes[order[i].second]), source + order[i].first % block_size_actual, sizeof(ext2_inode));
+            }
+            
+            first = end;
+        }
+        
+        return all_read;
+    }
+    
+
+    /*----------------------------------------------------------------------------------------------
+     * Name:    dir_entry_exists
+     * Type:    Function
+     * Purpose: Verifies whether a path exists or not.
+     * Input:   const string & path_to_check, containing the path to verify.
+     * Output:  vector<ext2_dir_entry>, containing ext2_dir_entry objects representing the path to
+     *          the desired folder if it is found, or containing nothing if not found.
+    ----------------------------------------------------------------------------------------------*/
+    vector<ext2::ext2_dir_entry> ext2::dir_entry_exists(const string & path_to_check)
+    {
+        // Tokenize the path that will be checked.
+        vector<string> path_tokens = utility::tokenize(path_to_check, DELIMITER_FSLASH);
+        
+        vector<ext2_dir_entry> to_return;
+        
+        // Check if the given path is relative or absolute.
+        if(path_to_check[0] == '/')
+        {
+            // Absolute path given.
+            to_return.push_back(pwd.front());
+        }
+        else
+        {
+            // Relative path given.
+            to_return = pwd;
+        }
+        
+        vector<ext2_dir_entry> current_dir_parse;
+        bool found_dir = true;
+        
+        // Loop through the path_tokens vector, following the user's desired path sequentially.
+        for (u32 i = 0; found_dir == true && i < path_tokens.size(); i++)
+        {
+            // Parse the current inode for its directory structure.
+            current_dir_parse = parse_directory_inode(to_return.back().inode);
+            
+            // Reset the found directory flag on each iteration.
+            found_dir = false;
+            
+            // Loop through the parsed directory listing to attempt to find a match.
+            for (u32 j = 0; j < current_dir_parse.size(); j++)
+            {
+                // First, check if the directory entry is a folder.
+                if (current_dir_parse[j].file_type == 2)
+                {
+                    // Then check if the names match.
+                    if (path_tokens[i] == current_dir_parse[j].name)
+                    {
+                        // If the directory entry is a folder and the names match, handle the
+                        // different scenarios.
+                        if (path_tokens[i] == ".")
+                        {
+                            // Intentionally do nothing.
+                        }
+                        else if (path_tokens[i] == "..")
+                        {
+                            // Go up one level unless already at the filesystem root.
+                            if (to_return.size() > 1)
+                            {
+                                to_return.pop_back();
+                            }
+                        }
+                        else
+                        {
+                            // Add the directory entry to the to_return vector.
+                            to_return.push_back(current_dir_parse[j]);
+                        }
+                        
+                        // Set the found directory flag.
+                        found_dir = true;
+                        break;
+                    }
+                }
+            }
+        }
+        
+        // If the directory was not found, clear the to_return vector.
+        if (found_dir == false)
+        {
+            to_return.clear();
+        }
+        
+        // Return the path to the folder.
+        return to_return;
+    } 
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    file_entry_exists
+     * Type:    Function
+     * Purpose: Verifies whether a file exists or not. Only checks in the pwd.
+     * Input:   const string & file_to_check, containing the path to verify.
+     * Output:  <reference> u32 & file_inode, will hold the file's inode number, should the file
+     *          exist.
+     * Output:  bool, detailing whether the file exists (true) or does not (false).
+    ----------------------------------------------------------------------------------------------*/
+    bool ext2::file_entry_exists(const string & file_to_check, u32 & file_inode)
+    {
+        // Assume the file does not exist.
+        bool to_return = false;
+        
+        // Parse the present working directory.
+        vector<ext2_dir_entry> file_path = parse_directory_inode(pwd.back().inode);
+        
+        // Loop through the contents of the pwd looking for a name match.
+        for (u32 i = 0; i < file_path.size(); i++)
+        {
+            // Check the name, and if the name matches, make sure it's not a directory.
+            if (file_path[i].name == file_to_check && file_path[i].file_type != EXT2_DIR_TYPE_DIR)
+            {
+                // Assuming the entry is indeed a file, store the file's inode and update the return
+                // value.
+                file_inode = file_path[i].inode;
+                to_return = true;
+            }
+        }
+        
+        // Return whether the file exists or not.
+        return to_return;
+        
+        // Below is code to enable pathing support in the function.  It is currently not working and
+        // commented out due to needing to work on other more important things.
+        
+        /***   START ACTUAL CODE   ***/
+        // @TODO convert code from dir_entry_exists
+        // @TODO do a deep examination of the algorithm to ensure it's appropriate for files
+        
+        // tokenize
+        // determine if relative path or local path
+        // loop through the path vector
+        
+        
+        // Tokenize the path that will be checked.
+        // vector<string> path_tokens = utility::tokenize(file_to_check, DELIMITER_FSLASH);
+        
+        // vector<ext2_dir_entry> file_path;
+        
+        // // Check if the given path is relative or absolute.
+        // if (file_to_check[0] == '/')
+        // {
+        //     // Absolute path given.
+        //     file_path.push_back(pwd.front());
+        // }
+        // else
+        // {
+        //     // Relative path given.
+        //     file_path = pwd;
+        // }
+        
+        // vector<ext2_dir_entry> current_dir_parse;
+        // bool found_dir_entry = true;
+        
+        // // Loop through the path_tokens vector, following the user's desired path sequentially.
+        // for (u32 i = 0; found_dir_entry == true && i < path_tokens.size(); i++)
+        // {
+        //     // Parse the current inode for its directory structure.
+        //     current_dir_parse = parse_directory_inode(file_path.back().inode);
+            
+        //     // Reset the found directory flag on each iteration.
+        //     found_dir_entry = false;
+            
+        //     // Loop through the parsed directory listing to attempt to find a match.
+        //     for (u32 j = 0; j < current_dir_parse.size(); j++)
+        //     {
+        //         // Check if the names match.
+        //         if (path_tokens[i] == current_dir_parse[j].name)
+        //         {
+        //             // Check if the directory entry is a folder.
+        //             if (current_dir_parse[j].file_type == 2)
+        //             {
+        //                 // If the directory entry is a folder handle the different scenarios.
+        //                 if (path_tokens[i] == ".")
+        //                 {
+        //                     // Intentionally do nothing.
+        //                 }
+        //                 else if (path_tokens[i] == "..")
+        //                 {
+        //                     // Go up one level unless already at the filesystem root.
+        //                     if (file_path.size() > 1)
+        //                     {
+        //                         file_path.pop_back();
+        //                     }
+        //                 }
+        //                 else
+        //                 {
+        //                     // Add the directory entry to the file_path vector.
+        //                     file_path.push_back(current_dir_parse[j]);
+        //                 }
+                        
+        //                 // Set the found directory flag.
+        //                 found_dir_entry = true;
+        //                 break;
+        //             }
+        //             else if (current_dir_parse[j].file_type == 2)
+        //             {
+                        
+        //             }
+        //         }
+        //     }
+        // }
+        
+        // // If the directory was not found, clear the file_path vector.
+        // if (found_dir_entry == false)
+        // {
+        //     file_inode = file_path.back().inode;
+        // }
+        
+        // // Return true if the file was found, false if not.
+        // return found_dir_entry;
+        /***   END ACTUAL CODE   ***/
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    file_path_exists
+     * Type:    Function
+     * Purpose: Verifies whether a file exists or not.  Unlike file_entry_exists, the file may be
+     *          given with a relative or absolute path.
+     * Input:   const string & path_to_check, containing the path to verify.
+     * Output:  <reference> u32 & file_inode, will hold the file's inode number, should the file
+     *          exist.
+     * Output:  bool, detailing whether the file exists (true) or does not (false).
+    ----------------------------------------------------------------------------------------------*/
+    bool ext2::file_path_exists(const string & path_to_check, u32 & file_inode)
+    {
+        // Without a slash, the file lives in the pwd.
+        size_t last_slash = path_to_check.find_last_of(DELIMITER_FSLASH);
+        if (last_slash == string::npos)
+        {
+            return file_entry_exists(path_to_check, file_inode);
+        }
+        
+        // Split the path into its directory and file name, then resolve the directory.
+        string file_name = path_to_check.substr(last_slash + 1);
+        vector<ext2_dir_entry> dir_path = dir_entry_exists(last_slash == 0 ?
+                                                           DELIMITER_FSLASH :
+                                                           path_to_check.substr(0, last_slash));
+        if (dir_path.size() == 0 || file_name.length() == 0)
+        {
+            return false;
+        }
+        
+        // Look for a non-directory entry with a matching name.
+        vector<ext2_dir_entry> dir_contents = parse_directory_inode(dir_path.back().inode);
+        for (u32 i = 0; i < dir_contents.size(); i++)
+        {
+            if (dir_contents[i].name == file_name && dir_contents[i].file_type != EXT2_DIR_TYPE_DIR)
+            {
+                file_inode = dir_contents[i].inode;
+                return true;
+            }
+        }
+        
+        return false;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    match_files
+     * Type:    Function
+     * Purpose: Finds the regular files matching a pattern, as match_entries does.
+     * Input:   const string & pattern, holds the pattern, relative to the pwd or absolute.
+     * Output:  <reference> vector<ext2_dir_entry> & matches, has the matching entries added to it.
+     * Output:  bool, true if any file matched.
+    ----------------------------------------------------------------------------------------------*/
+    bool ext2::match_files(const string & pattern, vector<ext2_dir_entry> & matches)
+    {
+        u32 dir_inode_num = 0;
+        vector<ext2_dir_entry> entries;
+        bool found = false;
+        
+        match_entries(pattern, dir_inode_num, entries);
+        for (u32 i = 0; i < entries.size(); i++)
+        {
+            if (entries[i].file_type == EXT2_DIR_TYPE_FILE)
+            {
+                matches.push_back(entries[i]);
+                found = true;
+            }
+        }
+        
+        return found;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    match_entries
+     * Type:    Function
+     * Purpose: Finds the directory entries matching a pattern, which may hold wildcards (*, ? and
+     *          [...]) in its last component, as in the shell.  Names starting with a dot only
+     *          match a pattern that starts with one too, and "." and ".." never match.
+     * Input:   const string & pattern, holds the pattern, relative to the pwd or absolute.
+     * Output:  <reference> u32 & dir_inode_num, will hold the inode number of the directory the
+     *          entries are in.
+     * Output:  <reference> vector<ext2_dir_entry> & matches, has the matching entries added to it.
+     * Output:  bool, true if anything matched.
+    ----------------------------------------------------------------------------------------------*/
+    bool ext2::match_entries(const string & pattern, u32 & dir_inode_num, vector<ext2_dir_entry> & matches)
+    {
+        // Split the pattern into its directory and name, then resolve the directory.
+        size_t last_slash = pattern.find_last_of(DELIMITER_FSLASH);
+        string name_pattern = (last_slash == string::npos ? pattern : pattern.substr(last_slash + 1));
+        vector<ext2_dir_entry> dir_path = (last_slash == string::npos ?
+                                           pwd :
+                                           dir_entry_exists(last_slash == 0 ?
+                                                            DELIMITER_FSLASH :
+                                                            pattern.substr(0, last_slash)));
+        if (dir_path.size() == 0 || name_pattern.length() == 0)
+        {
+            return false;
+        }
+        dir_inode_num = dir_path.back().inode;
+        
+        bool found = false;
+        vector<ext2_dir_entry> dir_contents = parse_directory_inode(dir_inode_num);
+        for (u32 i = 0; i < dir_contents.size(); i++)
+        {
+            if (dir_contents[i].inode != 0 &&
+                dir_contents[i].name != "." &&
+                dir_contents[i].name != ".." &&
+                fnmatch(name_pattern.c_str(), dir_contents[i].name.c_str(), FNM_PERIOD) == 0)
+            {
+                matches.push_back(dir_contents[i]);
+                found = true;
+            }
+        }
+        
+        return found;
+    }
+    
+    
+    void ext2::debug_dump_pwd_inode()
+    {
+        ext2_inode temp = readInode(pwd.back().inode);
+        print_inode(&temp);
+    }
+    
+    
+    void ext2::print_block(u32 block_to_dump, bool text)
+    {
+        buffer_pool::buffer block_buffer(block_size_actual);
+        u8 * raw_block = block_buffer.data();
+        
+        vdi->vdiSeek(blockToOffset(block_to_dump), SEEK_SET);
+        vdi->vdiRead(raw_block, (EXT2_BLOCK_BASE_SIZE << superblock.s_log_block_size));
+        
+        cout << "ext2::print_block\n";
+        
+        if (!text)
+        {
+            for (u32 i = 0; i < (EXT2_BLOCK_BASE_SIZE << superblock.s_log_block_size); i++)
+            {
+                cout << hex << setw(2) << setfill('0') << (int)raw_block[i] << ' ';
+            }
+        }
+        else
+        {
+            for (u32 i = 0; i < (EXT2_BLOCK_BASE_SIZE << superblock.s_log_block_size); i++)
+            {
+                cout << raw_block[i] << ' ';
+            }
+        }
+        cout << dec;
+    }
+    
+    
+    void ext2::debug_dump_block(u32 block_to_dump)
+    {
+        print_block(block_to_dump);
+    }
+    
+    
+    void ext2::debug_dump_inode(u32 inode_to_dump)
+    {
+        ext2_inode inode = readInode(inode_to_dump);
+        print_inode(&inode);
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    make_block_list
+     * Type:    Function
+     * Purpose: Unrolls an inode, reading all the different blocks associated with a file, including
+     *          direct, singly indirect, doubly indirect, and triply indirect.  Will return a list
+     *          containing all of these block numbers, in order, so the file can be stitched
+     *          together.  Files mapped by an ext4 extent tree are unrolled from their extents.
+     * Input:   const u32 inode_number, holding the number of the initial inode.
+     * Output:  list<u32>, containing a list of all the different block numbers where the file is
+     *          contained.
+    ----------------------------------------------------------------------------------------------*/
+    list<u32> ext2::make_block_list(const u32 inode_number)
+    {
+        list<u32> to_return;
+        
+        u32 * s_ind_block_buffer = nullptr;
+        u32 * d_ind_block_buffer = nullptr;
+        u32 * t_ind_block_buffer = nullptr;
+        buffer_pool::buffer s_ind_handle;
+        buffer_pool::buffer d_ind_handle;
+        buffer_pool::buffer t_ind_handle;
+        
+        // general algorithm for this function
+        // NOTE: THIS IS BRUTE FORCE AND UGLY AND NOT AT ALL OPTIMIZED AND MAKES ME FEEL DIRTY
+        // @TODO: Optimize.
+        // 
+        // read inode
+        // add direct block pointers to list
+        // read singly indirect block pointer
+        //   add direct block pointers to list
+        // read doubly indirect block pointer
+        //   read singly indirect block pointers
+        //     add direct block pointers to list
+        // read triply indirect block pointer
+        //   read doubly indirect block pointers
+        //     read singly indirect block pointers
+        //       add direct block pointers to list
+        
+        // Read the inode.
+        ext2_inode inode = readInode(inode_number);
+        
+        // Extent-mapped files are listed straight from their extents, with holes (and
+        // uninitialized extents) as zeroes.
+        if (uses_extents(inode))
+        {
+            vector<ext4_extent> extents;
+            read_extent_tree(inode, extents);
+            u64 num_blocks = (inode_size(inode) + block_size_actual - 1) / block_size_actual;
+            for (u32 i = 0; i < extents.size() && to_return.size() < num_blocks; i++)
+            {
+                bool initialized = (extents[i].ee_len <= EXT4_EXTENT_MAX_INIT_LEN);
+                u32 length = (initialized ? extents[i].ee_len : extents[i].ee_len - EXT4_EXTENT_MAX_INIT_LEN);
+                while (to_return.size() < extents[i].ee_block && to_return.size() < num_blocks)
+                {
+                    to_return.push_back(0);
+                }
+                for (u32 j = 0; j < length && to_return.size() < num_blocks; j++)
+                {
+                    to_return.push_back(initialized ? extents[i].ee_start_lo + j : 0);
+                }
+            }
+            return to_return;
+        }
+        
+        // Direct
+        // Add the direct blocks contained in the inode entry itself.
+        for (u32 i = 0; i < EXT2_INODE_NBLOCKS_DIR || inode.i_block[i] == 0; i++)
+        {
+            // Add the block to the block list.
+            to_return.push_back(inode.i_block[i]);
+        }
+        
+        // Singly Indirect
+        // Get and parse the singly indirect block and add its contents to the block list.
+        if (inode.i_block[EXT2_INODE_BLOCK_S_IND] != 0)
+        {
+            // Take a buffer from the pool for the singly indirect block.
+            s_ind_handle.reset(block_size_actual);
+            s_ind_block_buffer = s_ind_handle.as<u32>();
+            
+            // Set the cursor to and read from the particular block in question.
+            vdi->vdiSeek(blockToOffset(inode.i_block[EXT2_INODE_BLOCK_S_IND]), SEEK_SET);
+            vdi->vdiRead(s_ind_block_buffer, block_size_actual);
+            
+            // Iterate through the read block and add the block numbers to the list.  Stop if an
+            // entry of 0 is encountered.
+            for (u32 i = 0; i < block_size_actual / sizeof(u32) && s_ind_block_buffer[i] != 0; i++)
+            {
+                // Add the block to the block list.
+                to_return.push_back(s_ind_block_buffer[i]);
+            }
+        }
+        
+        // Doubly Indirect
+        // Get and parse the doubly indirect block to get the list of singly indirect blocks, then
+        // parse them and add their contents to the block list.
+        if (inode.i_block[EXT2_INODE_BLOCK_D_IND] != 0)
+        {
+            // Take a buffer from the pool for the doubly indirect block.
+            d_ind_handle.reset(block_size_actual);
+            d_ind_block_buffer = d_ind_handle.as<u32>();
+            
+            // Set the cursor to and read from the particular block in question.
+            vdi->vdiSeek(blockToOffset(inode.i_block[EXT2_INODE_BLOCK_D_IND]), SEEK_SET);
+            vdi->vdiRead(d_ind_block_buffer, block_size_actual);
+            
+            // Iterate through the read block, parsing the singly indirect blocks that are found.
+            // Stop if an entry of 0 is encountered.
+            for (u32 j = 0; j < block_size_actual / sizeof(u32) && d_ind_block_buffer[j] != 0; j++)
+            {
+                // Set the cursor to and read from the particular block in question.
+                vdi->vdiSeek(blockToOffset(d_ind_block_buffer[j]), SEEK_SET);
+                vdi->vdiRead(s_ind_block_buffer, block_size_actual);
+                
+                // Iterate through the read block and add the block numbers to the list.  Stop if an
+                // entry of 0 is encountered.
+                for (u32 i = 0; i < block_size_actual / sizeof(u32) && s_ind_block_buffer[i] != 0; i++)
+                {
+                    // Add the block to the block list.
+                    to_return.push_back(s_ind_block_buffer[i]);
+                }
+            }
+        }
+        
+        // Triply Indirect
+        // Get and parse the triply indirect block to get the list of doubly indirect blocks to get
+        // the list of singly indirect blocks, then parse them and add their contents to the block
+        // list.
+        if (inode.i_block[EXT2_INODE_BLOCK_T_IND] != 0)
+        {
+            // Take a buffer from the pool for the triply indirect block.
+            t_ind_handle.reset(block_size_actual);
+            t_ind_block_buffer = t_ind_handle.as<u32>();
+            
+            // Set the cursor to and read from the particular block in question.
+            vdi->vdiSeek(blockToOffset(inode.i_block[EXT2_INODE_BLOCK_T_IND]), SEEK_SET);
+            vdi->vdiRead(t_ind_block_buffer, block_size_actual);
+            
+            // Iterate through the read block, parsing the doubly indirect blocks that are found.
+            // Stop if an entry of 0 is encountered.
+            for (u32 k = 0; k < block_size_actual / sizeof(u32) && t_ind_block_buffer[k] != 0; k++)
+            {
+                // Set the cursor to and read from the particular block in question.
+                vdi->vdiSeek(blockToOffset(t_ind_block_buffer[k]), SEEK_SET);
+                vdi->vdiRead(d_ind_block_buffer, block_size_actual);
+                
+                // Iterate through the read block, parsing the singly indirect blocks that are
+                // found. Stop if an entry of 0 is encountered.
+                for (u32 j = 0; j < block_size_actual / sizeof(u32) && d_ind_block_buffer[j] != 0; j++)
+                {
+                    // Set the cursor to and read from the particular block in question.
+                    vdi->vdiSeek(blockToOffset(d_ind_block_buffer[j]), SEEK_SET);
+                    vdi->vdiRead(s_ind_block_buffer, block_size_actual);
+                    
+                    // Iterate through the read block and add the block numbers to the list.  Stop
+                    // if an entry of 0 is encountered.
+                    for (u32 i = 0; i < block_size_actual / sizeof(u32) && s_ind_block_buffer[i] != 0; i++)
+                    {
+                        // Add the block to the block list.
+                        to_return.push_back(s_ind_block_buffer[i]);
+                    }
+                }
+            }
+        }
+        
+        cout << "debug (ext2::make_block_list) leaving function\n";
+        
+        // Return the block list.
+        return to_return;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    map_logical_block
+     * Type:    Function
+     * Purpose: Maps a logical block of a file to the physical block holding it, by walking only the
+     *          direct, singly, doubly, or triply indirect path that covers that block.  Files
+     *          mapped by an ext4 extent tree are handed to map_extent_block.
+     * Input:   const ext2_inode & inode, holds the file's inode.
+     * Input:   u32 logical_block, holds the index of the block within the file.
+     * Input:   indirect_cache & cache, holds recently read indirect blocks.
+     * Output:  <pointer> u64 * hole_end, if given and the block is a hole, will hold the first
+     *          logical block past the hole as far as this lookup can tell.  A missing indirect
+     *          block makes every block beneath it a hole, so whole subtrees can be skipped.
+     * Output:  u32, holding the physical block number, or 0 if the block is a hole.
+    ----------------------------------------------------------------------------------------------*/
+    u32 ext2::map_logical_block(const ext2_inode & inode,
+                                u32 logical_block,
+                                indirect_cache & cache,
+                                u64 * hole_end)
+    {
+        if (uses_extents(inode))
+        {
+            return map_extent_block(inode, logical_block, cache, hole_end);
+        }
+        
+        u64 pointers_per_block = block_size_actual / EXT2_BLOCK_POINTER_SIZE;
+        u64 index = logical_block;
+        u64 level_start = 0;
+        u64 span_end = logical_block + 1;
+        u32 to_return = 0;
+        
+        // Direct blocks are stored in the inode itself.
+        if (index < EXT2_INODE_NBLOCKS_DIR)
+        {
+            to_return = inode.i_block[index];
+        }
+        else if ((index -= EXT2_INODE_NBLOCKS_DIR) < pointers_per_block)
+        {
+            // Singly indirect: one lookup.
+            level_start = EXT2_INODE_NBLOCKS_DIR;
+            u32 s_ind_block = inode.i_block[EXT2_INODE_BLOCK_S_IND];
+            if (s_ind_block == 0)
+                span_end = level_start + pointers_per_block;
+            else
+                to_return = read_indirect_block(s_ind_block, cache)[index];
+        }
+        else if ((index -= pointers_per_block) < pointers_per_block * pointers_per_block)
+        {
+            // Doubly indirect: two lookups.
+            level_start = EXT2_INODE_NBLOCKS_DIR + pointers_per_block;
+            u32 d_ind_block = inode.i_block[EXT2_INODE_BLOCK_D_IND];
+            u32 s_ind_block = 0;
+            if (d_ind_block == 0)
+                span_end = level_start + pointers_per_block * pointers_per_block;
+            else if ((s_ind_block = read_indirect_block(d_ind_block, cache)[index / pointers_per_block]) == 0)
+                span_end = level_start + (index / pointers_per_block + 1) * pointers_per_block;
+            else
+                to_return = read_indirect_block(s_ind_block, cache)[index % pointers_per_block];
+        }
+        else if ((index -= pointers_per_block * pointers_per_block) <
+                 pointers_per_block * pointers_per_block * pointers_per_block)
+        {
+            // Triply indirect: three lookups.
+            level_start = EXT2_INODE_NBLOCKS_DIR + pointers_per_block + pointers_per_block * pointers_per_block;
+            u64 d_span = pointers_per_block * pointers_per_block;
+            u32 t_ind_block = inode.i_block[EXT2_INODE_BLOCK_T_IND];
+            u32 d_ind_block = 0;
+            u32 s_ind_block = 0;
+            if (t_ind_block == 0)
+                span_end = level_start + d_span * pointers_per_block;
+            else if ((d_ind_block = read_indirect_block(t_ind_block, cache)[index / d_span]) == 0)
+                span_end = level_start + (index / d_span + 1) * d_span;
+            else if ((s_ind_block = read_indirect_block(d_ind_block, cache)[(index % d_span) / pointers_per_block]) == 0)
+                span_end = level_start + (index / pointers_per_block + 1) * pointers_per_block;
+            else
+                to_return = read_indirect_block(s_ind_block, cache)[index % pointers_per_block];
+        }
+        else
+        {
+            // Beyond the largest possible file, everything is a hole.
+            span_end = ~0ULL;
+        }
+        
+        if (to_return == 0 && hole_end != nullptr)
+        {
+            *hole_end = span_end;
+        }
+        
+        return to_return;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    read_indirect_block
+     * Type:    Function
+     * Purpose: Returns the block pointers held in an indirect block, reading the block only if it
+     *          is not already in the cache.  When the cache is full, the least recently used slot
+     *          is reused.
+     * Input:   u32 block_num, holds the indirect block to read.
+     * Input:   indirect_cache & cache, holds recently read indirect blocks.
+     * Output:  const vector<u32> &, holding the block pointers.  Only valid until the next call.
+    ----------------------------------------------------------------------------------------------*/
+    const vector<u32> & ext2::read_indirect_block(u32 block_num, indirect_cache & cache)
+    {
+        cache.clock++;
+        
+        // Look for the block in the cache, keeping track of the least recently used slot.
+        u32 victim = 0;
+        for (u32 i = 0; i < indirect_cache::NUM_SLOTS; i++)
+        {
+            if (cache.block[i] == block_num && !cache.pointers[i].empty())
+            {
+                cache.last_used[i] = cache.clock;
+                return cache.pointers[i];
+            }
+            if (cache.last_used[i] < cache.last_used[victim])
+            {
+                victim = i;
+            }
+        }
+        
+        // Not cached, so read it into the victim slot.
+        cache.pointers[victim].resize(block_size_actual / EXT2_BLOCK_POINTER_SIZE);
+        vdi->vdiPread(cache.pointers[victim].data(), block_size_actual, blockToOffset(block_num));
+        cache.block[victim] = block_num;
+        cache.last_used[victim] = cache.clock;
+        
+        return cache.pointers[victim];
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    inode_blocks
+     * Type:    Function
+     * Purpose: Lists every block an inode holds, indirect blocks included, in no particular order.
+     *          Inodes that keep no blocks (device files, pipes, sockets and fast symlinks) have
+     *          none listed.
+     * Input:   const ext2_inode & inode, holds the inode.
+     * Output:  <reference> vector<u32> & blocks, has the blocks added to it.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    void ext2::inode_blocks(const ext2_inode & inode, vector<u32> & blocks)
+    {
+        u32 type = inode.i_mode & 0xF000;
+        if (inode.i_blocks == 0 ||
+            (type != EXT2_INODE_TYPE_FILE && type != EXT2_INODE_TYPE_DIR && type != EXT2_INODE_TYPE_SYMLINK))
+        {
+            return;
+        }
+        
+        if (uses_extents(inode))
+        {
+            vector<ext4_extent> extents;
+            read_extent_tree(inode, extents, &blocks);
+            for (u32 i = 0; i < extents.size(); i++)
+            {
+                u32 length = (extents[i].ee_len > EXT4_EXTENT_MAX_INIT_LEN ? extents[i].ee_len - EXT4_EXTENT_MAX_INIT_LEN : extents[i].ee_len);
+                for (u32 j = 0; j < length && extents[i].ee_start_lo + j < superblock.s_blocks_count; j++)
+                {
+                    blocks.push_back(extents[i].ee_start_lo + j);
+                }
+            }
+            return;
+        }
+        
+        for (u32 i = 0; i < EXT2_INODE_NBLOCKS_DIR; i++)
+        {
+            if (inode.i_block[i] != 0 && inode.i_block[i] < superblock.s_blocks_count)
+            {
+                blocks.push_back(inode.i_block[i]);
+            }
+        }
+        indirect_blocks(inode.i_block[EXT2_INODE_BLOCK_S_IND], 1, blocks);
+        indirect_blocks(inode.i_block[EXT2_INODE_BLOCK_D_IND], 2, blocks);
+        indirect_blocks(inode.i_block[EXT2_INODE_BLOCK_T_IND], 3, blocks);
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    indirect_blocks
+     * Type:    Function
+     * Purpose: Lists an indirect block and every block below it.
+     * Input:   u32 block_num, holds the indirect block, or 0 for none.
+     * Input:   u32 depth, holds the levels of indirection (1 for a singly indirect block).
+     * Output:  <reference> vector<u32> & blocks, has the blocks added to it.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    void ext2::indirect_blocks(u32 block_num, u32 depth, vector<u32> & blocks)
+    {
+        if (block_num == 0 || block_num >= superblock.s_blocks_count)
+        {
+            return;
+        }
+        blocks.push_back(block_num);
+        
+        vector<u32> pointers(block_size_actual / EXT2_BLOCK_POINTER_SIZE);
+        vdi->vdiPread(pointers.data(), block_size_actual, blockToOffset(block_num));
+        for (u32 i = 0; i < pointers.size(); i++)
+        {
+            if (depth > 1)
+            {
+                indirect_blocks(pointers[i], depth - 1, blocks);
+            }
+            else if (pointers[i] != 0 && pointers[i] < superblock.s_blocks_count)
+            {
+                blocks.push_back(pointers[i]);
+            }
+        }
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    uses_extents
+     * Type:    Function
+     * Purpose: Checks whether an inode's blocks are mapped by an ext4 extent tree rather than by
+     *          direct and indirect block pointers.
+     * Input:   const ext2_inode & inode, holds the inode.
+     * Output:  bool, true if i_block holds the root of an extent tree.
+    ----------------------------------------------------------------------------------------------*/
+    bool ext2::uses_extents(const ext2_inode & inode) const
+    {
+        return (inode.i_flags & EXT4_INODE_FLAGS_EXTENTS) &&
+               (superblock.s_feature_incompat & EXT4_FEATURE_INCOMPAT_EXTENTS);
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    map_extent_block
+     * Type:    Function
+     * Purpose: Maps a logical block of an extent-mapped file to the physical block holding it.
+     *          Each node on the way down is binary searched for the last entry starting at or
+     *          before the block, so the cost is one node read per level of the tree (usually none
+     *          or one), however large the file.  Nodes are kept in the same cache as indirect
+     *          blocks.
+     *
+     *          Uninitialized extents read as zeroes, so they are treated as holes.  Block numbers
+     *          that need more than 32 bits cannot be addressed here and are treated as holes too.
+     * Input:   const ext2_inode & inode, holds the file's inode.
+     * Input:   u32 logical_block, holds the index of the block within the file.
+     * Input:   indirect_cache & cache, holds recently read tree nodes.
+     * Output:  <pointer> u64 * hole_end, if given and the block is a hole, will hold the first
+     *          logical block past the hole.
+     * Output:  u32, holding the physical block number, or 0 if the block is a hole.
+    ----------------------------------------------------------------------------------------------*/
+    u32 ext2::map_extent_block(const ext2_inode & inode, u32 logical_block, indirect_cache & cache, u64 * hole_end)
+    {
+        const u8 * node = (const u8 *)inode.i_block;
+        u32 node_size = sizeof(inode.i_block);
+        u64 next_start = ~0ULL;
+        u32 to_return = 0;
+        
+        for (u32 level = 0; level <= EXT4_EXTENT_MAX_DEPTH; level++)
+        {
+            ext4_extent_header header;
+            memcpy(&header, node, sizeof(ext4_extent_header));
+            if (header.eh_magic != EXT4_EXTENT_MAGIC ||
+                header.eh_entries > (node_size - sizeof(ext4_extent_header)) / sizeof(ext4_extent))
+            {
+                break;
+            }
+            const u8 * entries = node + sizeof(ext4_extent_header);
+            
+            // Find the first entry starting past the block.  Index entries and extents both start
+            // with the first logical block they cover.
+            u32 low = 0;
+            u32 high = header.eh_entries;
+            while (low < high)
+            {
+                u32 middle = (low + high) / 2;
+                u32 entry_start;
+                memcpy(&entry_start, entries + middle * sizeof(ext4_extent), sizeof(u32));
+                if (entry_start <= logical_block)
+                    low = middle + 1;
+                else
+                    high = middle;
+            }
+            
+            // Whatever is mapped next starts no later than that entry.
+            if (low < header.eh_entries)
+            {
+                u32 entry_start;
+                memcpy(&entry_start, entries + low * sizeof(ext4_extent), sizeof(u32));
+                if (entry_start < next_start)
+                    next_start = entry_start;
+            }
+            if (low == 0)
+            {
+                break;
+            }
+            
+            // The entry before it is the one that could cover the block.
+            if (header.eh_depth == 0)
+            {
+                ext4_extent extent;
+                memcpy(&extent, entries + (low - 1) * sizeof(ext4_extent), sizeof(ext4_extent));
+                bool initialized = (extent.ee_len <= EXT4_EXTENT_MAX_INIT_LEN);
+                u32 length = (initialized ? extent.ee_len : extent.ee_len - EXT4_EXTENT_MAX_INIT_LEN);
+                if (logical_block - extent.ee_block < length)
+                {
+                    if (initialized && extent.ee_start_hi == 0)
+                        to_return = extent.ee_start_lo + (logical_block - extent.ee_block);
+                    else
+                        next_start = (u64)extent.ee_block + length;
+                }
+                break;
+            }
+            
+            ext4_extent_idx index;
+            memcpy(&index, entries + (low - 1) * sizeof(ext4_extent_idx), sizeof(ext4_extent_idx));
+            if (index.ei_leaf_hi != 0 || index.ei_leaf_lo >= superblock.s_blocks_count)
+            {
+                break;
+            }
+            node = (const u8 *)read_indirect_block(index.ei_leaf_lo, cache).data();
+            node_size = block_size_actual;
+        }
+        
+        if (to_return == 0 && hole_end != nullptr)
+        {
+            *hole_end = next_start;
+        }
+        
+        return to_return;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    read_extent_tree
+     * Type:    Function
+     * Purpose: Reads a whole extent tree, for when every block of a file is wanted at once.
+     * Input:   const ext2_inode & inode, holds the file's inode.
+     * Output:  <reference> vector<ext4_extent> & extents, has the file's extents added to it, in
+     *          logical order.
+     * Output:  <pointer> vector<u32> * node_blocks, if given, has the blocks holding the tree's
+     *          index and leaf nodes (everything but the root) added to it.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    void ext2::read_extent_tree(const ext2_inode & inode, vector<ext4_extent> & extents, vector<u32> * node_blocks)
+    {
+        read_extent_node((const u8 *)inode.i_block, sizeof(inode.i_block), EXT4_EXTENT_MAX_DEPTH, extents, node_blocks);
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    read_extent_node
+     * Type:    Function
+     * Purpose: Reads an extent tree node and every node below it.
+     * Input:   const u8 * node, holds the node.
+     * Input:   u32 node_size, holds the size of the node in bytes.
+     * Input:   u32 depth_left, holds how many more levels may be followed, which stops a
+     *          corrupt tree from looping.
+     * Output:  <reference> vector<ext4_extent> & extents, has the extents added to it.
+     * Output:  <pointer> vector<u32> * node_blocks, if given, has the blocks of the nodes below
+     *          this one added to it.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    void ext2::read_extent_node(const u8 * node, u32 node_size, u32 depth_left, vector<ext4_extent> & extents, vector<u32> * node_blocks)
+    {
+        ext4_extent_header header;
+        memcpy(&header, node, sizeof(ext4_extent_header));
+        if (header.eh_magic != EXT4_EXTENT_MAGIC ||
+            header.eh_entries > (node_size - sizeof(ext4_extent_header)) / sizeof(ext4_extent))
+        {
+            return;
+        }
+        const u8 * entries = node + sizeof(ext4_extent_header);
+        
+        if (header.eh_depth == 0)
+        {
+            for (u32 i = 0; i < header.eh_entries; i++)
+            {
+                extents.emplace_back();
+                memcpy(&(extents.back()), entries + i * sizeof(ext4_extent), sizeof(ext4_extent));
+            }
+            return;
+        }
+        if (depth_left == 0)
+        {
+            return;
+        }
+        
+        vector<u8> child(block_size_actual);
+        for (u32 i = 0; i < header.eh_entries; i++)
+        {
+            ext4_extent_idx index;
+            memcpy(&index, entries + i * sizeof(ext4_extent_idx), sizeof(ext4_extent_idx));
+            if (index.ei_leaf_hi != 0 || index.ei_leaf_lo >= superblock.s_blocks_count)
+            {
+                continue;
+            }
+            if (node_blocks != nullptr)
+            {
+                node_blocks->push_back(index.ei_leaf_lo);
+            }
+            vdi->vdiPread(child.data(), block_size_actual, blockToOffset(index.ei_leaf_lo));
+            read_extent_node(child.data(), block_size_actual, depth_left - 1, extents, node_blocks);
+        }
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    make_dir_entry
+     * Type:    Function
+     * Purpose: Takes the inputs given and returns an ext2_dir_entry structure.
+     * Input:   const u32 inode_number, holding the number of the inode to be included.
+     * Input:   const string & filename, holding the filename to be included.
+     * Input:   const u8 filetype, holding the filetype to be included.
+     * Output:  ext2_dir_entry, containing the resulting ext2_dir_entry.
+    ----------------------------------------------------------------------------------------------*/
+    ext2::ext2_dir_entry ext2::make_dir_entry(const u32 inode_number, const string & filename, const u8 filetype)
+    {
+        ext2_dir_entry to_return;
+        
+        // Set the majority of the fields in the the to_return variable.
+        to_return.inode = inode_number;
+        to_return.file_type = filetype;
+        to_return.name_len = filename.length();
+        to_return.name.assign(filename);
+        
+        // Calculate the record length and then pad it to make sure it aligns to a 4-byte boundary.
+        to_return.rec_len = utility::nearest_mult_four(EXT2_DIR_BASE_SIZE + to_return.name_len);
+        
+        // Return the newly-minted ext2_dir_entry structure.
+        return to_return;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    valid_entry_name
+     * Type:    Function
+     * Purpose: Checks that a name can be given to a new directory entry: it must be a single path
+     *          component, so it cannot be empty, "." or "..", or hold a '/' or a null byte.
+     * Input:   const string & name, holds the name to check.
+     * Output:  bool, true if the name can be used.
+    ----------------------------------------------------------------------------------------------*/
+    bool ext2::valid_entry_name(const string & name) const
+    {
+        return !name.empty() &&
+               name != "." &&
+               name != ".." &&
+               name.find('/') == string::npos &&
+               name.find('\0') == string::npos;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    read_bitmap
+     * Type:    Function
+     * Purpose: Reads a bitmap into memory as a word-packed bitmap that can be searched quickly.
+     * Input:   const u32 block_num, holds the block that has the bitmap.
+     * Input:   const u64 num_bitmap_entries, holds the number of entries in a bitmap.
+     * Output:  bitmap, holds the bitmap.
+    ----------------------------------------------------------------------------------------------*/
+    bitmap ext2::read_bitmap(const u32 block_num, const u64 num_bitmap_entries)
+    {
+        bitmap to_return;
+        
+        // Process the bitmap from its block in the metadata cache, which holds any changes not
+        // yet committed.  On disk, entry i is bit (i % BITS_PER_BYTE) of byte
+        // (i / BITS_PER_BYTE), counting from the least significant bit.
+        to_return.load(metadata.get(block_num), num_bitmap_entries);
+        
+        // Return the bitmap.
+        return to_return;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    write_bitmap
+     * Type:    Function
+     * Purpose: Writes a bitmap to its block in the metadata cache.
+     * Input:   const bitmap & bitmap_to_write, holds the bitmap.
+     * Input:   const u32 block_num, holds the block number to write the bitmap to.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    void ext2::write_bitmap(const bitmap & bitmap_to_write, const u32 block_num)
+    {
+        // Copy the bitmap into its block in the metadata cache, least significant bit first, with
+        // the unused rest of the block marked as in use.  It reaches the disk at the next commit.
+        bitmap_to_write.store(metadata.get(block_num, false), block_size_actual);
+        metadata.mark_dirty(block_num);
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    load_free_space_index
+     * Type:    Function
+     * Purpose: Builds the free-space index from the block bitmaps, if that has not already been
+     *          done.  Afterwards, allocations are made against the index without reading any
+     *          bitmaps from disk.
+     * Input:   Nothing.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    void ext2::load_free_space_index()
+    {
+        if (free_space_loaded)
+        {
+            return;
+        }
+        
+        load_bgd_table();
+        prefetch_group_bitmaps();
+        free_space.reset(numBlockGroups);
+        for (u32 i = 0; i < numBlockGroups; i++)
+        {
+            free_space.load_group(i, read_bitmap(bgdTable[i].bg_block_bitmap, superblock.s_blocks_per_group));
+        }
+        free_space_loaded = true;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    prefetch_group_bitmaps
+     * Type:    Function
+     * Purpose: Reads the block and inode bitmaps of every block group into the metadata cache,
+     *          ahead of the first allocation.  Neighbouring bitmaps are read together, so under
+     *          flex_bg, where a flex group's bitmaps are packed side by side, each flex group
+     *          costs a single read rather than one per group.
+     * Input:   Nothing.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    void ext2::prefetch_group_bitmaps()
+    {
+        vector<u32> bitmap_blocks;
+        bitmap_blocks.reserve(numBlockGroups * 2);
+        for (u32 i = 0; i < numBlockGroups; i++)
+        {
+            bitmap_blocks.push_back(bgdTable[i].bg_block_bitmap);
+            bitmap_blocks.push_back(bgdTable[i].bg_inode_bitmap);
+        }
+        metadata.prefetch(bitmap_blocks);
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    group_has_super
+     * Type:    Function
+     * Purpose: Checks whether a block group holds a copy of the superblock and the descriptor
+     *          table.  Without sparse_super every group does; with it, only groups 0 and 1 and
+     *          the powers of 3, 5 and 7.
+     * Input:   u32 group, holds the block group.
+     * Output:  bool, true if the group starts with a superblock.
+    ----------------------------------------------------------------------------------------------*/
+    bool ext2::group_has_super(u32 group)
+    {
+        if (group <= 1 || !(superblock.s_feature_ro_compat & EXT2_FEATURE_RO_COMPAT_SPARSE_SUPER))
+        {
+            return true;
+        }
+        
+        const u32 bases[3] = {3, 5, 7};
+        for (u32 i = 0; i < 3; i++)
+        {
+            u64 power = bases[i];
+            while (power < group)
+            {
+                power *= bases[i];
+            }
+            if (power == group)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    group_data_start
+     * Type:    Function
+     * Purpose: Finds the first block of a group past the metadata laid out at its start: the
+     *          superblock and descriptor table copies (if the group has them), and the bitmaps
+     *          and inode tables placed there.  Without flex_bg those are the group's own; with
+     *          it, the first group of each flex group holds those of the whole flex group.  Used
+     *          as an allocation goal, so searches start where the data does.
+     * Input:   u32 group, holds the block group.
+     * Output:  u32, the block number.
+    ----------------------------------------------------------------------------------------------*/
+    u32 ext2::group_data_start(u32 group)
+    {
+        load_bgd_table();
+        
+        u32 group_start = superblock.s_first_data_block + group * superblock.s_blocks_per_group;
+        u32 group_end = (superblock.s_blocks_count - group_start < superblock.s_blocks_per_group ?
+                         superblock.s_blocks_count :
+                         group_start + superblock.s_blocks_per_group);
+        u32 start = group_start;
+        
+        if (group_has_super(group))
+        {
+            u32 table_blocks = ((u64)desc_size * numBlockGroups + block_size_actual - 1) / block_size_actual;
+            start += 1 + table_blocks + superblock.s_reserved_gdt_blocks;
         }
-        else
+        
+        // Skip over any bitmaps and inode tables packed straight after, in whatever order.
+        u32 first_group = group - group % groups_per_flex;
+        u32 last_group = (first_group + groups_per_flex < numBlockGroups ? first_group + groups_per_flex : numBlockGroups);
+        u32 inode_table_blocks = ((u64)superblock.s_inodes_per_group * superblock.s_inode_size + block_size_actual - 1) / block_size_actual;
+        bool moved = true;
+        while (moved && start < group_end)
         {
-            for (u32 i = 0; i < (EXT2_BLOCK_BASE_SIZE << superblock.s_log_block_size); i++)
+            moved = false;
+            for (u32 i = first_group; i < last_group; i++)
             {
-                cout << raw_block[i] << ' ';
+                if (bgdTable[i].bg_block_bitmap == start || bgdTable[i].bg_inode_bitmap == start)
+                {
+                    start += 1;
+                    moved = true;
+                }
+                else if (bgdTable[i].bg_inode_table == start)
+                {
+                    start += inode_table_blocks;
+                    moved = true;
+                }
             }
         }
-        cout << dec;
         
-        delete[] raw_block;
+        return (start < group_end ? start : group_start);
     }
     
     
-    void ext2::debug_dump_block(u32 block_to_dump)
+    /*----------------------------------------------------------------------------------------------
+     * Name:    write_free_space_index
+     * Type:    Function
+     * Purpose: Writes back the block bitmaps that have changed since the free-space index was
+     *          built or last written.
+     * Input:   Nothing.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    void ext2::write_free_space_index()
     {
-        print_block(block_to_dump);
+        if (!free_space_loaded)
+        {
+            return;
+        }
+        
+        for (u32 i = 0; i < numBlockGroups; i++)
+        {
+            if (free_space.is_dirty(i))
+            {
+                write_bitmap(free_space.group_bitmap(i), bgdTable[i].bg_block_bitmap);
+                free_space.mark_clean(i);
+            }
+        }
     }
     
     
-    void ext2::debug_dump_inode(u32 inode_to_dump)
+    /*----------------------------------------------------------------------------------------------
+     * Name:    allocation_goal
+     * Type:    Function
+     * Purpose: Chooses where a new file's blocks should ideally start: straight after the previous
+     *          file written to the same directory, or else near the directory's own data.
+     * Input:   u32 dir_inode_num, holds the inode number of the directory the file is going into.
+     * Input:   const ext2_inode & dir_inode, holds that directory's inode.
+     * Output:  u32, the goal block.
+    ----------------------------------------------------------------------------------------------*/
+    u32 ext2::allocation_goal(u32 dir_inode_num, const ext2_inode & dir_inode)
     {
-        ext2_inode inode = readInode(inode_to_dump);
-        print_inode(&inode);
+        if (last_allocated_dir == dir_inode_num && last_allocated_block != 0)
+        {
+            return last_allocated_block + 1;
+        }
+        
+        if (dir_inode.i_block[0] != 0 && !uses_extents(dir_inode))
+        {
+            return dir_inode.i_block[0];
+        }
+        
+        return group_data_start(inodeToBlockGroup(dir_inode_num));
     }
     
     
     /*----------------------------------------------------------------------------------------------
-     * Name:    make_block_list
+     * Name:    allocate_blocks
      * Type:    Function
-     * Purpose: Unrolls an inode, reading all the different blocks associated with a file, including
-     *          direct, singly indirect, doubly indirect, and triply indirect.  Will return a list
-     *          containing all of these block numbers, in order, so the file can be stitched
-     *          together.
-     * Input:   const u32 inode_number, holding the number of the initial inode.
-     * Output:  list<u32>, containing a list of all the different block numbers where the file is
-     *          contained.
+     * Purpose: Allocates blocks, as few runs as possible, as close to a goal as possible.
+     *
+     *          Blocks already reserved for the caller are used first.  Then a run long enough for
+     *          everything (plus the preallocation, when there is a reservation to keep it in) is
+     *          looked for at or just after the goal; failing that, in the block group whose
+     *          largest free run fits best; failing that, the longest runs available are taken one
+     *          after another.  Preallocated blocks left over go into the reservation.
+     * Input:   u32 goal, holds the block the allocation should ideally start at.
+     * Input:   u32 count, holds the number of blocks wanted.
+     * Input:   u32 prealloc, holds the number of extra blocks to try to reserve.
+     * Input:   vector<u32> & blocks, receives the allocated block numbers, in order.
+     * Input:   block_reservation * reservation, holds the caller's reservation, if it keeps one.
+     * Output:  bool, true if all the blocks were allocated.  On failure nothing is allocated.
     ----------------------------------------------------------------------------------------------*/
-    list<u32> ext2::make_block_list(const u32 inode_number)
+    bool ext2::allocate_blocks(u32 goal, u32 count, u32 prealloc, vector<u32> & blocks, block_reservation * reservation)
     {
-        list<u32> to_return;
-        
-        u32 * s_ind_block_buffer = nullptr;
-        u32 * d_ind_block_buffer = nullptr;
-        u32 * t_ind_block_buffer = nullptr;
-        
-        // general algorithm for this function
-        // NOTE: THIS IS BRUTE FORCE AND UGLY AND NOT AT ALL OPTIMIZED AND MAKES ME FEEL DIRTY
-        // @TODO: Optimize.
-        // 
-        // read inode
-        // add direct block pointers to list
-        // read singly indirect block pointer
-        //   add direct block pointers to list
-        // read doubly indirect block pointer
-        //   read singly indirect block pointers
-        //     add direct block pointers to list
-        // read triply indirect block pointer
-        //   read doubly indirect block pointers
-        //     read singly indirect block pointers
-        //       add direct block pointers to list
+        load_free_space_index();
         
-        // Read the inode.
-        ext2_inode inode = readInode(inode_number);
+        size_t blocks_at_start = blocks.size();
+        u32 extra = (reservation != nullptr ? prealloc : 0);
         
-        // Direct
-        // Add the direct blocks contained in the inode entry itself.
-        for (u32 i = 0; i < EXT2_INODE_NBLOCKS_DIR || inode.i_block[i] == 0; i++)
+        // Use the reservation first.
+        if (reservation != nullptr && reservation->length > 0 && count > 0)
         {
-            // Add the block to the block list.
-            to_return.push_back(inode.i_block[i]);
+            u32 take = (count < reservation->length ? count : reservation->length);
+            for (u32 i = 0; i < take; i++)
+            {
+                blocks.push_back(reservation->start + i);
+            }
+            reservation->start += take;
+            reservation->length -= take;
+            count -= take;
+            goal = blocks.back() + 1;
         }
         
-        // Singly Indirect
-        // Get and parse the singly indirect block and add its contents to the block list.
-        if (inode.i_block[EXT2_INODE_BLOCK_S_IND] != 0)
+        while (count > 0)
         {
-            // Allocate (and check) some memory for the singly indirect block buffer.
-            s_ind_block_buffer = new u32[block_size_actual / sizeof(u32)];
-            if (s_ind_block_buffer == nullptr)
+            // Keep the goal on the file system.
+            if (goal < superblock.s_first_data_block || goal >= superblock.s_blocks_count)
             {
-                cout << "Error allocating memory for the singly indirect block buffer.\n";
-                throw;
+                goal = superblock.s_first_data_block;
             }
             
-            // Set the cursor to and read from the particular block in question.
-            vdi->vdiSeek(blockToOffset(inode.i_block[EXT2_INODE_BLOCK_S_IND]), SEEK_SET);
-            vdi->vdiRead(s_ind_block_buffer, block_size_actual);
+            // Look near the goal, with the preallocation and then without it.
+            u32 group = blockToBlockGroup(goal);
+            u32 run_start = 0;
+            u32 run_length = 0;
+            bool found = free_space.find_run_near(group, blockBlockGroupIndex(goal), count + extra, run_start, run_length);
+            if (!found && extra > 0)
+            {
+                extra = 0;
+                found = free_space.find_run_near(group, blockBlockGroupIndex(goal), count, run_start, run_length);
+            }
             
-            // Iterate through the read block and add the block numbers to the list.  Stop if an
-            // entry of 0 is encountered.
-            for (u32 i = 0; i < block_size_actual / sizeof(u32) && s_ind_block_buffer[i] != 0; i++)
+            // Otherwise go wherever the best-fitting run is, taking it whole if it is too short.
+            if (!found)
             {
-                // Add the block to the block list.
-                to_return.push_back(s_ind_block_buffer[i]);
+                found = free_space.find_group(count + extra, group) &&
+                        free_space.find_run(group, count + extra, run_start, run_length);
             }
-        }
-        
-        // Doubly Indirect
-        // Get and parse the doubly indirect block to get the list of singly indirect blocks, then
-        // parse them and add their contents to the block list.
-        if (inode.i_block[EXT2_INODE_BLOCK_D_IND] != 0)
-        {
-            // Allocate (and check) some memory for the doubly indirect block buffer.
-            d_ind_block_buffer = new u32[block_size_actual / sizeof(u32)];
-            if (d_ind_block_buffer == nullptr)
+            if (!found)
             {
-                cout << "Error allocating memory for the doubly indirect block buffer.\n";
-                throw;
+                vector<u32> allocated(blocks.begin() + blocks_at_start, blocks.end());
+                release_blocks(allocated);
+                blocks.resize(blocks_at_start);
+                return false;
             }
             
-            // Set the cursor to and read from the particular block in question.
-            vdi->vdiSeek(blockToOffset(inode.i_block[EXT2_INODE_BLOCK_D_IND]), SEEK_SET);
-            vdi->vdiRead(d_ind_block_buffer, block_size_actual);
+            // Allocate the run, or as much of it as is wanted.
+            u32 take = (run_length < count + extra ? run_length : count + extra);
+            u32 for_caller = (take < count ? take : count);
+            u32 first_block = superblock.s_first_data_block + group * superblock.s_blocks_per_group + run_start;
+            free_space.allocate(group, run_start, take);
+            for (u32 i = 0; i < for_caller; i++)
+            {
+                blocks.push_back(first_block + i);
+            }
+            count -= for_caller;
             
-            // Iterate through the read block, parsing the singly indirect blocks that are found.
-            // Stop if an entry of 0 is encountered.
-            for (u32 j = 0; j < block_size_actual / sizeof(u32) && d_ind_block_buffer[j] != 0; j++)
+            // Anything beyond what the caller wanted is the preallocation.
+            if (take > for_caller)
             {
-                // Set the cursor to and read from the particular block in question.
-                vdi->vdiSeek(blockToOffset(d_ind_block_buffer[j]), SEEK_SET);
-                vdi->vdiRead(s_ind_block_buffer, block_size_actual);
-                
-                // Iterate through the read block and add the block numbers to the list.  Stop if an
-                // entry of 0 is encountered.
-                for (u32 i = 0; i < block_size_actual / sizeof(u32) && s_ind_block_buffer[i] != 0; i++)
-                {
-                    // Add the block to the block list.
-                    to_return.push_back(s_ind_block_buffer[i]);
-                }
+                reservation->start = first_block + for_caller;
+                reservation->length = take - for_caller;
+                extra = 0;
             }
+            
+            goal = first_block + take;
         }
         
-        // Triply Indirect
-        // Get and parse the triply indirect block to get the list of doubly indirect blocks to get
-        // the list of singly indirect blocks, then parse them and add their contents to the block
-        // list.
-        if (inode.i_block[EXT2_INODE_BLOCK_T_IND] != 0)
+        return true;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    release_blocks
+     * Type:    Function
+     * Purpose: Marks blocks as free in the free-space index, a run of consecutive blocks at a time.
+     * Input:   const vector<u32> & blocks, holds the block numbers to free.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    void ext2::release_blocks(const vector<u32> & blocks)
+    {
+        for (u32 i = 0; i < blocks.size();)
         {
-            // Allocate (and check) some memory for the triply indirect block buffer.
-            t_ind_block_buffer = new u32[block_size_actual / sizeof(u32)];
-            if (t_ind_block_buffer == nullptr)
+            // Find how far the run goes without leaving the block group.
+            u32 group = blockToBlockGroup(blocks[i]);
+            u32 run_length = 1;
+            while (i + run_length < blocks.size() &&
+                   blocks[i + run_length] == blocks[i] + run_length &&
+                   blockToBlockGroup(blocks[i + run_length]) == group)
             {
-                cout << "Error allocating memory for the triply indirect block buffer.\n";
-                throw;
+                run_length++;
             }
             
-            // Set the cursor to and read from the particular block in question.
-            vdi->vdiSeek(blockToOffset(inode.i_block[EXT2_INODE_BLOCK_T_IND]), SEEK_SET);
-            vdi->vdiRead(t_ind_block_buffer, block_size_actual);
-            
-            // Iterate through the read block, parsing the doubly indirect blocks that are found.
-            // Stop if an entry of 0 is encountered.
-            for (u32 k = 0; k < block_size_actual / sizeof(u32) && t_ind_block_buffer[k] != 0; k++)
+            free_space.release(group, blockBlockGroupIndex(blocks[i]), run_length);
+            i += run_length;
+        }
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    release_reservations
+     * Type:    Function
+     * Purpose: Gives back every block that was preallocated but never used, so that none of them
+     *          are written to disk as in use.
+     * Input:   Nothing.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    void ext2::release_reservations()
+    {
+        for (map<u32, block_reservation>::iterator i = reservations.begin(); i != reservations.end(); ++i)
+        {
+            if (i->second.length > 0)
             {
-                // Set the cursor to and read from the particular block in question.
-                vdi->vdiSeek(blockToOffset(t_ind_block_buffer[k]), SEEK_SET);
-                vdi->vdiRead(d_ind_block_buffer, block_size_actual);
-                
-                // Iterate through the read block, parsing the singly indirect blocks that are
-                // found. Stop if an entry of 0 is encountered.
-                for (u32 j = 0; j < block_size_actual / sizeof(u32) && d_ind_block_buffer[j] != 0; j++)
-                {
-                    // Set the cursor to and read from the particular block in question.
-                    vdi->vdiSeek(blockToOffset(d_ind_block_buffer[j]), SEEK_SET);
-                    vdi->vdiRead(s_ind_block_buffer, block_size_actual);
-                    
-                    // Iterate through the read block and add the block numbers to the list.  Stop
-                    // if an entry of 0 is encountered.
-                    for (u32 i = 0; i < block_size_actual / sizeof(u32) && s_ind_block_buffer[i] != 0; i++)
-                    {
-                        // Add the block to the block list.
-                        to_return.push_back(s_ind_block_buffer[i]);
-                    }
-                }
+                free_space.release(blockToBlockGroup(i->second.start), blockBlockGroupIndex(i->second.start), i->second.length);
             }
         }
-        
-        // Clean up the buffers.
-        if (s_ind_block_buffer)
-            delete[] s_ind_block_buffer;
-        if (d_ind_block_buffer)
-            delete[] d_ind_block_buffer;
-        if (t_ind_block_buffer)
-            delete[] t_ind_block_buffer;
-        
-        cout << "debug (ext2::make_block_list) leaving function\n";
-        
-        // Return the block list.
-        return to_return;
+        reservations.clear();
     }
     
     
     /*----------------------------------------------------------------------------------------------
-     * Name:    make_dir_entry
+     * Name:    charge_blocks
      * Type:    Function
-     * Purpose: Takes the inputs given and returns an ext2_dir_entry structure.
-     * Input:   const u32 inode_number, holding the number of the inode to be included.
-     * Input:   const string & filename, holding the filename to be included.
-     * Input:   const u8 filetype, holding the filetype to be included.
-     * Output:  ext2_dir_entry, containing the resulting ext2_dir_entry.
+     * Purpose: Takes newly used blocks off the free block counts in the block group descriptor
+     *          table and the superblock.  (The free-space index already has them as in use.)
+     * Input:   const u32 * blocks, holds the block numbers.
+     * Input:   u32 count, holds the number of blocks.
+     * Output:  Nothing.
     ----------------------------------------------------------------------------------------------*/
-    ext2::ext2_dir_entry ext2::make_dir_entry(const u32 inode_number, const string & filename, const u8 filetype)
+    void ext2::charge_blocks(const u32 * blocks, u32 count)
     {
-        ext2_dir_entry to_return;
-        
-        // Set the majority of the fields in the the to_return variable.
-        to_return.inode = inode_number;
-        to_return.file_type = filetype;
-        to_return.name_len = filename.length();
-        to_return.name.assign(filename);
-        
-        // Calculate the record length and then pad it to make sure it aligns to a 4-byte boundary.
-        to_return.rec_len = utility::nearest_mult_four(EXT2_DIR_BASE_SIZE + to_return.name_len);
+        load_bgd_table();
         
-        // Return the newly-minted ext2_dir_entry structure.
-        return to_return;
+        for (u32 i = 0; i < count; i++)
+        {
+            bgdTable[blockToBlockGroup(blocks[i])].bg_free_blocks_count -= 1;
+        }
+        superblock.s_free_blocks_count -= count;
+        bgd_table_dirty = true;
     }
     
     
     /*----------------------------------------------------------------------------------------------
-     * Name:    read_bitmap
+     * Name:    discharge_blocks
      * Type:    Function
-     * Purpose: Reads a bitmap into memory and returns one that is a bit easier to work with, that
-     *          is, one that is simply a vector of type bool.
-     * Input:   const u32 block_num, holds the block that has the bitmap.
-     * Input:   const u64 num_bitmap_entries, holds the number of entries in a bitmap.
-     * Output:  vector<bool>, holds the more-easily-referenced bitmap.
-     *
-     * @TODO    Create another more abstract version of this and put it in the utility namespace.
+     * Purpose: Adds freed blocks back onto the free block counts in the block group descriptor
+     *          table and the superblock, undoing charge_blocks.  (The free-space index is told
+     *          separately, by release_blocks.)
+     * Input:   const u32 * blocks, holds the block numbers.
+     * Input:   u32 count, holds the number of blocks.
+     * Output:  Nothing.
     ----------------------------------------------------------------------------------------------*/
-    vector<bool> ext2::read_bitmap(const u32 block_num, const u64 num_bitmap_entries)
+    void ext2::discharge_blocks(const u32 * blocks, u32 count)
     {
-        vector<bool> to_return;
-        
-        // Convert the number of entries in the bitmap to the size of the bitmap in bytes.
-        size_t bitmap_size = (num_bitmap_entries % BITS_PER_BYTE ?
-                              num_bitmap_entries / BITS_PER_BYTE + 1 :
-                              num_bitmap_entries / BITS_PER_BYTE);
+        load_bgd_table();
         
-        // Create a buffer for reading the bitmap block.
-        u8 * bitmap_block_buffer = nullptr;
-        bitmap_block_buffer = new u8[bitmap_size];
-        if (bitmap_block_buffer == nullptr)
+        for (u32 i = 0; i < count; i++)
         {
-            cout << "Error: Error allocating the bitmap block buffer. (ext2::read_bitmap)\n";
-            throw;
+            bgdTable[blockToBlockGroup(blocks[i])].bg_free_blocks_count += 1;
         }
+        superblock.s_free_blocks_count += count;
+        bgd_table_dirty = true;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    write_inode
+     * Type:    Function
+     * Purpose: Puts an inode into its inode table block in the metadata cache, to be written at
+     *          the next commit.
+     * Input:   const ext2_inode & inode, holds the inode.
+     * Input:   const u32 inode_num, holds the inode number.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    void ext2::write_inode(const ext2_inode & inode, const u32 inode_num)
+    {
+        off_t offset = inodeToOffset(inode_num) - blockToOffset(0);
+        u32 block_num = offset / block_size_actual;
         
-        // Seek to and read the bitmap into the buffer.
-        vdi->vdiSeek(blockToOffset(block_num), SEEK_SET);
-        vdi->vdiRead(bitmap_block_buffer, bitmap_size);
+        memcpy(&(metadata.get(block_num)[offset % block_size_actual]), &inode, sizeof(ext2_inode));
+        metadata.mark_dirty(block_num);
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    allocate_inode
+     * Type:    Function
+     * Purpose: Takes a free inode, searching the block groups from a preferred one onward.  The
+     *          inode bitmap and the free inode counts are updated in the metadata cache and in
+     *          memory, to be written at the next commit.
+     * Input:   u32 goal_group, holds the block group to try first.
+     * Output:  u32, the inode number, or 0 if there are no free inodes.
+    ----------------------------------------------------------------------------------------------*/
+    u32 ext2::allocate_inode(u32 goal_group)
+    {
+        load_bgd_table();
         
-        // Process the bitmap.
-        for (u32 i = 0; i < num_bitmap_entries; i++)
+        for (u32 i = 0; i < numBlockGroups; i++)
         {
-            // Access byte number i/BITS_PER_BYTE, bitshift it i%BITS_PER_BYTE to the left to get
-            // rid of any more significant bits, ensuring the bit we want is now in the most
-            // significant position itself, then bitshift it 7 to the right to get rid of any less
-            // significant bits, making the value either true or false.
-            to_return.push_back((bitmap_block_buffer[i / BITS_PER_BYTE] << (i % BITS_PER_BYTE)) >> 7);
+            u32 group = (goal_group + i) % numBlockGroups;
+            if (bgdTable[group].bg_free_inodes_count == 0)
+            {
+                continue;
+            }
+            
+            // Find the first free inode in the group's bitmap.  (The free count says there is one,
+            // but guard against the bitmap disagreeing, just in case.)
+            u8 * bitmap_block = metadata.get(bgdTable[group].bg_inode_bitmap);
+            bitmap inode_bitmap;
+            inode_bitmap.load(bitmap_block, superblock.s_inodes_per_group);
+            u64 index = inode_bitmap.find_clear(0);
+            if (index == bitmap::npos)
+            {
+                continue;
+            }
+            
+            // Mark the inode as used.
+            bitmap_block[index / BITS_PER_BYTE] |= 1 << (index % BITS_PER_BYTE);
+            metadata.mark_dirty(bgdTable[group].bg_inode_bitmap);
+            
+            // Account for it.
+            bgdTable[group].bg_free_inodes_count -= 1;
+            superblock.s_free_inodes_count -= 1;
+            bgd_table_dirty = true;
+            
+            return index + 1 + group * superblock.s_inodes_per_group;
         }
         
-        // Deallocate the bitmap block buffer.
-        delete[] bitmap_block_buffer;
+        return 0;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    release_inode
+     * Type:    Function
+     * Purpose: Gives back an inode taken by allocate_inode, clearing its bit in the inode bitmap
+     *          and adding it back to the free inode counts.
+     * Input:   u32 inode_num, holds the inode number.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    void ext2::release_inode(u32 inode_num)
+    {
+        load_bgd_table();
         
-        // Return the vectored bitmap.
-        return to_return;
+        u32 group = inodeToBlockGroup(inode_num);
+        u32 index = inodeBlockGroupIndex(inode_num);
+        
+        // Mark the inode as free.
+        u8 * bitmap_block = metadata.get(bgdTable[group].bg_inode_bitmap);
+        bitmap_block[index / BITS_PER_BYTE] &= ~(1 << (index % BITS_PER_BYTE));
+        metadata.mark_dirty(bgdTable[group].bg_inode_bitmap);
+        
+        // Account for it.
+        bgdTable[group].bg_free_inodes_count += 1;
+        superblock.s_free_inodes_count += 1;
+        bgd_table_dirty = true;
     }
     
     
     /*----------------------------------------------------------------------------------------------
-     * Name:    write_bitmap
+     * Name:    commit
      * Type:    Function
-     * Purpose: Writes a bitmap to disk.
-     * Input:   const vector<bool> & bitmap_vector, holds the bitmap in vector form.
-     * Input:   const u32 block_num, holds the block number to write the bitmap to.
+     * Purpose: Writes all pending metadata changes to disk: the block bitmaps held by the
+     *          free-space index, the inode bitmaps and inode table blocks in the metadata cache,
+     *          the block group descriptor table and the superblock.  Everything goes out in block
+     *          order, with neighbouring blocks written together.
+     * Input:   Nothing.
      * Output:  Nothing.
-     *
-     * @TODO    Create another more abstract version of this and put it in the utility namespace.
     ----------------------------------------------------------------------------------------------*/
-    void ext2::write_bitmap(const vector<bool> & bitmap_vector, const u32 block_num)
+    void ext2::commit()
     {
-        // Create a buffer for writing the bitmap block.
-        u8 * bitmap_block_buffer = nullptr;
-        bitmap_block_buffer = new u8[block_size_actual];
-        if (bitmap_block_buffer == nullptr)
+        // Give back any preallocated blocks that went unused, then put the block bitmaps that
+        // changed into the cache.
+        release_reservations();
+        write_free_space_index();
+        
+        if (bgd_table_dirty)
         {
-            cout << "Error: Error allocating the bitmap block buffer. (ext2::write_bitmap)\n";
-            throw;
+            // Copy the block group descriptors into the blocks that hold them.  A descriptor never
+            // straddles two blocks, and any part of it past ext2_block_group_desc is left as read.
+            off_t table_offset = bgd_table_start - blockToOffset(0);
+            for (u32 i = 0; i < numBlockGroups; i++)
+            {
+                u64 desc_offset = table_offset + (u64)i * desc_size;
+                u32 block_num = desc_offset / block_size_actual;
+                memcpy(&(metadata.get(block_num)[desc_offset % block_size_actual]), &(bgdTable[i]), sizeof(ext2_block_group_desc));
+                metadata.mark_dirty(block_num);
+            }
+            
+            // Total up the free blocks and inodes for the superblock.
+            superblock.s_free_blocks_count = 0;
+            superblock.s_free_inodes_count = 0;
+            for (u32 i = 0; i < numBlockGroups; i++)
+            {
+                superblock.s_free_blocks_count += bgdTable[i].bg_free_blocks_count;
+                superblock.s_free_inodes_count += bgdTable[i].bg_free_inodes_count;
+            }
+            bgd_table_dirty = false;
         }
         
-        // Zero out the buffer to ensure a pristine workspace.
-        memset(bitmap_block_buffer, 0, block_size_actual);
-        
-        // Copy the data from the bitmap vector into the buffer.
-        for (u32 i = 0; i < bitmap_vector.size(); i++)
+        if (!metadata.is_dirty())
         {
-            // Access byte number i/BITS_PER_BYTE, bitshift it 1 to the left then bitwise OR it with
-            // whatever the bitmap vector value is at index i.
-            bitmap_block_buffer[i / BITS_PER_BYTE] = (bitmap_block_buffer[i / BITS_PER_BYTE] << 1) | bitmap_vector[i];
+            return;
         }
         
-        // Seek to and write the bitmap to disk.
-        vdi->vdiSeek(blockToOffset(block_num), SEEK_SET);
-        vdi->vdiWrite(bitmap_block_buffer, block_size_actual);
+        // Modify the last write time (in Unix epoch time) and copy the superblock into its block.
+        superblock.s_wtime = time(nullptr);
+        off_t superblock_offset = superblock_start - blockToOffset(0);
+        u32 superblock_block = superblock_offset / block_size_actual;
+        memcpy(&(metadata.get(superblock_block)[superblock_offset % block_size_actual]), &superblock, sizeof(ext2_superblock));
+        metadata.mark_dirty(superblock_block);
         
-        // Deallocate the bitmap block buffer.
-        delete[] bitmap_block_buffer;
+        metadata.flush();
     }
 } // namespace vdi_explorer
\ No newline at end of file
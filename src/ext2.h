@@ -2,7 +2,12 @@
 #define EXT2_H
 
 #include "datatypes.h" //typedefs for s8, u8, s16, u16, s32, u32, s64, and u64
+#include "bitmap.h"
 #include "boot.h"
+#include "dir_slot_index.h"
+#include "dir_snapshot.h"
+#include "free_space_index.h"
+#include "metadata_cache.h"
 #include "vdi_reader.h"
 #include "constants.h"
 
@@ -11,6 +16,8 @@
 
 #include <fstream>
 #include <list>
+#include <map>
+#include <set>
 #include <string>
 #include <vector>
 #include <sys/types.h>
@@ -25,7 +32,7 @@ struct fs_entry_posix
     u16 permissions;
     u16 user_id;
     u16 group_id;
-    u32 size;
+    u64 size;
     s64 timestamp_created;
     s64 timestamp_modified;
 };
@@ -35,17 +42,59 @@ namespace vdi_explorer
     class ext2
     {
         public:
+            // Random-access handle to a file inside the file system.
+            class file_handle;
+            
+            // A host file to be copied into the present working directory by ingest.
+            struct ingest_item
+            {
+                int input_fd;
+                string name;
+                const vector<char> * contents = nullptr;    // the file's data, if read already
+            };
+            
             // Constructor
-            ext2(vdi_reader *);
+            ext2(vdi_reader *, bool = false);
             
             // Destructor
             ~ext2();
             
             vector<fs_entry_posix> get_directory_contents();
+            void get_directory_contents(dir_snapshot &);
+            
+            // Look up many files' details at once, reading each inode table block only once.
+            bool stat_many(const u32 *, u32, vector<fs_entry_posix> &);
+            
             string get_pwd();
             void set_pwd(const string &);
-            bool file_read(fstream &, const string &);
-            bool file_write(fstream &, string);
+            bool file_read(int, const string &);
+            
+            // Copy many files, named or matched by wildcards, out to a host directory.
+            bool extract_files(const vector<string> &, const string &);
+            bool file_write(int, string);
+            
+            // Change existing files in place.
+            bool file_write_at(int, const string &, u64);
+            bool file_append(int, const string &);
+            bool file_truncate(const string &, u64);
+            
+            // Copy many host files into the present working directory as one batch.
+            bool ingest(const vector<ingest_item> &);
+            
+            // Copy a host directory tree into the present working directory.
+            bool ingest_tree(const string &, string);
+            
+            // Copy a directory tree out to the host.
+            bool export_tree(const string &, const string &);
+            
+            // Remove files, or whole directory trees.
+            bool remove(const vector<string> &, bool);
+            
+            // Write all pending metadata changes to disk.
+            void commit();
+            
+            // Open a file for random access reads.
+            file_handle open(const string &);
             
             // Public debug functions.
             void debug_dump_pwd_inode();
@@ -115,7 +164,7 @@ namespace vdi_explorer
                  */
                 u8   s_prealloc_blocks;         /* Nr of blocks to try to preallocate*/
                 u8   s_prealloc_dir_blocks;     /* Nr to preallocate for dirs */
-                u16	 s_padding1;                /*  */
+                u16	 s_reserved_gdt_blocks;     /* Blocks set aside after the descriptor table for growth */
                 
                 /*
                  * Journaling support valid if EXT3_FEATURE_COMPAT_HAS_JOURNAL set.
@@ -126,11 +175,31 @@ namespace vdi_explorer
                 u32  s_last_orphan;		        /* start of list of inodes to delete */
                 u32  s_hash_seed[4];		    /* HTREE hash seed */
                 u8   s_def_hash_version;	    /* Default hash version to use */
-                u8   s_reserved_char_pad;       /*  */
-                u16  s_reserved_word_pad;       /*  */
+                u8   s_jnl_backup_type;         /* How s_jnl_blocks backs up the journal inode */
+                u16  s_desc_size;               /* Group descriptor size (64bit feature only) */
                 u32  s_default_mount_opts;      /*  */
                 u32  s_first_meta_bg; 	        /* First metablock block group */
-                u32  s_reserved[190];	        /* Padding to the end of the block */
+                
+                /*
+                 * ext4 fields.  Only s_log_groups_per_flex is used here; the rest are laid out to
+                 * place it.
+                 */
+                u32  s_mkfs_time;               /* When the file system was created */
+                u32  s_jnl_blocks[17];          /* Backup of the journal inode */
+                u32  s_blocks_count_hi;         /* High 32 bits of the blocks count */
+                u32  s_r_blocks_count_hi;       /* High 32 bits of the reserved blocks count */
+                u32  s_free_blocks_count_hi;    /* High 32 bits of the free blocks count */
+                u16  s_min_extra_isize;         /* All inodes have at least this many extra bytes */
+                u16  s_want_extra_isize;        /* New inodes should reserve this many bytes */
+                u32  s_flags;                   /* Miscellaneous flags */
+                u16  s_raid_stride;             /* RAID stride */
+                u16  s_mmp_interval;            /* Multi-mount protection check interval */
+                u64  s_mmp_block;               /* Multi-mount protection block */
+                u32  s_raid_stripe_width;       /* RAID stripe width */
+                u8   s_log_groups_per_flex;     /* 1 << (this variable) = Groups per flex group */
+                u8   s_checksum_type;           /* Metadata checksum algorithm */
+                u16  s_reserved_pad;            /*  */
+                u32  s_reserved[162];	        /* Padding to the end of the block */
             };
             
             // Block group descriptor.
@@ -182,7 +251,7 @@ namespace vdi_explorer
                 u32  i_block[EXT2_INODE_NBLOCKS_TOT];       /* Pointers to blocks */
                 u32  i_generation;	            /* File version (for NFS) */
                 u32  i_file_acl;	            /* File ACL */
-                u32  i_dir_acl;	                /* Directory ACL */
+                u32  i_dir_acl;	                /* Directory ACL, or high 32 bits of size for regular files */
                 u32  i_faddr;	                /* Fragment address */
                 union
                 {
@@ -214,6 +283,37 @@ namespace vdi_explorer
                 } osd2;				            /* OS dependent 2 */
             };
             
+            /*
+             * ext4 extent tree nodes.  An inode using extents holds the root node in its i_block
+             * array; deeper nodes take up a whole block.  Every node starts with a header, followed
+             * by index entries (pointing at the nodes below) or, at depth 0, by the extents
+             * themselves.  Entries are sorted by the first logical block they cover.
+             */
+            struct ext4_extent_header
+            {
+                u16  eh_magic;                  /* EXT4_EXTENT_MAGIC */
+                u16  eh_entries;                /* Number of valid entries */
+                u16  eh_max;                    /* Capacity of the node in entries */
+                u16  eh_depth;                  /* Levels below this node (0 for a leaf) */
+                u32  eh_generation;             /* Generation of the tree */
+            };
+            
+            struct ext4_extent
+            {
+                u32  ee_block;                  /* First logical block covered */
+                u16  ee_len;                    /* Number of blocks covered */
+                u16  ee_start_hi;               /* High 16 bits of the first physical block */
+                u32  ee_start_lo;               /* Low 32 bits of the first physical block */
+            };
+            
+            struct ext4_extent_idx
+            {
+                u32  ei_block;                  /* First logical block covered by the node below */
+                u32  ei_leaf_lo;                /* Low 32 bits of the node below */
+                u16  ei_leaf_hi;                /* High 16 bits of the node below */
+                u16  ei_unused;
+            };
+            
             /*
              * The new version of the directory entry.  Since EXT2 structures are
              * stored in intel byte order (little endian), and the name_len field could never be
@@ -235,10 +335,42 @@ namespace vdi_explorer
             
             u32 numBlockGroups = 0;
             
+            // The size of each entry in the block group descriptor table on disk (larger than
+            // ext2_block_group_desc under the 64bit feature), and how many block groups have
+            // their bitmaps and inode tables packed together (1 without flex_bg).
+            u32 desc_size = sizeof(ext2_block_group_desc);
+            u32 groups_per_flex = 1;
+            
+            // Whether the file system uses features that writes here would leave inconsistent (a
+            // journal, checksums, uninitialized groups, or anything unknown).  Every change is then
+            // refused.
+            bool read_only = false;
+            
             size_t block_size_actual = EXT2_BLOCK_BASE_SIZE;
-            size_t max_file_size = EXT2_MAX_ABS_FILE_SIZE;
+            u64 max_file_size = EXT2_MAX_ABS_FILE_SIZE;
             
             ext2_block_group_desc * bgdTable = nullptr;
+            bool bgd_table_loaded = false;
+            
+            // Free space in each block group, built from the block bitmaps the first time
+            // anything is allocated.
+            free_space_index free_space;
+            bool free_space_loaded = false;
+            
+            // Blocks set aside for an inode beyond what it asked for (see s_prealloc_blocks and
+            // s_prealloc_dir_blocks), so that it can keep growing contiguously.  They are marked
+            // in use in the free-space index, but given back before the bitmaps are written.
+            struct block_reservation
+            {
+                u32 start = 0;
+                u32 length = 0;
+            };
+            map<u32, block_reservation> reservations;
+            
+            // Where the previous file's data ended, and in which directory, so that the next file
+            // written to the same directory can follow straight on from it.
+            u32 last_allocated_dir = 0;
+            u32 last_allocated_block = 0;
             
             // Keep track of where the superblock starts.
             off_t superblock_start = 0;
@@ -246,35 +378,150 @@ namespace vdi_explorer
             // Keep track of where the block group descriptor table starts.
             off_t bgd_table_start = 0;
             
+            // Metadata blocks (bitmaps, inode tables, the descriptor table and the superblock)
+            // changed since the last commit, and whether the in-memory descriptor table has.
+            metadata_cache metadata;
+            bool bgd_table_dirty = false;
+            
             // a list of directories in order to keep track of the hierarchy
             // list<ext2_dir_entry> pwd;
             vector<ext2_dir_entry> pwd;
             
+            // A small cache of indirect blocks, used while mapping logical blocks of a file to the
+            // physical blocks that hold them.  Each slot holds the contents of one indirect block.
+            struct indirect_cache
+            {
+                static const u32 NUM_SLOTS = 8;
+                u32 block[NUM_SLOTS] = {0};
+                u32 last_used[NUM_SLOTS] = {0};
+                vector<u32> pointers[NUM_SLOTS];
+                u32 clock = 0;
+            };
+            
             u32 offsetToBlock(off_t);
             u32 inodeToBlockGroup(u32);
             u32 inodeBlockGroupIndex(u32);
+            u32 blockToBlockGroup(u32);
+            u32 blockBlockGroupIndex(u32);
             off_t blockToOffset(u32);
             off_t inodeToOffset(u32);
             vector<ext2_dir_entry> parse_directory_inode(ext2_inode);
             vector<ext2_dir_entry> parse_directory_inode(u32);
+            void read_directory(const ext2_inode &, dir_snapshot &);
             ext2_inode readInode(u32 inode);
-            // @TODO void write_inode(const ext2_inode &, const u32);
+            u64 inode_size(const ext2_inode &) const;
+            void set_inode_size(ext2_inode &, u64);
+            bool read_inodes(const vector<u32> &, vector<ext2_inode> &);
+            bool read_inodes(const u32 *, u32, ext2_inode *);
+            void write_inode(const ext2_inode &, const u32);
+            u32 allocate_inode(u32);
+            void release_inode(u32);
             // u32 bgd_starting_data_block(const u32);
             
             // @TODO convert to using commented prototype and function
             // bool dir_entry_exists(const string &, vector<ext2_dir_entry> &);
             vector<ext2_dir_entry> dir_entry_exists(const string &);
             bool file_entry_exists(const string &, u32 &);
+            bool file_path_exists(const string &, u32 &);
+            bool match_files(const string &, vector<ext2_dir_entry> &);
+            bool match_entries(const string &, u32 &, vector<ext2_dir_entry> &);
             
             // Unroll a file inode into an ordered list of blocks containing the file's data.
             list<u32> make_block_list(const u32);
             
+            // Map a logical block of a file to its physical block without unrolling the whole file.
+            u32 map_logical_block(const ext2_inode &, u32, indirect_cache &, u64 * = nullptr);
+            const vector<u32> & read_indirect_block(u32, indirect_cache &);
+            
+            // List every block an inode holds, indirect blocks included.
+            void inode_blocks(const ext2_inode &, vector<u32> &);
+            void indirect_blocks(u32, u32, vector<u32> &);
+            
+            // Read ext4 extent trees in place of block pointers.
+            bool uses_extents(const ext2_inode &) const;
+            u32 map_extent_block(const ext2_inode &, u32, indirect_cache &, u64 *);
+            void read_extent_tree(const ext2_inode &, vector<ext4_extent> &, vector<u32> * = nullptr);
+            void read_extent_node(const u8 *, u32, u32, vector<ext4_extent> &, vector<u32> *);
+            
             // Create an ext2_dir_entry structure.
             ext2_dir_entry make_dir_entry(const u32, const string &, const u8);
+            bool valid_entry_name(const string &) const;
             
             // Read and write bitmaps.
-            vector<bool> read_bitmap(const u32, const u64);
-            void write_bitmap(const vector<bool> &, const u32);
+            bitmap read_bitmap(const u32, const u64);
+            void write_bitmap(const bitmap &, const u32);
+            
+            // Build and write back the free-space index.
+            void load_bgd_table();
+            void load_free_space_index();
+            void prefetch_group_bitmaps();
+            bool group_has_super(u32);
+            u32 group_data_start(u32);
+            void write_free_space_index();
+            
+            // Block allocation.
+            u32 allocation_goal(u32, const ext2_inode &);
+            bool allocate_blocks(u32, u32, u32, vector<u32> &, block_reservation * = nullptr);
+            void release_blocks(const vector<u32> &);
+            void release_reservations();
+            void charge_blocks(const u32 *, u32);
+            void discharge_blocks(const u32 *, u32);
+            
+            // Where a host file's data lives, and how many blocks it could need, worked out before
+            // anything is allocated for it.  Streamed inputs get their blocks as they go.
+            struct input_plan
+            {
+                u64 size = 0;
+                vector<pair<u32, u32>> data_blocks; // [first, end) logical block ranges
+                u32 num_logical_blocks = 0;
+                u32 num_blocks_needed = 0;          // data plus indirect blocks, at most
+                bool streaming = false;             // size unknown until the input ends
+                const vector<char> * contents = nullptr;
+            };
+            bool ingest_into(u32, const vector<ingest_item> &);
+            bool plan_input(int, input_plan &);
+            bool write_input(int, const input_plan &, vector<u32> &, u32, u32, ext2_inode &, u32 &);
+            bool add_dir_entries(u32, vector<ext2_dir_entry> &);
+            bool remove_dir_entries(u32, const set<string> &);
+            
+            // Where each directory used so far has room for new entries, and what names it holds.
+            map<u32, dir_slot_index> dir_slots;
+            dir_slot_index & directory_slots(u32);
+            
+            // Directory creation, with new directories spread across block groups.
+            u32 last_directory_group = 0;
+            u32 find_directory_group(u32);
+            u32 make_directory(u32, string);
+            
+            // Reading files whose inodes are already at hand, and copying them out.
+            file_handle open_inode(u32, const ext2_inode &);
+            bool export_range(file_handle &, int, u64, u64);
+            
+            // A file being changed in place: its inode, the blocks allocated for it so far, and
+            // the indirect blocks read or changed, to be written back when the change is done.
+            struct edited_block
+            {
+                vector<u32> pointers;
+                bool dirty = false;
+            };
+            struct inode_edit
+            {
+                u32 inode_num = 0;
+                ext2_inode inode;
+                vector<u32> pool;
+                u32 pool_used = 0;
+                u32 goal = 0;
+                u32 blocks_wanted = 0;
+                map<u32, edited_block> indirect;
+            };
+            bool begin_edit(const string &, inode_edit &);
+            void finish_edit(inode_edit &);
+            bool write_range(inode_edit &, u64, const char *, size_t, u64 &);
+            void zero_block_tail(inode_edit &, u64);
+            u32 edit_map_block(inode_edit &, u32, bool);
+            edited_block & edit_indirect_block(inode_edit &, u32);
+            u32 edit_take_block(inode_edit &);
+            void truncate_indirect(inode_edit &, u32 &, u32, u64, u64, vector<u32> &);
             
             // Debug functions.
             void print_inode(ext2_inode *);
@@ -284,6 +531,31 @@ namespace vdi_explorer
             void print_bgd_table();
             void print_block(u32, bool = true);
     };
+    
+    
+    // A handle to an open file, allowing arbitrary byte ranges to be read without building the
+    // file's complete block list first.
+    class ext2::file_handle
+    {
+        public:
+            size_t pread(void *, size_t, u64);
+            u64 next_data(u64);
+            u64 next_hole(u64, u64);
+            
+            // Copy a range of the file into a host file inside the kernel, as far as it can.
+            u64 copy_to(int, u64, u64);
+            u64 size() const;
+            bool is_open() const;
+            void close();
+            
+        private:
+            friend class ext2;
+            
+            ext2 * file_system = nullptr;
+            u32 inode_num = 0;
+            ext2_inode inode;
+            indirect_cache cache;
+    };
 }
 
 #endif // EXT2_H
\ No newline at end of file
@@ -0,0 +1,421 @@
+/*--------------------------------------------------------------------------------------------------
+ * Author:      
+ * Date:        2026-10-19
+ * Assignment:  Final Project
+ * Source File: free_space_index.cpp
+ * Language:    C/C++
+ * Course:      Operating Systems
+ * Purpose:     Contains the implementation of the free_space_index class.
+ -------------------------------------------------------------------------------------------------*/
+
+#include "free_space_index.h"
+
+using namespace std;
+
+namespace vdi_explorer
+{
+    namespace
+    {
+        // How many free extents past the goal find_run_near looks at before giving up.
+        const u32 NEAR_SEARCH_LIMIT = 32;
+    } // namespace
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    reset
+     * Type:    Function
+     * Purpose: Empties the index and sizes it for a number of block groups, none of them loaded.
+     * Input:   u32 num_groups, holds the number of block groups in the file system.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    void free_space_index::reset(u32 num_groups)
+    {
+        groups.clear();
+        groups.resize(num_groups);
+        groups_by_largest_run.clear();
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    is_loaded
+     * Type:    Function
+     * Purpose: Checks whether a block group's free space has been loaded into the index.
+     * Input:   u32 group, holds the block group number.
+     * Output:  bool, true if the group has been loaded.
+    ----------------------------------------------------------------------------------------------*/
+    bool free_space_index::is_loaded(u32 group) const
+    {
+        return groups[group].loaded;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    load_group
+     * Type:    Function
+     * Purpose: Loads a block group's block bitmap into the index, breaking its free space into
+     *          extents.
+     * Input:   u32 group, holds the block group number.
+     * Input:   const bitmap & block_bitmap, holds the group's block bitmap as read from disk.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    void free_space_index::load_group(u32 group, const bitmap & block_bitmap)
+    {
+        u32 old_largest = largest_run(group);
+        
+        group_entry & entry = groups[group];
+        entry.blocks = block_bitmap;
+        entry.extents_by_start.clear();
+        entry.extents_by_length.clear();
+        entry.free_blocks = 0;
+        entry.loaded = true;
+        entry.dirty = false;
+        
+        // Walk the bitmap from free run to free run.
+        for (u64 start = block_bitmap.find_clear(0); start != bitmap::npos; start = block_bitmap.find_clear(start))
+        {
+            u64 end = block_bitmap.find_set(start);
+            add_extent(group, start, end - start);
+            start = end;
+        }
+        
+        rerank_group(group, old_largest);
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    free_blocks
+     * Type:    Function
+     * Purpose: Returns the number of free blocks in a block group.
+     * Input:   u32 group, holds the block group number.
+     * Output:  u32, the number of free blocks, or 0 if the group has not been loaded.
+    ----------------------------------------------------------------------------------------------*/
+    u32 free_space_index::free_blocks(u32 group) const
+    {
+        return groups[group].free_blocks;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    largest_run
+     * Type:    Function
+     * Purpose: Returns the length of the longest run of free blocks in a block group.
+     * Input:   u32 group, holds the block group number.
+     * Output:  u32, the length of the longest free run, or 0 if there is none.
+    ----------------------------------------------------------------------------------------------*/
+    u32 free_space_index::largest_run(u32 group) const
+    {
+        const group_entry & entry = groups[group];
+        return (entry.extents_by_length.empty() ? 0 : entry.extents_by_length.rbegin()->first);
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    find_group
+     * Type:    Function
+     * Purpose: Picks a block group for an allocation: the group whose largest free run fits the
+     *          request most tightly, or, if no group can hold the request in one run, the group
+     *          with the longest free run of all.
+     * Input:   u32 length, holds the number of blocks wanted.
+     * Input:   u32 & group, receives the block group number.
+     * Output:  bool, true if a group with any free space was found.
+    ----------------------------------------------------------------------------------------------*/
+    bool free_space_index::find_group(u32 length, u32 & group) const
+    {
+        if (groups_by_largest_run.empty())
+        {
+            return false;
+        }
+        
+        set<pair<u32, u32>>::const_iterator best = groups_by_largest_run.lower_bound(make_pair(length, 0));
+        if (best == groups_by_largest_run.end())
+        {
+            --best;
+        }
+        
+        group = best->second;
+        return true;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    find_run
+     * Type:    Function
+     * Purpose: Picks a free run within a block group: the shortest run that can hold the request,
+     *          or, if none can, the longest run the group has.
+     * Input:   u32 group, holds the block group number.
+     * Input:   u32 length, holds the number of blocks wanted.
+     * Input:   u32 & start, receives the first block (bitmap index) of the run.
+     * Input:   u32 & run_length, receives the full length of the run, which may be more or less
+     *          than the number of blocks wanted.
+     * Output:  bool, true if the group has any free run at all.
+    ----------------------------------------------------------------------------------------------*/
+    bool free_space_index::find_run(u32 group, u32 length, u32 & start, u32 & run_length) const
+    {
+        const group_entry & entry = groups[group];
+        if (entry.extents_by_length.empty())
+        {
+            return false;
+        }
+        
+        set<pair<u32, u32>>::const_iterator best = entry.extents_by_length.lower_bound(make_pair(length, 0));
+        if (best == entry.extents_by_length.end())
+        {
+            --best;
+        }
+        
+        run_length = best->first;
+        start = best->second;
+        return true;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    find_run_near
+     * Type:    Function
+     * Purpose: Looks for a free run of at least the given length at or just after a goal block:
+     *          first the free extent holding the goal itself, counting only from the goal onward,
+     *          then the next few free extents after it.
+     * Input:   u32 group, holds the block group number.
+     * Input:   u32 goal, holds the preferred first block (bitmap index).
+     * Input:   u32 length, holds the number of blocks wanted.
+     * Input:   u32 & start, receives the first block (bitmap index) of the run.
+     * Input:   u32 & run_length, receives the length of the run from start to its end.
+     * Output:  bool, true if a long enough run was found close to the goal.
+    ----------------------------------------------------------------------------------------------*/
+    bool free_space_index::find_run_near(u32 group, u32 goal, u32 length, u32 & start, u32 & run_length) const
+    {
+        const group_entry & entry = groups[group];
+        map<u32, u32>::const_iterator extent = entry.extents_by_start.upper_bound(goal);
+        
+        // Check the extent holding the goal, if the goal is free.
+        if (extent != entry.extents_by_start.begin())
+        {
+            map<u32, u32>::const_iterator previous = extent;
+            --previous;
+            u32 extent_end = previous->first + previous->second;
+            if (extent_end > goal && extent_end - goal >= length)
+            {
+                start = goal;
+                run_length = extent_end - goal;
+                return true;
+            }
+        }
+        
+        // Check the extents that follow.
+        for (u32 i = 0; extent != entry.extents_by_start.end() && i < NEAR_SEARCH_LIMIT; ++extent, i++)
+        {
+            if (extent->second >= length)
+            {
+                start = extent->first;
+                run_length = extent->second;
+                return true;
+            }
+        }
+        
+        return false;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    allocate
+     * Type:    Function
+     * Purpose: Marks a range of free blocks as used.  The range must lie within a single free
+     *          extent, as it always does when it was chosen with find_run.
+     * Input:   u32 group, holds the block group number.
+     * Input:   u32 start, holds the first block (bitmap index) of the range.
+     * Input:   u32 length, holds the number of blocks in the range.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    void free_space_index::allocate(u32 group, u32 start, u32 length)
+    {
+        group_entry & entry = groups[group];
+        if (length == 0 || entry.extents_by_start.empty())
+        {
+            return;
+        }
+        
+        // Find the extent holding the range: the last one starting at or before it.
+        map<u32, u32>::iterator extent = entry.extents_by_start.upper_bound(start);
+        if (extent == entry.extents_by_start.begin())
+        {
+            return;
+        }
+        --extent;
+        
+        u32 extent_start = extent->first;
+        u32 extent_length = extent->second;
+        if (start + length > extent_start + extent_length)
+        {
+            return;
+        }
+        
+        u32 old_largest = largest_run(group);
+        
+        // Cut the range out of the extent, keeping whatever is left on either side.
+        remove_extent(group, extent_start, extent_length);
+        if (start > extent_start)
+        {
+            add_extent(group, extent_start, start - extent_start);
+        }
+        if (start + length < extent_start + extent_length)
+        {
+            add_extent(group, start + length, extent_start + extent_length - start - length);
+        }
+        
+        entry.blocks.set_range(start, length);
+        entry.dirty = true;
+        
+        rerank_group(group, old_largest);
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    release
+     * Type:    Function
+     * Purpose: Marks a range of used blocks as free, merging it with any free extents it touches.
+     * Input:   u32 group, holds the block group number.
+     * Input:   u32 start, holds the first block (bitmap index) of the range.
+     * Input:   u32 length, holds the number of blocks in the range.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    void free_space_index::release(u32 group, u32 start, u32 length)
+    {
+        group_entry & entry = groups[group];
+        if (length == 0)
+        {
+            return;
+        }
+        
+        u32 old_largest = largest_run(group);
+        u32 new_start = start;
+        u32 new_end = start + length;
+        
+        // Merge with the extent that ends where the range begins.
+        map<u32, u32>::iterator next = entry.extents_by_start.lower_bound(start);
+        if (next != entry.extents_by_start.begin())
+        {
+            map<u32, u32>::iterator previous = next;
+            --previous;
+            if (previous->first + previous->second == start)
+            {
+                new_start = previous->first;
+                remove_extent(group, previous->first, previous->second);
+            }
+        }
+        
+        // Merge with the extent that begins where the range ends.
+        next = entry.extents_by_start.find(new_end);
+        if (next != entry.extents_by_start.end())
+        {
+            new_end += next->second;
+            remove_extent(group, next->first, next->second);
+        }
+        
+        add_extent(group, new_start, new_end - new_start);
+        
+        entry.blocks.clear_range(start, length);
+        entry.dirty = true;
+        
+        rerank_group(group, old_largest);
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    group_bitmap
+     * Type:    Function
+     * Purpose: Returns a block group's block bitmap, with all allocations made so far applied.
+     * Input:   u32 group, holds the block group number.
+     * Output:  const bitmap &, the group's block bitmap.
+    ----------------------------------------------------------------------------------------------*/
+    const bitmap & free_space_index::group_bitmap(u32 group) const
+    {
+        return groups[group].blocks;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    is_dirty
+     * Type:    Function
+     * Purpose: Checks whether a block group's bitmap has changed since it was loaded or last
+     *          written back.
+     * Input:   u32 group, holds the block group number.
+     * Output:  bool, true if the bitmap needs to be written back.
+    ----------------------------------------------------------------------------------------------*/
+    bool free_space_index::is_dirty(u32 group) const
+    {
+        return groups[group].dirty;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    mark_clean
+     * Type:    Function
+     * Purpose: Records that a block group's bitmap has been written back.
+     * Input:   u32 group, holds the block group number.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    void free_space_index::mark_clean(u32 group)
+    {
+        groups[group].dirty = false;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    add_extent
+     * Type:    Function
+     * Purpose: Adds a free extent to a group's extent lists.
+     * Input:   u32 group, holds the block group number.
+     * Input:   u32 start, holds the first block of the extent.
+     * Input:   u32 length, holds the length of the extent.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    void free_space_index::add_extent(u32 group, u32 start, u32 length)
+    {
+        group_entry & entry = groups[group];
+        entry.extents_by_start[start] = length;
+        entry.extents_by_length.insert(make_pair(length, start));
+        entry.free_blocks += length;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    remove_extent
+     * Type:    Function
+     * Purpose: Removes a free extent from a group's extent lists.
+     * Input:   u32 group, holds the block group number.
+     * Input:   u32 start, holds the first block of the extent.
+     * Input:   u32 length, holds the length of the extent.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    void free_space_index::remove_extent(u32 group, u32 start, u32 length)
+    {
+        group_entry & entry = groups[group];
+        entry.extents_by_start.erase(start);
+        entry.extents_by_length.erase(make_pair(length, start));
+        entry.free_blocks -= length;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    rerank_group
+     * Type:    Function
+     * Purpose: Moves a group to its new place in the ranking by largest free run.
+     * Input:   u32 group, holds the block group number.
+     * Input:   u32 old_largest, holds the group's largest free run before the change.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    void free_space_index::rerank_group(u32 group, u32 old_largest)
+    {
+        u32 new_largest = largest_run(group);
+        if (new_largest == old_largest && groups_by_largest_run.count(make_pair(old_largest, group)))
+        {
+            return;
+        }
+        
+        groups_by_largest_run.erase(make_pair(old_largest, group));
+        if (new_largest > 0)
+        {
+            groups_by_largest_run.insert(make_pair(new_largest, group));
+        }
+    }
+} // namespace vdi_explorer
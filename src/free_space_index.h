@@ -0,0 +1,66 @@
+#ifndef FREE_SPACE_INDEX_H
+#define FREE_SPACE_INDEX_H
+
+#include "datatypes.h" //typedefs for s8, u8, s16, u16, s32, u32, s64, and u64
+#include "bitmap.h"
+
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
+namespace vdi_explorer
+{
+    // An in-memory summary of the free blocks in each block group.  Every group's block bitmap
+    // is kept alongside a list of its free extents (runs of free blocks), indexed both by where
+    // they start and by how long they are, and the groups themselves are ranked by their largest
+    // free run.  Picking a group for an allocation and a run within it is then a couple of
+    // ordered-set lookups rather than a scan of the bitmaps on disk.
+    //
+    // Block positions are bit indexes within a group's bitmap.  Allocations and releases are made
+    // to the bitmaps held here, which are marked dirty so that they can be written back.
+    class free_space_index
+    {
+        public:
+            void reset(u32);
+            bool is_loaded(u32) const;
+            void load_group(u32, const bitmap &);
+            
+            u32 free_blocks(u32) const;
+            u32 largest_run(u32) const;
+            
+            // Choosing where to allocate.
+            bool find_group(u32, u32 &) const;
+            bool find_run(u32, u32, u32 &, u32 &) const;
+            bool find_run_near(u32, u32, u32, u32 &, u32 &) const;
+            
+            // Changing the free space.
+            void allocate(u32, u32, u32);
+            void release(u32, u32, u32);
+            
+            // Write-back support.
+            const bitmap & group_bitmap(u32) const;
+            bool is_dirty(u32) const;
+            void mark_clean(u32);
+        
+        private:
+            struct group_entry
+            {
+                bitmap blocks;
+                std::map<u32, u32> extents_by_start;                // start -> length
+                std::set<std::pair<u32, u32>> extents_by_length;    // (length, start)
+                u32 free_blocks = 0;
+                bool loaded = false;
+                bool dirty = false;
+            };
+            
+            std::vector<group_entry> groups;
+            std::set<std::pair<u32, u32>> groups_by_largest_run;    // (largest run, group)
+            
+            void add_extent(u32, u32, u32);
+            void remove_extent(u32, u32, u32);
+            void rerank_group(u32, u32);
+    };
+} // namespace vdi_explorer
+
+#endif // FREE_SPACE_INDEX_H
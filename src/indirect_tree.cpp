@@ -0,0 +1,227 @@
+/*--------------------------------------------------------------------------------------------------
+ * Author:      
+ * Date:        2026-10-19
+ * Assignment:  Final Project
+ * Source File: indirect_tree.cpp
+ * Language:    C/C++
+ * Course:      Operating Systems
+ * Purpose:     Contains the implementation of the indirect_tree_builder class.
+ -------------------------------------------------------------------------------------------------*/
+
+#include "indirect_tree.h"
+
+using namespace std;
+
+namespace vdi_explorer
+{
+    /*----------------------------------------------------------------------------------------------
+     * Name:    indirect_tree_builder
+     * Type:    Function
+     * Purpose: Constructor for the indirect_tree_builder class.
+     * Input:   u32 _pointers_per_block, holds the number of block pointers in an indirect block.
+     * Input:   const u32 * _pool, holds the blocks allocated for the file, in the order they
+     *          should be used.  It must stay valid for as long as the builder is used.
+     * Input:   u32 _pool_size, holds the number of blocks in the pool.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    indirect_tree_builder::indirect_tree_builder(u32 _pointers_per_block, const u32 * _pool, u32 _pool_size)
+    {
+        pointers_per_block = _pointers_per_block;
+        pool = _pool;
+        pool_size = _pool_size;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    blocks_needed
+     * Type:    Function
+     * Purpose: Counts the indirect blocks needed to map every block of a file with no holes.  A
+     *          file with holes never needs more than this.
+     * Input:   u32 num_logical_blocks, holds the number of blocks the file spans.
+     * Input:   u32 pointers, holds the number of block pointers in an indirect block.
+     * Output:  u32, the number of indirect blocks.
+    ----------------------------------------------------------------------------------------------*/
+    u32 indirect_tree_builder::blocks_needed(u32 num_logical_blocks, u32 pointers)
+    {
+        u64 pointers_squared = (u64)pointers * pointers;
+        u32 total = 0;
+        
+        if (num_logical_blocks <= EXT2_INODE_NBLOCKS_DIR)
+        {
+            return 0;
+        }
+        u64 blocks_left = num_logical_blocks - EXT2_INODE_NBLOCKS_DIR;
+        
+        // Singly indirect: one block.
+        total += 1;
+        if (blocks_left <= pointers)
+        {
+            return total;
+        }
+        blocks_left -= pointers;
+        
+        // Doubly indirect: the block itself plus one singly indirect block per pointers blocks.
+        u64 doubly_mapped = (blocks_left < pointers_squared ? blocks_left : pointers_squared);
+        total += 1 + (doubly_mapped + pointers - 1) / pointers;
+        if (blocks_left <= pointers_squared)
+        {
+            return total;
+        }
+        blocks_left -= pointers_squared;
+        
+        // Triply indirect: the block itself, a doubly indirect block per pointers^2 blocks, and a
+        // singly indirect block per pointers blocks.
+        total += 1 +
+                 (blocks_left + pointers_squared - 1) / pointers_squared +
+                 (blocks_left + pointers - 1) / pointers;
+        return total;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    map_block
+     * Type:    Function
+     * Purpose: Gives a logical block of the file a physical block from the pool, first taking
+     *          any indirect blocks on the way down to it that do not exist yet.
+     * Input:   u32 logical_block, holds the logical block to map.
+     * Output:  u32, the physical block now holding the logical block, or 0 if the pool ran out.
+    ----------------------------------------------------------------------------------------------*/
+    u32 indirect_tree_builder::map_block(u32 logical_block)
+    {
+        u64 pointers_squared = (u64)pointers_per_block * pointers_per_block;
+        u32 root = logical_block;
+        u32 depth = 0;
+        u32 slots[3] = {0};
+        
+        // Work out which root pointer leads to the block, and which slot to follow at each level
+        // of indirection below it.
+        if (logical_block >= EXT2_INODE_NBLOCKS_DIR)
+        {
+            u64 index = logical_block - EXT2_INODE_NBLOCKS_DIR;
+            if (index < pointers_per_block)
+            {
+                root = EXT2_INODE_BLOCK_S_IND;
+                depth = 1;
+                slots[0] = index;
+            }
+            else if ((index -= pointers_per_block) < pointers_squared)
+            {
+                root = EXT2_INODE_BLOCK_D_IND;
+                depth = 2;
+                slots[0] = index / pointers_per_block;
+                slots[1] = index % pointers_per_block;
+            }
+            else
+            {
+                index -= pointers_squared;
+                root = EXT2_INODE_BLOCK_T_IND;
+                depth = 3;
+                slots[0] = index / pointers_squared;
+                slots[1] = (index / pointers_per_block) % pointers_per_block;
+                slots[2] = index % pointers_per_block;
+            }
+        }
+        
+        // Walk down the tree, creating the indirect blocks that are missing.  (References into
+        // the map and its vectors stay valid as more nodes are added.)
+        u32 * pointer = &(roots[root]);
+        for (u32 i = 0; i < depth; i++)
+        {
+            if (*pointer == 0)
+            {
+                u32 indirect_block = take_block();
+                if (indirect_block == 0)
+                {
+                    return 0;
+                }
+                nodes[indirect_block].assign(pointers_per_block, 0);
+                *pointer = indirect_block;
+            }
+            pointer = &(nodes[*pointer][slots[i]]);
+        }
+        
+        // Map the block itself, unless it already is.
+        if (*pointer == 0)
+        {
+            *pointer = take_block();
+        }
+        return *pointer;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    blocks_used
+     * Type:    Function
+     * Purpose: Returns how many blocks have been taken from the pool, data and indirect alike.
+     *          Blocks past this point in the pool are unused.
+     * Input:   Nothing.
+     * Output:  u32, the number of blocks used.
+    ----------------------------------------------------------------------------------------------*/
+    u32 indirect_tree_builder::blocks_used() const
+    {
+        return pool_used;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    extend_pool
+     * Type:    Function
+     * Purpose: Replaces the pool with a bigger one that starts with the same blocks, for when the
+     *          blocks are allocated as they are needed.  If map_block ran out of blocks, it can be
+     *          called again for the same logical block afterwards.
+     * Input:   const u32 * _pool, holds the new pool.
+     * Input:   u32 _pool_size, holds the number of blocks in the new pool.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    void indirect_tree_builder::extend_pool(const u32 * _pool, u32 _pool_size)
+    {
+        pool = _pool;
+        pool_size = _pool_size;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    root_pointers
+     * Type:    Function
+     * Purpose: Copies out the pointers that belong in the inode's i_block array.
+     * Input:   u32 * i_block, receives EXT2_INODE_NBLOCKS_TOT block pointers.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    void indirect_tree_builder::root_pointers(u32 * i_block) const
+    {
+        for (u32 i = 0; i < EXT2_INODE_NBLOCKS_TOT; i++)
+        {
+            i_block[i] = roots[i];
+        }
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    indirect_blocks
+     * Type:    Function
+     * Purpose: Returns every indirect block built so far, with its contents, in block order.
+     * Input:   Nothing.
+     * Output:  const map<u32, vector<u32>> &, block number -> block pointers.
+    ----------------------------------------------------------------------------------------------*/
+    const map<u32, vector<u32>> & indirect_tree_builder::indirect_blocks() const
+    {
+        return nodes;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    take_block
+     * Type:    Function
+     * Purpose: Takes the next block from the pool.
+     * Input:   Nothing.
+     * Output:  u32, the block number, or 0 if the pool is empty.
+    ----------------------------------------------------------------------------------------------*/
+    u32 indirect_tree_builder::take_block()
+    {
+        if (pool_used >= pool_size)
+        {
+            return 0;
+        }
+        return pool[pool_used++];
+    }
+} // namespace vdi_explorer
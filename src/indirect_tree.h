@@ -0,0 +1,50 @@
+#ifndef INDIRECT_TREE_H
+#define INDIRECT_TREE_H
+
+#include "datatypes.h" //typedefs for s8, u8, s16, u16, s32, u32, s64, and u64
+#include "constants.h"
+
+#include <map>
+#include <vector>
+
+namespace vdi_explorer
+{
+    // Builds a file's complete block map (direct pointers plus the singly, doubly and triply
+    // indirect trees) in memory, as logical blocks are handed physical blocks from a pool of
+    // blocks allocated for the file.  Blocks are taken from the pool strictly in order, and any
+    // indirect block a logical block needs is taken before the block itself, so each indirect
+    // block lands immediately before the data it maps, as in the classic ext2 layout.  Once every
+    // block has been mapped, the indirect blocks are all available at once to be written in a
+    // single pass.
+    class indirect_tree_builder
+    {
+        public:
+            // Constructor
+            indirect_tree_builder(u32, const u32 *, u32);
+            
+            // The number of indirect blocks a file with this many logical blocks could need.
+            static u32 blocks_needed(u32, u32);
+            
+            u32 map_block(u32);
+            u32 blocks_used() const;
+            
+            // Point the builder at a bigger pool, which starts with the same blocks.
+            void extend_pool(const u32 *, u32);
+            
+            void root_pointers(u32 *) const;
+            const std::map<u32, std::vector<u32>> & indirect_blocks() const;
+        
+        private:
+            u32 pointers_per_block = 0;
+            const u32 * pool = nullptr;
+            u32 pool_size = 0;
+            u32 pool_used = 0;
+            
+            u32 roots[EXT2_INODE_NBLOCKS_TOT] = {0};
+            std::map<u32, std::vector<u32>> nodes; // indirect block number -> its pointers
+            
+            u32 take_block();
+    };
+} // namespace vdi_explorer
+
+#endif // INDIRECT_TREE_H
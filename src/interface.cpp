@@ -20,7 +20,11 @@
 #include <string>
 #include <stdexcept>
 #include <cstdio>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
 #include <time.h>
+#include <unistd.h>
 
 using namespace std;
 using namespace vdi_explorer;
@@ -48,104 +52,223 @@ namespace vdi_explorer
     void interface::interactive()
     {
         string command_string;
-        vector<string> tokens;
-        vector<string> tokens2;
 
         while (true)
         {
             cout << "\nCommand: ";
-            getline(cin, command_string);
-            tokens = utility::tokenize(command_string, DELIMITER_SPACE);
-            tokens2 = utility::tokenize(command_string, DELIMITER_FSLASH);
-            
-            // Debug info.
-            for (unsigned int i = 0; i < tokens.size(); i++)
-                cout << "debug (ext2::interface::interactive): " << tokens[i] << endl;
-            // End debug info.
+            if (!getline(cin, command_string))
+            {
+                // End of input, so leave the same way the exit command does.
+                command_exit();
+            }
+            execute(command_string);
+        }
+    }
+    
+    
+    void interface::execute(const string & command_string)
+    {
+        vector<string> tokens = utility::tokenize(command_string, DELIMITER_SPACE);
+        
+        if (tokens.size() == 0)
+            return;
             
-            if (tokens.size() == 0)
-                continue;
+        switch (hash_command(tokens[0]))
+        {
+            case code_append:
+                if (tokens.size() < 3)
+                {
+                    cout << "Not enough arguments.\n";
+                    command_help("append");
+                }
+                else
+                {
+                    command_append(tokens);
+                }
+                break;
                 
-            switch (hash_command(tokens[0]))
-            {
-                case code_cd:
-                    if (tokens.size() < 2)
-                    {
-                        cout << "Not enough arguments.\n";
-                        command_help("cd");
-                    }
-                    else
-                    {
-                        command_cd(tokens[1]);
-                    }
-                    break;
-                    
-                case code_cp:
-                    if (tokens.size() < 4)
-                    {
-                        cout << "Not enough arguments.\n";
-                        command_help("cp");
-                    }
-                    else
-                    {
-                        command_cp(tokens[1], tokens[2], tokens[3]);
-                    }
-                    break;
-                    
-                case code_exit:
-                    command_exit();
-                    break;
-                    
-                case code_help:
-                    if (tokens.size() < 2)
-                    {
-                        command_help("");
-                    }
-                    else
-                    {
-                        command_help(tokens[1]);
-                    }
-                    break;
-                    
-                case code_ls:
-                    if (tokens.size() < 2)
-                    {
-                        command_ls("");
-                    }
-                    else
-                    {
-                        command_ls(tokens[1]);
-                    }
-                    break;
-                    
-                case code_pwd:
-                    command_pwd();
-                    break;
+            case code_cat:
+                command_cat(tokens);
+                break;
                 
-                // Debug
-                case code_dump_pwd_inode:
-                    command_dump_pwd_inode();
-                    break;
+            case code_cd:
+                if (tokens.size() < 2)
+                {
+                    cout << "Not enough arguments.\n";
+                    command_help("cd");
+                }
+                else
+                {
+                    command_cd(tokens[1]);
+                }
+                break;
                 
-                case code_dump_block:
-                    command_dump_block(stoi(tokens[1]));
-                    break;
+            case code_cp:
+                if (tokens.size() < 4)
+                {
+                    cout << "Not enough arguments.\n";
+                    command_help("cp");
+                }
+                else if (tokens[1] == "-r")
+                {
+                    command_cp_recursive(tokens);
+                }
+                else if (tokens[1] == "in" && (tokens[2] == "--manifest" || tokens.back() == "."))
+                {
+                    command_cp_in_batch(tokens);
+                }
+                else if (tokens[1] == "out" && is_cp_out_batch(tokens))
+                {
+                    command_cp_out_batch(tokens);
+                }
+                else
+                {
+                    command_cp(tokens[1], tokens[2], tokens[3]);
+                }
+                break;
                 
-                case code_dump_inode:
-                    command_dump_inode(stoi(tokens[1]));
-                    break;
-                // End debug.
+            case code_exit:
+                command_exit();
+                break;
                 
-                case code_unknown:
-                    cout << "Unknown command.\n";
-                    break;
-                    
-                default:
-                    // A Bad Thing happened.  This should never get triggered.
-                    cout << "A Bad Thing happened.  You should not be seeing this.";
-                    break;
+            case code_head:
+                command_head(tokens);
+                break;
+                
+            case code_help:
+                if (tokens.size() < 2)
+                {
+                    command_help("");
+                }
+                else
+                {
+                    command_help(tokens[1]);
+                }
+                break;
+                
+            case code_ls:
+                command_ls(tokens);
+                break;
+                
+            case code_pwd:
+                command_pwd();
+                break;
+                
+            case code_rm:
+                if (tokens.size() < 2 || (tokens[1] == "-r" && tokens.size() < 3))
+                {
+                    cout << "Not enough arguments.\n";
+                    command_help("rm");
+                }
+                else
+                {
+                    command_rm(tokens);
+                }
+                break;
+                
+            case code_tail:
+                command_tail(tokens);
+                break;
+                
+            case code_truncate:
+                command_truncate(tokens);
+                break;
+                
+            case code_write:
+                command_write(tokens);
+                break;
+            
+            // Debug
+            case code_dump_pwd_inode:
+                command_dump_pwd_inode();
+                break;
+            
+            case code_dump_block:
+                command_dump_block(stoi(tokens[1]));
+                break;
+            
+            case code_dump_inode:
+                command_dump_inode(stoi(tokens[1]));
+                break;
+            // End debug.
+            
+            case code_unknown:
+                cout << "Unknown command.\n";
+                break;
+                
+            default:
+                // A Bad Thing happened.  This should never get triggered.
+                cout << "A Bad Thing happened.  You should not be seeing this.";
+                break;
+        }
+    }
+    
+    
+    void interface::command_append(const vector<string> & tokens)
+    {
+        int os_file = ::open(tokens[1].c_str(), O_RDONLY);
+        if (os_file == -1)
+        {
+            cout << "Error: File does not exist.  (interface::command_append)\n";
+            return;
+        }
+        
+        // Add the host file onto the end, then commit the metadata changes.
+        file_system->file_append(os_file, tokens[2]);
+        file_system->commit();
+        ::close(os_file);
+    }
+    
+    
+    void interface::command_cat(const vector<string> & tokens)
+    {
+        u64 offset = 0;
+        u64 length = 0;
+        bool length_given = false;
+        
+        // Check for a byte range in the form --range <offset>[:<length>].
+        if (tokens.size() == 4 && tokens[1] == "--range")
+        {
+            size_t colon = tokens[2].find(':');
+            try
+            {
+                offset = stoull(tokens[2].substr(0, colon));
+                if (colon != string::npos)
+                {
+                    length = stoull(tokens[2].substr(colon + 1));
+                    length_given = true;
+                }
+            }
+            catch (const exception &)
+            {
+                cout << "Invalid range.\n";
+                command_help("cat");
+                return;
             }
         }
+        else if (tokens.size() != 2)
+        {
+            cout << "Wrong number of arguments.\n";
+            command_help("cat");
+            return;
+        }
+        
+        // Open the file.
+        ext2::file_handle file = file_system->open(tokens.back());
+        if (!file.is_open())
+        {
+            cout << "Error: File does not exist.  (interface::command_cat)\n";
+            return;
+        }
+        
+        // Without a length, print everything from the offset to the end of the file.
+        if (!length_given)
+        {
+            length = (offset < file.size() ? file.size() - offset : 0);
+        }
+        
+        print_file_range(file, offset, length);
+        file.close();
     }
     
     
@@ -162,207 +285,462 @@ namespace vdi_explorer
     {
         cout << "*** Implementation in progress.  Bust out the bugspray. ***\n";
         
-        fstream os_file;
-        
         if (direction == "in")
         {
-            // cout << "Implementing... Please stand by.\n";
-            // return;
-            
             // Attempt to open the file for input to check if it exists.
-            os_file.open(copy_from, ios_base::in | ios::binary);
+            int os_file = ::open(copy_from.c_str(), O_RDONLY);
             
             // Actually check if the file exists.
-            if (!os_file.good())
+            if (os_file == -1)
             {
                 // File does not exist, so display an error.
                 cout << "Error: File does not exist.  (interface::command_cp)\n";
+                return;
             }
-            else
-            {
-                // File exists, so write it to the virtual disk.
-                file_system->file_write(os_file, copy_to);
-            }
+            
+            // File exists, so write it to the virtual disk, then commit the metadata changes.
+            file_system->file_write(os_file, copy_to);
+            file_system->commit();
             
             // Close the file.
-            os_file.close();
+            ::close(os_file);
             
             // Return.  Duh.
             return;
         }
         else if (direction == "out")
         {
-            // Attempt to open the file for input to see if it already exists.
-            os_file.open(copy_to, ios_base::in);
-            bool file_exists = os_file.good();
-            os_file.close();
-            
-            // Actually check if the file exists.
-            if (file_exists)
+            // Create the file for writing, refusing to touch one that already exists.
+            int os_file = ::open(copy_to.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+            if (os_file == -1)
             {
-                cout << "Error, file already exists.";
+                if (errno == EEXIST)
+                    cout << "Error, file already exists.";
+                else
+                    cout << "Error opening file for writing.\n";
                 return;
             }
-            else
+            
+            // Actually copy file out from the other file system.
+            bool successful = file_system->file_read(os_file, copy_from);
+            ::close(os_file);
+            
+            if (!successful)
             {
-                // Open file for writing.
-                os_file.open(copy_to, ios::out | ios::binary);
-                if (!os_file.good())
-                {
-                    cout << "Error opening file for writing.\n";
-                    return;
-                }
-                
-                // Actually copy file out from the other file system.
-                bool successful = file_system->file_read(os_file, copy_from);
-                os_file.close();
-                
-                if (!successful)
-                {
-                    remove(copy_to.c_str());
-                }
+                remove(copy_to.c_str());
             }
         }
     }
     
     
     // @TODO format output neatly into appropriately sized columns -> function in utility?
-    // @TODO sort vector by name
     // @TODO colorize: 
         // Yellow with black background: Device
         // Pink: Graphic image file
-    void interface::command_ls(const string & switches)
+    void interface::command_ls(const vector<string> & tokens)
     {
-        vector<fs_entry_posix> file_listing = file_system->get_directory_contents();
+        string switches;
+        string pattern;
+        bool sorted = false;
+        dir_snapshot::sort_key sort_by = dir_snapshot::sort_name;
+        for (u32 i = 1; i < tokens.size(); i++)
+        {
+            if (tokens[i] == "--sort=name")
+            {
+                sorted = true;
+                sort_by = dir_snapshot::sort_name;
+            }
+            else if (tokens[i] == "--sort=size")
+            {
+                sorted = true;
+                sort_by = dir_snapshot::sort_size;
+            }
+            else if (tokens[i] == "--sort=time")
+            {
+                sorted = true;
+                sort_by = dir_snapshot::sort_mtime;
+            }
+            else if (tokens[i][0] == '-')
+            {
+                switches = tokens[i];
+            }
+            else
+            {
+                pattern = tokens[i];
+            }
+        }
+        
+        file_system->get_directory_contents(file_listing);
+        
+        // Work out which entries to show, and in what order: directory order unless asked
+        // otherwise, and only those matching the pattern if there is one.
+        vector<u32> shown;
+        if (!pattern.empty())
+        {
+            file_listing.match(pattern, shown);
+            if (sorted)
+            {
+                vector<bool> matched(file_listing.size(), false);
+                for (u32 i = 0; i < shown.size(); i++)
+                {
+                    matched[shown[i]] = true;
+                }
+                shown.clear();
+                const vector<u32> & order = file_listing.order(sort_by);
+                for (u32 i = 0; i < order.size(); i++)
+                {
+                    if (matched[order[i]])
+                    {
+                        shown.push_back(order[i]);
+                    }
+                }
+            }
+        }
+        else if (sorted)
+        {
+            shown = file_listing.order(sort_by);
+        }
+        else
+        {
+            shown.resize(file_listing.size());
+            for (u32 i = 0; i < shown.size(); i++)
+            {
+                shown[i] = i;
+            }
+        }
+        
         vector<string> filename_tokens;
-        for (u32 i = 0; i < file_listing.size(); i++)
+        string name;
+        for (u32 j = 0; j < shown.size(); j++)
         {
-            filename_tokens = utility::tokenize(file_listing[i].name, DELIMITER_DOT);
+            u32 i = shown[j];
+            name.assign(file_listing.name(i), file_listing.name_length(i));
+            filename_tokens = utility::tokenize(name, DELIMITER_DOT);
             string file_extension = (filename_tokens.size() > 1 ? filename_tokens.back() : ""); 
             
             if (switches == "-l" || switches == "-al"){
-                if (switches == "-l" && (file_listing[i].name == "." || file_listing[i].name ==".."));
+                if (switches == "-l" && (name == "." || name ==".."));
                 else 
                     { // list permissions for each file
-                if (file_listing[i].type == EXT2_DIR_TYPE_DIR)
+                if (file_listing.type(i) == EXT2_DIR_TYPE_DIR)
                     cout << "d";
                 else
                     cout << "-";
-                if (file_listing[i].permissions & EXT2_INODE_PERM_USER_READ)
+                if (file_listing.permissions(i) & EXT2_INODE_PERM_USER_READ)
                     cout << "r";
                 else 
                     cout << "-"; 
-                if (file_listing[i].permissions & EXT2_INODE_PERM_USER_WRITE)
+                if (file_listing.permissions(i) & EXT2_INODE_PERM_USER_WRITE)
                     cout << "w";
                 else 
                     cout << "-";
-                if (file_listing[i].permissions & EXT2_INODE_PERM_USER_EXECUTE)
+                if (file_listing.permissions(i) & EXT2_INODE_PERM_USER_EXECUTE)
                     cout << "x";
                 else 
                     cout << "-";
-                if (file_listing[i].permissions & EXT2_INODE_PERM_GROUP_READ)
+                if (file_listing.permissions(i) & EXT2_INODE_PERM_GROUP_READ)
                     cout << "r";
                 else 
                     cout << "-"; 
-                if (file_listing[i].permissions & EXT2_INODE_PERM_GROUP_WRITE)
+                if (file_listing.permissions(i) & EXT2_INODE_PERM_GROUP_WRITE)
                     cout << "w";
                 else 
                     cout << "-";
-                if (file_listing[i].permissions & EXT2_INODE_PERM_GROUP_EXECUTE)
+                if (file_listing.permissions(i) & EXT2_INODE_PERM_GROUP_EXECUTE)
                     cout << "x";
                 else 
                     cout << "-";
-                if (file_listing[i].permissions & EXT2_INODE_PERM_OTHER_READ)
+                if (file_listing.permissions(i) & EXT2_INODE_PERM_OTHER_READ)
                     cout << "r";
                 else 
                     cout << "-"; 
-                if (file_listing[i].permissions & EXT2_INODE_PERM_OTHER_WRITE)
+                if (file_listing.permissions(i) & EXT2_INODE_PERM_OTHER_WRITE)
                     cout << "w";
                 else 
                     cout << "-";
-                if (file_listing[i].permissions & EXT2_INODE_PERM_OTHER_EXECUTE)
+                if (file_listing.permissions(i) & EXT2_INODE_PERM_OTHER_EXECUTE)
                     cout << "x ";
                 else 
                     cout << "- ";
 
                 // set file type, UID, GID, and size
-                cout << setw(2) << ((file_listing[i].type== EXT2_DIR_TYPE_DIR)?2:1)<< " ";
-                cout << setw(5) << file_listing[i].user_id<< " ";
-                cout << setw(5) << file_listing[i].group_id << " ";
-                cout << setw(10) << file_listing[i].size << " ";
+                cout << setw(2) << ((file_listing.type(i)== EXT2_DIR_TYPE_DIR)?2:1)<< " ";
+                cout << setw(5) << file_listing.user_id(i)<< " ";
+                cout << setw(5) << file_listing.group_id(i) << " ";
+                cout << setw(10) << file_listing.file_size(i) << " ";
                 
                 // translate unix epoch timestamps to readable time
                 time_t     curr;
                 struct tm  ts;
                 char       buf[80];
-                curr = file_listing[i].timestamp_modified;
+                curr = file_listing.timestamp_modified(i);
                 ts = *localtime(&curr);
                 strftime(buf, sizeof(buf), "%b %d %M:%S", &ts);
                 printf("%s ", buf);
 
                 }
             }
-            if (file_listing[i].type == EXT2_DIR_TYPE_DIR){
+            if (file_listing.type(i) == EXT2_DIR_TYPE_DIR){
                 if (switches != "-al" ){
-                    if (file_listing[i].name == "." || file_listing[i].name ==".."); // don't print out . and .. directories with -l switch
+                    if (name == "." || name ==".."); // don't print out . and .. directories with -l switch
                     else 
-                        cout << "\033[1;34m" << file_listing[i].name << "\033[0m"<< "/"; //blue (bold) - directory or recognized data file                }
+                        cout << "\033[1;34m" << name << "\033[0m"<< "/"; //blue (bold) - directory or recognized data file                }
                 }
-                else if ((switches == "-al" ) && (file_listing[i].name == "." || file_listing[i].name ==".."))
-                    cout << "\033[1;34m" << file_listing[i].name << "\033[0m";
+                else if ((switches == "-al" ) && (name == "." || name ==".."))
+                    cout << "\033[1;34m" << name << "\033[0m";
                 else 
-                    cout << "\033[1;34m" << file_listing[i].name << "\033[0m" << "/"; //blue (bold) - directory or recognized data file
+                    cout << "\033[1;34m" << name << "\033[0m" << "/"; //blue (bold) - directory or recognized data file
             }
-            else if ((file_listing[i].type == EXT2_DIR_TYPE_FILE) &&
-                    (file_listing[i].permissions & EXT2_INODE_PERM_USER_EXECUTE ||
-                     file_listing[i].permissions & EXT2_INODE_PERM_GROUP_EXECUTE ||
-                     file_listing[i].permissions & EXT2_INODE_PERM_OTHER_EXECUTE)){
-                cout << "\033[1;32m" << file_listing[i].name << "\033[0m" << "*"; //green - executable files
+            else if ((file_listing.type(i) == EXT2_DIR_TYPE_FILE) &&
+                    (file_listing.permissions(i) & EXT2_INODE_PERM_USER_EXECUTE ||
+                     file_listing.permissions(i) & EXT2_INODE_PERM_GROUP_EXECUTE ||
+                     file_listing.permissions(i) & EXT2_INODE_PERM_OTHER_EXECUTE)){
+                cout << "\033[1;32m" << name << "\033[0m" << "*"; //green - executable files
                      }  
-            else if (file_listing[i].type == EXT2_INODE_TYPE_SYMLINK)
-                cout << "\033[6;36m" << file_listing[i].name << "\033[0m"; //cyan - linked file
-            else if (file_listing[i].type == EXT2_INODE_TYPE_SYMLINK)
-                cout << "\033[3;33m" << file_listing[i].name << "\033[0m"; //yellow (with black background) - device
-            else if ((file_listing[i].type == EXT2_DIR_TYPE_FILE) &&  
+            else if (file_listing.type(i) == EXT2_INODE_TYPE_SYMLINK)
+                cout << "\033[6;36m" << name << "\033[0m"; //cyan - linked file
+            else if (file_listing.type(i) == EXT2_INODE_TYPE_SYMLINK)
+                cout << "\033[3;33m" << name << "\033[0m"; //yellow (with black background) - device
+            else if ((file_listing.type(i) == EXT2_DIR_TYPE_FILE) &&  
                     (file_extension == "png" ||
                      file_extension == "jpg" ||
                      file_extension == "raw" ||
                      file_extension == "gif" ||
                      file_extension == "bmp" ||
                      file_extension == "tif")){ //38 - black
-                cout << "\033[5;31m" << file_listing[i].name << "\033[0m"; }//pink - graphic image file
-            else if ((file_listing[i].type == EXT2_DIR_TYPE_FILE) &&
+                cout << "\033[5;31m" << name << "\033[0m"; }//pink - graphic image file
+            else if ((file_listing.type(i) == EXT2_DIR_TYPE_FILE) &&
                     (file_extension == "zip" ||
                      file_extension == "tar" ||
                      file_extension == "rar" ||
                      file_extension == "7z" ||
                      file_extension == "xz")){
-                cout << "\033[0;31m" << file_listing[i].name << "\033[0m"; }//red - archive file
+                cout << "\033[0;31m" << name << "\033[0m"; }//red - archive file
             else 
-                cout << file_listing[i].name;
+                cout << name;
             
-            if ((switches == "-l" && (file_listing[i].name != "." && file_listing[i].name !="..")) || switches == "-al")
+            if ((switches == "-l" && (name != "." && name !="..")) || switches == "-al")
                 cout << "\n"; 
-            else if (switches != "-al" && (file_listing[i].name == "." || file_listing[i].name ==".."));
+            else if (switches != "-al" && (name == "." || name ==".."));
             else
                 cout << "\t";
         }
         return;
     }
     
+    void interface::command_cp_in_batch(const vector<string> & tokens)
+    {
+        vector<string> host_paths;
+        vector<string> names;
+        
+        if (tokens[2] == "--manifest")
+        {
+            // Each line of the manifest holds a host path, optionally followed by a name.
+            ifstream manifest(tokens[3]);
+            if (!manifest)
+            {
+                cout << "Error: Manifest file does not exist.  (interface::command_cp_in_batch)\n";
+                return;
+            }
+            
+            string line;
+            while (getline(manifest, line))
+            {
+                vector<string> fields = utility::tokenize(line, DELIMITER_SPACE);
+                if (fields.empty())
+                {
+                    continue;
+                }
+                host_paths.push_back(fields[0]);
+                names.push_back(fields.size() > 1 ? fields[1] : "");
+            }
+        }
+        else
+        {
+            // Every token between "in" and the final "." is a host path.
+            host_paths.assign(tokens.begin() + 2, tokens.end() - 1);
+            names.assign(host_paths.size(), "");
+        }
+        
+        // Open every host file, naming each file that was not given a name after its host file.
+        vector<ext2::ingest_item> batch;
+        for (size_t i = 0; i < host_paths.size(); i++)
+        {
+            ext2::ingest_item item;
+            item.input_fd = ::open(host_paths[i].c_str(), O_RDONLY);
+            if (item.input_fd == -1)
+            {
+                cout << "Error: File does not exist: " << host_paths[i] << "  (interface::command_cp_in_batch)\n";
+                continue;
+            }
+            
+            item.name = names[i];
+            if (item.name.empty())
+            {
+                vector<string> path_parts = utility::tokenize(host_paths[i], DELIMITER_FSLASH);
+                item.name = (path_parts.empty() ? host_paths[i] : path_parts.back());
+            }
+            batch.push_back(item);
+        }
+        
+        // Write the whole batch to the virtual disk, then commit the metadata changes once.
+        file_system->ingest(batch);
+        file_system->commit();
+        
+        // Close the files.
+        for (size_t i = 0; i < batch.size(); i++)
+        {
+            ::close(batch[i].input_fd);
+        }
+    }
+    
+    
+    void interface::command_cp_out_batch(const vector<string> & tokens)
+    {
+        // Every token between "out" and the last is a file or pattern; the last is the host
+        // directory to copy into.
+        struct stat destination;
+        if (stat(tokens.back().c_str(), &destination) != 0 || !S_ISDIR(destination.st_mode))
+        {
+            cout << "Error: Copying several files needs a host directory to copy into.  (interface::command_cp_out_batch)\n";
+            return;
+        }
+        
+        vector<string> patterns(tokens.begin() + 2, tokens.end() - 1);
+        file_system->extract_files(patterns, tokens.back());
+    }
+    
+    
+    void interface::command_cp_recursive(const vector<string> & tokens)
+    {
+        if (tokens[2] == "out")
+        {
+            // Copy the tree out to the host directory given, or one named after it.
+            if (tokens.size() > 4)
+            {
+                file_system->export_tree(tokens[3], tokens[4]);
+            }
+            else
+            {
+                vector<string> path_parts = utility::tokenize(tokens[3], DELIMITER_FSLASH);
+                file_system->export_tree(tokens[3], (path_parts.empty() ? tokens[3] : path_parts.back()));
+            }
+            return;
+        }
+        if (tokens[2] != "in")
+        {
+            cout << "Error: Use cp -r in or cp -r out.  (interface::command_cp_recursive)\n";
+            return;
+        }
+        
+        // Name the copy after the host directory unless told otherwise.
+        string name;
+        if (tokens.size() > 4)
+        {
+            name = tokens[4];
+        }
+        else
+        {
+            vector<string> path_parts = utility::tokenize(tokens[3], DELIMITER_FSLASH);
+            name = (path_parts.empty() ? tokens[3] : path_parts.back());
+        }
+        
+        // Copy the tree, then commit the metadata changes once.
+        file_system->ingest_tree(tokens[3], name);
+        file_system->commit();
+    }
+    
+    
     void interface::command_exit()
     {
-        // exit the program
+        // Commit any outstanding metadata changes, then exit the program.
+        file_system->commit();
         exit(0);
     }
     
     
+    void interface::command_head(const vector<string> & tokens)
+    {
+        bool count_lines = true;
+        u64 count = 10;
+        
+        if (!parse_count_option(tokens, count_lines, count))
+        {
+            command_help("head");
+            return;
+        }
+        
+        // Open the file.
+        ext2::file_handle file = file_system->open(tokens.back());
+        if (!file.is_open())
+        {
+            cout << "Error: File does not exist.  (interface::command_head)\n";
+            return;
+        }
+        
+        // Counting bytes is just a range starting at 0.
+        if (!count_lines)
+        {
+            print_file_range(file, 0, count);
+            file.close();
+            return;
+        }
+        
+        // Otherwise read from the start of the file, stopping after the requested number of
+        // newlines have been printed.
+        vector<char> buffer(65536);
+        u64 offset = 0;
+        u64 lines_seen = 0;
+        while (lines_seen < count)
+        {
+            size_t bytes_read = file.pread(buffer.data(), buffer.size(), offset);
+            if (bytes_read == 0)
+            {
+                break;
+            }
+            
+            size_t bytes_to_print = 0;
+            while (bytes_to_print < bytes_read && lines_seen < count)
+            {
+                if (buffer[bytes_to_print++] == '\n')
+                {
+                    lines_seen++;
+                }
+            }
+            
+            cout.write(buffer.data(), bytes_to_print);
+            offset += bytes_read;
+        }
+        cout.flush();
+        
+        file.close();
+    }
+    
+    
     void interface::command_help(const string & command)
     {
         command_code hashed_command = hash_command(command);
         switch (hashed_command)
         {
             case code_none:
+            case code_append:
+                // explain append command
+                cout << "append <host_file> <file>\n";
+                cout << "Adds the contents of a host file onto the end of a file.\n";
+                if (hashed_command != code_none)
+                    break;
+                else
+                    cout << endl;
+                
+            case code_cat:
+                // explain cat command
+                cout << "cat [--range <offset>[:<length>]] <file>\n";
+                cout << "Prints the contents of a file, or just the given byte range of it.\n";
+                if (hashed_command != code_none)
+                    break;
+                else
+                    cout << endl;
+                
             case code_cd:
                 // explain cd command
                 cout << "cd <directory_to_change_to>\n";
@@ -376,8 +754,18 @@ namespace vdi_explorer
             case code_cp:
                 // explain cp command
                 cout << "cp <in|out> <file_to_copy_from> <file_to_copy_to>\n";
+                cout << "cp in <file_to_copy_from> [file_to_copy_from ...] .\n";
+                cout << "cp in --manifest <manifest_file>\n";
+                cout << "cp out <file_or_pattern> [file_or_pattern ...] <host_directory>\n";
+                cout << "cp -r <in|out> <directory_to_copy_from> [directory_to_copy_to]\n";
                 cout << "Copy a file between the host OS and the virtual hard drive and vice " <<
                         "versa.\n";
+                cout << "Many host files can be copied into the present working directory at " <<
+                        "once, keeping their names, or as listed in a manifest file with one " <<
+                        "\"<host_file> [name]\" per line.\n";
+                cout << "A host file may also be a pipe or other stream, which is read until it " <<
+                        "ends.  With -r, a whole host directory tree is copied into the present " <<
+                        "working directory, or out of the virtual hard drive.\n";
                 if (hashed_command != code_none)
                     break;
                 else
@@ -392,6 +780,15 @@ namespace vdi_explorer
                 else
                     cout << endl;
                 
+            case code_head:
+                // explain head command
+                cout << "head [-c <bytes> | -n <lines>] <file>\n";
+                cout << "Prints the first bytes or lines (10 lines by default) of a file.\n";
+                if (hashed_command != code_none)
+                    break;
+                else
+                    cout << endl;
+                
             case code_help:
                 // explain help command
                 cout << "help [command]\n";
@@ -403,8 +800,10 @@ namespace vdi_explorer
                 
             case code_ls:
                 // explain ls command
-                cout << "ls [-al]\n";
-                cout << "List the contents of the present working directory.\n";
+                cout << "ls [-al] [--sort=name|size|time] [pattern]\n";
+                cout << "List the contents of the present working directory, or the entries matching a\n";
+                cout << "wildcard pattern.  Entries are listed in directory order unless sorted by name,\n";
+                cout << "size (largest first) or modification time (newest first).\n";
                 if (hashed_command != code_none)
                     break;
                 else
@@ -414,6 +813,47 @@ namespace vdi_explorer
                 // explain pwd command
                 cout << "pwd\n";
                 cout << "Prints out the present working directory.\n";
+                if (hashed_command != code_none)
+                    break;
+                else
+                    cout << endl;
+                
+            case code_rm:
+                // explain rm command
+                cout << "rm [-r] <file_or_pattern> [file_or_pattern ...]\n";
+                cout << "Removes files from the virtual hard drive.  With -r, directories are " <<
+                        "removed too, along with everything in them.\n";
+                if (hashed_command != code_none)
+                    break;
+                else
+                    cout << endl;
+                
+            case code_tail:
+                // explain tail command
+                cout << "tail [-c <bytes> | -n <lines>] <file>\n";
+                cout << "Prints the last bytes or lines (10 lines by default) of a file, reading " <<
+                        "only the end of the file.\n";
+                if (hashed_command != code_none)
+                    break;
+                else
+                    cout << endl;
+                
+            case code_truncate:
+                // explain truncate command
+                cout << "truncate -s <size> <file>\n";
+                cout << "Shrinks or extends a file to the given size.  Blocks past the new end " <<
+                        "are freed; an extension reads back as zeroes.\n";
+                if (hashed_command != code_none)
+                    break;
+                else
+                    cout << endl;
+                
+            case code_write:
+                // explain write command
+                cout << "write [--at <offset>] <host_file> <file>\n";
+                cout << "Writes the contents of a host file into an existing file, starting at " <<
+                        "the given offset (0 by default), in place.  Only the blocks written to " <<
+                        "are touched, and the file grows if the data runs past its end.\n";
                 break;
 
             case code_unknown:
@@ -437,6 +877,214 @@ namespace vdi_explorer
     }
     
     
+    void interface::command_rm(const vector<string> & tokens)
+    {
+        // Remove everything named, then commit the metadata changes once.
+        bool recursive = (tokens[1] == "-r");
+        vector<string> patterns(tokens.begin() + (recursive ? 2 : 1), tokens.end());
+        file_system->remove(patterns, recursive);
+        file_system->commit();
+    }
+    
+    
+    void interface::command_tail(const vector<string> & tokens)
+    {
+        bool count_lines = true;
+        u64 count = 10;
+        
+        if (!parse_count_option(tokens, count_lines, count))
+        {
+            command_help("tail");
+            return;
+        }
+        
+        // Open the file.
+        ext2::file_handle file = file_system->open(tokens.back());
+        if (!file.is_open())
+        {
+            cout << "Error: File does not exist.  (interface::command_tail)\n";
+            return;
+        }
+        
+        u64 file_size = file.size();
+        u64 start = 0;
+        
+        if (!count_lines)
+        {
+            // The last count bytes, or the whole file if it is smaller.
+            start = (count < file_size ? file_size - count : 0);
+        }
+        else if (count == 0)
+        {
+            start = file_size;
+        }
+        else
+        {
+            // Scan backwards from the end of the file, a chunk at a time, until enough newlines
+            // have been found.  A newline at the very end of the file does not start a new line.
+            vector<char> buffer(65536);
+            u64 end = file_size;
+            char last_char = 0;
+            if (end > 0 && file.pread(&last_char, 1, end - 1) == 1 && last_char == '\n')
+            {
+                end--;
+            }
+            
+            u64 lines_seen = 0;
+            bool found = false;
+            while (end > 0 && !found)
+            {
+                u64 chunk_start = (end > buffer.size() ? end - buffer.size() : 0);
+                file.pread(buffer.data(), end - chunk_start, chunk_start);
+                
+                for (u64 i = end - chunk_start; i > 0; i--)
+                {
+                    if (buffer[i - 1] == '\n' && ++lines_seen == count)
+                    {
+                        start = chunk_start + i;
+                        found = true;
+                        break;
+                    }
+                }
+                
+                end = chunk_start;
+            }
+        }
+        
+        print_file_range(file, start, file_size - start);
+        file.close();
+    }
+    
+    
+    void interface::command_truncate(const vector<string> & tokens)
+    {
+        u64 size = 0;
+        
+        if (tokens.size() != 4 || tokens[1] != "-s")
+        {
+            cout << "Wrong number of arguments.\n";
+            command_help("truncate");
+            return;
+        }
+        try
+        {
+            size = stoull(tokens[2]);
+        }
+        catch (const exception &)
+        {
+            cout << "Invalid size.\n";
+            command_help("truncate");
+            return;
+        }
+        
+        // Change the size, then commit the metadata changes.
+        file_system->file_truncate(tokens[3], size);
+        file_system->commit();
+    }
+    
+    
+    void interface::command_write(const vector<string> & tokens)
+    {
+        u64 offset = 0;
+        
+        // Check for a starting offset in the form --at <offset>.
+        if (tokens.size() == 5 && tokens[1] == "--at")
+        {
+            try
+            {
+                offset = stoull(tokens[2]);
+            }
+            catch (const exception &)
+            {
+                cout << "Invalid offset.\n";
+                command_help("write");
+                return;
+            }
+        }
+        else if (tokens.size() != 3)
+        {
+            cout << "Wrong number of arguments.\n";
+            command_help("write");
+            return;
+        }
+        
+        int os_file = ::open(tokens[tokens.size() - 2].c_str(), O_RDONLY);
+        if (os_file == -1)
+        {
+            cout << "Error: File does not exist.  (interface::command_write)\n";
+            return;
+        }
+        
+        // Write the host file into place, then commit the metadata changes.
+        file_system->file_write_at(os_file, tokens.back(), offset);
+        file_system->commit();
+        ::close(os_file);
+    }
+    
+    
+    void interface::print_file_range(ext2::file_handle & file, u64 offset, u64 length)
+    {
+        vector<char> buffer(65536);
+        
+        // Copy the range to standard output one buffer at a time.
+        while (length > 0)
+        {
+            size_t bytes_read = file.pread(buffer.data(),
+                                           (length < buffer.size() ? length : buffer.size()),
+                                           offset);
+            if (bytes_read == 0)
+            {
+                break;
+            }
+            
+            cout.write(buffer.data(), bytes_read);
+            offset += bytes_read;
+            length -= bytes_read;
+        }
+        cout.flush();
+    }
+    
+    
+    bool interface::parse_count_option(const vector<string> & tokens, bool & count_lines, u64 & count)
+    {
+        // Just a file name keeps the defaults.
+        if (tokens.size() == 2)
+        {
+            return true;
+        }
+        
+        // Otherwise expect -c <bytes> or -n <lines> before the file name.
+        if (tokens.size() != 4 || (tokens[1] != "-c" && tokens[1] != "-n"))
+        {
+            cout << "Wrong number of arguments.\n";
+            return false;
+        }
+        
+        try
+        {
+            count = stoull(tokens[2]);
+        }
+        catch (const exception &)
+        {
+            cout << "Invalid count.\n";
+            return false;
+        }
+        
+        count_lines = (tokens[1] == "-n");
+        return true;
+    }
+    
+    
+    bool interface::is_cp_out_batch(const vector<string> & tokens)
+    {
+        // Several files, wildcards, or a host directory to copy into all call for a batch.
+        struct stat destination;
+        return tokens.size() > 4 ||
+               tokens[2].find_first_of("*?[") != string::npos ||
+               (stat(tokens.back().c_str(), &destination) == 0 && S_ISDIR(destination.st_mode));
+    }
+    
+    
     // Debug.
     void interface::command_dump_pwd_inode()
     {
@@ -455,7 +1103,15 @@ namespace vdi_explorer
     
     interface::command_code interface::hash_command(const string & command)
     {
-        if (command == "cd")
+        if (command == "append")
+        {
+            return code_append;
+        }
+        else if (command == "cat")
+        {
+            return code_cat;
+        }
+        else if (command == "cd")
         {
             return code_cd;
         }
@@ -467,6 +1123,10 @@ namespace vdi_explorer
         {
             return code_exit;
         }
+        else if (command == "head")
+        {
+            return code_head;
+        }
         else if (command == "help")
         {
             return code_help;
@@ -483,6 +1143,22 @@ namespace vdi_explorer
         {
             return code_pwd;
         }
+        else if (command == "rm")
+        {
+            return code_rm;
+        }
+        else if (command == "tail")
+        {
+            return code_tail;
+        }
+        else if (command == "truncate")
+        {
+            return code_truncate;
+        }
+        else if (command == "write")
+        {
+            return code_write;
+        }
         else if (command == "")
         {
             return code_none;
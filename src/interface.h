@@ -14,18 +14,26 @@ namespace vdi_explorer
             ~interface();
             
             void interactive();
+            void execute(const string &);
             
         private:
             enum command_code
             {
                 code_none = -2,
                 code_unknown,
+                code_append,
+                code_cat,
                 code_cd,
                 code_cp,
                 code_exit,
+                code_head,
                 code_help,
                 code_ls,
-                code_pwd
+                code_pwd,
+                code_rm,
+                code_tail,
+                code_truncate,
+                code_write
                 // Debug.
                 , code_dump_pwd_inode
                 , code_dump_block
@@ -33,12 +41,22 @@ namespace vdi_explorer
                 // End debug.
             };
             
+            void command_append(const vector<string> &);
+            void command_cat(const vector<string> &);
             void command_cd(const string &);
             void command_cp(const string &, const string &, const string &);
+            void command_cp_in_batch(const vector<string> &);
+            void command_cp_out_batch(const vector<string> &);
+            void command_cp_recursive(const vector<string> &);
             void command_exit();
+            void command_head(const vector<string> &);
             void command_help(const string &);
-            void command_ls(const string &);
+            void command_ls(const vector<string> &);
             void command_pwd();
+            void command_rm(const vector<string> &);
+            void command_tail(const vector<string> &);
+            void command_truncate(const vector<string> &);
+            void command_write(const vector<string> &);
             // Debug.
             void command_dump_pwd_inode();
             void command_dump_block(u32);
@@ -47,7 +65,19 @@ namespace vdi_explorer
             
             command_code hash_command(const string &);
             
+            // Write a byte range of an open file to standard output.
+            void print_file_range(ext2::file_handle &, u64, u64);
+            
+            // Parse the optional [-c N | -n N] switch shared by head and tail.
+            bool parse_count_option(const vector<string> &, bool &, u64 &);
+            
+            // Decide whether a cp out command copies a batch of files into a host directory.
+            bool is_cp_out_batch(const vector<string> &);
+            
             // pointer to the file system object
             ext2 * file_system = nullptr;
+            
+            // The last directory listed by ls, kept so its memory is reused.
+            dir_snapshot file_listing;
     };
 } // namespace vdi_explorer
\ No newline at end of file
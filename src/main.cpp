@@ -21,15 +21,41 @@ using namespace std;
 int main(int argc, char *argv[])
 {
     string cmd, filename;
+    bool lazy = false;
+    bool direct = false;
+    int arg = 1;
     // bool flag;
     
+    // usage: vdi [--lazy] [--direct] image [command...]
+    // --lazy skips the start-up diagnostics and reads the file system's metadata only as it is
+    // needed, which suits one-shot runs.  --direct reads file data with direct I/O, so bulk
+    // copies out of the image do not fill the host's page cache.
+    for (; arg < argc && string(argv[arg]).compare(0, 2, "--") == 0; arg++){
+        if (string(argv[arg]) == "--lazy")
+            lazy = true;
+        else if (string(argv[arg]) == "--direct")
+            direct = true;
+        else
+            break;
+    }
+    
     // grab VDI file passed into program
-    if (argc > 1){
-        //cout << argc <<" " << argv[0]<< " " << argv[1]<< " " << argv[2] << endl;
-        filename = argv[1];
-        cout << "Reading file: " << argv[1] << "\n"<< endl;
+    if (arg < argc){
+        filename = argv[arg++];
+        
+        // Anything after the image is a command to run in place of the interactive prompt.
+        for (; arg < argc; arg++){
+            if (!cmd.empty())
+                cmd += " ";
+            cmd += argv[arg];
+        }
+        
+        if (cmd.empty())
+            cout << "Reading file: " << filename << "\n"<< endl;
         vdi_explorer::vdi_reader fs(filename);
-        vdi_explorer::ext2 e2(&fs);
+        if (direct && !fs.vdiSetDirect(true))
+            cout << "Direct I/O is not available for this image; using buffered I/O.\n";
+        vdi_explorer::ext2 e2(&fs, lazy);
         
         // Debug info.
         // string temp_string; temp_string.assign("      this ||is   a test  ||   ");
@@ -40,7 +66,10 @@ int main(int argc, char *argv[])
         // End debug info.
 
         vdi_explorer::interface my_interface(&e2);
-        my_interface.interactive();
+        if (cmd.empty())
+            my_interface.interactive();
+        else
+            my_interface.execute(cmd);
     }
     //vdi_explorer::vdi_reader fs(filename);
     
@@ -0,0 +1,210 @@
+/*--------------------------------------------------------------------------------------------------
+ * Author:      
+ * Date:        2026-10-19
+ * Assignment:  Final Project
+ * Source File: metadata_cache.cpp
+ * Language:    C/C++
+ * Course:      Operating Systems
+ * Purpose:     Contains the implementation of the metadata_cache class.
+ -------------------------------------------------------------------------------------------------*/
+
+#include "metadata_cache.h"
+#include "constants.h"
+
+#include <algorithm>
+#include <cstdio>
+
+using namespace std;
+
+namespace vdi_explorer
+{
+    /*----------------------------------------------------------------------------------------------
+     * Name:    attach
+     * Type:    Function
+     * Purpose: Tells the cache where the blocks it holds live.
+     * Input:   vdi_reader * _vdi, holds the virtual disk to read from and write to.
+     * Input:   off_t _base_offset, holds the offset of block 0 on the virtual disk.
+     * Input:   size_t _block_size, holds the block size.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    void metadata_cache::attach(vdi_reader * _vdi, off_t _base_offset, size_t _block_size)
+    {
+        vdi = _vdi;
+        base_offset = _base_offset;
+        block_size = _block_size;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    get
+     * Type:    Function
+     * Purpose: Returns the cached copy of a block, reading it in first if it is not cached yet.
+     * Input:   u32 block_num, holds the block number.
+     * Input:   bool fill, holds whether to read the block's current contents from the disk.  A
+     *          caller about to overwrite the whole block can skip the read.
+     * Output:  u8 *, the block's contents.  It stays valid until the cache is destroyed.
+    ----------------------------------------------------------------------------------------------*/
+    u8 * metadata_cache::get(u32 block_num, bool fill)
+    {
+        map<u32, cached_block>::iterator entry = blocks.find(block_num);
+        if (entry != blocks.end())
+        {
+            return entry->second.data.data();
+        }
+        
+        cached_block & new_block = blocks[block_num];
+        new_block.data.assign(block_size, 0);
+        if (fill)
+        {
+            vdi->vdiSeek(base_offset + (off_t)block_num * block_size, SEEK_SET);
+            vdi->vdiRead(new_block.data.data(), block_size);
+        }
+        return new_block.data.data();
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    peek
+     * Type:    Function
+     * Purpose: Returns the cached copy of a block, without reading it in if it is not cached.
+     * Input:   u32 block_num, holds the block number.
+     * Output:  const u8 *, the block's contents, or nullptr if the block is not cached.
+    ----------------------------------------------------------------------------------------------*/
+    const u8 * metadata_cache::peek(u32 block_num) const
+    {
+        map<u32, cached_block>::const_iterator entry = blocks.find(block_num);
+        return (entry == blocks.end() ? nullptr : entry->second.data.data());
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    prefetch
+     * Type:    Function
+     * Purpose: Reads many blocks into the cache ahead of their use, such as the bitmaps of every
+     *          block group.  Blocks already cached are left alone, and each run of neighbouring
+     *          blocks is read with a single read, so metadata packed together on disk (as under
+     *          flex_bg) costs one large read rather than one per block.
+     * Input:   vector<u32> block_nums, holds the blocks, in any order.
+     * Output:  u32, the number of reads issued.
+    ----------------------------------------------------------------------------------------------*/
+    u32 metadata_cache::prefetch(vector<u32> block_nums)
+    {
+        sort(block_nums.begin(), block_nums.end());
+        block_nums.erase(unique(block_nums.begin(), block_nums.end()), block_nums.end());
+        
+        vector<u8> run;
+        u32 num_reads = 0;
+        for (u32 first = 0; first < block_nums.size();)
+        {
+            if (blocks.count(block_nums[first]) != 0)
+            {
+                first++;
+                continue;
+            }
+            
+            // Extend the run over the neighbouring blocks that are not cached either.
+            u32 end = first + 1;
+            while (end < block_nums.size() &&
+                   block_nums[end] == block_nums[end - 1] + 1 &&
+                   blocks.count(block_nums[end]) == 0 &&
+                   (end - first) * block_size < EXT2_METADATA_READ_MAX)
+            {
+                end++;
+            }
+            
+            run.resize((end - first) * block_size);
+            vdi->vdiPread(run.data(), run.size(), base_offset + (off_t)block_nums[first] * block_size);
+            num_reads++;
+            for (u32 i = first; i < end; i++)
+            {
+                blocks[block_nums[i]].data.assign(run.begin() + (i - first) * block_size,
+                                                  run.begin() + (i - first + 1) * block_size);
+            }
+            first = end;
+        }
+        
+        return num_reads;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    mark_dirty
+     * Type:    Function
+     * Purpose: Records that a cached block has been changed and needs to be written.
+     * Input:   u32 block_num, holds the block number.  The block must already be cached.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    void metadata_cache::mark_dirty(u32 block_num)
+    {
+        map<u32, cached_block>::iterator entry = blocks.find(block_num);
+        if (entry != blocks.end() && !entry->second.dirty)
+        {
+            entry->second.dirty = true;
+            num_dirty++;
+        }
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    is_dirty
+     * Type:    Function
+     * Purpose: Checks whether any cached block is waiting to be written.
+     * Input:   Nothing.
+     * Output:  bool, true if there is anything to flush.
+    ----------------------------------------------------------------------------------------------*/
+    bool metadata_cache::is_dirty() const
+    {
+        return num_dirty > 0;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    flush
+     * Type:    Function
+     * Purpose: Writes every dirty block to disk in block order, coalescing runs of neighbouring
+     *          dirty blocks into single writes.  The blocks stay cached, now clean.
+     * Input:   Nothing.
+     * Output:  u32, the number of writes issued.
+    ----------------------------------------------------------------------------------------------*/
+    u32 metadata_cache::flush()
+    {
+        vector<u8> run;
+        u32 run_start = 0;
+        u32 num_writes = 0;
+        
+        for (map<u32, cached_block>::iterator entry = blocks.begin(); entry != blocks.end(); ++entry)
+        {
+            if (!entry->second.dirty)
+            {
+                continue;
+            }
+            
+            // Write out the current run if this block does not follow on from it.
+            if (!run.empty() && entry->first != run_start + run.size() / block_size)
+            {
+                vdi->vdiSeek(base_offset + (off_t)run_start * block_size, SEEK_SET);
+                vdi->vdiWrite(run.data(), run.size());
+                num_writes++;
+                run.clear();
+            }
+            
+            // Add the block to the run.
+            if (run.empty())
+            {
+                run_start = entry->first;
+            }
+            run.insert(run.end(), entry->second.data.begin(), entry->second.data.end());
+            entry->second.dirty = false;
+        }
+        
+        if (!run.empty())
+        {
+            vdi->vdiSeek(base_offset + (off_t)run_start * block_size, SEEK_SET);
+            vdi->vdiWrite(run.data(), run.size());
+            num_writes++;
+        }
+        
+        num_dirty = 0;
+        return num_writes;
+    }
+} // namespace vdi_explorer
@@ -0,0 +1,47 @@
+#ifndef METADATA_CACHE_H
+#define METADATA_CACHE_H
+
+#include "datatypes.h" //typedefs for s8, u8, s16, u16, s32, u32, s64, and u64
+#include "vdi_reader.h"
+
+#include <map>
+#include <vector>
+#include <sys/types.h>
+
+namespace vdi_explorer
+{
+    // A write-back cache of file system metadata blocks (bitmaps, the block group descriptor
+    // table, inode tables and the superblock).  Changes are made to the cached copies and marked
+    // dirty; nothing reaches the disk until flush, which writes every dirty block in block order,
+    // with runs of neighbouring blocks going out as a single write.  However many times a block
+    // is changed between flushes, it is written once.
+    class metadata_cache
+    {
+        public:
+            void attach(vdi_reader *, off_t, size_t);
+            
+            u8 * get(u32, bool = true);
+            const u8 * peek(u32) const;
+            u32 prefetch(std::vector<u32>);
+            void mark_dirty(u32);
+            
+            bool is_dirty() const;
+            u32 flush();
+        
+        private:
+            struct cached_block
+            {
+                std::vector<u8> data;
+                bool dirty = false;
+            };
+            
+            vdi_reader * vdi = nullptr;
+            off_t base_offset = 0;
+            size_t block_size = 0;
+            
+            std::map<u32, cached_block> blocks;
+            u32 num_dirty = 0;
+    };
+} // namespace vdi_explorer
+
+#endif // METADATA_CACHE_H
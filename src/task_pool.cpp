@@ -0,0 +1,210 @@
+/*--------------------------------------------------------------------------------------------------
+ * Author:      
+ * Date:        2026-10-19
+ * Assignment:  Final Project
+ * Source File: task_pool.cpp
+ * Language:    C/C++
+ * Course:      Operating Systems
+ * Purpose:     Contains the implementation of the work_stealing_pool class.
+ -------------------------------------------------------------------------------------------------*/
+
+#include "task_pool.h"
+
+using namespace std;
+
+namespace vdi_explorer
+{
+    // The pool and queue the current thread works for, if it is a worker.
+    static thread_local const work_stealing_pool * current_pool = nullptr;
+    static thread_local u32 current_worker = 0;
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    work_stealing_pool
+     * Type:    Function
+     * Purpose: Constructor for the work_stealing_pool class.  Starts the workers, which wait for
+     *          tasks until the pool is destroyed.
+     * Input:   u32 num_workers, holds the number of worker threads to start (at least one is).
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    work_stealing_pool::work_stealing_pool(u32 num_workers)
+    {
+        if (num_workers == 0)
+        {
+            num_workers = 1;
+        }
+        
+        for (u32 i = 0; i < num_workers; i++)
+        {
+            queues.push_back(unique_ptr<worker_queue>(new worker_queue));
+        }
+        for (u32 i = 0; i < num_workers; i++)
+        {
+            workers.push_back(thread(&work_stealing_pool::run_worker, this, i));
+        }
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    ~work_stealing_pool
+     * Type:    Function
+     * Purpose: Destructor for the work_stealing_pool class.  Finishes every outstanding task, then
+     *          stops the workers.
+     * Input:   Nothing.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    work_stealing_pool::~work_stealing_pool()
+    {
+        wait();
+        {
+            lock_guard<mutex> lock(pool_mutex);
+            stopping = true;
+            work_available.notify_all();
+        }
+        for (u32 i = 0; i < workers.size(); i++)
+        {
+            workers[i].join();
+        }
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    submit
+     * Type:    Function
+     * Purpose: Adds a task to the pool.  A task submitted by one of the pool's own workers goes on
+     *          that worker's queue; any other goes on each queue in turn.
+     * Input:   function<void()> task, holds the task.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    void work_stealing_pool::submit(function<void()> task)
+    {
+        u32 queue_num = 0;
+        {
+            lock_guard<mutex> lock(pool_mutex);
+            if (current_pool == this)
+            {
+                queue_num = current_worker;
+            }
+            else
+            {
+                queue_num = next_queue;
+                next_queue = (next_queue + 1) % queues.size();
+            }
+            num_pending++;
+        }
+        
+        {
+            lock_guard<mutex> lock(queues[queue_num]->queue_mutex);
+            queues[queue_num]->tasks.push_back(move(task));
+        }
+        
+        lock_guard<mutex> lock(pool_mutex);
+        num_queued++;
+        work_available.notify_one();
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    wait
+     * Type:    Function
+     * Purpose: Waits until every task submitted so far, and every task those submit in turn, has
+     *          finished.
+     * Input:   Nothing.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    void work_stealing_pool::wait()
+    {
+        unique_lock<mutex> lock(pool_mutex);
+        work_done.wait(lock, [&]()
+        {
+            return num_pending == 0;
+        });
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    take_task
+     * Type:    Function
+     * Purpose: Takes a task for a worker: the newest one on its own queue, or failing that, the
+     *          oldest one on the first other queue that has any.
+     * Input:   u32 worker_num, holds the worker's number.
+     * Output:  function<void()> & task, receives the task.
+     * Output:  bool, true if a task was taken.
+    ----------------------------------------------------------------------------------------------*/
+    bool work_stealing_pool::take_task(u32 worker_num, function<void()> & task)
+    {
+        for (u32 i = 0; i < queues.size(); i++)
+        {
+            worker_queue & queue = *(queues[(worker_num + i) % queues.size()]);
+            lock_guard<mutex> lock(queue.queue_mutex);
+            if (queue.tasks.empty())
+            {
+                continue;
+            }
+            
+            if (i == 0)
+            {
+                task = move(queue.tasks.back());
+                queue.tasks.pop_back();
+            }
+            else
+            {
+                task = move(queue.tasks.front());
+                queue.tasks.pop_front();
+            }
+            return true;
+        }
+        
+        return false;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    run_worker
+     * Type:    Function
+     * Purpose: The body of each worker thread.  Runs tasks until the pool is stopped, sleeping
+     *          while there are none to be had.
+     * Input:   u32 worker_num, holds the worker's number.
+     * Output:  Nothing.
+    ----------------------------------------------------------------------------------------------*/
+    void work_stealing_pool::run_worker(u32 worker_num)
+    {
+        current_pool = this;
+        current_worker = worker_num;
+        
+        while (true)
+        {
+            {
+                unique_lock<mutex> lock(pool_mutex);
+                work_available.wait(lock, [&]()
+                {
+                    return stopping || num_queued > 0;
+                });
+                if (stopping)
+                {
+                    return;
+                }
+            }
+            
+            // Another worker may get to the task first, in which case go back to waiting.
+            function<void()> task;
+            if (!take_task(worker_num, task))
+            {
+                continue;
+            }
+            {
+                lock_guard<mutex> lock(pool_mutex);
+                num_queued--;
+            }
+            
+            task();
+            
+            lock_guard<mutex> lock(pool_mutex);
+            num_pending--;
+            if (num_pending == 0)
+            {
+                work_done.notify_all();
+            }
+        }
+    }
+} // namespace vdi_explorer
@@ -0,0 +1,58 @@
+#ifndef TASK_POOL_H
+#define TASK_POOL_H
+
+#include "datatypes.h" //typedefs for s8, u8, s16, u16, s32, u32, s64, and u64
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace vdi_explorer
+{
+    // A fixed set of worker threads running tasks that may submit more tasks, as when walking a
+    // tree.  Each worker has its own queue: tasks submitted by a worker go on the back of its own
+    // queue and it takes its next task from the back too, so it keeps working on what it found
+    // most recently.  A worker whose queue runs dry steals from the front of another worker's
+    // queue, taking the oldest task, which is usually the one with the most work left under it.
+    class work_stealing_pool
+    {
+        public:
+            // Constructor
+            work_stealing_pool(u32);
+            
+            // Destructor
+            ~work_stealing_pool();
+            
+            void submit(std::function<void()>);
+            
+            // Wait until every task submitted, including those submitted by other tasks, is done.
+            void wait();
+            
+        private:
+            struct worker_queue
+            {
+                std::mutex queue_mutex;
+                std::deque<std::function<void()>> tasks;
+            };
+            
+            std::vector<std::unique_ptr<worker_queue>> queues;
+            std::vector<std::thread> workers;
+            
+            std::mutex pool_mutex;
+            std::condition_variable work_available;
+            std::condition_variable work_done;
+            s32 num_queued = 0;     // tasks waiting in the queues
+            u32 num_pending = 0;    // tasks submitted and not yet finished
+            u32 next_queue = 0;     // where tasks submitted from outside the pool go next
+            bool stopping = false;
+            
+            bool take_task(u32, std::function<void()> &);
+            void run_worker(u32);
+    };
+} // namespace vdi_explorer
+
+#endif // TASK_POOL_H
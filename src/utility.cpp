@@ -1,11 +1,20 @@
 // Code from user "Evan Teran" on stackoverflow.com to assist with trimming strings.
 // http://stackoverflow.com/questions/216823/whats-the-best-way-to-trim-stdstring
 
+#include "datatypes.h"
+
 #include <algorithm> 
 #include <functional> 
 #include <cctype>
 #include <locale>
 #include <string>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 #include <iostream>
 
@@ -107,4 +116,193 @@ namespace utility
         // Calculate the value and return.
         return value + 4 * (value % 4 != 0) - value % 4;
     }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    read_fully
+     * Type:    Function
+     * Purpose: Read from a file descriptor until the buffer is full or the end of the file is
+     *          reached.  Pipes and terminals may return less than was asked for on each call.
+     * Input:   int fd, holds the file descriptor to read from.
+     * Input:   void * buf, the buffer into which the data should be read.
+     * Input:   size_t count, the number of bytes which should be read.
+     * Output:  size_t, holding the number of bytes read.  Less than count only at end of file or
+     *          on an error.
+    ----------------------------------------------------------------------------------------------*/
+    size_t read_fully(int fd, void * buf, size_t count)
+    {
+        size_t bytes_read = 0;
+        
+        while (bytes_read < count)
+        {
+            ssize_t result = ::read(fd, (char *)buf + bytes_read, count - bytes_read);
+            if (result < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (result <= 0)
+            {
+                break;
+            }
+            bytes_read += result;
+        }
+        
+        return bytes_read;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    write_fully
+     * Type:    Function
+     * Purpose: Write a whole buffer to a file descriptor, retrying short writes.
+     * Input:   int fd, holds the file descriptor to write to.
+     * Input:   const void * buf, contains the data to be written.
+     * Input:   size_t count, holds the number of bytes to be written.
+     * Output:  bool, true if every byte was written.
+    ----------------------------------------------------------------------------------------------*/
+    bool write_fully(int fd, const void * buf, size_t count)
+    {
+        size_t bytes_written = 0;
+        
+        while (bytes_written < count)
+        {
+            ssize_t result = ::write(fd, (const char *)buf + bytes_written, count - bytes_written);
+            if (result < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (result <= 0)
+            {
+                return false;
+            }
+            bytes_written += result;
+        }
+        
+        return true;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    pwrite_fully
+     * Type:    Function
+     * Purpose: Write a whole buffer to a given offset in a file descriptor, retrying short writes.
+     *          The file descriptor's own offset is left alone, so several threads can write to
+     *          different parts of the same file at once.
+     * Input:   int fd, holds the file descriptor to write to.
+     * Input:   const void * buf, contains the data to be written.
+     * Input:   size_t count, holds the number of bytes to be written.
+     * Input:   u64 offset, holds the offset in the file to write at.
+     * Output:  bool, true if every byte was written.
+    ----------------------------------------------------------------------------------------------*/
+    bool pwrite_fully(int fd, const void * buf, size_t count, u64 offset)
+    {
+        size_t bytes_written = 0;
+        
+        while (bytes_written < count)
+        {
+            ssize_t result = ::pwrite(fd, (const char *)buf + bytes_written, count - bytes_written, offset + bytes_written);
+            if (result < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (result <= 0)
+            {
+                return false;
+            }
+            bytes_written += result;
+        }
+        
+        return true;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    skip_zeroes
+     * Type:    Function
+     * Purpose: Advance a file descriptor past a run of zeroes.  Seekable files simply have their
+     *          offset moved, which leaves a hole once something is written after it; anything else
+     *          (pipes, terminals) gets the zeroes written out.
+     * Input:   int fd, holds the file descriptor to advance.
+     * Input:   u64 count, holds the number of zero bytes to skip.
+     * Output:  bool, true if the file descriptor was advanced.
+    ----------------------------------------------------------------------------------------------*/
+    bool skip_zeroes(int fd, u64 count)
+    {
+        // Try to seek first.
+        if (::lseek(fd, count, SEEK_CUR) != -1)
+        {
+            return true;
+        }
+        
+        // Otherwise write the zeroes out a chunk at a time.
+        char zeroes[65536];
+        memset(zeroes, 0, sizeof(zeroes));
+        while (count > 0)
+        {
+            size_t chunk = (count < sizeof(zeroes) ? count : sizeof(zeroes));
+            if (!write_fully(fd, zeroes, chunk))
+            {
+                return false;
+            }
+            count -= chunk;
+        }
+        
+        return true;
+    }
+    
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    is_zero_filled
+     * Type:    Function
+     * Purpose: Check whether a buffer holds nothing but zeroes.  The buffer is OR-ed together 32
+     *          (AVX2) or 16 (SSE2) bytes at a time, and tested once per 128 bytes, so the check
+     *          runs at memory speed on block-sized buffers.
+     * Input:   const void * buf, holds the buffer to check.
+     * Input:   size_t count, holds the size of the buffer in bytes.
+     * Output:  bool, true if every byte in the buffer is zero.
+    ----------------------------------------------------------------------------------------------*/
+    bool is_zero_filled(const void * buf, size_t count)
+    {
+        const char * bytes = (const char *)buf;
+        size_t i = 0;
+        
+        #if defined(__AVX2__)
+        for (; i + 128 <= count; i += 128)
+        {
+            __m256i acc = _mm256_or_si256(
+                _mm256_or_si256(_mm256_loadu_si256((const __m256i *)(bytes + i)),
+                                _mm256_loadu_si256((const __m256i *)(bytes + i + 32))),
+                _mm256_or_si256(_mm256_loadu_si256((const __m256i *)(bytes + i + 64)),
+                                _mm256_loadu_si256((const __m256i *)(bytes + i + 96))));
+            if (!_mm256_testz_si256(acc, acc))
+            {
+                return false;
+            }
+        }
+        #elif defined(__SSE2__)
+        for (; i + 128 <= count; i += 128)
+        {
+            __m128i acc = _mm_loadu_si128((const __m128i *)(bytes + i));
+            for (u32 j = 16; j < 128; j += 16)
+            {
+                acc = _mm_or_si128(acc, _mm_loadu_si128((const __m128i *)(bytes + i + j)));
+            }
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(acc, _mm_setzero_si128())) != 0xffff)
+            {
+                return false;
+            }
+        }
+        #endif
+        
+        // Check whatever is left over a byte at a time.
+        for (; i < count; i++)
+        {
+            if (bytes[i] != 0)
+            {
+                return false;
+            }
+        }
+        
+        return true;
+    }
 } // namespace utility
\ No newline at end of file
@@ -31,4 +31,19 @@ namespace utility
     
     // Find the nearest multiple of 4 greater than or equal to the provided value.
     unsigned int nearest_mult_four(u32);
+    
+    // read from a file descriptor until the buffer is full or the end of the file is reached
+    size_t read_fully(int, void *, size_t);
+    
+    // write a whole buffer to a file descriptor, retrying short writes
+    bool write_fully(int, const void *, size_t);
+    
+    // write a whole buffer to a given offset in a file descriptor, retrying short writes
+    bool pwrite_fully(int, const void *, size_t, u64);
+    
+    // advance a file descriptor past a run of zeroes, leaving a hole where the file allows it
+    bool skip_zeroes(int, u64);
+    
+    // check whether a buffer holds nothing but zeroes
+    bool is_zero_filled(const void *, size_t);
 }
\ No newline at end of file
@@ -9,16 +9,20 @@
  -------------------------------------------------------------------------------------------------*/
 
 #include "vdi_reader.h"
+#include "buffer_pool.h"
 #include "datatypes.h"
 #include <iostream>
 #include <iomanip>
 #include <fcntl.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <cerrno>
+#include <cstdint>
 #include <cstring>
 
 //#define DEBUG_VDI_WRITE_DISABLED
-#define DEBUG_VDI_OUTPUT_TRANSLATION
+//#define DEBUG_VDI_OUTPUT_TRANSLATION
+//#define DEBUG_VDI_OUTPUT_HEADER
 
 /* VDI reader should read the VDI header and populate the VDI header structure,
    and read the VDI Map into pageMap*/
@@ -30,8 +34,8 @@ namespace vdi_explorer{
      * Name:    vdi_reader
      * Type:    Function
      * Purpose: Constructor for the vdi_reader class.
-     * Input:   std::string fs, containing the file name to open.  Also prints out some debug
-     *          information currently.
+     * Input:   std::string fs, containing the file name to open.  Prints out the header if
+     *          DEBUG_VDI_OUTPUT_HEADER is defined.
      * Output:  Nothing.
     ----------------------------------------------------------------------------------------------*/
     vdi_reader::vdi_reader(string fs)
@@ -39,6 +43,7 @@ namespace vdi_explorer{
         vdiOpen(fs);
         
         // Debug info.
+        #ifdef DEBUG_VDI_OUTPUT_HEADER
         cout << "VDI Header Information:" << endl;
         cout << "Dynamic/Static: " << (hdr.imageType == 1 ? "1 - dynamic" : "2 - static") << endl;
         cout << "MBR Start Offset: " << hdr.offsetData << endl; //2097152 - Where MBR is located
@@ -53,6 +58,7 @@ namespace vdi_explorer{
         cout << "Pages Allocated: " << hdr.pagesAllocated << endl;
         
         cout << endl;
+        #endif
     }
     
     /*----------------------------------------------------------------------------------------------
@@ -95,6 +101,7 @@ namespace vdi_explorer{
             cout << "Error opening file.\n";
             throw;
         }
+        path = fileName;
         
         // Read the header, then verify its size and signature.
         size_t nBytes = read(fd, &hdr, sizeof(VDIHeader));
@@ -128,7 +135,7 @@ namespace vdi_explorer{
         
         // Allocated the page bitmap and verify it allocated correctly.
         u32 bitmapSize = (hdr.totalPages + 8191) / 8192;
-        pageBitmap = new u8(bitmapSize);
+        pageBitmap = new u8[bitmapSize];
         if (pageBitmap == nullptr)
         {
             ::close(fd);
@@ -139,7 +146,7 @@ namespace vdi_explorer{
         }
         
         // Allocate the dirty bitmap and verify it allocated correctly.
-        dirtyBitmap = new u8(bitmapSize);
+        dirtyBitmap = new u8[bitmapSize];
         if (dirtyBitmap == nullptr)
         {
             ::close(fd);
@@ -183,19 +190,19 @@ namespace vdi_explorer{
         // Keep track of whether the header needs to be written.
         bool mustWriteHeader = false;
         
-        // Determine the size of the dirty bitmap.
-        u32 bitmapSize = (hdr.totalPages + 8191) / 8192;
+        // Determine the number of page map chunks.  Each holds 1024 entries, and has one bit in
+        // the dirty bitmap.
+        u32 numChunks = (hdr.totalPages + 1023) / 1024;
         size_t chunkSize;
         
         // Scan through dirtyBitmap and write any modified chunks of the page map to disk.
-        // @TODO change the name of 'i' to something a little more descriptive.
-        for (u32 i = 0; i < bitmapSize; i++)
+        for (u32 chunkNum = 0; chunkNum < numChunks; chunkNum++)
         {
-            // @TODO Add comment to describe exactly what this line does.
-            if (dirtyBitmap[i / 8] & (1 << (i % 8)))
+            // Check the chunk's bit in the dirty bitmap.
+            if (dirtyBitmap[chunkNum / 8] & (1 << (chunkNum % 8)))
             {
                 // Calculate the chunk size and clamp it to 4096 if necessary.
-                chunkSize = (hdr.totalPages - i * 1024) * sizeof(s32);
+                chunkSize = (hdr.totalPages - chunkNum * 1024) * sizeof(s32);
                 if (chunkSize > 4096)
                 {
                     chunkSize = 4096;
@@ -204,8 +211,8 @@ namespace vdi_explorer{
                 // Write the updated page map to the VDI and set the flag so the header will be
                 // written as well.
                 #ifndef DEBUG_VDI_WRITE_DISABLED
-                ::lseek(fd, hdr.offsetPages + i * 4096, SEEK_SET);
-                ::write(fd, pageMap + i * 1024, chunkSize);
+                ::lseek(fd, hdr.offsetPages + (off_t)chunkNum * 4096, SEEK_SET);
+                ::write(fd, pageMap + chunkNum * 1024, chunkSize);
                 #endif
                 mustWriteHeader = true;
             }
@@ -220,8 +227,9 @@ namespace vdi_explorer{
             #endif
         }
         
-        // Close the file descriptor and deallocate variables.
+        // Close the file descriptors and deallocate variables.
         ::close(fd);
+        vdiSetDirect(false);
         if (dirtyBitmap)
             delete[] dirtyBitmap;
         if (pageBitmap)
@@ -275,12 +283,33 @@ namespace vdi_explorer{
      * Output:  size_t, holding the number of bytes actually read into the buffer.
     ----------------------------------------------------------------------------------------------*/
     size_t vdi_reader::vdiRead(void *buf, size_t count)
+    {
+        // Read from the cursor, then move the cursor past what was read.
+        size_t nBytes = vdiPread(buf, count, cursor);
+        cursor += nBytes;
+        
+        // Return the number of bytes read.
+        return nBytes;
+    }
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    vdiPread
+     * Type:    Function
+     * Purpose: Reads a certain number of bytes from a given place on the virtual disk into a
+     *          buffer, without using or moving the cursor.  Each page is read with a positioned
+     *          read, so several threads can read at once.
+     * Input:   void *buf, the buffer into which the data should be read.
+     * Input:   size_t count, the number of bytes which should be read.
+     * Input:   off_t offset, the place on the virtual disk to read from.
+     * Output:  size_t, holding the number of bytes actually read into the buffer.
+    ----------------------------------------------------------------------------------------------*/
+    size_t vdi_reader::vdiPread(void *buf, size_t count, off_t offset)
     {
         off_t location;
         size_t chunkSize, nBytes = 0;
         
         // Determine the size of the first chunk.
-        chunkSize = hdr.pageSize - cursor % hdr.pageSize;
+        chunkSize = hdr.pageSize - offset % hdr.pageSize;
         if (chunkSize > count)
         {
             chunkSize = count;
@@ -288,23 +317,18 @@ namespace vdi_explorer{
         
         while (count > 0)
         {
-            // Read a chunk.
-            location = vdiTranslate();
+            // Read a chunk.  Unallocated pages read back as zeroes.
+            location = vdiTranslate(offset + nBytes);
             if (location == 0)
             {
-                for (u32 i = 0; i < chunkSize; i++)
-                {
-                    ((u8 *)buf)[nBytes + i] = '\0';
-                }
+                ::memset(((u8 *)buf) + nBytes, 0, chunkSize);
             }
-            else
+            else if (::pread(fd, ((u8 *)buf) + nBytes, chunkSize, location) != (ssize_t)chunkSize)
             {
-                ::lseek(fd, location, SEEK_SET);
-                ::read(fd, ((u8 *)buf) + nBytes, chunkSize);
+                // Stop at a failed or short read, so the caller can tell the data is not all there.
+                return nBytes;
             }
-            // Update the cursor to the new position, augment the number of bytes read, and reduce
-            // the number of bytes yet to be read.
-            cursor += chunkSize;
+            // Augment the number of bytes read, and reduce the number of bytes yet to be read.
             nBytes += chunkSize;
             count -= chunkSize;
             
@@ -320,6 +344,293 @@ namespace vdi_explorer{
         return nBytes;
     }
     
+    /*----------------------------------------------------------------------------------------------
+     * Name:    vdiPreadBulk
+     * Type:    Function
+     * Purpose: Reads a certain number of bytes from a given place on the virtual disk, as
+     *          vdiPread does, but for bulk file data that will not be read again.  With direct I/O
+     *          on, the reads bypass the host page cache: runs of pages that are contiguous in the
+     *          VDI file are read together, and each read is rounded out to the alignment direct
+     *          I/O needs.  Anything direct I/O cannot read is read the ordinary way.
+     * Input:   void *buf, the buffer into which the data should be read.  A page-aligned buffer
+     *          (see buffer_pool) lets aligned reads go straight into it.
+     * Input:   size_t count, the number of bytes which should be read.
+     * Input:   off_t offset, the place on the virtual disk to read from.
+     * Output:  size_t, holding the number of bytes actually read into the buffer.
+    ----------------------------------------------------------------------------------------------*/
+    size_t vdi_reader::vdiPreadBulk(void *buf, size_t count, off_t offset)
+    {
+        if (directFd == -1 || directFailed)
+        {
+            return vdiPread(buf, count, offset);
+        }
+        
+        size_t nBytes = 0;
+        while (count > 0)
+        {
+            // Take in the rest of this page, and the following pages for as long as they carry
+            // straight on in the VDI file (or are unallocated too).
+            off_t location = vdiTranslate(offset + nBytes);
+            size_t chunkSize = hdr.pageSize - (offset + nBytes) % hdr.pageSize;
+            while (chunkSize < count)
+            {
+                off_t next = vdiTranslate(offset + nBytes + chunkSize);
+                if (location == 0 ? next != 0 : next != location + (off_t)chunkSize)
+                {
+                    break;
+                }
+                chunkSize += hdr.pageSize;
+            }
+            if (chunkSize > count)
+            {
+                chunkSize = count;
+            }
+            
+            // Unallocated pages read back as zeroes.
+            if (location == 0)
+            {
+                ::memset(((u8 *)buf) + nBytes, 0, chunkSize);
+            }
+            else if (!vdiDirectRead(((u8 *)buf) + nBytes, chunkSize, location) &&
+                     ::pread(fd, ((u8 *)buf) + nBytes, chunkSize, location) != (ssize_t)chunkSize)
+            {
+                return nBytes;
+            }
+            
+            nBytes += chunkSize;
+            count -= chunkSize;
+        }
+        
+        // Return the number of bytes read.
+        return nBytes;
+    }
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    vdiCopyOut
+     * Type:    Function
+     * Purpose: Copies a certain number of bytes from a given place on the virtual disk into a host
+     *          file without the data passing through user space.  Runs of pages that are
+     *          contiguous in the VDI file are each handed to the kernel whole (see vdiCopyRange).
+     *          Unallocated pages are skipped over, leaving whatever the host file holds there (a
+     *          hole, in a new file); the caller must extend the file if they come last.
+     *          With direct I/O on, nothing is copied, since the kernel's copy goes through the
+     *          page cache that direct I/O is meant to keep clear.
+     * Input:   int outFd, the host file to copy into.  It must be a regular file.
+     * Input:   off_t outOffset, the place in the host file to copy to.
+     * Input:   size_t count, the number of bytes which should be copied.
+     * Input:   off_t offset, the place on the virtual disk to copy from.
+     * Output:  ssize_t, holding the number of bytes copied, which is short if the kernel stopped
+     *          part way; the rest can be copied the ordinary way.  -1 if nothing could be copied.
+    ----------------------------------------------------------------------------------------------*/
+    ssize_t vdi_reader::vdiCopyOut(int outFd, off_t outOffset, size_t count, off_t offset)
+    {
+        if (directFd != -1 && !directFailed)
+        {
+            return -1;
+        }
+        
+        size_t nBytes = 0;
+        while (nBytes < count)
+        {
+            // Take in the rest of this page, and the following pages for as long as they carry
+            // straight on in the VDI file (or are unallocated too).
+            off_t location = vdiTranslate(offset + nBytes);
+            size_t chunkSize = hdr.pageSize - (offset + nBytes) % hdr.pageSize;
+            while (nBytes + chunkSize < count)
+            {
+                off_t next = vdiTranslate(offset + nBytes + chunkSize);
+                if (location == 0 ? next != 0 : next != location + (off_t)chunkSize)
+                {
+                    break;
+                }
+                chunkSize += hdr.pageSize;
+            }
+            if (chunkSize > count - nBytes)
+            {
+                chunkSize = count - nBytes;
+            }
+            
+            if (location != 0)
+            {
+                ssize_t nCopied = vdiCopyRange(outFd, outOffset + nBytes, chunkSize, location);
+                if (nCopied != (ssize_t)chunkSize)
+                {
+                    if (nCopied > 0)
+                    {
+                        nBytes += nCopied;
+                    }
+                    return (nBytes > 0 ? (ssize_t)nBytes : -1);
+                }
+            }
+            
+            nBytes += chunkSize;
+        }
+        
+        // Return the number of bytes copied.
+        return nBytes;
+    }
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    vdiCopyRange
+     * Type:    Function
+     * Purpose: Copies a run of the VDI file into a host file inside the kernel.  copy_file_range is
+     *          tried first, which can share the data outright on file systems that support it.
+     *          Where the host will not copy between the two files (they are on different file
+     *          systems, say), the data is spliced through a pipe instead, which moves page
+     *          references rather than the bytes themselves.
+     * Input:   int outFd, the host file to copy into.
+     * Input:   off_t outOffset, the place in the host file to copy to.
+     * Input:   size_t count, the number of bytes which should be copied.
+     * Input:   off_t location, the place in the VDI file to copy from.
+     * Output:  ssize_t, holding the number of bytes copied, or -1 if nothing could be copied.
+    ----------------------------------------------------------------------------------------------*/
+    ssize_t vdi_reader::vdiCopyRange(int outFd, off_t outOffset, size_t count, off_t location)
+    {
+        const size_t pipeSize = 1048576;
+        loff_t inPosition = location, outPosition = outOffset;
+        size_t nBytes = 0;
+        ssize_t nCopied = 0;
+        
+        while (nBytes < count)
+        {
+            nCopied = ::copy_file_range(fd, &inPosition, outFd, &outPosition, count - nBytes, 0);
+            if (nCopied <= 0)
+            {
+                break;
+            }
+            nBytes += nCopied;
+        }
+        
+        // Only fall back to splice if copy_file_range cannot be used at all for these files.
+        if (nBytes == count || nCopied == 0 ||
+            (errno != EXDEV && errno != EINVAL && errno != ENOSYS && errno != EOPNOTSUPP))
+        {
+            return (nBytes > 0 || nCopied == 0 ? (ssize_t)nBytes : -1);
+        }
+        
+        int pipeFds[2];
+        if (::pipe(pipeFds) != 0)
+        {
+            return (nBytes > 0 ? (ssize_t)nBytes : -1);
+        }
+        // A bigger pipe means fewer trips into the kernel.  The default size works too.
+        ::fcntl(pipeFds[1], F_SETPIPE_SZ, pipeSize);
+        
+        while (nBytes < count)
+        {
+            ssize_t nIn = ::splice(fd, &inPosition, pipeFds[1], nullptr, count - nBytes, SPLICE_F_MOVE);
+            if (nIn <= 0)
+            {
+                break;
+            }
+            
+            // Drain the pipe into the host file.
+            ssize_t nOut = 0;
+            while (nOut < nIn)
+            {
+                ssize_t nMoved = ::splice(pipeFds[0], nullptr, outFd, &outPosition, nIn - nOut, SPLICE_F_MOVE);
+                if (nMoved <= 0)
+                {
+                    break;
+                }
+                nOut += nMoved;
+            }
+            nBytes += nOut;
+            if (nOut < nIn)
+            {
+                break;
+            }
+        }
+        
+        ::close(pipeFds[0]);
+        ::close(pipeFds[1]);
+        return (nBytes > 0 ? (ssize_t)nBytes : -1);
+    }
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    vdiSetDirect
+     * Type:    Function
+     * Purpose: Turns direct I/O on or off for bulk reads.  Direct I/O goes through a second,
+     *          read-only descriptor opened with O_DIRECT; small and metadata reads, and all writes,
+     *          stay buffered.  (The kernel writes back any buffered changes before a direct read
+     *          of the same range, so the two never disagree.)  The descriptor is opened and closed
+     *          only here, so this must not be called while bulk reads are running.
+     * Input:   bool enable, holds whether direct I/O should be on.
+     * Output:  bool, whether direct I/O is on.  It stays off if the host file system refuses
+     *          O_DIRECT.
+    ----------------------------------------------------------------------------------------------*/
+    bool vdi_reader::vdiSetDirect(bool enable)
+    {
+        if (!enable)
+        {
+            if (directFd != -1)
+            {
+                ::close(directFd);
+                directFd = -1;
+            }
+            return false;
+        }
+        
+        if (directFd == -1)
+        {
+            directFd = ::open(path.c_str(), O_RDONLY | O_DIRECT);
+            directFailed = false;
+        }
+        return directFd != -1 && !directFailed;
+    }
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    vdiDirectRead
+     * Type:    Function
+     * Purpose: Reads from the VDI file with direct I/O.  The range is rounded out to
+     *          buffer_pool::ALIGNMENT (a page, and a whole number of sectors); if the range and
+     *          the buffer are already aligned, the data is read straight into the buffer, and
+     *          otherwise through an aligned buffer from the pool.
+     * Input:   u8 * buf, the buffer into which the data should be read.
+     * Input:   size_t count, the number of bytes which should be read.
+     * Input:   off_t location, the place in the VDI file to read from.
+     * Output:  bool, whether all of it was read.  If the host refuses the read outright, direct
+     *          I/O is given up on: later bulk reads go through the page cache.  The descriptor is
+     *          left open, since other threads may be reading through it.
+    ----------------------------------------------------------------------------------------------*/
+    bool vdi_reader::vdiDirectRead(u8 * buf, size_t count, off_t location)
+    {
+        if (directFailed)
+        {
+            return false;
+        }
+        
+        const off_t alignment = buffer_pool::ALIGNMENT;
+        off_t start = location / alignment * alignment;
+        off_t end = (location + (off_t)count + alignment - 1) / alignment * alignment;
+        ssize_t nRead;
+        
+        if (start == location && end - start == (off_t)count && (uintptr_t)buf % alignment == 0)
+        {
+            nRead = ::pread(directFd, buf, count, location);
+            if (nRead == (ssize_t)count)
+            {
+                return true;
+            }
+        }
+        else
+        {
+            buffer_pool::buffer bounce(end - start);
+            nRead = ::pread(directFd, bounce.data(), end - start, start);
+            if (nRead >= (location - start) + (off_t)count)
+            {
+                ::memcpy(buf, bounce.data() + (location - start), count);
+                return true;
+            }
+        }
+        
+        if (nRead == -1 && errno == EINVAL)
+        {
+            directFailed = true;
+        }
+        return false;
+    }
+    
     /*----------------------------------------------------------------------------------------------
      * Name:    vdiWrite
      * Type:    Function
@@ -393,24 +704,50 @@ namespace vdi_explorer{
      * @TODO    Yet again, turn the magic numbers into well-named constants.
     ----------------------------------------------------------------------------------------------*/
     off_t vdi_reader::vdiTranslate()
+    {
+        return vdiTranslate(cursor);
+    }
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    vdiPhysicalOffset
+     * Type:    Function
+     * Purpose: Finds where in the VDI file a given place on the virtual disk is stored, so that
+     *          reads can be put in the order they will hit the VDI file.
+     * Input:   off_t offset, holds the place on the virtual disk.
+     * Output:  off_t, holds the offset in the VDI file, or 0 if the page is not allocated.
+    ----------------------------------------------------------------------------------------------*/
+    off_t vdi_reader::vdiPhysicalOffset(off_t offset)
+    {
+        return vdiTranslate(offset);
+    }
+    
+    /*----------------------------------------------------------------------------------------------
+     * Name:    vdiTranslate
+     * Type:    Function
+     * Purpose: Performs the virtual-to-physical translation for a given place on the virtual disk.
+     * Input:   off_t position, holds the place on the virtual disk.
+     * Output:  off_t, holds the offset to the actual data on disk.
+    ----------------------------------------------------------------------------------------------*/
+    off_t vdi_reader::vdiTranslate(off_t position)
     {
         u32 pageNum;
         off_t offset;
         
-        // Check to make sure the cursor is pointing to somewhere valid on the vitual disk.
-        if ((u64)cursor >= hdr.diskSize)
+        // Check to make sure the position is somewhere valid on the vitual disk.
+        if ((u64)position >= hdr.diskSize)
         {
             return 0;
         }
         
         // Compute the page number and offset.
         // @TODO look into creating a function to perform this as a bitshift.
-        pageNum = cursor / hdr.pageSize;
-        offset = cursor - pageNum * hdr.pageSize;
+        pageNum = position / hdr.pageSize;
+        offset = position - (off_t)pageNum * hdr.pageSize;
         
         // Load page map chunk if necessary.
-        // Check if the page map chunk is loaded.
+        // Check if the page map chunk is loaded.  Only one thread loads a chunk.
         u32 chunkNum = pageNum / 1024;
+        lock_guard<mutex> lock(pageMapMutex);
         if ((pageBitmap[chunkNum / 8] & (1 << (chunkNum % 8))) == 0)
         {
             // Calculate the chunk size and clamp it to 4096 if exceeded.
@@ -421,8 +758,7 @@ namespace vdi_explorer{
             }
             
             // Read the page map chunk from disk.
-            ::lseek(fd, hdr.offsetPages + 4096 * chunkNum, SEEK_SET);
-            ::read(fd, pageMap + 1024 * chunkNum, chunkSize);
+            ::pread(fd, pageMap + 1024 * chunkNum, chunkSize, hdr.offsetPages + (off_t)chunkNum * 4096);
             pageBitmap[chunkNum / 8] |= ( 1 << (chunkNum % 8));
         }
         
@@ -432,8 +768,9 @@ namespace vdi_explorer{
             return 0;
         }
         
-        // Do actual virtual to physical translation.
-        offset += pageMap[pageNum] * hdr.pageSize + hdr.offsetData;
+        // Do actual virtual to physical translation.  The page's place in the VDI file is worked
+        // out in 64 bits, since images grow well past 4 GiB.
+        offset += (off_t)pageMap[pageNum] * hdr.pageSize + hdr.offsetData;
         
         #ifdef DEBUG_VDI_OUTPUT_TRANSLATION
         cout << "VDI Translation Offset: " << offset << endl;
@@ -455,13 +792,12 @@ namespace vdi_explorer{
     void vdi_reader::vdiAllocatePageFrame()
     {
         // Add page frame.
-        u8 *tmpBuffer = new u8[hdr.pageSize];
-        ::memset(tmpBuffer, 0, hdr.pageSize);
+        buffer_pool::buffer tmpBuffer(hdr.pageSize);
+        ::memset(tmpBuffer.data(), 0, hdr.pageSize);
         #ifndef DEBUG_VDI_WRITE_DISABLED
         ::lseek(fd, 0, SEEK_END);
-        ::write(fd, tmpBuffer, hdr.pageSize);
+        ::write(fd, tmpBuffer.data(), hdr.pageSize);
         #endif
-        delete[] tmpBuffer;
         
         // Update the page map.
         u32 pageNum = cursor / hdr.pageSize;
@@ -469,5 +805,13 @@ namespace vdi_explorer{
         hdr.pagesAllocated++;
         u32 chunkNum = pageNum / 1024;
         dirtyBitmap[chunkNum / 8] |= (1 << (chunkNum % 8));
+        
+        // Write the new page map entry and the header back straight away.  vdiClose does this
+        // too, but it is not reached when the program exits without unwinding, and until then
+        // the page would be lost from the image.
+        #ifndef DEBUG_VDI_WRITE_DISABLED
+        ::pwrite(fd, pageMap + pageNum, sizeof(s32), hdr.offsetPages + (off_t)pageNum * sizeof(s32));
+        ::pwrite(fd, &hdr, sizeof(VDIHeader), 0);
+        #endif
     }
 } // namespace vdi_explorer
\ No newline at end of file
@@ -3,6 +3,8 @@
 
 #include "datatypes.h" //typedefs for s8, u8, s16, u16, s32, u32, s64, and u64
 
+#include <atomic>
+#include <mutex>
 #include <string>
 #include <sys/types.h>
 
@@ -28,6 +30,23 @@ namespace vdi_explorer{
             // Reads count bytes from the file, placing them in the specified buffer.
             size_t vdiRead(void * buf, size_t count);
             
+            // Reads count bytes from the given place on the virtual disk, leaving the cursor alone.
+            // Safe to call from several threads at once, as long as nothing is being written.
+            size_t vdiPread(void * buf, size_t count, off_t offset);
+            
+            // Reads file data in bulk, bypassing the host page cache if direct I/O is on.
+            size_t vdiPreadBulk(void * buf, size_t count, off_t offset);
+            
+            // Copies count bytes from the given place on the virtual disk into a host file, inside
+            // the kernel.  Returns the number of bytes copied, or -1 if the host cannot do it.
+            ssize_t vdiCopyOut(int outFd, off_t outOffset, size_t count, off_t offset);
+            
+            // Turns direct (O_DIRECT) I/O on or off for bulk reads.  Returns whether it is on.
+            bool vdiSetDirect(bool enable);
+            
+            // Finds where in the VDI file a place on the virtual disk is stored (0 if nowhere).
+            off_t vdiPhysicalOffset(off_t offset);
+            
             // Writes count bytes to the file from the buffer.
             size_t vdiWrite(const void * buf, size_t count);
             
@@ -58,17 +77,30 @@ namespace vdi_explorer{
             // Extracted from VDIFile struct.
             VDIHeader hdr;
             s32 fd;
+            s32 directFd = -1;      // the VDI file opened with O_DIRECT, for bulk reads
+            std::atomic<bool> directFailed{false};  // the host refused a direct read
+            std::string path;
             off_t cursor;
             s32 *pageMap = nullptr;
             u8 *pageBitmap = nullptr;
             u8 *dirtyBitmap = nullptr;
 
+            // Guards the loading of page map chunks.
+            std::mutex pageMapMutex;
+
             // Performs the virtual-to-physical address translation.
             off_t vdiTranslate();
+            off_t vdiTranslate(off_t position);
             
             // Allocates a new page frame in the VDI file.
             void vdiAllocatePageFrame();
             
+            // Reads from the VDI file through directFd, rounding out to aligned boundaries.
+            bool vdiDirectRead(u8 * buf, size_t count, off_t location);
+            
+            // Copies a run of the VDI file into a host file with copy_file_range, or splice.
+            ssize_t vdiCopyRange(int outFd, off_t outOffset, size_t count, off_t location);
+            
             // @TODO Think about making a small function to do the calculation
             //       of cursor / hdr.pageSize utilizing bitshift, since it's a
             //       common function.